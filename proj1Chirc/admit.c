@@ -0,0 +1,208 @@
+/*
+ *
+ *  CMSC 23300 / 33300 - Networks and Distributed Systems
+ *
+ *  Admission Control Functions
+ *
+ *  Decides whether a freshly accepted connection may stay, before
+ *  anything is allocated or any thread is started for it. The
+ *  number of connections open at once can be capped overall and
+ *  per client address, and the rate at which connections are
+ *  accepted can be limited. Connections over a cap are sent an
+ *  ERROR and closed at once; connections over the rate are simply
+ *  not accepted yet, so they wait in the listen backlog.
+ *
+ */
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include "admit.h"
+
+
+struct admitAddr
+{
+  uint32_t addr;
+  int count;
+  struct admitAddr * next;
+};
+
+typedef struct admitAddr admitAddr;
+
+static int backlog = ADMITBACKLOG;
+static int maxClients = ADMITMAX;
+static int maxPerIp = ADMITPERIP;
+static double rate = ADMITRATE;
+
+static int numClients = 0;
+static admitAddr * addrs[ADMITBUCKETS];
+static pthread_mutex_t admitLock = PTHREAD_MUTEX_INITIALIZER;
+
+// accept rate token bucket, only used by the accepting thread
+static double tokens = 0;
+static struct timespec lastRefill;
+
+
+/* admit_configure:
+ * Given a comma separated list of settings, such as
+ * "backlog=1024,max=10000,perip=50,rate=500", updates the
+ * admission settings. A max, perip or rate of 0 means no limit.
+ * Returns -1 if the list is invalid.
+ */
+int admit_configure(char * spec)
+{
+  char * savePtr;
+  char * setting = strtok_r(spec, ",", &savePtr);
+  while (setting)
+  {
+    char * equals = strchr(setting, '=');
+    if (equals == NULL)
+      return -1;
+    *equals = '\0';
+    char * end;
+    long value = strtol(equals + 1, &end, 10);
+    if (end == equals + 1 || *end || value < 0 || value > INT_MAX)
+      return -1;
+    if (!strcmp(setting, "backlog") && value > 0)
+      backlog = value;
+    else if (!strcmp(setting, "max"))
+      maxClients = value;
+    else if (!strcmp(setting, "perip"))
+      maxPerIp = value;
+    else if (!strcmp(setting, "rate"))
+      rate = value;
+    else
+      return -1;
+    setting = strtok_r(NULL, ",", &savePtr);
+  }
+  return 1;
+}
+
+
+/* admit_backlog:
+ * Returns the listen backlog to use.
+ */
+int admit_backlog(void)
+{
+  return backlog;
+}
+
+
+/* admit_throttle:
+ * Called by the accepting thread before each accept. Returns 0
+ * if a connection may be accepted now, or else the number of
+ * milliseconds until one may. Only a connection which is really
+ * accepted is charged, with admit_accepted.
+ */
+int admit_throttle(void)
+{
+  if (rate <= 0)
+    return 0;
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  if (lastRefill.tv_sec == 0 && lastRefill.tv_nsec == 0)
+    tokens = rate;
+  else
+    tokens += ((now.tv_sec - lastRefill.tv_sec) + (now.tv_nsec - lastRefill.tv_nsec) / 1e9) * rate;
+  // allow a burst of up to one second's worth
+  if (tokens > rate)
+    tokens = rate;
+  lastRefill = now;
+  if (tokens >= 1)
+    return 0;
+  return (int) ((1 - tokens) * 1000 / rate) + 1;
+}
+
+
+/* admit_accepted:
+ * Called by the accepting thread once an accept which
+ * admit_throttle allowed has returned a connection.
+ */
+void admit_accepted(void)
+{
+  if (rate > 0)
+    tokens -= 1;
+}
+
+
+/* admit_check:
+ * Given a client's IPv4 address in network byte order, counts a
+ * new connection from it. Returns ADMIT_OK, or the reason the
+ * connection must be turned away, in which case it is not counted.
+ */
+int admit_check(uint32_t addr)
+{
+  int reason = ADMIT_OK;
+  pthread_mutex_lock(&admitLock);
+  admitAddr ** bucket = &addrs[addr % ADMITBUCKETS];
+  admitAddr * entry = *bucket;
+  while (entry && entry->addr != addr)
+    entry = entry->next;
+  if (maxClients && numClients >= maxClients)
+    reason = ADMIT_FULL;
+  else if (maxPerIp && entry && entry->count >= maxPerIp)
+    reason = ADMIT_PERIP;
+  else
+  {
+    if (entry == NULL)
+    {
+      entry = (admitAddr *) malloc(sizeof(admitAddr));
+      entry->addr = addr;
+      entry->count = 0;
+      entry->next = *bucket;
+      *bucket = entry;
+    }
+    entry->count++;
+    numClients++;
+  }
+  pthread_mutex_unlock(&admitLock);
+  return reason;
+}
+
+
+/* admit_release:
+ * Given a client's IPv4 address in network byte order, uncounts
+ * one of its connections once it has closed.
+ */
+void admit_release(uint32_t addr)
+{
+  pthread_mutex_lock(&admitLock);
+  admitAddr ** prev = &addrs[addr % ADMITBUCKETS];
+  while (*prev && (*prev)->addr != addr)
+    prev = &(*prev)->next;
+  admitAddr * entry = *prev;
+  if (entry)
+  {
+    numClients--;
+    if (--entry->count == 0)
+    {
+      *prev = entry->next;
+      free(entry);
+    }
+  }
+  pthread_mutex_unlock(&admitLock);
+}
+
+
+/* admit_reject:
+ * Tells a client why its connection was turned away
+ * and closes it.
+ */
+void admit_reject(int socket, char * ip, int reason)
+{
+  char * msg = "Server is full";
+  if (reason == ADMIT_PERIP)
+    msg = "Too many connections from your host";
+  else if (reason == ADMIT_MEMORY)
+    msg = "Server out of memory";
+  char reply[128];
+  int replyLen = snprintf(reply, sizeof(reply), "ERROR :Closing Link: %s (%s)\r\n", ip, msg);
+  // the accepting thread must not block on a slow client
+  send(socket, reply, replyLen, MSG_NOSIGNAL | MSG_DONTWAIT);
+  close(socket);
+}
@@ -0,0 +1,35 @@
+/*
+ *
+ *  CMSC 23300 / 33300 - Networks and Distributed Systems
+ *
+ *  Connection admission control
+ *
+ */
+
+#ifndef ADMIT_H_
+#define ADMIT_H_
+
+#include <stdint.h>
+
+#define ADMITBACKLOG 1024
+// 0 means no limit
+#define ADMITMAX 0
+#define ADMITPERIP 0
+#define ADMITRATE 0
+#define ADMITBUCKETS 4096
+
+// why a connection was turned away
+#define ADMIT_OK 0
+#define ADMIT_FULL 1
+#define ADMIT_PERIP 2
+#define ADMIT_MEMORY 3
+
+int admit_configure(char * spec);
+int admit_backlog(void);
+int admit_throttle(void);
+void admit_accepted(void);
+int admit_check(uint32_t addr);
+void admit_release(uint32_t addr);
+void admit_reject(int socket, char * ip, int reason);
+
+#endif /* ADMIT_H_ */
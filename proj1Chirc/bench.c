@@ -0,0 +1,701 @@
+/*
+ *
+ *  CMSC 23300 / 33300 - Networks and Distributed Systems
+ *
+ *  Microbenchmarks
+ *
+ *  Times the functions every command goes through, one at a time,
+ *  over inputs like the ones a busy server sees: pipelined bursts
+ *  of commands, long PRIVMSGs, NAMES replies for full channels and
+ *  lookups in large user and channel lists. Replies are written to
+ *  a socket which a second thread drains, so sending costs what it
+ *  costs in the server.
+ *
+ *  Each benchmark runs with more and more iterations until it has
+ *  run for the bench time, and prints one line in the format of Go
+ *  benchmarks, so results from two commits can be compared with
+ *  benchstat or a few lines of awk:
+ *
+ *    BenchmarkParser/privmsg  2000000  251.3 ns/op  3.00 allocs/op
+ *
+ *  Allocations are counted by linking with --wrap for malloc,
+ *  calloc and realloc; see the bench target of the Makefile.
+ *
+ *  The Queue benchmarks have several producer threads push lines
+ *  to one consumer, through the lock-free queue outbound lines are
+ *  queued on and, for comparison, through a queue guarded by a
+ *  mutex. They double as a stress test: the consumer checks every
+ *  line arrives once and in each producer's order, and exits with
+ *  an error if not.
+ *
+ *  Any setting chirc takes can be given with -s key=value, such as
+ *  -s latency=enabled=0 to measure what latency tracking costs.
+ *
+ *  Usage: chirc_bench [-t seconds] [-f filter] [-s key=value]
+ *
+ */
+#include <poll.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/eventfd.h>
+#include <sys/types.h>
+#include "casemap.h"
+#include "command.h"
+#include "config.h"
+#include "epoch.h"
+#include "globalData.h"
+#include "latency.h"
+#include "listfxns.h"
+#include "mpsc.h"
+#include "netio.h"
+#include "parser.h"
+#include "reply.h"
+#include "server.h"
+#include "simclist.h"
+#include "structures.h"
+
+// size of the lists the seekers walk
+#define BENCHUSERS 1000
+#define BENCHCHANNELS 500
+// members of the channel NAMES is run on, as many as fit one reply
+#define BENCHMEMBERS 50
+#define BENCHBURST 32
+// threads pushing to one consumer in the queue benchmarks
+#define BENCHPRODUCERS 8
+
+struct benchmark
+{
+  char * name;
+  void (* run)(long n);
+};
+
+typedef struct benchmark benchmark;
+
+struct benchLine
+{
+  mpscNode node;
+  struct benchLine * next;
+  int producer;
+  long seq;
+};
+
+typedef struct benchLine benchLine;
+
+// what the queue benchmarks push lines through
+struct benchQueue
+{
+  int locked;
+  // the lock-free queue, and the wakeup its consumer waits on
+  mpscQueue mpsc;
+  int wakeFd;
+  int woken;
+  // the queue guarded by a mutex
+  pthread_mutex_t mutex;
+  pthread_cond_t ready;
+  int waiting;
+  benchLine * head;
+  benchLine * tail;
+};
+
+typedef struct benchQueue benchQueue;
+
+struct benchProducer
+{
+  benchQueue * queue;
+  benchLine * lines;
+  long num;
+};
+
+typedef struct benchProducer benchProducer;
+
+static unsigned long allocs = 0;
+
+static list_t * userList;
+static list_t * chanList;
+static serverInfo * servData;
+static char ** commandList;
+// where replies go; drained by another thread
+static int replySocket;
+static userInfo * benchUser;
+// what the benchmarks work on
+static char burst[MAXINPUTBUFLEN];
+static int burstLen;
+static char privmsgLine[PARSERMAXLINE];
+static replyPackage namesReply;
+static replyPackage errorReply;
+static chircConfig config;
+// keeps results alive so the compiler cannot drop the work
+static volatile long sink;
+
+void * __real_malloc(size_t size);
+void * __real_calloc(size_t num, size_t size);
+void * __real_realloc(void * ptr, size_t size);
+
+
+/* __wrap_malloc:
+ * Counts an allocation made anywhere in chirc.
+ */
+void * __wrap_malloc(size_t size)
+{
+  __atomic_fetch_add(&allocs, 1, __ATOMIC_RELAXED);
+  return __real_malloc(size);
+}
+
+
+/* __wrap_calloc:
+ * Counts an allocation made anywhere in chirc.
+ */
+void * __wrap_calloc(size_t num, size_t size)
+{
+  __atomic_fetch_add(&allocs, 1, __ATOMIC_RELAXED);
+  return __real_calloc(num, size);
+}
+
+
+/* __wrap_realloc:
+ * Counts an allocation made anywhere in chirc.
+ */
+void * __wrap_realloc(void * ptr, size_t size)
+{
+  __atomic_fetch_add(&allocs, 1, __ATOMIC_RELAXED);
+  return __real_realloc(ptr, size);
+}
+
+
+/* drain_replies:
+ * Reads and throws away everything sent to the reply socket.
+ */
+static void * drain_replies(void * arg)
+{
+  int socket = *(int *) arg;
+  char buf[65536];
+  while (read(socket, buf, sizeof(buf)) > 0)
+    ;
+  return NULL;
+}
+
+
+/* free_words:
+ * Frees the strings break_commands or parser stored in list.
+ */
+static void free_words(char ** list, int num)
+{
+  for (int i = 0; i < num; i++)
+    free(list[i]);
+}
+
+
+/* run_line:
+ * Runs one command line as the server would for info.
+ */
+static void run_line(userInfo * info, char * line)
+{
+  char * argList[PARSERMAXARGS];
+  memset(argList, 0, sizeof(argList));
+  int argNum = parser(line, strlen(line), argList);
+  int command = command_search(argList[0], commandList);
+  run_command(command, argList, argNum, info, userList, chanList, servData);
+  free_words(argList, argNum);
+}
+
+
+/* new_user:
+ * Registers a user the way a client would. Replies to it go to
+ * socket.
+ */
+static userInfo * new_user(char * nick, int socket)
+{
+  char line[PARSERMAXLINE];
+  userInfo * info = (userInfo *) malloc(sizeof(userInfo));
+  memset(info, 0, sizeof(userInfo));
+  strcpy(info->host, "bench.example.com");
+  info->socket = socket;
+  snprintf(line, sizeof(line), "NICK %s", nick);
+  run_line(info, line);
+  snprintf(line, sizeof(line), "USER %s * * :Bench User", nick);
+  run_line(info, line);
+  return info;
+}
+
+
+/* setup:
+ * Sets up server state as main does, then fills it with users
+ * and channels for the benchmarks to work on.
+ */
+static void setup(void)
+{
+  parser_limits(config.limits.maxParams, config.limits.maxCommands, config.limits.lineLen);
+  pthread_mutex_init(&lock, NULL);
+  pthread_mutex_init(&chanLock, NULL);
+  epoch_init();
+  latency_init();
+  server_init();
+  netio_init(NETIO_SEND, 0);
+
+  servData = (serverInfo *) malloc(sizeof(serverInfo));
+  memset(servData, 0, sizeof(serverInfo));
+  strcpy(servData->serverHost, "bench.example.com");
+  strcpy(servData->serverVersion, "version2");
+  strcpy(servData->createdDate, "today");
+  strcpy(servData->userModes, "ao");
+  strcpy(servData->chanModes, "mtov");
+  servData->flood = config.flood;
+  servData->keepalive = config.keepalive;
+  servData->limits = config.limits;
+
+  userList = (list_t *) malloc(sizeof(list_t));
+  list_init(userList);
+  list_attributes_copy(userList, user_info_size, 1);
+  list_attributes_comparator(userList, nick_comparator);
+  list_attributes_seeker(userList, (element_seeker) seeker);
+  chanList = (list_t *) malloc(sizeof(list_t));
+  list_init(chanList);
+  list_attributes_copy(chanList, chan_info_size, 1);
+  list_attributes_comparator(chanList, chan_comparator);
+  list_attributes_seeker(chanList, (element_seeker) chan_seeker);
+  commandList = (char **) malloc(COMMANDNUM * sizeof(char *));
+  command_init(commandList);
+
+  int sockets[2];
+  socketpair(AF_UNIX, SOCK_STREAM, 0, sockets);
+  replySocket = sockets[0];
+  static int drainSocket;
+  drainSocket = sockets[1];
+  pthread_t drainThread;
+  pthread_create(&drainThread, NULL, drain_replies, &drainSocket);
+
+  // users nobody listens to; what is sent to them fails at once
+  char nick[MAXNICK];
+  char line[PARSERMAXLINE];
+  for (int i = 0; i < BENCHUSERS; i++)
+  {
+    snprintf(nick, sizeof(nick), "user%04d", i);
+    userInfo * info = new_user(nick, -1);
+    if (i < BENCHCHANNELS)
+    {
+      snprintf(line, sizeof(line), "JOIN #chan%04d", i);
+      run_line(info, line);
+    }
+    if (i < BENCHMEMBERS - 1)
+      run_line(info, "JOIN #bench");
+  }
+  benchUser = new_user("bencher", replySocket);
+  run_line(benchUser, "JOIN #bench");
+  for (int i = 0; i < 20; i++)
+  {
+    snprintf(line, sizeof(line), "JOIN #chan%04d", i * 7);
+    run_line(benchUser, line);
+  }
+
+  // a pipelined burst, as a client catching up after a stall sends
+  burstLen = 0;
+  for (int i = 0; i < BENCHBURST; i++)
+  {
+    if (i % 4 == 0)
+      burstLen += sprintf(burst + burstLen, "PING bench.example.com\r\n");
+    else if (i % 4 == 1)
+      burstLen += sprintf(burst + burstLen, "JOIN #chan%04d\r\n", i);
+    else
+      burstLen += sprintf(burst + burstLen, "PRIVMSG #bench :message %d of a pipelined burst of "
+                          "ordinary chat lines\r\n", i);
+  }
+
+  // a PRIVMSG close to the longest line allowed
+  int len = sprintf(privmsgLine, "PRIVMSG #bench :");
+  while (len < PARSERMAXLINE - 40)
+    len += sprintf(privmsgLine + len, "lorem ipsum dolor ");
+
+  // a NAMES reply as full as the reply buffer allows
+  memset(&namesReply, 0, sizeof(replyPackage));
+  strcpy(namesReply.serverName, servData->serverHost);
+  strcpy(namesReply.nickname, "bencher");
+  memcpy(namesReply.responseCode, RPL_NAMREPLY, REPLYCODELEN);
+  namesReply.numArgs = 2;
+  strcpy(namesReply.args, "= #bench");
+  len = 0;
+  for (int i = 0; len < 450; i++)
+    len += sprintf(namesReply.message + len, "%suser%04d", i ? " " : "@", i);
+
+  memset(&errorReply, 0, sizeof(replyPackage));
+  strcpy(errorReply.serverName, servData->serverHost);
+  strcpy(errorReply.nickname, "bencher");
+  memcpy(errorReply.responseCode, ERR_NOSUCHNICK, REPLYCODELEN);
+  errorReply.numArgs = 1;
+  strcpy(errorReply.args, "nobody");
+}
+
+
+static void bench_break_commands(long n)
+{
+  char * cmndList[PARSERMAXCOMMANDS];
+  for (long i = 0; i < n; i++)
+  {
+    int num = break_commands(burst, burstLen, cmndList);
+    sink = num;
+    free_words(cmndList, num);
+  }
+}
+
+
+static void bench_parser_privmsg(long n)
+{
+  char * argList[PARSERMAXARGS];
+  int len = strlen(privmsgLine);
+  for (long i = 0; i < n; i++)
+  {
+    int num = parser(privmsgLine, len, argList);
+    sink = num;
+    free_words(argList, num);
+  }
+}
+
+
+static void bench_parser_user(long n)
+{
+  char line[] = "USER guest 0 * :Ronnie Reagan";
+  char * argList[PARSERMAXARGS];
+  int len = strlen(line);
+  for (long i = 0; i < n; i++)
+  {
+    int num = parser(line, len, argList);
+    sink = num;
+    free_words(argList, num);
+  }
+}
+
+
+static void bench_command_search(long n)
+{
+  // a mix weighted like real traffic, including an unknown verb
+  char * verbs[] = {"PRIVMSG", "PRIVMSG", "PRIVMSG", "PING", "PONG",
+                    "JOIN", "NOTICE", "WHO", "MODE", "FOO"};
+  int numVerbs = sizeof(verbs) / sizeof(verbs[0]);
+  for (long i = 0; i < n; i++)
+    sink = command_search(verbs[i % numVerbs], commandList);
+}
+
+
+static void bench_send_response_names(long n)
+{
+  for (long i = 0; i < n; i++)
+    sink = send_response(replySocket, &namesReply);
+}
+
+
+static void bench_send_response_error(long n)
+{
+  for (long i = 0; i < n; i++)
+    sink = send_response(replySocket, &errorReply);
+}
+
+
+static void bench_names(long n)
+{
+  for (long i = 0; i < n; i++)
+    run_line(benchUser, "NAMES #bench");
+}
+
+
+static void bench_run_ping(long n)
+{
+  char * argList[] = {"PING", "bench.example.com"};
+  for (long i = 0; i < n; i++)
+    sink = run_command(PING, argList, 2, benchUser, userList, chanList, servData);
+}
+
+
+static void bench_run_pong(long n)
+{
+  char * argList[] = {"PONG", "bench.example.com"};
+  for (long i = 0; i < n; i++)
+    sink = run_command(PONG, argList, 2, benchUser, userList, chanList, servData);
+}
+
+
+static void bench_seek_user(long n)
+{
+  char nick[MAXNICK];
+  for (long i = 0; i < n; i++)
+  {
+    snprintf(nick, sizeof(nick), "USER%04ld", (i * 7919) % BENCHUSERS);
+    pthread_mutex_lock(&lock);
+    sink = (long) list_seek(userList, casemap_key(nick));
+    pthread_mutex_unlock(&lock);
+  }
+}
+
+
+static void bench_seek_channel(long n)
+{
+  char name[MAXCHANNAME];
+  for (long i = 0; i < n; i++)
+  {
+    snprintf(name, sizeof(name), "chan%04ld", (i * 7919) % BENCHCHANNELS);
+    pthread_mutex_lock(&chanLock);
+    sink = (long) list_seek(chanList, casemap_key(name));
+    pthread_mutex_unlock(&chanLock);
+  }
+}
+
+
+static void bench_seek_chanmode(long n)
+{
+  char name[MAXCHANNAME];
+  for (long i = 0; i < n; i++)
+  {
+    snprintf(name, sizeof(name), "chan%04ld", (i % 20) * 7);
+    sink = (long) list_seek(benchUser->channelModes, casemap_key(name));
+  }
+}
+
+
+/* queue_push:
+ * Adds a line to a benchmark queue, waking the consumer if
+ * it may be asleep.
+ */
+static void queue_push(benchQueue * queue, benchLine * line)
+{
+  if (queue->locked)
+  {
+    pthread_mutex_lock(&queue->mutex);
+    line->next = NULL;
+    if (queue->tail)
+      queue->tail->next = line;
+    else
+      queue->head = line;
+    queue->tail = line;
+    if (queue->waiting)
+      pthread_cond_signal(&queue->ready);
+    pthread_mutex_unlock(&queue->mutex);
+    return;
+  }
+  mpsc_push(&queue->mpsc, &line->node);
+  if (!__atomic_exchange_n(&queue->woken, 1, __ATOMIC_ACQ_REL))
+  {
+    uint64_t one = 1;
+    if (write(queue->wakeFd, &one, sizeof(one)) == -1)
+      perror("write");
+  }
+}
+
+
+/* queue_take:
+ * Returns the lines pushed since the last call, oldest first,
+ * waiting for one if there are none. Lines from the lock-free
+ * queue come one at a time.
+ */
+static benchLine * queue_take(benchQueue * queue)
+{
+  if (queue->locked)
+  {
+    pthread_mutex_lock(&queue->mutex);
+    queue->waiting = 1;
+    while (queue->head == NULL)
+      pthread_cond_wait(&queue->ready, &queue->mutex);
+    queue->waiting = 0;
+    benchLine * lines = queue->head;
+    queue->head = queue->tail = NULL;
+    pthread_mutex_unlock(&queue->mutex);
+    return lines;
+  }
+  while (1)
+  {
+    mpscNode * node = mpsc_pop(&queue->mpsc);
+    if (node)
+    {
+      ((benchLine *) node)->next = NULL;
+      return (benchLine *) node;
+    }
+    struct pollfd pfd = { queue->wakeFd, POLLIN, 0 };
+    poll(&pfd, 1, -1);
+    uint64_t count;
+    if (read(queue->wakeFd, &count, sizeof(count)) == -1)
+      count = 0;
+    __atomic_exchange_n(&queue->woken, 0, __ATOMIC_ACQ_REL);
+  }
+}
+
+
+/* produce:
+ * Pushes one producer's lines, in order.
+ */
+static void * produce(void * arg)
+{
+  benchProducer * producer = (benchProducer *) arg;
+  for (long i = 0; i < producer->num; i++)
+    queue_push(producer->queue, &producer->lines[i]);
+  return NULL;
+}
+
+
+/* run_queue:
+ * Has BENCHPRODUCERS threads push n lines between them through
+ * a queue to the calling thread, checking each line arrives once
+ * and in order.
+ */
+static void run_queue(long n, int locked)
+{
+  benchQueue queue;
+  memset(&queue, 0, sizeof(benchQueue));
+  queue.locked = locked;
+  mpsc_init(&queue.mpsc);
+  queue.wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  pthread_mutex_init(&queue.mutex, NULL);
+  pthread_cond_init(&queue.ready, NULL);
+  benchProducer producers[BENCHPRODUCERS];
+  pthread_t threads[BENCHPRODUCERS];
+  long expect[BENCHPRODUCERS];
+  for (int p = 0; p < BENCHPRODUCERS; p++)
+  {
+    producers[p].queue = &queue;
+    producers[p].num = n / BENCHPRODUCERS + (p < n % BENCHPRODUCERS);
+    producers[p].lines = (benchLine *) malloc((producers[p].num + 1) * sizeof(benchLine));
+    for (long i = 0; i < producers[p].num; i++)
+    {
+      producers[p].lines[i].producer = p;
+      producers[p].lines[i].seq = i;
+    }
+    expect[p] = 0;
+  }
+  for (int p = 0; p < BENCHPRODUCERS; p++)
+    pthread_create(&threads[p], NULL, produce, &producers[p]);
+  for (long taken = 0; taken < n; )
+    for (benchLine * line = queue_take(&queue); line; line = line->next, taken++)
+      if (line->seq != expect[line->producer]++)
+      {
+        printf("FAIL: line %ld of producer %d arrived when %ld was expected\n",
+               line->seq, line->producer, expect[line->producer] - 1);
+        exit(1);
+      }
+  for (int p = 0; p < BENCHPRODUCERS; p++)
+  {
+    pthread_join(threads[p], NULL);
+    if (expect[p] != producers[p].num)
+    {
+      printf("FAIL: %ld of %ld lines of producer %d arrived\n", expect[p], producers[p].num, p);
+      exit(1);
+    }
+    free(producers[p].lines);
+  }
+  close(queue.wakeFd);
+  pthread_mutex_destroy(&queue.mutex);
+  pthread_cond_destroy(&queue.ready);
+}
+
+
+static void bench_queue_mpsc(long n)
+{
+  run_queue(n, 0);
+}
+
+
+static void bench_queue_mutex(long n)
+{
+  run_queue(n, 1);
+}
+
+
+static benchmark benchmarks[] =
+{
+  {"BreakCommands/burst32", bench_break_commands},
+  {"Parser/privmsg", bench_parser_privmsg},
+  {"Parser/user", bench_parser_user},
+  {"CommandSearch/mix", bench_command_search},
+  {"SendResponse/names", bench_send_response_names},
+  {"SendResponse/error", bench_send_response_error},
+  {"Names/members50", bench_names},
+  {"RunCommand/ping", bench_run_ping},
+  {"RunCommand/pong", bench_run_pong},
+  {"Seeker/user1000", bench_seek_user},
+  {"Seeker/channel500", bench_seek_channel},
+  {"Seeker/chanmode20", bench_seek_chanmode},
+  {"Queue/mpsc8", bench_queue_mpsc},
+  {"Queue/mutex8", bench_queue_mutex},
+};
+
+
+/* elapsed:
+ * Returns the number of nanoseconds between two times.
+ */
+static double elapsed(struct timespec * start, struct timespec * end)
+{
+  return (end->tv_sec - start->tv_sec) * 1e9 + (end->tv_nsec - start->tv_nsec);
+}
+
+
+/* measure:
+ * Runs a benchmark with more iterations each round until a round
+ * takes at least benchTime seconds, then prints its results.
+ */
+static void measure(benchmark * b, double benchTime)
+{
+  struct timespec start, end;
+  long n = 1;
+  double ns;
+  unsigned long allocated;
+  while (1)
+  {
+    unsigned long before = __atomic_load_n(&allocs, __ATOMIC_RELAXED);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    b->run(n);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    allocated = __atomic_load_n(&allocs, __ATOMIC_RELAXED) - before;
+    ns = elapsed(&start, &end);
+    if (ns >= benchTime * 1e9 || n >= 1000000000)
+      break;
+    // aim a little past the bench time, growing at most 100 times
+    long next = ns > 0 ? (long) (n * benchTime * 1.2e9 / ns) : n * 100;
+    if (next > n * 100)
+      next = n * 100;
+    n = next > n ? next : n + 1;
+  }
+  printf("Benchmark%s\t%ld\t%.1f ns/op\t%.2f allocs/op\n", b->name, n,
+         ns / n, (double) allocated / n);
+  fflush(stdout);
+}
+
+
+int main(int argc, char *argv[])
+{
+  double benchTime = 1.0;
+  char * filter = NULL;
+  int opt;
+  config_default(&config);
+  while ((opt = getopt(argc, argv, "t:f:s:h")) != -1)
+    switch (opt)
+    {
+      case 't':
+        benchTime = atof(optarg);
+        break;
+      case 'f':
+        filter = optarg;
+        break;
+      case 's':
+      {
+        char * equals = strchr(optarg, '=');
+        if (equals)
+          *equals = '\0';
+        if (!equals || config_set(&config, optarg, equals + 1) == -1)
+        {
+          printf("ERROR: Invalid setting -s %s\n", optarg);
+          exit(-1);
+        }
+        break;
+      }
+      default:
+        printf("Usage: chirc_bench [-t seconds] [-f filter] [-s key=value]\n");
+        exit(0);
+    }
+
+  setup();
+  for (unsigned i = 0; i < sizeof(benchmarks) / sizeof(benchmarks[0]); i++)
+    if (!filter || strstr(benchmarks[i].name, filter))
+      measure(&benchmarks[i], benchTime);
+  return 0;
+}
@@ -0,0 +1,358 @@
+/*
+ *
+ *  CMSC 23300 / 33300 - Networks and Distributed Systems
+ *
+ *  Memory Budget Functions
+ *
+ *  Every connection has an account of the memory chirc holds on its
+ *  behalf, by what it is for: its input and parse buffers, its held
+ *  output, its user record with its strings, and its channel
+ *  memberships. Charging an account is two relaxed atomic adds, one
+ *  to the account and one to the total of every account.
+ *
+ *  A connection whose account grows over the per-client cap is
+ *  evicted. When the total grows over the global cap, the server
+ *  sheds load: new connections are turned away, and the connection
+ *  using the most memory is evicted; the next is only evicted once
+ *  that one has gone, if the total is still over. Like keepalives,
+ *  eviction only shuts down the reading side of the socket, and
+ *  the connection's own thread calls budget_disconnect to remove
+ *  it as if it had quit.
+ *
+ *  "STATS z" sends an operator the total and the connections using
+ *  the most memory, along with what the kernel still has queued to
+ *  send them, which is not counted against any cap, nor are the
+ *  lines held for zerocopy sends it reports.
+ *
+ */
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <linux/sockios.h>
+#include "budget.h"
+#include "command.h"
+#include "netio.h"
+
+
+struct budgetAccount
+{
+  long bytes[BUDGETKINDS];
+  // NULL while the descriptor is not a client's
+  userInfo * info;
+  int evicted;
+};
+
+typedef struct budgetAccount budgetAccount;
+
+struct budgetTop
+{
+  char nick[MAXNICK];
+  long bytes[BUDGETKINDS];
+  long total;
+  int sendq;
+};
+
+typedef struct budgetTop budgetTop;
+
+static long clientCap = BUDGETCLIENT * 1024L;
+static long totalCap = BUDGETTOTAL * 1024L;
+static long total = 0;
+// connections evicted to shed load which have not gone yet
+static int shedding = 0;
+// one account for each descriptor a client has had, by descriptor
+static budgetAccount ** accounts = NULL;
+static int numAccounts = 0;
+static pthread_mutex_t budgetLock = PTHREAD_MUTEX_INITIALIZER;
+
+
+/* budget_configure:
+ * Given a comma separated list of settings, such as
+ * "client=512,total=1048576", updates the memory caps, in
+ * kilobytes. A cap of 0 means no limit. Returns -1 if the
+ * list is invalid.
+ */
+int budget_configure(char * spec)
+{
+  char * savePtr;
+  char * setting = strtok_r(spec, ",", &savePtr);
+  while (setting)
+  {
+    char * equals = strchr(setting, '=');
+    if (equals == NULL)
+      return -1;
+    *equals = '\0';
+    char * end;
+    long value = strtol(equals + 1, &end, 10);
+    if (end == equals + 1 || *end || value < 0)
+      return -1;
+    if (!strcmp(setting, "client"))
+      clientCap = value * 1024;
+    else if (!strcmp(setting, "total"))
+      totalCap = value * 1024;
+    else
+      return -1;
+    setting = strtok_r(NULL, ",", &savePtr);
+  }
+  return 1;
+}
+
+
+/* budget_init:
+ * Sets up the accounts. Must be called before any
+ * connection is accepted.
+ */
+void budget_init(void)
+{
+  // descriptors can never reach the limit they had at startup
+  struct rlimit limit;
+  if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur != RLIM_INFINITY)
+    numAccounts = limit.rlim_cur;
+  else
+    numAccounts = BUDGETMAXFDS;
+  if (numAccounts > BUDGETMAXFDS)
+    numAccounts = BUDGETMAXFDS;
+  accounts = (budgetAccount **) calloc(numAccounts, sizeof(budgetAccount *));
+  if (accounts == NULL)
+    numAccounts = 0;
+}
+
+
+/* find_account:
+ * Returns the account of socket, or NULL if it has none.
+ */
+static budgetAccount * find_account(int socket)
+{
+  if (socket < 0 || socket >= numAccounts)
+    return NULL;
+  return __atomic_load_n(&accounts[socket], __ATOMIC_ACQUIRE);
+}
+
+
+/* account_total:
+ * Returns the bytes charged to account.
+ */
+static long account_total(budgetAccount * account)
+{
+  long sum = 0;
+  for (int kind = 0; kind < BUDGETKINDS; kind++)
+    sum += __atomic_load_n(&account->bytes[kind], __ATOMIC_RELAXED);
+  return sum;
+}
+
+
+/* evict:
+ * Evicts the connection on socket for reason, unless it is
+ * already being evicted. Returns 1 if it was evicted now.
+ */
+static int evict(budgetAccount * account, int socket, int reason)
+{
+  int ok = BUDGET_OK;
+  if (!__atomic_compare_exchange_n(&account->evicted, &ok, reason, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+    return 0;
+  // wakes the connection's thread out of recv()
+  shutdown(socket, SHUT_RD);
+  return 1;
+}
+
+
+/* shed:
+ * Evicts the connection using the most memory, unless one evicted
+ * to shed load is still on its way out.
+ */
+static void shed(void)
+{
+  pthread_mutex_lock(&budgetLock);
+  if (shedding)
+  {
+    pthread_mutex_unlock(&budgetLock);
+    return;
+  }
+  int largest = -1;
+  long largestBytes = 0;
+  for (int socket = 0; socket < numAccounts; socket++)
+  {
+    budgetAccount * account = accounts[socket];
+    if (account == NULL || account->info == NULL || account->evicted)
+      continue;
+    long bytes = account_total(account);
+    if (bytes > largestBytes)
+    {
+      largest = socket;
+      largestBytes = bytes;
+    }
+  }
+  if (largest != -1 && evict(accounts[largest], largest, BUDGET_TOTAL))
+    shedding++;
+  pthread_mutex_unlock(&budgetLock);
+}
+
+
+/* budget_open:
+ * Starts an empty account for the client on socket.
+ */
+void budget_open(int socket, userInfo * info)
+{
+  if (socket < 0 || socket >= numAccounts)
+    return;
+  pthread_mutex_lock(&budgetLock);
+  budgetAccount * account = accounts[socket];
+  if (account == NULL)
+    account = (budgetAccount *) malloc(sizeof(budgetAccount));
+  if (account)
+  {
+    memset(account, 0, sizeof(budgetAccount));
+    account->info = info;
+    __atomic_store_n(&accounts[socket], account, __ATOMIC_RELEASE);
+  }
+  pthread_mutex_unlock(&budgetLock);
+}
+
+
+/* budget_charge:
+ * Charges bytes of kind to the account of socket, or credits
+ * them back if bytes is negative, evicting connections if a cap
+ * is crossed.
+ */
+void budget_charge(int socket, int kind, long bytes)
+{
+  budgetAccount * account = find_account(socket);
+  if (account == NULL)
+    return;
+  __atomic_add_fetch(&account->bytes[kind], bytes, __ATOMIC_RELAXED);
+  long now = __atomic_add_fetch(&total, bytes, __ATOMIC_RELAXED);
+  if (bytes <= 0)
+    return;
+  if (clientCap && account_total(account) > clientCap)
+    evict(account, socket, BUDGET_CLIENT);
+  if (totalCap && now > totalCap)
+    shed();
+}
+
+
+/* budget_close:
+ * Credits back everything charged to the account of socket
+ * once its client has gone. Must be called before the socket
+ * is closed.
+ */
+void budget_close(int socket)
+{
+  budgetAccount * account = find_account(socket);
+  if (account == NULL)
+    return;
+  pthread_mutex_lock(&budgetLock);
+  __atomic_sub_fetch(&total, account_total(account), __ATOMIC_RELAXED);
+  memset(account->bytes, 0, sizeof(account->bytes));
+  account->info = NULL;
+  if (account->evicted == BUDGET_TOTAL)
+    shedding--;
+  pthread_mutex_unlock(&budgetLock);
+}
+
+
+/* budget_evicted:
+ * Returns why the connection on socket was evicted,
+ * or BUDGET_OK if it was not.
+ */
+int budget_evicted(int socket)
+{
+  budgetAccount * account = find_account(socket);
+  return account ? __atomic_load_n(&account->evicted, __ATOMIC_RELAXED) : BUDGET_OK;
+}
+
+
+/* budget_full:
+ * Returns 1 if new connections must be turned away
+ * to keep under the global cap.
+ */
+int budget_full(void)
+{
+  return totalCap && __atomic_load_n(&total, __ATOMIC_RELAXED) >= totalCap;
+}
+
+
+/* budget_disconnect:
+ * Closes the connection of a client which was evicted. Must be
+ * called from the client's own thread.
+ */
+void budget_disconnect(userInfo * info, int reason, list_t * userList, list_t * chanList)
+{
+  char clientMsg[] = "Memory limit exceeded";
+  char totalMsg[] = "Server out of memory";
+  char * msg = (reason == BUDGET_CLIENT) ? clientMsg : totalMsg;
+  disconnect(info, msg, userList, chanList);
+}
+
+
+/* budget_report:
+ * Sends nick the memory used by every client together and by
+ * each of the BUDGETTOP clients using the most, in bytes, and
+ * any lines dropped as they could not be queued.
+ */
+void budget_report(int socket, char * serverHost, char * nick)
+{
+  budgetTop top[BUDGETTOP];
+  int numTop = 0;
+  int clients = 0;
+  char line[BUDGETLINELEN];
+
+  // copy first, so nothing is sent with the lock held
+  pthread_mutex_lock(&budgetLock);
+  for (int fd = 0; fd < numAccounts; fd++)
+  {
+    budgetAccount * account = accounts[fd];
+    if (account == NULL || account->info == NULL)
+      continue;
+    clients++;
+    long bytes = account_total(account);
+    if (numTop == BUDGETTOP && bytes <= top[numTop - 1].total)
+      continue;
+    int n = (numTop < BUDGETTOP) ? numTop++ : numTop - 1;
+    while (n > 0 && top[n - 1].total < bytes)
+    {
+      top[n] = top[n - 1];
+      n--;
+    }
+    strncpy(top[n].nick, account->info->nickname[0] ? account->info->nickname : "*", MAXNICK - 1);
+    top[n].nick[MAXNICK - 1] = '\0';
+    for (int kind = 0; kind < BUDGETKINDS; kind++)
+      top[n].bytes[kind] = __atomic_load_n(&account->bytes[kind], __ATOMIC_RELAXED);
+    top[n].total = bytes;
+    if (ioctl(fd, SIOCOUTQ, &top[n].sendq) == -1)
+      top[n].sendq = 0;
+  }
+  pthread_mutex_unlock(&budgetLock);
+
+  int len = snprintf(line, sizeof(line), ":%s NOTICE %s :memory total=%ld client_cap=%ld total_cap=%ld clients=%i",
+                     serverHost, nick, __atomic_load_n(&total, __ATOMIC_RELAXED),
+                     clientCap, totalCap, clients);
+  netio_line(socket, line, len, NULL, 0);
+  if (netio_zerocopy() == 1)
+  {
+    netioZcStats zc;
+    netio_zerocopy_stats(&zc);
+    len = snprintf(line, sizeof(line),
+                   ":%s NOTICE %s :memory zerocopy buffers=%ld bytes=%ld sends=%ld copied=%ld fallbacks=%ld",
+                   serverHost, nick, zc.buffers, zc.bytes, zc.sends, zc.copied, zc.fallbacks);
+    netio_line(socket, line, len, NULL, 0);
+  }
+  long drops = netio_queue_drops();
+  if (drops)
+  {
+    len = snprintf(line, sizeof(line), ":%s NOTICE %s :memory queue dropped=%ld", serverHost, nick, drops);
+    netio_line(socket, line, len, NULL, 0);
+  }
+  for (int n = 0; n < numTop; n++)
+  {
+    len = snprintf(line, sizeof(line),
+                   ":%s NOTICE %s :memory %s total=%ld input=%ld output=%ld user=%ld channels=%ld sendq=%i",
+                   serverHost, nick, top[n].nick, top[n].total, top[n].bytes[BUDGET_INPUT],
+                   top[n].bytes[BUDGET_OUTPUT], top[n].bytes[BUDGET_USER],
+                   top[n].bytes[BUDGET_CHANNELS], top[n].sendq);
+    netio_line(socket, line, len, NULL, 0);
+  }
+}
@@ -0,0 +1,52 @@
+/*
+ *
+ *  CMSC 23300 / 33300 - Networks and Distributed Systems
+ *
+ *  Per-connection and global memory budgets
+ *
+ */
+
+#ifndef BUDGET_H_
+#define BUDGET_H_
+
+#include "simclist.h"
+#include "structures.h"
+
+// what a connection's memory is used for
+#define BUDGET_INPUT 0
+#define BUDGET_OUTPUT 1
+#define BUDGET_USER 2
+#define BUDGET_CHANNELS 3
+#define BUDGETKINDS 4
+
+// why a connection was evicted
+#define BUDGET_OK 0
+#define BUDGET_CLIENT 1
+#define BUDGET_TOTAL 2
+
+// kilobytes; 0 means no limit
+#define BUDGETCLIENT 0
+#define BUDGETTOTAL 0
+// connections listed by "STATS z"
+#define BUDGETTOP 10
+#define BUDGETLINELEN 512
+// most descriptors accounts are kept for
+#define BUDGETMAXFDS 1048576
+// bytes registering takes: the user's copy in the user list,
+// and its list of channels
+#define BUDGETREGISTER (sizeof(userInfo) + sizeof(struct list_entry_s) + sizeof(list_t))
+// bytes one channel membership takes: the user's forChannel record,
+// its copy in the channel's user list, and its member snapshot slot
+#define BUDGETJOIN (sizeof(forChannel) + sizeof(userInfo) + 2 * sizeof(struct list_entry_s) + sizeof(int))
+
+int budget_configure(char * spec);
+void budget_init(void);
+void budget_open(int socket, userInfo * info);
+void budget_charge(int socket, int kind, long bytes);
+void budget_close(int socket);
+int budget_evicted(int socket);
+int budget_full(void);
+void budget_disconnect(userInfo * info, int reason, list_t * userList, list_t * chanList);
+void budget_report(int socket, char * serverHost, char * nick);
+
+#endif /* BUDGET_H_ */
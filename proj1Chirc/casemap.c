@@ -0,0 +1,66 @@
+/*
+ *
+ *  CMSC 23300 / 33300 - Networks and Distributed Systems
+ *
+ *  Casemapping Functions
+ *
+ *  Nicknames and channel names are compared without regard to
+ *  case, using the rfc1459 casemapping: besides A-Z, the characters
+ *  "[]\^" are the upper case forms of "{}|~". Whenever a name is
+ *  stored, its folded form and an FNV-1a hash of it are stored next
+ *  to it, so comparing two names only compares hashes, and then
+ *  folded bytes when the hashes are equal. A name being looked up
+ *  is folded once per lookup with casemap_key.
+ *
+ */
+#include <string.h>
+#include "casemap.h"
+
+
+/* casemap_char:
+ * Returns the lower case form of c.
+ */
+unsigned char casemap_char(unsigned char c)
+{
+  if (c >= 'A' && c <= '^')
+    return c + ('a' - 'A');
+  return c;
+}
+
+
+/* casemap_fold:
+ * Stores the folded form of name in folded, which holds size
+ * bytes, and returns the hash of the folded name. A name too
+ * long for folded is hashed in full, so it cannot hash the
+ * same as a shorter name it was truncated to.
+ */
+uint32_t casemap_fold(char * folded, const char * name, int size)
+{
+  // FNV-1a
+  uint32_t hash = 2166136261u;
+  int n = 0;
+  for (; name[n]; n++)
+  {
+    unsigned char c = casemap_char((unsigned char) name[n]);
+    if (n < size - 1)
+      folded[n] = c;
+    hash ^= c;
+    hash *= 16777619u;
+  }
+  if (n > size - 1)
+    n = size - 1;
+  memset(folded + n, 0, size - n);
+  return hash;
+}
+
+
+/* casemap_key:
+ * Returns the key to look name up with. The key belongs to the
+ * calling thread and is overwritten by its next call.
+ */
+nameKey * casemap_key(const char * name)
+{
+  static __thread nameKey key;
+  key.hash = casemap_fold(key.folded, name, MAXKEY);
+  return &key;
+}
@@ -0,0 +1,30 @@
+/*
+ *
+ *  CMSC 23300 / 33300 - Networks and Distributed Systems
+ *
+ *  rfc1459 casemapping of nicknames and channel names
+ *
+ */
+
+#ifndef CASEMAP_H_
+#define CASEMAP_H_
+
+#include <stdint.h>
+
+// longest name a lookup key can hold, as long as any command
+#define MAXKEY 512
+
+// a name folded to lower case, and the hash of the folded name
+struct nameKey
+{
+  char folded[MAXKEY];
+  uint32_t hash;
+};
+
+typedef struct nameKey nameKey;
+
+unsigned char casemap_char(unsigned char c);
+uint32_t casemap_fold(char * folded, const char * name, int size);
+nameKey * casemap_key(const char * name);
+
+#endif /* CASEMAP_H_ */
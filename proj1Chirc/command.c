@@ -15,11 +15,21 @@
 #include <string.h>
 #include <sys/socket.h>
 #include <sys/types.h>
+#include "budget.h"
+#include "casemap.h"
 #include "command.h"
+#include "drain.h"
 #include "globalData.h"
 #include "globalUser.h"
+#include "epoch.h"
+#include "history.h"
+#include "latency.h"
 #include "listfxns.h"
+#include "members.h"
+#include "modes.h"
+#include "netio.h"
 #include "reply.h"
+#include "server.h"
 #include "structures.h"
 
 
@@ -52,6 +62,11 @@ void command_init(char ** commands)
   commands[16] = "AWAY";
   commands[17] = "NAMES";
   commands[18] = "WHO";
+  commands[19] = "SERVER";
+  commands[20] = "PASS";
+  commands[21] = "HISTORY";
+  commands[22] = "STATS";
+  commands[23] = "DRAIN";
 }
 
 
@@ -83,6 +98,9 @@ int command_search(char *command, char **comList)
  */
 int run_command(int command, char ** argList, int argNum, userInfo * info, list_t * userList, list_t * chanList, serverInfo * servData)
 {
+  int result = 1;
+  latencySpan span;
+  latency_start(&span);
   replyPackage reply;
   memset(&reply, 0, sizeof(replyPackage));
   memcpy(reply.serverName, servData->serverHost, strlen(servData->serverHost));
@@ -207,10 +225,24 @@ int run_command(int command, char ** argList, int argNum, userInfo * info, list_
         who(argList[1], info, userList, chanList, &reply, servData);
       }
       break;
+    case HISTORY:
+      if (argNum == 2)
+        history(argList[1], NULL, info, chanList, &reply, servData);
+      else if (argNum == 3)
+        history(argList[1], argList[2], info, chanList, &reply, servData);
+      break;
+    case STATS:
+      stats(argNum > 1 ? argList[1] : NULL, info, &reply, servData);
+      break;
+    case DRAIN:
+      drain(info, &reply, servData);
+      break;
     default  :
-      return -1;
+      result = -1;
+      break;
   }
-  return 1;
+  latency_end(&span, command, argList, argNum, info);
+  return result;
 }
 
 
@@ -270,7 +302,7 @@ void user(char * username, char * name, userInfo * info, list_t * userList, list
     // stores user data globally if user has just registered
     if (info->nickname[0])
     {
-      pthread_mutex_lock(&lock);
+      latency_lock(&lock);
       info->channelModes = (list_t *) malloc(sizeof(list_t));
       list_init(info->channelModes);
       list_attributes_copy(info->channelModes, chanmode_info_size, 1);
@@ -278,10 +310,12 @@ void user(char * username, char * name, userInfo * info, list_t * userList, list
       list_attributes_seeker(info->channelModes, (element_seeker)chanmode_seeker);
       pthread_mutex_unlock(&lock);
 
-      pthread_mutex_lock (&lock);
+      latency_lock(&lock);
       list_append(userList, info);
       list_sort(userList, -1);
       pthread_mutex_unlock(&lock);
+      budget_charge(info->socket, BUDGET_USER, BUDGETREGISTER);
+      server_introduce(info, servData);
 
       memcpy(reply->nickname, info->nickname, strlen(info->nickname));
       
@@ -342,9 +376,9 @@ void nick(char * nickname, userInfo * info, list_t * userList, list_t * chanList
   originalNick[strlen(info->nickname)] = '\0';
 
   int argLen = 0;
-  if (nickLen >= MAXNICK)
+  if (nickLen > servData->limits.nickLen)
   {
-    nickLen = MAXNICK;
+    nickLen = servData->limits.nickLen + 1;
     nickOverflow = 1;
   }
   if (!(info->nickname[0]))
@@ -354,14 +388,16 @@ void nick(char * nickname, userInfo * info, list_t * userList, list_t * chanList
     // if user registered, fetch global info data
     if (info->username[0])
     {
-      pthread_mutex_lock(&lock);
+      latency_lock(&lock);
       globalIndex = list_locate(userList, info);
       pthread_mutex_unlock(&lock);
     }
   }
-  // determines if nick is already taken
-  pthread_mutex_lock(&lock);
-  if (list_seek(userList, &nickname))
+  // determines if nick is already taken, by anyone but
+  // the user changing the case of their own nick
+  latency_lock(&lock);
+  userInfo * holder = (userInfo *) list_seek(userList, casemap_key(nickname));
+  if (holder && (holder->remote || holder->socket != info->socket))
   {
     pthread_mutex_unlock(&lock);
 
@@ -382,11 +418,12 @@ void nick(char * nickname, userInfo * info, list_t * userList, list_t * chanList
   }
   if (nickOverflow)
     info->nickname[nickLen-1] = '\0';
+  user_key(info);
 
 	// globally stores user data if user has just registered
   if ((isFirstNick) && (info->username[0]))
   {
-    pthread_mutex_lock(&lock);
+    latency_lock(&lock);
     info->channelModes = (list_t *) malloc(sizeof(list_t));
     list_init(info->channelModes);
     list_attributes_copy(info->channelModes, chanmode_info_size, 1);
@@ -394,10 +431,12 @@ void nick(char * nickname, userInfo * info, list_t * userList, list_t * chanList
     list_attributes_seeker(info->channelModes, (element_seeker)chanmode_seeker);
     pthread_mutex_unlock(&lock);
 
-    pthread_mutex_lock(&lock);
+    latency_lock(&lock);
     list_append(userList, info);
 		list_sort(userList, -1);
     pthread_mutex_unlock(&lock);
+    budget_charge(info->socket, BUDGET_USER, BUDGETREGISTER);
+    server_introduce(info, servData);
 
     memcpy(reply->nickname, info->nickname, strlen(info->nickname));
     
@@ -449,41 +488,32 @@ void nick(char * nickname, userInfo * info, list_t * userList, list_t * chanList
                       strlen(info->nickname) + 3; // account for spaces and colon
     char replyEnd[replyEndLen];
     snprintf(replyEnd, replyEndLen, "NICK :%s", info->nickname);
-    pthread_mutex_lock(&lock);
+    notify_peers(info, chanList, replyBeginning, replyBeginLen, replyEnd, replyEndLen);
+    latency_lock(&lock);
     list_iterator_start(info->channelModes);
     while (list_iterator_hasnext(info->channelModes))
     {
       forChannel * chanModes = (forChannel *) list_iterator_next(info->channelModes);
       pthread_mutex_unlock(&lock);
       char * chanName = chanModes->channelName;
-      pthread_mutex_lock(&chanLock);
-      channelData * channel = (channelData *) list_seek(chanList, &chanName);
+      latency_lock(&chanLock);
+      channelData * channel = (channelData *) list_seek(chanList, casemap_key(chanName));
       pthread_mutex_unlock(&chanLock);
-      pthread_mutex_lock(&channel->chanUserLock);
-      list_iterator_start(channel->userList);
-      while (list_iterator_hasnext(channel->userList))
-      {
-        userInfo * user = (userInfo *) list_iterator_next(channel->userList);
-        send(user->socket, replyBeginning, replyBeginLen, 0);
-        send(user->socket, replyEnd, replyEndLen, 0);
-        send(user->socket, "\r\n", 2, 0);
-      }
-      list_iterator_stop(channel->userList);
-      pthread_mutex_unlock(&channel->chanUserLock);
-      pthread_mutex_lock(&lock);
+      latency_lock(&lock);
       int userIndex = list_locate(channel->userList, info);
       pthread_mutex_unlock(&lock);
-      pthread_mutex_lock(&channel->chanUserLock);
+      latency_lock(&channel->chanUserLock);
       list_delete_at(channel->userList, userIndex);
       list_insert_at(channel->userList, info, userIndex);
       list_sort(channel->userList, -1);
       pthread_mutex_unlock(&channel->chanUserLock);
-      pthread_mutex_lock(&lock);
+      latency_lock(&lock);
     }
     list_iterator_stop(info->channelModes);
     pthread_mutex_unlock(&lock);
     memcpy(reply->nickname, nickname, strlen(nickname));
-    pthread_mutex_lock(&lock);
+    server_nick(originalNick, info->nickname);
+    latency_lock(&lock);
     list_delete_at(userList, globalIndex);
     list_insert_at(userList, info, globalIndex);
     list_sort(userList, -1);
@@ -568,8 +598,8 @@ void privmsg(char *to_nick, char *msg, userInfo *info, list_t *userList, list_t
     
     channelData * to_channel;
     // if channel does not exist
-    pthread_mutex_lock(&chanLock);
-    if (!(to_channel = (channelData *) list_seek(chanList, &to_nick)))
+    latency_lock(&chanLock);
+    if (!(to_channel = (channelData *) list_seek(chanList, casemap_key(to_nick))))
     {
       pthread_mutex_unlock(&chanLock);
       reply->clientSocket = info->socket;
@@ -586,22 +616,19 @@ void privmsg(char *to_nick, char *msg, userInfo *info, list_t *userList, list_t
       pthread_mutex_unlock(&chanLock);
       int canChat = 1;
       int inChannel = -1;
-      pthread_mutex_lock(&to_channel->chanUserLock);
+      // the sender's channel list is only ever reshaped by its own thread
       if ((inChannel = list_locate(info->channelModes, to_channel)) > -1)
       {
-        if (to_channel->modes[0] == 'm' || to_channel->modes[1] == 'm')
+        if (to_channel->modes & MODE_MODERATED)
         {
           forChannel * userChannel = (forChannel *) list_get_at(info->channelModes, inChannel);
-          if (userChannel->modes[0] != 'o' && 
-              userChannel->modes[0] != 'v' &&
-              info->modes[0] != 'o' &&
-              info->modes[1] != 'o')
+          if (!(userChannel->modes & (MODE_CHANOP | MODE_VOICE)) &&
+              !(info->modes & MODE_OPER))
           {
             canChat = 0;
           }
         }
       }
-      pthread_mutex_unlock(&to_channel->chanUserLock);
       // check if user is part of channel
       if ((inChannel == -1) || (canChat == 0))
       {
@@ -628,26 +655,28 @@ void privmsg(char *to_nick, char *msg, userInfo *info, list_t *userList, list_t
                         strlen(msg) + 3; // account for spaces
       char replyEnd[replyEndLen];
       snprintf(replyEnd, replyEndLen, "PRIVMSG #%s %s", to_channel->name, msg);
-      pthread_mutex_lock(&to_channel->chanUserLock);
-      list_iterator_start(to_channel->userList);
-      while (list_iterator_hasnext(to_channel->userList))
+      // fan out over the member snapshot instead of locking the channel
+      epoch_enter();
+      memberSnapshot * members = members_read(to_channel);
+      netio_batch_start();
+      // large fan-outs share one copy of the line
+      if (members)
+        netio_share(replyBeginning, replyBeginLen, replyEnd, replyEndLen, members->numMembers - 1);
+      for (int i = 0; members && i < members->numMembers; i++)
       {
-        recieving_user = (userInfo *) list_iterator_next(to_channel->userList);
-        if (strcmp(recieving_user->nickname, info->nickname))
-        {
-          send(recieving_user->socket, replyBeginning, replyBeginLen, 0);
-          send(recieving_user->socket, replyEnd, replyEndLen, 0);
-          send(recieving_user->socket, "\r\n", 2, 0);
-        }
+        if (members->sockets[i] != info->socket)
+          netio_line(members->sockets[i], replyBeginning, replyBeginLen, replyEnd, replyEndLen);
       }
-      list_iterator_stop(to_channel->userList);
-      pthread_mutex_unlock(&to_channel->chanUserLock);
+      netio_batch_flush();
+      history_append(to_channel, replyBeginning, replyBeginLen, replyEnd, replyEndLen);
+      epoch_exit();
+      server_message(info, "PRIVMSG", to_channel, NULL, msg);
     }
     return;
   }
   // determine if nickname is valid
-  pthread_mutex_lock(&lock);
-  if (!(recieving_user = (userInfo *) list_seek(userList, &to_nick)))
+  latency_lock(&lock);
+  if (!(recieving_user = (userInfo *) list_seek(userList, casemap_key(to_nick))))
   {
     pthread_mutex_unlock(&lock);
     reply->clientSocket= info->socket;
@@ -663,7 +692,7 @@ void privmsg(char *to_nick, char *msg, userInfo *info, list_t *userList, list_t
     pthread_mutex_unlock(&lock);
 
   // receive away message if receiver is away
-  if (recieving_user->modes[0] == 'a' || recieving_user->modes[1] == 'a')
+  if (recieving_user->modes & MODE_AWAY)
   {
     memcpy(reply->responseCode, RPL_AWAY, REPLYCODELEN);
     reply->numArgs = 1;
@@ -674,6 +703,12 @@ void privmsg(char *to_nick, char *msg, userInfo *info, list_t *userList, list_t
     memcpy(reply->message, recieving_user->away, strlen(recieving_user->away));
     send_response(info->socket, reply);
   }
+  // route message to the server a remote user is on
+  if (recieving_user->remote)
+  {
+    server_message(info, "PRIVMSG", NULL, recieving_user, msg);
+    return;
+  }
   // send message to destination user 
   int replyBeginLen = 1 + strlen(info->nickname) + // account for colon
                       1 + strlen(info->username) + // account for bang
@@ -692,10 +727,8 @@ void privmsg(char *to_nick, char *msg, userInfo *info, list_t *userList, list_t
   snprintf(replyEnd, replyEndLen, "%s %s %s", "PRIVMSG",
                                               recieving_user->nickname,
                                               msg);
-  pthread_mutex_lock(&lock);
-  send(recieving_user->socket, replyBeginning, replyBeginLen, 0);
-  send(recieving_user->socket, replyEnd, replyEndLen, 0);
-  send(recieving_user->socket, "\r\n", 2, 0);
+  latency_lock(&lock);
+  netio_line(recieving_user->socket, replyBeginning, replyBeginLen, replyEnd, replyEndLen);
   pthread_mutex_unlock(&lock);
   return;
 }
@@ -724,33 +757,30 @@ void notice(char *to_nick, char *msg, userInfo *info, list_t *userList, list_t *
 
     channelData *to_channel;
     // if channel does not exist
-    pthread_mutex_lock(&chanLock);
-    if (!(to_channel = (channelData *) list_seek(chanList, &to_nick)))
+    latency_lock(&chanLock);
+    if (!(to_channel = (channelData *) list_seek(chanList, casemap_key(to_nick))))
     {
       pthread_mutex_unlock(&chanLock);
       return;
     }
     else
     {
-      pthread_mutex_unlock(&lock);
+      pthread_mutex_unlock(&chanLock);
       int canChat = 1;
       int inChannel = -1;
-      pthread_mutex_lock(&to_channel->chanUserLock);
+      // the sender's channel list is only ever reshaped by its own thread
       if ((inChannel = list_locate(info->channelModes, to_channel)) > -1)
       {
-        if (to_channel->modes[0] == 'm' || to_channel->modes[1] == 'm')
+        if (to_channel->modes & MODE_MODERATED)
         {
           forChannel * userChannel = (forChannel *) list_get_at(info->channelModes, inChannel);
-        if (userChannel->modes[0] != 'o' &&
-            userChannel->modes[0] != 'v' &&
-            info->modes[0] != 'o' &&
-            info->modes[1] != 'o')
+          if (!(userChannel->modes & (MODE_CHANOP | MODE_VOICE)) &&
+              !(info->modes & MODE_OPER))
           {
             canChat = 0;
           }
         }
       }
-      pthread_mutex_unlock(&to_channel->chanUserLock);
       // check if user is part of channel
       if ((inChannel == -1) || (canChat == 0))
       {
@@ -770,27 +800,29 @@ void notice(char *to_nick, char *msg, userInfo *info, list_t *userList, list_t *
                         strlen(msg) + 3; // account for spaces
       char replyEnd[replyEndLen];
       snprintf(replyEnd, replyEndLen, "NOTICE #%s %s", to_channel->name, msg);
-      pthread_mutex_lock(&lock);
-      list_iterator_start(to_channel->userList);
-      while(list_iterator_hasnext(to_channel->userList))
+      // fan out over the member snapshot instead of locking the channel
+      epoch_enter();
+      memberSnapshot * members = members_read(to_channel);
+      netio_batch_start();
+      // large fan-outs share one copy of the line
+      if (members)
+        netio_share(replyBeginning, replyBeginLen, replyEnd, replyEndLen, members->numMembers - 1);
+      for (int i = 0; members && i < members->numMembers; i++)
       {
-        recieving_user = (userInfo *) list_iterator_next(to_channel->userList);
-        if (strcmp(recieving_user->nickname, info->nickname))
-        {
-          send(recieving_user->socket, replyBeginning, replyBeginLen, 0);
-          send(recieving_user->socket, replyEnd, replyEndLen, 0);
-          send(recieving_user->socket, "\r\n", 2, 0);
-        }
+        if (members->sockets[i] != info->socket)
+          netio_line(members->sockets[i], replyBeginning, replyBeginLen, replyEnd, replyEndLen);
       }
-      list_iterator_stop(to_channel->userList);
-      pthread_mutex_unlock(&lock);
+      netio_batch_flush();
+      history_append(to_channel, replyBeginning, replyBeginLen, replyEnd, replyEndLen);
+      epoch_exit();
+      server_message(info, "NOTICE", to_channel, NULL, msg);
     }
     return;
   }
 
   // determine if nickname is valid
-  pthread_mutex_lock(&lock);
-  if (!(recieving_user = (userInfo *) list_seek(userList, &to_nick)))
+  latency_lock(&lock);
+  if (!(recieving_user = (userInfo *) list_seek(userList, casemap_key(to_nick))))
   {
     pthread_mutex_unlock(&lock);
     return;
@@ -798,6 +830,13 @@ void notice(char *to_nick, char *msg, userInfo *info, list_t *userList, list_t *
   else
     pthread_mutex_unlock(&lock);
 
+  // route message to the server a remote user is on
+  if (recieving_user->remote)
+  {
+    server_message(info, "NOTICE", NULL, recieving_user, msg);
+    return;
+  }
+
   // send message to destination user
   int replyBeginLen = 1 + strlen(info->nickname) + // account for colon
                       1 + strlen(info->username) + // account for bang
@@ -816,10 +855,8 @@ void notice(char *to_nick, char *msg, userInfo *info, list_t *userList, list_t *
   snprintf(replyEnd, replyEndLen, "%s %s %s", "NOTICE",
                                               recieving_user->nickname,
                                               msg);
-  pthread_mutex_lock(&lock);
-  send(recieving_user->socket, replyBeginning, replyBeginLen, 0);
-  send(recieving_user->socket, replyEnd, replyEndLen, 0);
-  send(recieving_user->socket, "\r\n", 2, 0);
+  latency_lock(&lock);
+  netio_line(recieving_user->socket, replyBeginning, replyBeginLen, replyEnd, replyEndLen);
   free(recieving_user);
   pthread_mutex_unlock(&lock);
   return;
@@ -840,19 +877,29 @@ void lusers(userInfo *info, list_t *userList, replyPackage *reply, serverInfo *s
   int num_invisible = 0;
   int num_operators = 0;
   int num_channels = 0;
-  int num_servers = 1;
+  int num_servers = 1 + server_count();
 
-  pthread_mutex_lock(&lock);
+  latency_lock(&lock);
   int num_clients = num_pthreads;
   int num_users = list_size(userList);
-  int num_unknown = num_clients - num_users;
+  // remote users are not connected to us
+  int num_local = 0;
+  list_iterator_start(userList);
+  while (list_iterator_hasnext(userList))
+  {
+    userInfo * user = (userInfo *) list_iterator_next(userList);
+    if (!user->remote)
+      num_local++;
+  }
+  list_iterator_stop(userList);
+  int num_unknown = num_clients - num_local;
   pthread_mutex_unlock(&lock);
 
   reply->numArgs = 7;
 
   // pack all of lusers arguments into reply struct
-  // should be set to total number of digits plus spaces in future
-  int argLen = 14; 
+  // counts include remote users, so leave room for multi-digit values
+  int argLen = MAXARGS - 1;
   snprintf(reply->args, argLen, "%d %d %d %d %d %d %d", num_clients, 
                                                        num_invisible,
                                                        num_operators,
@@ -889,9 +936,9 @@ void whois(char * nickname, userInfo * info, list_t * userList, replyPackage * r
   int argLen;
 
   userInfo * user = malloc(sizeof(userInfo));
-  pthread_mutex_lock(&lock);
+  latency_lock(&lock);
   // checks if nickname is invalid
-  if (!(user = (userInfo *) list_seek(userList, &nickname)))
+  if (!(user = (userInfo *) list_seek(userList, casemap_key(nickname))))
   {
     pthread_mutex_unlock(&lock);
     memcpy(reply->responseCode, ERR_NOSUCHNICK, REPLYCODELEN);
@@ -915,7 +962,7 @@ void whois(char * nickname, userInfo * info, list_t * userList, replyPackage * r
     memcpy(reply->message, user->name, strlen(user->name));
     reply->message[strlen(user->name)-1] = '\0';
     send_response(info->socket, reply);
-    pthread_mutex_lock(&lock);
+    latency_lock(&lock);
     if (list_size(user->channelModes) > 0)
     {
       memcpy(reply->responseCode, RPL_WHOISCHANNELS, REPLYCODELEN);
@@ -931,12 +978,12 @@ void whois(char * nickname, userInfo * info, list_t * userList, replyPackage * r
       {
         forChannel * chanAndMode = (forChannel *) list_iterator_next(user->channelModes);
         pthread_mutex_unlock(&lock);
-        if (chanAndMode->modes[0] == 'o')
+        if (chanAndMode->modes & MODE_CHANOP)
         {
           memcpy(reply->message+totalReplyLen, "@", 1);
           totalReplyLen++;
         }
-        else if (chanAndMode->modes[0] == 'v')
+        else if (chanAndMode->modes & MODE_VOICE)
         {
           memcpy(reply->message+totalReplyLen, "+", 1);
           totalReplyLen++;
@@ -946,26 +993,27 @@ void whois(char * nickname, userInfo * info, list_t * userList, replyPackage * r
         memcpy(reply->message+totalReplyLen, chanAndMode->channelName, strlen(chanAndMode->channelName));
         totalReplyLen += strlen(chanAndMode->channelName) + 1; // account for space char
         reply->message[totalReplyLen-1] = ' ';
-        pthread_mutex_lock(&lock);
+        latency_lock(&lock);
       }
       list_iterator_stop(user->channelModes);
       pthread_mutex_unlock(&lock);
       reply->message[totalReplyLen] = '\0';
       send_response(info->socket, reply);
-      pthread_mutex_lock(&lock); 
+      latency_lock(&lock); 
     }
     pthread_mutex_unlock(&lock);
     memcpy(reply->responseCode, RPL_WHOISSERVER, REPLYCODELEN);
     reply->numArgs = 3;
-    argLen = strlen(user->nickname) + strlen(servData->serverHost) +
+    char * userServer = user->remote ? user->server : servData->serverHost;
+    argLen = strlen(user->nickname) + strlen(userServer) +
              strlen(servData->serverVersion) + reply->numArgs;
     snprintf(reply->args, argLen, "%s %s %s", user->nickname,
-                                              servData->serverHost,
+                                              userServer,
                                               servData->serverVersion);
     reply->args[argLen] = '\0';
     send_response(info->socket, reply);
     
-    if (user->modes[0] == 'a' || user->modes[1] == 'a')
+    if (user->modes & MODE_AWAY)
     {
       memcpy(reply->responseCode, RPL_AWAY, REPLYCODELEN);
       reply->numArgs = 1;
@@ -976,7 +1024,7 @@ void whois(char * nickname, userInfo * info, list_t * userList, replyPackage * r
       memcpy(reply->message, user->away, strlen(user->away));
       send_response(info->socket, reply);
     }
-    if (user->modes[0] == 'o' || user->modes[1] == 'o')
+    if (user->modes & MODE_OPER)
     {
       memcpy(reply->responseCode, RPL_WHOISOPERATOR, REPLYCODELEN);
       reply->numArgs = 1;
@@ -997,6 +1045,54 @@ void whois(char * nickname, userInfo * info, list_t * userList, replyPackage * r
 }
 
 
+/* notify_peers:
+ * Given a userInfo struct and the channel list, sends the line
+ * made of begin and end once to every local user who shares a
+ * channel with the user, the user included, however many
+ * channels they share. The recipients are gathered under the
+ * lock and sent to after it is released, in one netio batch.
+ * The members of a channel who do not fit in the set when
+ * memory runs out are sent to under the lock instead.
+ */
+void notify_peers(userInfo * info, list_t * chanList, char * begin, int beginLen, char * end, int endLen)
+{
+  memberSet peers = {0, 0, NULL};
+  epoch_enter();
+  latency_lock(&lock);
+  list_iterator_start(info->channelModes);
+  while (list_iterator_hasnext(info->channelModes))
+  {
+    forChannel * chanModes = (forChannel *) list_iterator_next(info->channelModes);
+    latency_lock(&chanLock);
+    channelData * channel = (channelData *) list_seek(chanList, casemap_key(chanModes->channelName));
+    pthread_mutex_unlock(&chanLock);
+    if (channel == NULL)
+      continue;
+    memberSnapshot * snapshot = members_read(channel);
+    if (members_gather(&peers, snapshot) == -1)
+    {
+      // out of memory: a member may now hear this twice, but
+      // none of them is left out
+      for (int i = 0; i < snapshot->numMembers; i++)
+        netio_line(snapshot->sockets[i], begin, beginLen, end, endLen);
+    }
+  }
+  list_iterator_stop(info->channelModes);
+  pthread_mutex_unlock(&lock);
+  epoch_exit();
+
+  members_unique(&peers);
+  netio_batch_start();
+  for (int i = 0; i < peers.numSockets; i++)
+  {
+    if (peers.sockets[i] >= 0)
+      netio_line(peers.sockets[i], begin, beginLen, end, endLen);
+  }
+  netio_batch_flush();
+  members_release(&peers);
+}
+
+
 /* ping:
  * Given a userInfo struct and a serverInfo struct,
  * Sends a "PONG" response to the client, which
@@ -1009,9 +1105,8 @@ void ping(userInfo * info, serverInfo * servData)
   int replyLen = strlen(pongMsg) + strlen(servData->serverHost) + 1;
   reply = (char *) malloc(replyLen*sizeof(char *));
   snprintf(reply, replyLen, "%s%s", pongMsg, servData->serverHost);
-  pthread_mutex_lock(&lock);
-  send(info->socket, reply, replyLen, 0);
-  send(info->socket, "\r\n", 2, 0);
+  latency_lock(&lock);
+  netio_line(info->socket, reply, replyLen, NULL, 0);
   pthread_mutex_unlock(&lock);
   free(reply);
   return;
@@ -1039,16 +1134,15 @@ void quit(char * msg, userInfo * info, list_t * userList, list_t * chanList)
   snprintf(reply, replyLen, quitMsg, info->host, msg);
   
   // remove user from global user list
-  pthread_mutex_lock(&lock);
-  num_pthreads--;
+  // the client's thread stops counting itself when it exits
+  latency_lock(&lock);
   int userIndex = list_locate(userList, info);
   list_delete_at(userList, userIndex);
   list_sort(userList, -1);
   pthread_mutex_unlock(&lock);
 
-  pthread_mutex_lock(&lock);
-  send(info->socket, reply, replyLen, 0);
-  send(info->socket, "\r\n", 2, 0);
+  latency_lock(&lock);
+  netio_line(info->socket, reply, replyLen, NULL, 0);
   pthread_mutex_unlock(&lock);
 
   int replyBeginLen = 1 + strlen(info->nickname) + // account for colon
@@ -1063,35 +1157,53 @@ void quit(char * msg, userInfo * info, list_t * userList, list_t * chanList)
                     strlen(msg) + 3; // account for spaces and colon
   char replyEnd[replyEndLen];
   snprintf(replyEnd, replyEndLen, "QUIT :%s", msg);
-  pthread_mutex_lock(&lock);
+  server_quit(info, msg);
+  notify_peers(info, chanList, replyBeginning, replyBeginLen, replyEnd, replyEndLen);
+  latency_lock(&lock);
   list_iterator_start(info->channelModes);
   while (list_iterator_hasnext(info->channelModes))
   {
     forChannel * chanModes = (forChannel *) list_iterator_next(info->channelModes);
     char * chanName = chanModes->channelName;
-    pthread_mutex_lock(&chanLock);
-    channelData * channel = (channelData *) list_seek(chanList, &chanName);
+    latency_lock(&chanLock);
+    channelData * channel = (channelData *) list_seek(chanList, casemap_key(chanName));
     pthread_mutex_unlock(&chanLock);
-    list_iterator_start(channel->userList);
-    while (list_iterator_hasnext(channel->userList))
-    {
-      userInfo * user = (userInfo *) list_iterator_next(channel->userList);
-      send(user->socket, replyBeginning, replyBeginLen, 0);
-      send(user->socket, replyEnd, replyEndLen, 0);
-      send(user->socket, "\r\n", 2, 0);
-    }
-    list_iterator_stop(channel->userList);
+    latency_lock(&channel->chanUserLock);
     int userIndex = list_locate(channel->userList, info);
     list_delete_at(channel->userList, userIndex);
     list_sort(channel->userList, -1);
+    members_publish(channel);
+    pthread_mutex_unlock(&channel->chanUserLock);
   }
   list_iterator_stop(info->channelModes);
   pthread_mutex_unlock(&lock);
+  netio_release(info->socket);
   shutdown(info->socket, 2);
   return;
 }
 
 
+/* disconnect:
+ * Closes the connection of a client for the reason in msg, such
+ * as a ping timeout. Registered users are removed from all lists
+ * as if they quit; others are just told why. Must be called from
+ * the client's own thread.
+ */
+void disconnect(userInfo * info, char * msg, list_t * userList, list_t * chanList)
+{
+  if (info->channelModes)
+  {
+    quit(msg, info, userList, chanList);
+    return;
+  }
+  char reply[MAXHOST + strlen(msg) + 32];
+  int replyLen = snprintf(reply, sizeof(reply), "ERROR :Closing Link: %s (%s)", info->host, msg);
+  netio_line(info->socket, reply, replyLen, NULL, 0);
+  netio_release(info->socket);
+  shutdown(info->socket, 2);
+}
+
+
 void join(char * chanName, userInfo * info, list_t * userList, list_t * chanList, replyPackage * reply, serverInfo * servData)
 {
   // remove # from chanName
@@ -1100,19 +1212,24 @@ void join(char * chanName, userInfo * info, list_t * userList, list_t * chanList
     memcpy(chanName, &chanName[1], strlen(chanName)-1);
     chanName[strlen(chanName)-1] = '\0';
   }
+  // longer names are cut short, as long nicknames are
+  if ((int) strlen(chanName) > servData->limits.chanLen)
+    chanName[servData->limits.chanLen] = '\0';
   // figure out when to return ERR_NOSUCHCHANNEL
   channelData * channel;
   // if chanName is not part of chanList, create new channelData structure
-  pthread_mutex_lock(&chanLock);
-  channel = list_seek(chanList, &chanName);
+  latency_lock(&chanLock);
+  channel = list_seek(chanList, casemap_key(chanName));
   pthread_mutex_unlock(&chanLock);
 
   // create new channel if channel does not exist
+  int isCreator = (channel == NULL);
   if (channel == NULL)
   {
     channelData * newChannel = (channelData *) malloc(sizeof(channelData));
     memset(newChannel, 0, sizeof(channelData));
     memcpy(newChannel->name, chanName, strlen(chanName));
+    chan_key(newChannel);
     pthread_mutex_init(&newChannel->chanUserLock, NULL); // this could be problem
     // remember to delete mutex upon channel deletion
     newChannel->userList = (list_t *) malloc(sizeof(list_t));
@@ -1120,10 +1237,13 @@ void join(char * chanName, userInfo * info, list_t * userList, list_t * chanList
     list_attributes_copy(newChannel->userList, user_info_size, 1);
     list_attributes_comparator(newChannel->userList, nick_comparator);
     list_attributes_seeker(newChannel->userList, (element_seeker) seeker);
-    pthread_mutex_lock(&lock);
+    members_init(newChannel);
+    history_init(newChannel);
+    latency_lock(&lock);
     list_append(newChannel->userList, info);
     list_sort(newChannel->userList, -1);
-    pthread_mutex_lock(&chanLock);
+    members_publish(newChannel);
+    latency_lock(&chanLock);
     list_append(chanList, newChannel);
     list_sort(chanList, 1);
     pthread_mutex_unlock(&chanLock);
@@ -1134,9 +1254,10 @@ void join(char * chanName, userInfo * info, list_t * userList, list_t * chanList
     //int originalIndex = list_locate(userList, info);
     forChannel * memberStatusMode = (forChannel *) malloc(sizeof(forChannel));
     memset(memberStatusMode, 0, sizeof(forChannel));
-    memcpy(memberStatusMode->channelName, chanName, sizeof(chanName));
-    memcpy(memberStatusMode->modes, "o\0", 2);
-    pthread_mutex_lock(&lock);
+    memcpy(memberStatusMode->channelName, chanName, strlen(chanName));
+    chanmode_key(memberStatusMode);
+    memberStatusMode->modes = MODE_CHANOP;
+    latency_lock(&lock);
     list_append(info->channelModes, memberStatusMode);
     list_sort(info->channelModes, -1);
     // update global userList
@@ -1145,12 +1266,13 @@ void join(char * chanName, userInfo * info, list_t * userList, list_t * chanList
     list_insert_at(userList, info, originalIndex);
     list_sort(userList, -1);
     pthread_mutex_unlock(&lock);
+    budget_charge(info->socket, BUDGET_CHANNELS, BUDGETJOIN);
   }
   else
   {
     // if part of chanList, obtain channelData structure and delete from list (so it can be updated)
     // check to see if user is already part of channel
-    pthread_mutex_lock(&lock);
+    latency_lock(&lock);
     if (list_locate(channel->userList, info) > -1)
     {
       pthread_mutex_unlock(&lock);
@@ -1159,21 +1281,22 @@ void join(char * chanName, userInfo * info, list_t * userList, list_t * chanList
     pthread_mutex_unlock(&lock);
 
     // Update the userList of channel
-    pthread_mutex_lock(&channel->chanUserLock);
-    pthread_mutex_lock(&chanLock);
+    latency_lock(&channel->chanUserLock);
+    latency_lock(&chanLock);
     int originalIndex = list_locate(chanList, channel);
     pthread_mutex_unlock(&chanLock);
     list_append(channel->userList, info);
     list_sort(channel->userList, -1);
+    members_publish(channel);
     pthread_mutex_unlock(&channel->chanUserLock);
 
     // update user channel list
     originalIndex = list_locate(userList, info);
     forChannel * memberStatusMode = (forChannel *) malloc(sizeof(forChannel));
     memset(memberStatusMode, 0, sizeof(forChannel));
-    memcpy(memberStatusMode->channelName, chanName, sizeof(chanName));
-    memset(memberStatusMode->modes, 0, 2);
-    pthread_mutex_lock(&lock);
+    memcpy(memberStatusMode->channelName, chanName, strlen(chanName));
+    chanmode_key(memberStatusMode);
+    latency_lock(&lock);
     list_append(info->channelModes, memberStatusMode);
     list_sort(info->channelModes, -1);
     // update global userList
@@ -1181,6 +1304,7 @@ void join(char * chanName, userInfo * info, list_t * userList, list_t * chanList
     list_insert_at(userList, info, originalIndex);
     list_sort(userList, -1);
     pthread_mutex_unlock(&lock);
+    budget_charge(info->socket, BUDGET_CHANNELS, BUDGETJOIN);
   }
   // send initial JOIN message to all users in channel
   int replyLen = 1 + strlen(info->nickname) + // account for colon
@@ -1194,16 +1318,20 @@ void join(char * chanName, userInfo * info, list_t * userList, list_t * chanList
                                                       info->username,
                                                       info->host,
                                                       chanName);
-  pthread_mutex_lock(&channel->chanUserLock);
+  latency_lock(&channel->chanUserLock);
+  netio_batch_start();
   list_iterator_start(channel->userList);
   while (list_iterator_hasnext(channel->userList))
   {
     userInfo * user = (userInfo *) list_iterator_next(channel->userList);
-    send(user->socket, initReply, replyLen, 0);
-    send(user->socket, "\r\n", 2, 0);
+    if (user->remote)
+      continue;
+    netio_line(user->socket, initReply, replyLen, NULL, 0);
   }
   list_iterator_stop(channel->userList);
+  netio_batch_flush();
   pthread_mutex_unlock(&channel->chanUserLock);
+  server_join(info, chanName, isCreator ? 'o' : '\0');
 
   if (channel->topic[0])
   {
@@ -1227,8 +1355,8 @@ void part(char * chanName, char * msg, userInfo * info, list_t * userList, list_
   }
   // if channel doesn't exist, return ERR_NOSUCHCHANNEL
   channelData * channel;
-  pthread_mutex_lock(&chanLock);
-  channel = list_seek(chanList, &chanName);
+  latency_lock(&chanLock);
+  channel = list_seek(chanList, casemap_key(chanName));
   pthread_mutex_unlock(&chanLock);
   if (channel == NULL)
   {
@@ -1241,7 +1369,7 @@ void part(char * chanName, char * msg, userInfo * info, list_t * userList, list_
     return;
   }
   // if user is not member of channel, return ERR_NOTONCHANNEL
-  pthread_mutex_lock(&channel->chanUserLock);
+  latency_lock(&channel->chanUserLock);
   if ((userIndex = list_locate(channel->userList, info)) == -1)
   {
     pthread_mutex_unlock(&channel->chanUserLock);
@@ -1254,19 +1382,20 @@ void part(char * chanName, char * msg, userInfo * info, list_t * userList, list_
     return;
   }
   pthread_mutex_unlock(&channel->chanUserLock);
-  pthread_mutex_lock(&lock);
+  latency_lock(&lock);
   // if user is op or voice in channel, delete this data from userList
 
   forChannel * chanAndModeRef;
   int originalIndex;
-  if ((chanAndModeRef = list_seek(info->channelModes, &chanName)))
+  if ((chanAndModeRef = list_seek(info->channelModes, casemap_key(chanName))))
   {
     originalIndex = list_locate(info->channelModes, chanAndModeRef);
     list_delete_at(info->channelModes, originalIndex);
     originalIndex = list_locate(userList, info);
-    //list_delete_at(userList, originalIndex);
+    list_delete_at(userList, originalIndex);
     list_insert_at(userList, info, originalIndex);
     list_sort(userList, -1);
+    budget_charge(info->socket, BUDGET_CHANNELS, -(long) BUDGETJOIN);
   }
   pthread_mutex_unlock(&lock);
 
@@ -1297,38 +1426,41 @@ void part(char * chanName, char * msg, userInfo * info, list_t * userList, list_
       msg[strlen(msg)-2] = '\0';
     }
     messageLen = strlen(msg) + 3; // account for space
-    pthread_mutex_lock(&channel->chanUserLock);
+    latency_lock(&channel->chanUserLock);
     messageReply = (char *) malloc(messageLen*sizeof(char));
     snprintf(messageReply, messageLen, " :%s", msg); // account for colon
     pthread_mutex_unlock(&channel->chanUserLock);
   }
 
-  pthread_mutex_lock(&channel->chanUserLock);
+  latency_lock(&channel->chanUserLock);
+  netio_batch_start();
   list_iterator_start(channel->userList);
   while (list_iterator_hasnext(channel->userList))
   {
     userInfo * user = (userInfo *) list_iterator_next(channel->userList);
-    send(user->socket, initReply, replyLen, 0);
-    if (msgPresent)
-    {
-      send(user->socket, messageReply, messageLen, 0);
-    }
-    send(user->socket, "\r\n", 2, 0);
+    if (user->remote)
+      continue;
+    netio_line(user->socket, initReply, replyLen, msgPresent ? messageReply : NULL, messageLen);
   }
   list_iterator_stop(channel->userList);
+  netio_batch_flush();
 
   // remove user from channel userList
   list_delete_at(channel->userList, userIndex);
+  members_publish(channel);
   pthread_mutex_unlock(&channel->chanUserLock);
+  server_part(info, chanName, msgPresent ? msg : NULL);
   
-  pthread_mutex_lock(&channel->chanUserLock);
+  latency_lock(&channel->chanUserLock);
   // if numUsers is 0, remove channel from chanList
   if (list_size(channel->userList) == 0)
   {
     pthread_mutex_unlock(&channel->chanUserLock);
     // delete userList here
-    pthread_mutex_lock(&chanLock);
+    latency_lock(&chanLock);
     int chanIndex = list_locate(chanList, channel);
+    members_free(channel);
+    history_free(channel);
     list_delete_at(chanList, chanIndex);
     pthread_mutex_unlock(&chanLock);
   }
@@ -1350,8 +1482,8 @@ void topic(char * chanName, char * msg, userInfo * info, list_t * chanList, repl
   int argLen;
 
   // determine if user is on channel
-  pthread_mutex_lock(&chanLock);
-  if (!(channel = (channelData *) list_seek(chanList, &chanName)))
+  latency_lock(&chanLock);
+  if (!(channel = (channelData *) list_seek(chanList, casemap_key(chanName))))
   {
     pthread_mutex_unlock(&chanLock);
     reply->numArgs = 1;
@@ -1364,7 +1496,7 @@ void topic(char * chanName, char * msg, userInfo * info, list_t * chanList, repl
   }
   else
     pthread_mutex_unlock(&chanLock);
-  pthread_mutex_lock(&lock);
+  latency_lock(&lock);
   if (list_locate(channel->userList, info) == -1)
   {
     pthread_mutex_unlock(&lock);
@@ -1404,15 +1536,13 @@ void topic(char * chanName, char * msg, userInfo * info, list_t * chanList, repl
   else
   {
     // if chan in topic mode, only op can change topic
-    if (channel->modes[0] == 't' || channel->modes[1] == 't')
+    if (channel->modes & MODE_TOPICLOCK)
     {
-      pthread_mutex_lock(&channel->chanUserLock);
+      latency_lock(&channel->chanUserLock);
       int chanIndex = list_locate(info->channelModes, channel);
       forChannel * userChannel = (forChannel *) list_get_at(info->channelModes, chanIndex);
       pthread_mutex_unlock(&channel->chanUserLock);
-      if (userChannel->modes[0] != 'o' && 
-          info->modes[0] != 'o' &&
-          info->modes[1] != 'o')
+      if (!(userChannel->modes & MODE_CHANOP) && !(info->modes & MODE_OPER))
       {
         memcpy(reply->responseCode, ERR_CHANOPRIVSNEEDED, REPLYCODELEN);
         reply->numArgs = 1;
@@ -1437,8 +1567,11 @@ void topic(char * chanName, char * msg, userInfo * info, list_t * chanList, repl
     // reset the topic
     else
     {
+      int topicLen = strlen(msg);
+      if (topicLen > servData->limits.topicLen)
+        topicLen = servData->limits.topicLen;
       memset(channel->topic, 0, MAXTOPIC);
-      memcpy(channel->topic, msg, strlen(msg));
+      memcpy(channel->topic, msg, topicLen);
     }
     int replyBeginLen = 1 + strlen(info->nickname) + // account for colon
                         1 + strlen(info->username) + // account for bang
@@ -1455,16 +1588,18 @@ void topic(char * chanName, char * msg, userInfo * info, list_t * chanList, repl
     snprintf(replyEnd, replyEndLen, "TOPIC #%s :%s", channel->name, msg);
 
     userInfo * recieving_user;
-    pthread_mutex_lock(&channel->chanUserLock);
+    latency_lock(&channel->chanUserLock);
+    netio_batch_start();
     list_iterator_start(channel->userList);
     while (list_iterator_hasnext(channel->userList))
     {
       recieving_user = (userInfo *) list_iterator_next(channel->userList);
-      send(recieving_user->socket, replyBeginning, replyBeginLen, 0);
-      send(recieving_user->socket, replyEnd, replyEndLen, 0);
-      send(recieving_user->socket, "\r\n", 2, 0);
+      if (recieving_user->remote)
+        continue;
+      netio_line(recieving_user->socket, replyBeginning, replyBeginLen, replyEnd, replyEndLen);
     }
     list_iterator_stop(channel->userList);
+    netio_batch_flush();
     pthread_mutex_unlock(&channel->chanUserLock);
   }
   return;
@@ -1481,7 +1616,7 @@ void list(char * chanName, userInfo * info, list_t * chanList, replyPackage * re
   reply->numArgs = 3;
   if (chanName == NULL)
   {
-    pthread_mutex_lock(&chanLock);
+    latency_lock(&chanLock);
     list_iterator_start(chanList);
     while (list_iterator_hasnext(chanList))
     {
@@ -1489,7 +1624,7 @@ void list(char * chanName, userInfo * info, list_t * chanList, replyPackage * re
       pthread_mutex_unlock(&chanLock);
       if (strcmp(channel->name, "*"))
       {
-        pthread_mutex_lock(&channel->chanUserLock);
+        latency_lock(&channel->chanUserLock);
         num_users = list_size(channel->userList);
         pthread_mutex_unlock(&channel->chanUserLock);
         int num_users_digits = 0;
@@ -1503,7 +1638,7 @@ void list(char * chanName, userInfo * info, list_t * chanList, replyPackage * re
         memcpy(reply->message, channel->topic, strlen(channel->topic));
         send_response(info->socket, reply);
       }
-      pthread_mutex_lock(&chanLock);
+      latency_lock(&chanLock);
     }
     list_iterator_stop(chanList);
     pthread_mutex_unlock(&chanLock);
@@ -1516,10 +1651,10 @@ void list(char * chanName, userInfo * info, list_t * chanList, replyPackage * re
       memcpy(chanName, &chanName[1], strlen(chanName)-1);
       chanName[strlen(chanName)-1] = '\0';
     }
-    pthread_mutex_lock(&chanLock);
-    if ((channel = (channelData *) list_seek(chanList, &chanName)))
+    latency_lock(&chanLock);
+    if ((channel = (channelData *) list_seek(chanList, casemap_key(chanName))))
     {
-      pthread_mutex_lock(&channel->chanUserLock);
+      latency_lock(&channel->chanUserLock);
       num_users = list_size(channel->userList);
       pthread_mutex_unlock(&channel->chanUserLock);
       int num_users_digits = 0;
@@ -1552,8 +1687,8 @@ void mode(char * firstName, char * secondName, char * adjMode, userInfo * info,
     firstName[strlen(firstName)-1] = '\0';
     
     channelData * channel;
-    pthread_mutex_lock(&chanLock);
-    if (!(channel = (channelData *) list_seek(chanList, &firstName)))
+    latency_lock(&chanLock);
+    if (!(channel = (channelData *) list_seek(chanList, casemap_key(firstName))))
     {
       pthread_mutex_unlock(&chanLock);
       // return an error, there's no such channel
@@ -1569,10 +1704,12 @@ void mode(char * firstName, char * secondName, char * adjMode, userInfo * info,
     // return mode of channel
     if (adjMode == NULL)
     {
+      char modes[MODEMAXLETTERS];
+      mode_render(MODECHANNEL, channel->modes, modes);
       memcpy(reply->responseCode, RPL_CHANNELMODEIS, REPLYCODELEN);
       reply->numArgs = 2;
-      argLen = strlen(channel->name) + strlen(channel->modes) + reply->numArgs;
-      snprintf(reply->args, argLen, "%s %s", channel->name, channel->modes);
+      argLen = strlen(channel->name) + strlen(modes) + reply->numArgs;
+      snprintf(reply->args, argLen, "%s %s", channel->name, modes);
       reply->args[argLen] = '\0';
       send_response(info->socket, reply);
       return;
@@ -1580,10 +1717,8 @@ void mode(char * firstName, char * secondName, char * adjMode, userInfo * info,
     // make sure user is operator on channel
     userInfo * updatingUser;
     int globalIndex;
-    pthread_mutex_lock(&channel->chanUserLock);
-    if (list_locate(channel->userList, info) == -1 &&
-        info->modes[0] != 'o' &&
-        info->modes[1] != 'o')
+    latency_lock(&channel->chanUserLock);
+    if (list_locate(channel->userList, info) == -1 && !(info->modes & MODE_OPER))
     {
       pthread_mutex_unlock(&channel->chanUserLock);
       // person isn't on channel, can't make changes
@@ -1600,9 +1735,7 @@ void mode(char * firstName, char * secondName, char * adjMode, userInfo * info,
     globalIndex = list_locate(updatingUser->channelModes, channel);
     userChannel = (forChannel *) list_get_at(updatingUser->channelModes, globalIndex);
     pthread_mutex_unlock(&channel->chanUserLock);
-    if (userChannel->modes[0] != 'o' && 
-        info->modes[0] != 'o' && 
-        info->modes[1] != 'o')
+    if (!(userChannel->modes & MODE_CHANOP) && !(info->modes & MODE_OPER))
     {
       // user can't make updates, they're not an operator
       memcpy(reply->responseCode, ERR_CHANOPRIVSNEEDED, REPLYCODELEN);
@@ -1615,9 +1748,10 @@ void mode(char * firstName, char * secondName, char * adjMode, userInfo * info,
     }
     if (secondName == NULL)
     {
+      unsigned int bit = mode_bit(MODECHANNEL, adjMode[1]);
       if (adjMode[0] == '+')
       {
-        if (adjMode[1] != 't' && adjMode[1] != 'm')
+        if (!bit)
         {
           // return an error
           // incorrect flags
@@ -1629,23 +1763,8 @@ void mode(char * firstName, char * secondName, char * adjMode, userInfo * info,
           send_response(info->socket, reply);
           return;
         }
-        // if either spot already contains that flag
-        if (channel->modes[0] == adjMode[1] || channel->modes[1] == adjMode[1])
-        {
-          // send confirmation
-        }
-        // if the first spot is taken, set the second spot to the flag
-        // otherwise, set the first spot to the flag
-        if (channel->modes[0])
-        {
-          channel->modes[1] = adjMode[1];
-          channel->modes[2] = '\0';
-        }
-        else
-        {
-          channel->modes[0] = adjMode[1];
-          channel->modes[1] = '\0';
-        }
+        // MODE takes no lock, so two changes at once must not undo each other
+        __atomic_fetch_or(&channel->modes, bit, __ATOMIC_RELAXED);
         // send confirmation
         // return
         int replyBeginLen = 1 + strlen(info->nickname) + // account for colon
@@ -1663,22 +1782,24 @@ void mode(char * firstName, char * secondName, char * adjMode, userInfo * info,
         snprintf(replyEnd, replyEndLen, "MODE #%s %s", channel->name, adjMode);
 
         userInfo * recieving_user;
-        pthread_mutex_lock(&channel->chanUserLock);
+        latency_lock(&channel->chanUserLock);
+        netio_batch_start();
         list_iterator_start(channel->userList);
         while (list_iterator_hasnext(channel->userList))
         {
           recieving_user = (userInfo *) list_iterator_next(channel->userList);
-          send(recieving_user->socket, replyBeginning, replyBeginLen, 0);
-          send(recieving_user->socket, replyEnd, replyEndLen, 0);
-          send(recieving_user->socket, "\r\n", 2, 0);
+          if (recieving_user->remote)
+            continue;
+          netio_line(recieving_user->socket, replyBeginning, replyBeginLen, replyEnd, replyEndLen);
         }
         list_iterator_stop(channel->userList);
+        netio_batch_flush();
         pthread_mutex_unlock(&channel->chanUserLock);
         return;
       }
       else if (adjMode[0] == '-')
       {
-        if (adjMode[1] != 't' && adjMode[1] != 'm')
+        if (!bit)
         {
           // return an error
           // incorrect flags
@@ -1690,28 +1811,7 @@ void mode(char * firstName, char * secondName, char * adjMode, userInfo * info,
           send_response(info->socket, reply);
           return;
         }
-        // if the first spot has the flag
-        if (channel->modes[0] == adjMode[1])
-        {
-          // move the second flag to the first position, set the second flag to NULL
-          if (channel->modes[1] != '\0')
-          {
-            channel->modes[0] = channel->modes[1];
-            channel->modes[1] = '\0';
-          }
-          else
-            memset(&channel->modes[0], 0, 1);
-          // send confirmation
-        }
-        else if (channel->modes[1] == adjMode[1])
-        {
-          // if the second flag matches, set that flag to NULL
-          channel->modes[1] = '\0';
-        }
-        else
-        {
-          // that flag doesn't exist
-        }
+        __atomic_fetch_and(&channel->modes, ~bit, __ATOMIC_RELAXED);
         int replyBeginLen = 1 + strlen(info->nickname) + // account for colon
                             1 + strlen(info->username) + // account for bang
                             1 + strlen(info->host) + // account for @
@@ -1727,16 +1827,18 @@ void mode(char * firstName, char * secondName, char * adjMode, userInfo * info,
         snprintf(replyEnd, replyEndLen, "MODE #%s %s", channel->name, adjMode);
 
         userInfo * recieving_user;
-        pthread_mutex_lock(&channel->chanUserLock);
+        latency_lock(&channel->chanUserLock);
+        netio_batch_start();
         list_iterator_start(channel->userList);
         while (list_iterator_hasnext(channel->userList))
         {
           recieving_user = (userInfo *) list_iterator_next(channel->userList);
-          send(recieving_user->socket, replyBeginning, replyBeginLen, 0);
-          send(recieving_user->socket, replyEnd, replyEndLen, 0);
-          send(recieving_user->socket, "\r\n", 2, 0);
+          if (recieving_user->remote)
+            continue;
+          netio_line(recieving_user->socket, replyBeginning, replyBeginLen, replyEnd, replyEndLen);
         }
         list_iterator_stop(channel->userList);
+        netio_batch_flush();
         pthread_mutex_unlock(&channel->chanUserLock);
       }
     }
@@ -1745,8 +1847,16 @@ void mode(char * firstName, char * secondName, char * adjMode, userInfo * info,
     else
     {
       userInfo * updatingUser;
-      pthread_mutex_lock(&channel->chanUserLock);
-      if (!(updatingUser = (userInfo *) list_seek(channel->userList, &secondName)))
+      forChannel * userChannel = NULL;
+      latency_lock(&channel->chanUserLock);
+      if ((updatingUser = (userInfo *) list_seek(channel->userList, casemap_key(secondName))))
+      {
+        // get the list of channels and modes for that user
+        globalIndex = list_locate(updatingUser->channelModes, channel);
+        if (globalIndex >= 0)
+          userChannel = (forChannel *) list_get_at(updatingUser->channelModes, globalIndex);
+      }
+      if (userChannel == NULL)
       {
         pthread_mutex_unlock(&channel->chanUserLock);
         memcpy(reply->responseCode, ERR_USERNOTINCHANNEL, REPLYCODELEN);
@@ -1758,51 +1868,27 @@ void mode(char * firstName, char * secondName, char * adjMode, userInfo * info,
         return;
         // return an error, there's no such user
       }
-      forChannel * userChannel;
-      // get the list of channels and modes for that user
-      globalIndex = list_locate(updatingUser->channelModes, channel); 
-      userChannel = (forChannel *) list_get_at(updatingUser->channelModes, globalIndex);
-      pthread_mutex_unlock(&channel->chanUserLock);
-      if (adjMode[0] == '+')
+      unsigned int bit = mode_bit(MODEMEMBER, adjMode[1]);
+      if (!bit && (adjMode[0] == '+' || adjMode[0] == '-'))
       {
-        if (adjMode[1] != 'v' && adjMode[1] != 'o')
-        {
-          // return an error
-          // incorrect flags
-          memcpy(reply->responseCode, ERR_UNKNOWNMODE, REPLYCODELEN);
-          reply->numArgs = 2;
-          argLen = 1 + strlen(channel->name) + reply->numArgs;
-          snprintf(reply->args, argLen, "%c %s", adjMode[1], channel->name);
-          reply->args[argLen] = '\0';
-          send_response(info->socket, reply);
-          return;
-        }
-        // if the first spot has the flag
-        userChannel->modes[0] = adjMode[1];
-        // send confirmation
+        pthread_mutex_unlock(&channel->chanUserLock);
+        // return an error
+        // incorrect flags
+        memcpy(reply->responseCode, ERR_UNKNOWNMODE, REPLYCODELEN);
+        reply->numArgs = 2;
+        argLen = 1 + strlen(channel->name) + reply->numArgs;
+        snprintf(reply->args, argLen, "%c %s", adjMode[1], channel->name);
+        reply->args[argLen] = '\0';
+        send_response(info->socket, reply);
+        return;
       }
+      // changed under chanUserLock, while the member cannot leave, and
+      // two changes at once to one member must not undo each other
+      if (adjMode[0] == '+')
+        __atomic_fetch_or(&userChannel->modes, bit, __ATOMIC_RELAXED);
       else if (adjMode[0] == '-')
-      {
-        if (adjMode[1] != 'v' && adjMode[1] != 'o')
-        {
-          // return an error
-          // incorrect flags
-          memcpy(reply->responseCode, ERR_UNKNOWNMODE, REPLYCODELEN);
-          reply->numArgs = 2;
-          argLen = 1 + strlen(channel->name) + reply->numArgs;
-          snprintf(reply->args, argLen, "%c %s", adjMode[1], channel->name);
-          reply->args[argLen] = '\0';
-          send_response(info->socket, reply);
-          return;
-        }
-        // if the first spot has the flag
-        if (userChannel->modes[0] == adjMode[1])
-        {
-          // set flag to NULL
-          memset(&userChannel->modes[0], 0, 1);
-          // send confirmation
-        }
-      }
+        __atomic_fetch_and(&userChannel->modes, ~bit, __ATOMIC_RELAXED);
+      pthread_mutex_unlock(&channel->chanUserLock);
       int replyBeginLen = 1 + strlen(info->nickname) + // account for colon
                           1 + strlen(info->username) + // account for bang
                           1 + strlen(info->host) + // account for @
@@ -1818,19 +1904,21 @@ void mode(char * firstName, char * secondName, char * adjMode, userInfo * info,
       char replyEnd[replyEndLen];
       snprintf(replyEnd, replyEndLen, "MODE #%s %s %s", channel->name, adjMode, secondName);
       userInfo * recieving_user;
-      pthread_mutex_lock(&channel->chanUserLock);
+      latency_lock(&channel->chanUserLock);
+      netio_batch_start();
       list_iterator_start(channel->userList);
       while (list_iterator_hasnext(channel->userList))
       {
         recieving_user = (userInfo *) list_iterator_next(channel->userList);
-        send(recieving_user->socket, replyBeginning, replyBeginLen, 0);
-        send(recieving_user->socket, replyEnd, replyEndLen, 0);
-        send(recieving_user->socket, "\r\n", 2, 0);
+        if (recieving_user->remote)
+          continue;
+        netio_line(recieving_user->socket, replyBeginning, replyBeginLen, replyEnd, replyEndLen);
       }
       list_iterator_stop(channel->userList);
+      netio_batch_flush();
       pthread_mutex_unlock(&channel->chanUserLock);
       // globally update user list
-      pthread_mutex_lock(&lock);
+      latency_lock(&lock);
       int userIndex = list_locate(userList, updatingUser);
       list_delete_at(userList, userIndex);
       list_insert_at(userList, updatingUser, userIndex);
@@ -1845,7 +1933,8 @@ void mode(char * firstName, char * secondName, char * adjMode, userInfo * info,
   else
   {
     userInfo * user;
-    if (strcmp(firstName, info->nickname))
+    nameKey * firstKey = casemap_key(firstName);
+    if ((firstKey->hash != info->nickHash) || memcmp(firstKey->folded, info->foldedNick, MAXNICK))
     {
       // return unmatched users error
       reply->numArgs = 0;
@@ -1853,17 +1942,18 @@ void mode(char * firstName, char * secondName, char * adjMode, userInfo * info,
       send_response(info->socket, reply);
       return;
     }
-    pthread_mutex_lock(&lock);
-    if (!(user = (userInfo *) list_seek(userList, &firstName)))
+    latency_lock(&lock);
+    if (!(user = (userInfo *) list_seek(userList, casemap_key(firstName))))
     {
       pthread_mutex_unlock(&lock);
       return;
       // return an error, there's no such user
     }
     pthread_mutex_unlock(&lock);
+    unsigned int bit = mode_bit(MODEUSER, adjMode[1]);
     if (adjMode[0] == '+')
     {
-      if (adjMode[1] != 'o' && adjMode[1] != 'a')
+      if (!bit)
       {
         reply->numArgs = 0;
         memcpy(reply->responseCode, ERR_UMODEUNKNOWNFLAG, REPLYCODELEN);
@@ -1875,7 +1965,7 @@ void mode(char * firstName, char * secondName, char * adjMode, userInfo * info,
     }
     else if (adjMode[0] == '-')
     {
-      if (adjMode[1] != 'o' && adjMode[1] != 'a')
+      if (!bit)
       {
         // return an error
         // incorrect flags
@@ -1884,31 +1974,18 @@ void mode(char * firstName, char * secondName, char * adjMode, userInfo * info,
         send_response(info->socket, reply);
         return;
       }
-      // if the first spot has the flag
-      if (adjMode[1] == 'o')
+      // users can drop operator status, but away is set with AWAY
+      if (bit == MODE_OPER)
       {
-        if (user->modes[0] == adjMode[1])
-        {
-          // move the second flag to the first position, set the second flag to NULL
-          user->modes[0] = user->modes[1];
-          memset(&user->modes[1], 0, 1);
-          // send confirmation
-        }
-        else if (user->modes[1] == adjMode[1])
-        {
-          // if the second flag matches, set that flag to NULL
-          memset(&user->modes[1], 0, 1);
-          // send confirmation
-        }
+        user->modes &= ~bit;
         int replyBeginLen = strlen(info->nickname) +
                             strlen("MODE") +
                             strlen(info->nickname) +
                             strlen(adjMode) + 6; // account for colon and spaces
         char replyBeginning[replyBeginLen];
         snprintf(replyBeginning, replyBeginLen, ":%s MODE %s :%s", info->nickname, info->nickname, adjMode);
-        pthread_mutex_lock(&lock);
-        send(info->socket, replyBeginning, replyBeginLen, 0);
-        send(info->socket, "\r\n", 2, 0);
+        latency_lock(&lock);
+        netio_line(info->socket, replyBeginning, replyBeginLen, NULL, 0);
         pthread_mutex_unlock(&lock);
       }
     }
@@ -1927,17 +2004,8 @@ void oper(char * password, userInfo * info, list_t * userList, list_t * chanList
     send_response(info->socket, reply);
     return;
   }
-  pthread_mutex_lock(&lock);
-  if (info->modes[0] == 'a')
-  {
-    info->modes[1] = 'o';
-    info->modes[2] = '\0';
-  }
-  else
-  {
-    info->modes[0] = 'o';
-    info->modes[1] = '\0';
-  }
+  latency_lock(&lock);
+  info->modes |= MODE_OPER;
   int globalIndex = list_locate(userList, info);
   list_delete_at(userList, globalIndex);
   list_insert_at(userList, info, globalIndex);
@@ -1947,10 +2015,10 @@ void oper(char * password, userInfo * info, list_t * userList, list_t * chanList
   {
     forChannel * channelMode = (forChannel *) list_iterator_next(info->channelModes);
     char * chanName = channelMode->channelName;
-    pthread_mutex_lock(&chanLock);
-    channelData * channel = (channelData *) list_seek(chanList, &chanName);
+    latency_lock(&chanLock);
+    channelData * channel = (channelData *) list_seek(chanList, casemap_key(chanName));
     pthread_mutex_unlock(&chanLock);
-    pthread_mutex_lock(&channel->chanUserLock);
+    latency_lock(&channel->chanUserLock);
     int userIndex = list_locate(channel->userList, info);
     list_delete_at(channel->userList, userIndex);
     list_insert_at(channel->userList, info, userIndex);
@@ -1971,18 +2039,8 @@ void away(char * msg, userInfo * info, list_t * userList, list_t * chanList, rep
   int globalIndex;
   if (msg == NULL)
   {
-    if (info->modes[0] == 'a')
-    {
-      if (info->modes[1] == 'o')
-        memcpy(&info->modes[0], &info->modes[1], 2);
-      else
-        memset(&info->modes[0], 0, 1);
-    }
-    else if (info->modes[1] == 'a')
-    {
-      info->modes[1] = '\0';
-    }
-    pthread_mutex_lock(&lock);
+    info->modes &= ~MODE_AWAY;
+    latency_lock(&lock);
     memset(info->away, 0, MAXAWAY);
     globalIndex = list_locate(userList, info);
     list_delete_at(userList, globalIndex);
@@ -1994,19 +2052,13 @@ void away(char * msg, userInfo * info, list_t * userList, list_t * chanList, rep
     send_response(info->socket, reply);
     return;
   }
-  pthread_mutex_lock(&lock);
-  if (info->modes[0] == 'o')
-  {
-    info->modes[1] = 'a';
-    info->modes[2] = '\0';
-  }
-  else
-  {
-    info->modes[0] = 'a';
-    info->modes[1] = '\0';
-  }  
-  memcpy(info->away, msg, strlen(msg));
-  info->away[strlen(msg)-1] = '\0';
+  latency_lock(&lock);
+  info->modes |= MODE_AWAY;
+  int awayLen = strlen(msg);
+  if (awayLen > servData->limits.awayLen + 1)
+    awayLen = servData->limits.awayLen + 1;
+  memcpy(info->away, msg, awayLen);
+  info->away[awayLen-1] = '\0';
   globalIndex = list_locate(userList, info);
   list_delete_at(userList, globalIndex);
   list_insert_at(userList, info, globalIndex);
@@ -2016,10 +2068,10 @@ void away(char * msg, userInfo * info, list_t * userList, list_t * chanList, rep
   {
     forChannel * channelMode = (forChannel *) list_iterator_next(info->channelModes);
     char * chanName = channelMode->channelName;
-    pthread_mutex_lock(&chanLock);
-    channelData * channel = (channelData *) list_seek(chanList, &chanName);
+    latency_lock(&chanLock);
+    channelData * channel = (channelData *) list_seek(chanList, casemap_key(chanName));
     pthread_mutex_unlock(&chanLock);
-    pthread_mutex_lock(&channel->chanUserLock);
+    latency_lock(&channel->chanUserLock);
     int userIndex = list_locate(channel->userList, info);
     list_delete_at(channel->userList, userIndex);
     list_insert_at(channel->userList, info, userIndex);
@@ -2033,15 +2085,58 @@ void away(char * msg, userInfo * info, list_t * userList, list_t * chanList, rep
   send_response(info->socket, reply);
 }
 
+/* names_send:
+ * Sends the namesLen bytes of space separated names as
+ * RPL_NAMREPLY replies, as many names to a line as fit in
+ * MAXNAMES, and at least one line. Sends while no lock is
+ * held, as send_response takes the user list lock.
+ */
+void names_send(userInfo * info, replyPackage * reply, char * names, int namesLen)
+{
+  int start = 0;
+  do
+  {
+    int end = namesLen;
+    if (end - start > MAXNAMES)
+    {
+      end = start + MAXNAMES;
+      while (end > start && names[end] != ' ')
+        end--;
+    }
+    memset(reply->message, 0, 512);
+    memcpy(reply->message, names + start, end - start);
+    send_response(info->socket, reply);
+    start = end + 1;
+  } while (start < namesLen);
+}
+
+/* names_alloc:
+ * Returns a buffer for the names of numUsers users and sets size
+ * to its length. If there is not enough memory for them all,
+ * returns fallback, of MAXNAMES + 1 bytes, so that only the names
+ * which fit in one RPL_NAMREPLY are sent.
+ */
+char * names_alloc(int numUsers, char * fallback, int * size)
+{
+  *size = numUsers * (MAXNICK + 1) + 1;
+  char * names = (char *) malloc(*size);
+  if (names)
+    return names;
+  *size = MAXNAMES + 1;
+  return fallback;
+}
+
 void names(char * chanName, userInfo * info, list_t * userList, list_t * chanList, replyPackage * reply, serverInfo * servData)
 {
   int argLen;
   char userChanMode = '=';
+  char fallback[MAXNAMES + 1];
+  int namesSize;
 
   // if no channel name provided, give info on all channels
   if (chanName == NULL)
   {
-    pthread_mutex_lock(&chanLock);
+    latency_lock(&chanLock);
     list_iterator_start(chanList);
     while (list_iterator_hasnext(chanList))
     {
@@ -2054,39 +2149,39 @@ void names(char * chanName, userInfo * info, list_t * userList, list_t * chanLis
       snprintf(reply->args, argLen, "%c #%s", userChanMode, channel->name);
       reply->args[argLen] = '\0';
 
-      memset(reply->message, 0, 512);
       int totalReplyLen = 0;
-      pthread_mutex_lock(&channel->chanUserLock);
+      latency_lock(&channel->chanUserLock);
+      char * names = names_alloc(list_size(channel->userList), fallback, &namesSize);
       list_iterator_start(channel->userList);
       while (list_iterator_hasnext(channel->userList))
       {
         userInfo * user = (userInfo *) list_iterator_next(channel->userList);
-        char * channelName = (char *) malloc(strlen(channel->name)*sizeof(char));
-        memcpy(channelName, channel->name, strlen(channel->name));
-        forChannel * userChannel = (forChannel *) list_seek(user->channelModes, &channelName); 
+        if (totalReplyLen + MAXNICK + 1 > namesSize)
+          break;
+        forChannel * userChannel = (forChannel *) list_seek(user->channelModes, casemap_key(channel->name));
         if (userChannel)
         {
-          if (userChannel->modes[0] == 'o')
+          if (userChannel->modes & MODE_CHANOP)
           {
-            memcpy(reply->message+totalReplyLen, "@", 1);
+            memcpy(names+totalReplyLen, "@", 1);
             totalReplyLen++;
           }
-          else if (userChannel->modes[0] == 'v')
+          else if (userChannel->modes & MODE_VOICE)
           {
-            memcpy(reply->message+totalReplyLen, "+", 1);
+            memcpy(names+totalReplyLen, "+", 1);
             totalReplyLen++;
           }
         }
-        memcpy(reply->message+totalReplyLen, user->nickname, strlen(user->nickname));
+        memcpy(names+totalReplyLen, user->nickname, strlen(user->nickname));
         totalReplyLen += strlen(user->nickname) + 1; // account for space char
-        reply->message[totalReplyLen-1] = ' ';
+        names[totalReplyLen-1] = ' ';
       }
       list_iterator_stop(channel->userList);
       pthread_mutex_unlock(&channel->chanUserLock);
-      if (totalReplyLen > 0)
-        reply->message[totalReplyLen-1] = '\0';
-      send_response(info->socket, reply);
-      pthread_mutex_lock(&chanLock);
+      names_send(info, reply, names, totalReplyLen ? totalReplyLen-1 : 0);
+      if (names != fallback)
+        free(names);
+      latency_lock(&chanLock);
     }
     list_iterator_stop(chanList);
     pthread_mutex_unlock(&chanLock);
@@ -2098,27 +2193,28 @@ void names(char * chanName, userInfo * info, list_t * userList, list_t * chanLis
     argLen = strlen("*") + reply->numArgs + 1; // account for user chan mode
     userChanMode = '*';
     snprintf(reply->args, argLen, "%c %s", userChanMode, "*");
-    memset(reply->message, 0, 512);
     int totalReplyLen = 0;
-    pthread_mutex_lock(&lock);
+    latency_lock(&lock);
+    char * names = names_alloc(list_size(userList), fallback, &namesSize);
     list_iterator_start(userList);
     while(list_iterator_hasnext(userList))
     {
       userInfo * user = (userInfo *) list_iterator_next(userList);
+      if (totalReplyLen + MAXNICK + 1 > namesSize)
+        break;
       if (list_size(user->channelModes) == 0)
       {
-        memcpy(reply->message+totalReplyLen, user->nickname, strlen(user->nickname));
+        memcpy(names+totalReplyLen, user->nickname, strlen(user->nickname));
         totalReplyLen += strlen(user->nickname) + 1; // account for space char
-        reply->message[totalReplyLen-1] = ' ';
+        names[totalReplyLen-1] = ' ';
       }
     }
     list_iterator_stop(userList);
     pthread_mutex_unlock(&lock);
     if (totalReplyLen > 0)
-    {
-      reply->message[totalReplyLen-1] = '\0';
-      send_response(info->socket, reply);
-    }
+      names_send(info, reply, names, totalReplyLen-1);
+    if (names != fallback)
+      free(names);
   }   // if channel name provided, only give info on channel
   else
   {
@@ -2131,8 +2227,8 @@ void names(char * chanName, userInfo * info, list_t * userList, list_t * chanLis
     // figure out when to return ERR_NOSUCHCHANNEL
     channelData * channel;
     // if chanName is not part of chanList, create new channelData structure
-    pthread_mutex_lock(&chanLock);
-    channel = list_seek(chanList, &chanName);
+    latency_lock(&chanLock);
+    channel = list_seek(chanList, casemap_key(chanName));
     pthread_mutex_unlock(&chanLock);
 
     if (channel != NULL)
@@ -2144,32 +2240,35 @@ void names(char * chanName, userInfo * info, list_t * userList, list_t * chanLis
       snprintf(reply->args, argLen, "%c #%s", userChanMode, channel->name);
       reply->args[argLen] = '\0';
 
-      memset(reply->message, 0, 512);
       int totalReplyLen = 0;
-      pthread_mutex_lock(&channel->chanUserLock);
+      latency_lock(&channel->chanUserLock);
+      char * names = names_alloc(list_size(channel->userList), fallback, &namesSize);
       list_iterator_start(channel->userList);
       while (list_iterator_hasnext(channel->userList))
       {
         userInfo * user = (userInfo *) list_iterator_next(channel->userList);
-        forChannel * userChannel = (forChannel *) list_seek(user->channelModes, &chanName);
-        if (userChannel->modes[0] == 'o')
+        if (totalReplyLen + MAXNICK + 1 > namesSize)
+          break;
+        forChannel * userChannel = (forChannel *) list_seek(user->channelModes, casemap_key(chanName));
+        if (userChannel->modes & MODE_CHANOP)
         {
-          memcpy(reply->message+totalReplyLen, "@", 1);
+          memcpy(names+totalReplyLen, "@", 1);
           totalReplyLen++;
         }
-        else if (userChannel->modes[0] == 'v')
+        else if (userChannel->modes & MODE_VOICE)
         {
-          memcpy(reply->message+totalReplyLen, "+", 1);
+          memcpy(names+totalReplyLen, "+", 1);
           totalReplyLen++;
         }
-        memcpy(reply->message+totalReplyLen, user->nickname, strlen(user->nickname));
+        memcpy(names+totalReplyLen, user->nickname, strlen(user->nickname));
         totalReplyLen = totalReplyLen + strlen(user->nickname) + 1; // account for space char
-        reply->message[totalReplyLen-1] = ' ';
+        names[totalReplyLen-1] = ' ';
       }
       list_iterator_stop(channel->userList);
-      reply->message[totalReplyLen-1] = '\0';
       pthread_mutex_unlock(&channel->chanUserLock);
-      send_response(info->socket, reply);
+      names_send(info, reply, names, totalReplyLen ? totalReplyLen-1 : 0);
+      if (names != fallback)
+        free(names);
     }
   }
   // send RPL_ENDOFNAMES
@@ -2195,7 +2294,7 @@ void who(char * mask, userInfo * info, list_t * userList, list_t * chanList, rep
   // if there's no mask
   if (strlen(mask) == 1 && (mask[0] == '*' || mask[0] == '0'))
   {
-    pthread_mutex_lock(&lock);
+    latency_lock(&lock);
     list_t * send_to;
     send_to = (list_t *) malloc(sizeof(list_t));
     list_init(send_to);
@@ -2206,7 +2305,7 @@ void who(char * mask, userInfo * info, list_t * userList, list_t * chanList, rep
     channelData * channel;
     userInfo *about_user = malloc(sizeof(userInfo));
     char *from_user = info->nickname;
-    pthread_mutex_lock(&chanLock);
+    latency_lock(&chanLock);
     list_iterator_start(chanList);
     //for each channel
     while (list_iterator_hasnext(chanList))
@@ -2214,8 +2313,8 @@ void who(char * mask, userInfo * info, list_t * userList, list_t * chanList, rep
       channel = (channelData *) list_iterator_next(chanList);
       pthread_mutex_unlock(&chanLock);
       //if user is on channel
-      pthread_mutex_lock(&channel->chanUserLock);
-      if((list_seek(channel->userList, &from_user)))
+      latency_lock(&channel->chanUserLock);
+      if((list_seek(channel->userList, casemap_key(from_user))))
       {
         list_iterator_start(channel->userList);
         //look at the user list
@@ -2225,26 +2324,26 @@ void who(char * mask, userInfo * info, list_t * userList, list_t * chanList, rep
           pthread_mutex_unlock(&channel->chanUserLock);
           list_append(send_to, about_user);
           list_sort(send_to, -1);
-          pthread_mutex_lock(&channel->chanUserLock);
+          latency_lock(&channel->chanUserLock);
         }
         list_iterator_stop(channel->userList);
         pthread_mutex_unlock(&channel->chanUserLock);
       }
       else
         pthread_mutex_unlock(&channel->chanUserLock);
-      pthread_mutex_lock(&chanLock);
+      latency_lock(&chanLock);
     }
     list_iterator_stop(chanList);
     pthread_mutex_unlock(&chanLock);
 
-    pthread_mutex_lock(&lock);
+    latency_lock(&lock);
     list_iterator_start(userList);
     char * tempname;
     while (list_iterator_hasnext(userList))
     {
       about_user = (userInfo *) list_iterator_next(userList);
       tempname = about_user->nickname;
-      if (list_seek(send_to, &tempname))
+      if (list_seek(send_to, casemap_key(tempname)))
         continue;
 
       char ircOp = 'n';
@@ -2257,11 +2356,11 @@ void who(char * mask, userInfo * info, list_t * userList, list_t * chanList, rep
                         strlen(about_user->name) + 12; // account for spaces, :0, status, and voic_oper
 
       char replyEnd[replyEndLen];
-      if (about_user->modes[0] == 'a' || about_user->modes[1] == 'a')
+      if (about_user->modes & MODE_AWAY)
         status = 'G';
       else
         status = 'H';
-      if (about_user->modes[0] == 'o' || about_user->modes[1] == 'o')
+      if (about_user->modes & MODE_OPER)
         ircOp = '*';
       int totFlags = 4;
       char * flags = (char *) malloc(sizeof(char)*totFlags);
@@ -2285,7 +2384,7 @@ void who(char * mask, userInfo * info, list_t * userList, list_t * chanList, rep
       memcpy(reply->message, replyEnd, strlen(replyEnd));
       pthread_mutex_unlock(&lock);
       send_response(info->socket, reply);
-      pthread_mutex_lock(&lock);
+      latency_lock(&lock);
     }
     list_iterator_stop(userList);
     pthread_mutex_unlock(&lock);
@@ -2306,8 +2405,8 @@ void who(char * mask, userInfo * info, list_t * userList, list_t * chanList, rep
       mask[strlen(mask)-1] = '\0';
     }
     channelData * channel;
-    pthread_mutex_lock(&chanLock);  
-    if (!(channel = list_seek(chanList, &mask)))
+    latency_lock(&chanLock);  
+    if (!(channel = list_seek(chanList, casemap_key(mask))))
     {
       pthread_mutex_unlock(&chanLock);
       // return error, no such channel
@@ -2316,7 +2415,7 @@ void who(char * mask, userInfo * info, list_t * userList, list_t * chanList, rep
     else
       pthread_mutex_unlock(&chanLock);
     forChannel * forChan;
-    pthread_mutex_lock(&channel->chanUserLock);
+    latency_lock(&channel->chanUserLock);
     list_iterator_start(channel->userList);
     while (list_iterator_hasnext(channel->userList))
     {
@@ -2325,7 +2424,7 @@ void who(char * mask, userInfo * info, list_t * userList, list_t * chanList, rep
       char voic_oper = 'n';
       userInfo * about_user = (userInfo *) list_iterator_next(channel->userList);
       char * tempChanName = channel->name;
-      forChan = list_seek(about_user->channelModes, &tempChanName);
+      forChan = list_seek(about_user->channelModes, casemap_key(tempChanName));
       int replyEndLen = strlen(channel->name) +
                         strlen(about_user->username) +
                         strlen(about_user->host) +
@@ -2334,17 +2433,17 @@ void who(char * mask, userInfo * info, list_t * userList, list_t * chanList, rep
                         strlen(about_user->name) + 13; // account for #, :, spaces, status, and voic_op
       char replyEnd[replyEndLen];
 
-      if (about_user->modes[0] == 'a' || about_user->modes[1] == 'a')
+      if (about_user->modes & MODE_AWAY)
         status = 'G';
       else
         status = 'H';
-      if (about_user->modes[0] == 'o' || about_user->modes[1] == 'o')
+      if (about_user->modes & MODE_OPER)
       {
         ircOp = '*';
       }
-      if (forChan->modes[0] == 'o' || forChan->modes[1] == 'o')
+      if (forChan->modes & MODE_CHANOP)
         voic_oper = '@';
-      else if (forChan->modes[0] == 'v' || forChan->modes[1] == 'v')
+      else if (forChan->modes & MODE_VOICE)
         voic_oper = '+';
       int totFlags = 4;
       char * flags = (char *) malloc(sizeof(char)*totFlags);
@@ -2393,3 +2492,123 @@ void who(char * mask, userInfo * info, list_t * userList, list_t * chanList, rep
   }
 }
     
+
+
+/* history:
+ * Given a channel name, an optional number of lines, a userInfo struct,
+ * a global list of channels, a replyPackage struct, and a serverInfo struct,
+ * sends the user the most recent messages sent to the channel, oldest
+ * first, followed by a NOTICE marking the end of them.
+ * Client responses:
+ * ERR_NOSUCHCHANNEL if the channel does not exist.
+ * ERR_NOTONCHANNEL if the user is not on the channel.
+ */
+void history(char * chanName, char * count, userInfo * info, list_t * chanList, replyPackage * reply, serverInfo * servData)
+{
+  // remove # from channel
+  if (chanName[0] == '#')
+  {
+    memcpy(chanName, &chanName[1], strlen(chanName)-1);
+    chanName[strlen(chanName)-1] = '\0';
+  }
+  channelData * channel;
+  int argLen;
+
+  latency_lock(&chanLock);
+  if (!(channel = (channelData *) list_seek(chanList, casemap_key(chanName))))
+  {
+    pthread_mutex_unlock(&chanLock);
+    reply->numArgs = 1;
+    argLen = strlen(chanName) + reply->numArgs;
+    snprintf(reply->args, argLen, "%s", chanName);
+    reply->args[argLen] = '\0';
+    memcpy(reply->responseCode, ERR_NOSUCHCHANNEL, REPLYCODELEN);
+    send_response(info->socket, reply);
+    return;
+  }
+  pthread_mutex_unlock(&chanLock);
+  // only members may read what was said in a channel
+  if (list_locate(info->channelModes, channel) == -1)
+  {
+    reply->numArgs = 1;
+    argLen = strlen(channel->name) + reply->numArgs;
+    snprintf(reply->args, argLen, "%s", channel->name);
+    reply->args[argLen] = '\0';
+    memcpy(reply->responseCode, ERR_NOTONCHANNEL, REPLYCODELEN);
+    send_response(info->socket, reply);
+    return;
+  }
+
+  epoch_enter();
+  history_replay(channel, info->socket, count ? atoi(count) : 0);
+  epoch_exit();
+
+  char endReply[MAXHOST + MAXNICK + MAXCHANNAME + 40];
+  int endLen = snprintf(endReply, sizeof(endReply), ":%s NOTICE %s :End of #%s history",
+                        servData->serverHost, info->nickname, channel->name);
+  netio_line(info->socket, endReply, endLen, NULL, 0);
+}
+
+
+/* stats:
+ * Given a query letter, a userInfo struct, a replyPackage struct,
+ * and a serverInfo struct, sends the user the statistics asked for.
+ * Operators can ask for "l", the latency percentiles of every
+ * command used so far, and "z", the clients using the most memory.
+ * Client responses:
+ * RPL_ENDOFSTATS at the end of every report.
+ * ERR_NOPRIVILEGES
+ */
+void stats(char * query, userInfo * info, replyPackage * reply, serverInfo * servData)
+{
+  int argLen;
+  int isLatency = query && (query[0] == 'l' || query[0] == 'L');
+  int isMemory = query && (query[0] == 'z' || query[0] == 'Z');
+  // latency shows the server's locks and memory use names other
+  // users, so only operators see either
+  if ((isLatency || isMemory) && !(info->modes & MODE_OPER))
+  {
+    memcpy(reply->responseCode, ERR_NOPRIVILEGES, REPLYCODELEN);
+    reply->numArgs = 0;
+    send_response(info->socket, reply);
+    return;
+  }
+  if (isLatency)
+    latency_report(info->socket, servData->serverHost, reply->nickname);
+  else if (isMemory)
+    budget_report(info->socket, servData->serverHost, reply->nickname);
+
+  memcpy(reply->responseCode, RPL_ENDOFSTATS, REPLYCODELEN);
+  reply->numArgs = 1;
+  if (query == NULL)
+    query = "*";
+  argLen = strlen(query) + reply->numArgs;
+  if (argLen > MAXARGS - 1)
+    argLen = MAXARGS - 1;
+  snprintf(reply->args, argLen, "%s", query);
+  reply->args[argLen] = '\0';
+  send_response(info->socket, reply);
+}
+
+
+/* drain:
+ * Given a userInfo struct, a replyPackage struct and a serverInfo
+ * struct, starts draining the server if the user is an operator.
+ * Client responses:
+ * ERR_NOPRIVILEGES
+ */
+void drain(userInfo * info, replyPackage * reply, serverInfo * servData)
+{
+  if (!(info->modes & MODE_OPER))
+  {
+    memcpy(reply->responseCode, ERR_NOPRIVILEGES, REPLYCODELEN);
+    reply->numArgs = 0;
+    send_response(info->socket, reply);
+    return;
+  }
+  char notice[MAXHOST + MAXNICK + 64];
+  int noticeLen = snprintf(notice, sizeof(notice), ":%s NOTICE %s :Draining, no new connections are accepted",
+                           servData->serverHost, info->nickname);
+  netio_line(info->socket, notice, noticeLen, NULL, 0);
+  drain_start();
+}
@@ -11,7 +11,7 @@
 #include "simclist.h"
 #include "structures.h"
 
-#define COMMANDNUM 19
+#define COMMANDNUM 24
 
 #define NICK 	0
 #define USER 	1
@@ -32,6 +32,11 @@
 #define AWAY 16
 #define NAMES 17
 #define WHO 18
+#define SERVER 19
+#define PASS 20
+#define HISTORY 21
+#define STATS 22
+#define DRAIN 23
 
 extern int num_pthreads;
 
@@ -48,7 +53,9 @@ void notice(char *to_nick, char *msg, userInfo *info, list_t *userList, list_t *
 void lusers(userInfo *info, list_t *userList, replyPackage *reply, serverInfo *servData);
 void whois(char * nickname, userInfo * info, list_t * userList, replyPackage * reply, serverInfo * servData);
 void ping(userInfo * info, serverInfo * servData);
+void notify_peers(userInfo * info, list_t * chanList, char * begin, int beginLen, char * end, int endLen);
 void quit(char * msg, userInfo * info, list_t * userList, list_t * chanList);
+void disconnect(userInfo * info, char * msg, list_t * userList, list_t * chanList);
 void join(char * chanName, userInfo * info, list_t * userList, list_t * chanList, replyPackage * reply, serverInfo * servData);
 void part(char * chanName, char * msg, userInfo * info, list_t * userList, list_t * chanList, replyPackage * reply, serverInfo * servData);
 void topic(char * chanName, char * msg, userInfo * info, list_t * chanList, replyPackage * reply, serverInfo * servData);
@@ -56,7 +63,12 @@ void list(char * chanName, userInfo * info, list_t * chanList, replyPackage * re
 void mode(char * firstName, char * secondName, char * adjMode, userInfo * info, list_t * userList, list_t * chanList, replyPackage * reply, serverInfo * servData);
 void oper(char * password, userInfo * info, list_t * userList, list_t * chanList, replyPackage * reply, serverInfo * servData);
 void away(char * msg, userInfo * info, list_t * userList, list_t * chanList, replyPackage * reply, serverInfo * servData);
+void names_send(userInfo * info, replyPackage * reply, char * names, int namesLen);
+char * names_alloc(int numUsers, char * fallback, int * size);
 void names(char * chanName, userInfo * info, list_t * userList, list_t * chanList, replyPackage * reply, serverInfo * servData);
 void who(char * mask, userInfo * info, list_t * userList, list_t * chanList, replyPackage * reply, serverInfo * servData);
+void history(char * chanName, char * count, userInfo * info, list_t * chanList, replyPackage * reply, serverInfo * servData);
+void stats(char * query, userInfo * info, replyPackage * reply, serverInfo * servData);
+void drain(userInfo * info, replyPackage * reply, serverInfo * servData);
 
 #endif /* COMMAND_H_ */
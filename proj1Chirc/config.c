@@ -0,0 +1,221 @@
+/*
+ *
+ *  CMSC 23300 / 33300 - Networks and Distributed Systems
+ *
+ *  Configuration Functions
+ *
+ *  Every setting chirc takes can be given in a configuration file
+ *  loaded with -c, one "key = value" per line, with lines starting
+ *  with '#' ignored. Command line flags are applied after the file,
+ *  so they override it; -s key=value sets any key from the command
+ *  line. For example:
+ *
+ *    port = 6667
+ *    password = foobar
+ *    workers = 4
+ *    flood = rate=5,burst=20
+ *    keepalive = ping=120,timeout=60
+ *    admit = backlog=1024,perip=50
+ *    memory = client=512,total=1048576
+ *    drain = rate=50,wait=10,flush=2000
+ *    unix = path=/run/chirc.sock,host=bots.local,oper=1000
+ *    history = depth=64,bytes=32768
+ *    latency = slow=100,log=/var/log/chirc-slow.log
+ *    output = hold=1,size=4096,flush=0,queue=1,zerocopy=1,zcmembers=1000
+ *    input = start=512,idle=30
+ *    input_buffer = 8192
+ *    max_targets = 100
+ *    nicklen = 9
+ *    chanlen = 20
+ *
+ *  Name lengths can only be lowered below the sizes in structures.h,
+ *  since users and channels are copied into their lists by size.
+ *
+ */
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "admit.h"
+#include "budget.h"
+#include "drain.h"
+#include "config.h"
+#include "flood.h"
+#include "history.h"
+#include "input.h"
+#include "keepalive.h"
+#include "latency.h"
+#include "local.h"
+#include "netio.h"
+#include "parser.h"
+#include "shard.h"
+
+
+/* config_default:
+ * Fills in the default settings.
+ */
+void config_default(chircConfig * config)
+{
+  memset(config, 0, sizeof(chircConfig));
+  config->port = "6667";
+  config->backend = NETIO_URING;
+  config->workers = 0;
+  config->ringEntries = NETIORING;
+  flood_default(&config->flood);
+  keepalive_default(&config->keepalive);
+  config->limits.inputBuffer = INPUTBUFLEN;
+  config->limits.maxCommands = PARSERMAXCOMMANDS;
+  config->limits.maxParams = PARSERMAXARGS;
+  config->limits.maxTargets = SHARDTARGETS;
+  config->limits.lineLen = PARSERMAXLINE;
+  config->limits.nickLen = MAXNICK - 1;
+  config->limits.chanLen = CHANLEN;
+  config->limits.topicLen = MAXTOPIC - 1;
+  config->limits.awayLen = MAXAWAY - 2;
+}
+
+
+/* set_number:
+ * Stores value in number if it is a whole number between
+ * min and max. Returns -1 if it is not.
+ */
+static int set_number(int * number, char * value, int min, int max)
+{
+  char * end;
+  long n = strtol(value, &end, 10);
+  if (end == value || *end || n < min || n > max)
+    return -1;
+  *number = (int) n;
+  return 1;
+}
+
+
+/* config_set:
+ * Given the name of a setting and its value, updates the
+ * configuration. Returns -1 if there is no such setting
+ * or the value is invalid.
+ */
+int config_set(chircConfig * config, char * key, char * value)
+{
+  char spec[CONFIGLINELEN];
+  strncpy(spec, value, CONFIGLINELEN - 1);
+  spec[CONFIGLINELEN - 1] = '\0';
+
+  if (!strcmp(key, "port"))
+    config->port = strdup(value);
+  else if (!strcmp(key, "password"))
+    config->passwd = strdup(value);
+  else if (!strcmp(key, "name"))
+    config->serverName = strdup(value);
+  else if (!strcmp(key, "link"))
+  {
+    // server to link to, as host:port
+    if (config->numLinks == MAXLINKS || !strchr(value, ':'))
+      return -1;
+    config->links[config->numLinks++] = strdup(value);
+  }
+  else if (!strcmp(key, "trace"))
+    config->trace = strdup(value);
+  else if (!strcmp(key, "backend"))
+  {
+    int backend = netio_backend(value);
+    if (backend == -1)
+      return -1;
+    config->backend = backend;
+  }
+  else if (!strcmp(key, "workers"))
+    return set_number(&config->workers, value, 0, MAXSHARDS);
+  else if (!strcmp(key, "uring_entries"))
+    return set_number(&config->ringEntries, value, 1, NETIORING);
+  else if (!strcmp(key, "output"))
+    return netio_configure(spec);
+  else if (!strcmp(key, "flood"))
+    return flood_configure(&config->flood, spec);
+  else if (!strcmp(key, "keepalive"))
+    return keepalive_configure(&config->keepalive, spec);
+  else if (!strcmp(key, "admit"))
+    return admit_configure(spec);
+  else if (!strcmp(key, "drain"))
+    return drain_configure(spec);
+  else if (!strcmp(key, "memory"))
+    return budget_configure(spec);
+  else if (!strcmp(key, "unix"))
+    return local_configure(spec);
+  else if (!strcmp(key, "history"))
+    return history_configure(spec);
+  else if (!strcmp(key, "latency"))
+    return latency_configure(spec);
+  else if (!strcmp(key, "input"))
+    return input_configure(spec);
+  else if (!strcmp(key, "input_buffer"))
+    return set_number(&config->limits.inputBuffer, value, PARSERMAXLINE + 2, MAXINPUTBUFLEN);
+  else if (!strcmp(key, "max_commands"))
+    return set_number(&config->limits.maxCommands, value, 1, MAXINPUTBUFLEN / 2);
+  else if (!strcmp(key, "max_params"))
+    return set_number(&config->limits.maxParams, value, 2, MAXARGS);
+  else if (!strcmp(key, "max_targets"))
+    return set_number(&config->limits.maxTargets, value, 1, SHARDMAXTARGETS);
+  else if (!strcmp(key, "line_length"))
+    return set_number(&config->limits.lineLen, value, 16, PARSERMAXLINE);
+  else if (!strcmp(key, "nicklen"))
+    return set_number(&config->limits.nickLen, value, 1, MAXNICK - 1);
+  else if (!strcmp(key, "chanlen"))
+    return set_number(&config->limits.chanLen, value, 1, MAXCHANNAME - 1);
+  else if (!strcmp(key, "topiclen"))
+    return set_number(&config->limits.topicLen, value, 1, MAXTOPIC - 1);
+  else if (!strcmp(key, "awaylen"))
+    return set_number(&config->limits.awayLen, value, 1, MAXAWAY - 2);
+  else
+    return -1;
+  return 1;
+}
+
+
+/* trim:
+ * Returns str without its leading and trailing whitespace.
+ */
+static char * trim(char * str)
+{
+  while (isspace((unsigned char) *str))
+    str++;
+  int len = strlen(str);
+  while (len && isspace((unsigned char) str[len - 1]))
+    str[--len] = '\0';
+  return str;
+}
+
+
+/* config_load:
+ * Applies every setting in the configuration file at path.
+ * Returns 0 on success, -1 if the file cannot be read, or
+ * the number of the first invalid line.
+ */
+int config_load(chircConfig * config, char * path)
+{
+  FILE * file = fopen(path, "r");
+  if (file == NULL)
+    return -1;
+  char line[CONFIGLINELEN];
+  int lineNum = 0;
+  while (fgets(line, CONFIGLINELEN, file))
+  {
+    lineNum++;
+    char * setting = trim(line);
+    if (!setting[0] || setting[0] == '#')
+      continue;
+    char * equals = strchr(setting, '=');
+    if (equals == NULL)
+    {
+      fclose(file);
+      return lineNum;
+    }
+    *equals = '\0';
+    if (config_set(config, trim(setting), trim(equals + 1)) == -1)
+    {
+      fclose(file);
+      return lineNum;
+    }
+  }
+  fclose(file);
+  return 0;
+}
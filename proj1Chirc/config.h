@@ -0,0 +1,45 @@
+/*
+ *
+ *  CMSC 23300 / 33300 - Networks and Distributed Systems
+ *
+ *  Runtime configuration
+ *
+ */
+
+#ifndef CONFIG_H_
+#define CONFIG_H_
+
+#include "server.h"
+#include "structures.h"
+
+#define CONFIGLINELEN 1024
+#define INPUTBUFLEN 6000
+// input buffers live on the heap and grow to input_buffer
+// bytes at most, which this keeps within reason
+#define MAXINPUTBUFLEN (1 << 16)
+// characters in a channel name, not counting its '#'
+#define CHANLEN 9
+
+struct chircConfig
+{
+  char * port;
+  char * passwd;
+  char * serverName;
+  char * links[MAXLINKS];
+  int numLinks;
+  char * trace;
+  int backend;
+  int workers;
+  int ringEntries;
+  floodConfig flood;
+  keepaliveConfig keepalive;
+  limitConfig limits;
+};
+
+typedef struct chircConfig chircConfig;
+
+void config_default(chircConfig * config);
+int config_set(chircConfig * config, char * key, char * value);
+int config_load(chircConfig * config, char * path);
+
+#endif /* CONFIG_H_ */
@@ -0,0 +1,242 @@
+/*
+ *
+ *  CMSC 23300 / 33300 - Networks and Distributed Systems
+ *
+ *  Drain Functions
+ *
+ *  Before a server is taken down for maintenance it can be drained,
+ *  so its clients do not all reconnect elsewhere at the same moment.
+ *  Sending chirc SIGUSR1, or an operator sending DRAIN, closes the
+ *  listening sockets, so new connections are refused at once, and
+ *  then disconnects the clients already connected a few at a time,
+ *  at the configured rate, oldest first. Each is sent an ERROR line
+ *  saying why, and its thread waits for the kernel to send
+ *  everything still queued for it before letting go of the
+ *  connection. chirc exits once the last client has gone.
+ *
+ *  Like keepalives, the timer thread only shuts down the reading
+ *  side of a socket; the client's own thread calls drain_disconnect
+ *  to remove it as if it had quit.
+ *
+ */
+// for pipe2
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <linux/sockios.h>
+#include "command.h"
+#include "drain.h"
+#include "timer.h"
+
+
+static int rate = DRAINRATE;
+static int waitSecs = DRAINWAIT;
+static int flushMs = DRAINFLUSH;
+// written to when a drain is asked for, read by the accepting thread
+static int wakeFds[2] = { -1, -1 };
+static int draining = 0;
+// every client connection, oldest first
+static drainEntry clients = { &clients, &clients, -1, 0, 0 };
+static int numClients = 0;
+// clients which may be disconnected so far, in the current tick
+static double credit = 0;
+static timerEntry drainTimer;
+static pthread_mutex_t drainLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t drainDone = PTHREAD_COND_INITIALIZER;
+
+
+/* drain_configure:
+ * Given a comma separated list of settings, such as
+ * "rate=50,wait=10,flush=2000", updates the drain settings. rate
+ * is in clients per second, 0 meaning all at once; wait is the
+ * seconds to wait before the first client is disconnected, and
+ * flush the most milliseconds to wait for a client's output to be
+ * sent. Returns -1 if the list is invalid.
+ */
+int drain_configure(char * spec)
+{
+  char * savePtr;
+  char * setting = strtok_r(spec, ",", &savePtr);
+  while (setting)
+  {
+    char * equals = strchr(setting, '=');
+    if (equals == NULL)
+      return -1;
+    *equals = '\0';
+    char * end;
+    long value = strtol(equals + 1, &end, 10);
+    if (end == equals + 1 || *end || value < 0 || value > INT_MAX)
+      return -1;
+    if (!strcmp(setting, "rate"))
+      rate = value;
+    else if (!strcmp(setting, "wait"))
+      waitSecs = value;
+    else if (!strcmp(setting, "flush"))
+      flushMs = value;
+    else
+      return -1;
+    setting = strtok_r(NULL, ",", &savePtr);
+  }
+  return 1;
+}
+
+
+/* drain_tick:
+ * Timer callback. Disconnects the clients the rate allows
+ * since the last tick.
+ */
+static long drain_tick(void * arg)
+{
+  // timer callbacks must not block; try again next tick
+  if (pthread_mutex_trylock(&drainLock))
+    return TIMERTICK;
+  credit += rate ? rate * TIMERTICK / 1000.0 : numClients;
+  while (credit >= 1 && clients.next != &clients)
+  {
+    drainEntry * entry = clients.next;
+    entry->prev->next = entry->next;
+    entry->next->prev = entry->prev;
+    entry->next = entry->prev = NULL;
+    __atomic_store_n(&entry->drained, 1, __ATOMIC_RELEASE);
+    // wakes the client's thread out of recv()
+    shutdown(entry->socket, SHUT_RD);
+    credit -= 1;
+  }
+  // credit is not saved up while there is no one to disconnect
+  if (clients.next == &clients && credit > 1)
+    credit = 1;
+  pthread_mutex_unlock(&drainLock);
+  return TIMERTICK;
+}
+
+
+/* on_signal:
+ * Signal handler asking for a drain.
+ */
+static void on_signal(int sig)
+{
+  drain_start();
+}
+
+
+/* drain_init:
+ * Sets up SIGUSR1 to start a drain. Returns a descriptor which
+ * becomes readable once a drain is asked for, or -1 on failure.
+ */
+int drain_init(void)
+{
+  if (pipe2(wakeFds, O_NONBLOCK | O_CLOEXEC) == -1)
+    return -1;
+  timer_setup(&drainTimer, drain_tick, NULL);
+  struct sigaction action;
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = on_signal;
+  sigemptyset(&action.sa_mask);
+  action.sa_flags = SA_RESTART;
+  if (sigaction(SIGUSR1, &action, NULL) == -1)
+    return -1;
+  return wakeFds[0];
+}
+
+
+/* drain_start:
+ * Asks for a drain. Safe to call from a signal handler.
+ */
+void drain_start(void)
+{
+  char wake = 0;
+  if (write(wakeFds[1], &wake, 1) == -1)
+    return;
+}
+
+
+/* drain_run:
+ * Called by the accepting thread once a drain is asked for and
+ * it has stopped accepting. Disconnects every client at the drain
+ * rate, and returns the number of clients drained once they have
+ * all gone.
+ */
+int drain_run(void)
+{
+  pthread_mutex_lock(&drainLock);
+  draining = 1;
+  int drained = numClients;
+  pthread_mutex_unlock(&drainLock);
+  timer_add(&drainTimer, waitSecs ? waitSecs * 1000L : TIMERTICK);
+  pthread_mutex_lock(&drainLock);
+  while (numClients)
+    pthread_cond_wait(&drainDone, &drainLock);
+  pthread_mutex_unlock(&drainLock);
+  return drained;
+}
+
+
+/* drain_open:
+ * Adds a new client connection to those a drain disconnects.
+ */
+void drain_open(drainEntry * entry, int socket)
+{
+  entry->socket = socket;
+  entry->drained = 0;
+  entry->open = 1;
+  pthread_mutex_lock(&drainLock);
+  entry->next = &clients;
+  entry->prev = clients.prev;
+  clients.prev->next = entry;
+  clients.prev = entry;
+  numClients++;
+  pthread_mutex_unlock(&drainLock);
+}
+
+
+/* drain_close:
+ * Removes a connection from those a drain disconnects, once it
+ * has closed or become a server link. Does nothing if it was
+ * already removed.
+ */
+void drain_close(drainEntry * entry)
+{
+  pthread_mutex_lock(&drainLock);
+  if (entry->open)
+  {
+    if (entry->next)
+    {
+      entry->prev->next = entry->next;
+      entry->next->prev = entry->prev;
+      entry->next = entry->prev = NULL;
+    }
+    entry->open = 0;
+    if (--numClients == 0 && draining)
+      pthread_cond_signal(&drainDone);
+  }
+  pthread_mutex_unlock(&drainLock);
+}
+
+
+/* drain_disconnect:
+ * Closes the connection of a drained client, once the kernel has
+ * sent everything queued for it or the flush time is up. Must be
+ * called from the client's own thread.
+ */
+void drain_disconnect(userInfo * info, list_t * userList, list_t * chanList)
+{
+  char msg[] = "Server going down for maintenance, please reconnect";
+  disconnect(info, msg, userList, chanList);
+  int queued;
+  for (int waited = 0; waited < flushMs; waited += 10)
+  {
+    if (ioctl(info->socket, SIOCOUTQ, &queued) == -1 || queued == 0)
+      break;
+    poll(NULL, 0, 10);
+  }
+}
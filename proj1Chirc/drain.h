@@ -0,0 +1,42 @@
+/*
+ *
+ *  CMSC 23300 / 33300 - Networks and Distributed Systems
+ *
+ *  Graceful drain before maintenance
+ *
+ */
+
+#ifndef DRAIN_H_
+#define DRAIN_H_
+
+#include "simclist.h"
+#include "structures.h"
+
+// clients disconnected per second
+#define DRAINRATE 50
+// seconds to wait before the first disconnect
+#define DRAINWAIT 0
+// milliseconds to wait for a client's output to leave
+#define DRAINFLUSH 2000
+
+struct drainEntry
+{
+  struct drainEntry * next;
+  struct drainEntry * prev;
+  int socket;
+  // set once the client has been told to leave
+  int drained;
+  int open;
+};
+
+typedef struct drainEntry drainEntry;
+
+int drain_configure(char * spec);
+int drain_init(void);
+void drain_start(void);
+int drain_run(void);
+void drain_open(drainEntry * entry, int socket);
+void drain_close(drainEntry * entry);
+void drain_disconnect(userInfo * info, list_t * userList, list_t * chanList);
+
+#endif /* DRAIN_H_ */
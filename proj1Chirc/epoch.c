@@ -0,0 +1,179 @@
+/*
+ *
+ *  CMSC 23300 / 33300 - Networks and Distributed Systems
+ *
+ *  Epoch-based Reclamation Functions
+ *
+ *  Lets threads read shared data published through a pointer
+ *  without taking a lock. Readers bracket their accesses with
+ *  epoch_enter and epoch_exit. A writer which replaces the data
+ *  hands the old copy to epoch_retire, which frees it only once
+ *  the global epoch has advanced twice. The epoch only advances
+ *  when every thread inside a read section has seen the current
+ *  epoch, so no reader can still hold the old copy by then.
+ *
+ *  Every thread which reads gets a reader record the first time.
+ *  Records are never freed; a record is given back when its thread
+ *  exits and reused by the next new thread.
+ *
+ */
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include "epoch.h"
+
+
+struct epochReader
+{
+  struct epochReader * next;
+  int inUse;
+  int active;
+  unsigned long epoch;
+};
+
+typedef struct epochReader epochReader;
+
+struct retiredPtr
+{
+  struct retiredPtr * next;
+  void * ptr;
+  unsigned long epoch;
+};
+
+typedef struct retiredPtr retiredPtr;
+
+static unsigned long globalEpoch = 0;
+static epochReader * readers = NULL;
+static pthread_key_t readerKey;
+static __thread epochReader * self = NULL;
+// writers only: pointers waiting to be freed
+static pthread_mutex_t retireLock;
+static retiredPtr * retired = NULL;
+
+
+/* reader_release:
+ * Gives a thread's reader record back when the thread exits.
+ */
+static void reader_release(void * arg)
+{
+  epochReader * reader = (epochReader *) arg;
+  __atomic_store_n(&reader->active, 0, __ATOMIC_RELEASE);
+  __atomic_store_n(&reader->inUse, 0, __ATOMIC_RELEASE);
+}
+
+
+/* reader_get:
+ * Returns the calling thread's reader record, taking a free
+ * one or adding a new one the first time.
+ */
+static epochReader * reader_get(void)
+{
+  if (self)
+    return self;
+  epochReader * reader;
+  for (reader = __atomic_load_n(&readers, __ATOMIC_ACQUIRE); reader; reader = reader->next)
+  {
+    int unused = 0;
+    if (__atomic_compare_exchange_n(&reader->inUse, &unused, 1, 0,
+                                    __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+      break;
+  }
+  if (reader == NULL)
+  {
+    reader = (epochReader *) malloc(sizeof(epochReader));
+    memset(reader, 0, sizeof(epochReader));
+    reader->inUse = 1;
+    reader->next = __atomic_load_n(&readers, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&readers, &reader->next, reader, 0,
+                                        __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+      ;
+  }
+  pthread_setspecific(readerKey, reader);
+  self = reader;
+  return reader;
+}
+
+
+/* epoch_init:
+ * Sets up epoch tracking. Must be called before any
+ * threads are started.
+ */
+void epoch_init(void)
+{
+  pthread_key_create(&readerKey, reader_release);
+  pthread_mutex_init(&retireLock, NULL);
+}
+
+
+/* epoch_enter:
+ * Starts a read section. Pointers loaded inside it stay
+ * valid until the matching epoch_exit.
+ */
+void epoch_enter(void)
+{
+  epochReader * reader = reader_get();
+  __atomic_store_n(&reader->active, 1, __ATOMIC_SEQ_CST);
+  __atomic_store_n(&reader->epoch, __atomic_load_n(&globalEpoch, __ATOMIC_SEQ_CST), __ATOMIC_SEQ_CST);
+}
+
+
+/* epoch_exit:
+ * Ends a read section.
+ */
+void epoch_exit(void)
+{
+  __atomic_store_n(&self->active, 0, __ATOMIC_RELEASE);
+}
+
+
+/* epoch_advance:
+ * Moves the global epoch on if every reader inside a read
+ * section has seen it. Caller must hold retireLock.
+ */
+static void epoch_advance(void)
+{
+  unsigned long epoch = __atomic_load_n(&globalEpoch, __ATOMIC_SEQ_CST);
+  epochReader * reader;
+  for (reader = __atomic_load_n(&readers, __ATOMIC_ACQUIRE); reader; reader = reader->next)
+  {
+    if (__atomic_load_n(&reader->active, __ATOMIC_SEQ_CST) &&
+        __atomic_load_n(&reader->epoch, __ATOMIC_SEQ_CST) != epoch)
+      return;
+  }
+  __atomic_store_n(&globalEpoch, epoch + 1, __ATOMIC_SEQ_CST);
+}
+
+
+/* epoch_retire:
+ * Frees ptr, which must already be unreachable for new
+ * readers, once no reader can still be using it. Pointers
+ * retired earlier are freed here as they become safe.
+ */
+void epoch_retire(void * ptr)
+{
+  pthread_mutex_lock(&retireLock);
+  if (ptr)
+  {
+    retiredPtr * entry = (retiredPtr *) malloc(sizeof(retiredPtr));
+    entry->ptr = ptr;
+    entry->epoch = __atomic_load_n(&globalEpoch, __ATOMIC_SEQ_CST);
+    entry->next = retired;
+    retired = entry;
+  }
+  epoch_advance();
+  unsigned long epoch = __atomic_load_n(&globalEpoch, __ATOMIC_SEQ_CST);
+  retiredPtr ** prev = &retired;
+  while (*prev)
+  {
+    retiredPtr * entry = *prev;
+    if (entry->epoch + 2 <= epoch)
+    {
+      *prev = entry->next;
+      free(entry->ptr);
+      free(entry);
+    }
+    else
+      prev = &entry->next;
+  }
+  pthread_mutex_unlock(&retireLock);
+}
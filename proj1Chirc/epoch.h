@@ -0,0 +1,17 @@
+/*
+ *
+ *  CMSC 23300 / 33300 - Networks and Distributed Systems
+ *
+ *  Epoch-based reclamation
+ *
+ */
+
+#ifndef EPOCH_H_
+#define EPOCH_H_
+
+void epoch_init(void);
+void epoch_enter(void);
+void epoch_exit(void);
+void epoch_retire(void * ptr);
+
+#endif /* EPOCH_H_ */
@@ -0,0 +1,212 @@
+/*
+ *
+ *  CMSC 23300 / 33300 - Networks and Distributed Systems
+ *
+ *  Flood Control Functions
+ *
+ *  Every client connection has a token bucket which refills at a
+ *  fixed rate up to a burst size. Each command costs a number of
+ *  tokens depending on its class, for each target it names, so
+ *  a PRIVMSG to ten channels costs as much as ten PRIVMSGs. A
+ *  command the client cannot afford is held back until the bucket
+ *  has refilled enough, so the rest of the client's input waits in
+ *  its socket buffer. A client is disconnected only once the
+ *  commands it has sent and which are still waiting to run would
+ *  take longer than the abuse limit at the rate. That backlog keeps
+ *  growing while a client sends above the rate, but stays as it is
+ *  for one sending at the rate, however long it keeps sending and
+ *  whatever its commands cost.
+ *
+ */
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include <sys/types.h>
+#include "command.h"
+#include "flood.h"
+#include "netio.h"
+#include "structures.h"
+
+
+/* flood_default:
+ * Fills in the default flood control settings.
+ */
+void flood_default(floodConfig * config)
+{
+  memset(config, 0, sizeof(floodConfig));
+  config->rate = FLOODRATE;
+  config->burst = FLOODBURST;
+  config->cost[FLOOD_FREE] = 0;
+  config->cost[FLOOD_MSG] = FLOODCOSTMSG;
+  config->cost[FLOOD_CHAN] = FLOODCOSTCHAN;
+  config->cost[FLOOD_QUERY] = FLOODCOSTQUERY;
+  config->abuse = FLOODABUSE;
+}
+
+
+/* flood_configure:
+ * Given a comma separated list of settings, such as
+ * "rate=5,burst=20,msg=1,chan=2,query=5,abuse=30",
+ * updates the flood control settings. A rate of 0 turns
+ * flood control off. Returns -1 if the list is invalid.
+ */
+int flood_configure(floodConfig * config, char * spec)
+{
+  char * savePtr;
+  char * setting = strtok_r(spec, ",", &savePtr);
+  while (setting)
+  {
+    char * equals = strchr(setting, '=');
+    if (equals == NULL)
+      return -1;
+    *equals = '\0';
+    char * end;
+    double value = strtod(equals + 1, &end);
+    // written so that a NaN is refused as well
+    if (end == equals + 1 || *end || !(value >= 0))
+      return -1;
+    if (!strcmp(setting, "rate"))
+      config->rate = value;
+    else if (!strcmp(setting, "burst"))
+      config->burst = value;
+    else if (!strcmp(setting, "msg"))
+      config->cost[FLOOD_MSG] = value;
+    else if (!strcmp(setting, "chan"))
+      config->cost[FLOOD_CHAN] = value;
+    else if (!strcmp(setting, "query"))
+      config->cost[FLOOD_QUERY] = value;
+    else if (!strcmp(setting, "abuse"))
+      config->abuse = value;
+    else
+      return -1;
+    setting = strtok_r(NULL, ",", &savePtr);
+  }
+  return 1;
+}
+
+
+/* flood_init:
+ * Gives the new connection on socket a full bucket.
+ */
+void flood_init(floodBucket * bucket, floodConfig * config, int socket)
+{
+  memset(bucket, 0, sizeof(floodBucket));
+  bucket->socket = socket;
+  bucket->tokens = config->burst;
+  clock_gettime(CLOCK_MONOTONIC, &bucket->last);
+}
+
+
+/* flood_class:
+ * Given a command code, returns its flood control class.
+ * Unknown commands are charged as messages.
+ */
+int flood_class(int command)
+{
+  switch (command)
+  {
+    case PING:
+    case PONG:
+    case QUIT:
+      return FLOOD_FREE;
+    case JOIN:
+    case PART:
+    case TOPIC:
+    case MODE:
+      return FLOOD_CHAN;
+    case WHO:
+    case WHOIS:
+    case LIST:
+    case NAMES:
+    case LUSERS:
+    case MOTD:
+    case HISTORY:
+    case STATS:
+      return FLOOD_QUERY;
+    default:
+      return FLOOD_MSG;
+  }
+}
+
+
+/* elapsed:
+ * Returns the number of seconds between two times.
+ */
+static double elapsed(struct timespec * from, struct timespec * to)
+{
+  return (to->tv_sec - from->tv_sec) + (to->tv_nsec - from->tv_nsec) / 1e9;
+}
+
+
+/* backlog:
+ * Returns how many commands the client on socket has sent which
+ * are still to be run: the queued ones already read, and the
+ * unread input counted as lines of lineBytes each.
+ */
+static int backlog(int socket, int queued, int lineBytes)
+{
+  int unread;
+  if ((lineBytes <= 0) || (ioctl(socket, FIONREAD, &unread) == -1))
+    unread = 0;
+  return queued + (lineBytes > 0 ? unread / lineBytes : 0);
+}
+
+
+/* flood_wait:
+ * Charges a command to the client's bucket, once for each of its
+ * targets if it names several, first sleeping until
+ * the bucket holds enough tokens if it does not; output held for
+ * the client is sent before it sleeps. queued is the number of
+ * commands read after this one, and lineBytes how long the lines
+ * they came in are on average. Returns 1 if the command may run,
+ * or -1 if the client's backlog would take longer than the abuse
+ * limit to run and it must be disconnected.
+ */
+int flood_wait(floodBucket * bucket, floodConfig * config, int command, int targets, int queued, int lineBytes)
+{
+  double cost = config->cost[flood_class(command)] * targets;
+  if ((config->rate <= 0) || (cost <= 0))
+    return 1;
+
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  bucket->tokens += elapsed(&bucket->last, &now) * config->rate;
+  if (bucket->tokens > config->burst)
+    bucket->tokens = config->burst;
+  bucket->last = now;
+
+  if (bucket->tokens >= cost)
+  {
+    bucket->tokens -= cost;
+    return 1;
+  }
+
+  // the commands still waiting are taken to cost what this one does
+  if (backlog(bucket->socket, queued, lineBytes) * cost / config->rate > config->abuse)
+    return -1;
+
+  // hold the command back until the bucket can pay for it, letting
+  // out the replies held for the client meanwhile
+  double wait = (cost - bucket->tokens) / config->rate;
+  struct timespec delay;
+  delay.tv_sec = (time_t) wait;
+  delay.tv_nsec = (long) ((wait - delay.tv_sec) * 1e9);
+  netio_release(bucket->socket);
+  nanosleep(&delay, NULL);
+  netio_hold(bucket->socket);
+  clock_gettime(CLOCK_MONOTONIC, &bucket->last);
+  bucket->tokens = 0;
+  return 1;
+}
+
+
+/* flood_disconnect:
+ * Closes the connection of a client which kept flooding.
+ */
+void flood_disconnect(userInfo * info, list_t * userList, list_t * chanList)
+{
+  char floodMsg[] = "Excess Flood";
+  disconnect(info, floodMsg, userList, chanList);
+}
@@ -0,0 +1,35 @@
+/*
+ *
+ *  CMSC 23300 / 33300 - Networks and Distributed Systems
+ *
+ *  Per-client flood control
+ *
+ */
+
+#ifndef FLOOD_H_
+#define FLOOD_H_
+
+#include "simclist.h"
+#include "structures.h"
+
+// command classes, each with its own token cost
+#define FLOOD_FREE 0
+#define FLOOD_MSG 1
+#define FLOOD_CHAN 2
+#define FLOOD_QUERY 3
+
+#define FLOODRATE 5.0
+#define FLOODBURST 20.0
+#define FLOODCOSTMSG 1.0
+#define FLOODCOSTCHAN 2.0
+#define FLOODCOSTQUERY 5.0
+#define FLOODABUSE 30.0
+
+void flood_default(floodConfig * config);
+int flood_configure(floodConfig * config, char * spec);
+void flood_init(floodBucket * bucket, floodConfig * config, int socket);
+int flood_class(int command);
+int flood_wait(floodBucket * bucket, floodConfig * config, int command, int targets, int queued, int lineBytes);
+void flood_disconnect(userInfo * info, list_t * userList, list_t * chanList);
+
+#endif /* FLOOD_H_ */
@@ -0,0 +1,207 @@
+/*
+ *
+ *  CMSC 23300 / 33300 - Networks and Distributed Systems
+ *
+ *  Channel History Functions
+ *
+ *  Every channel keeps its most recent messages in a ring of
+ *  fixed size slots, allocated in one piece when the channel is
+ *  created, so a channel never holds more than the configured
+ *  number of bytes however busy it is. Slots hold the lines
+ *  exactly as they were fanned out to members, and HISTORY sends
+ *  them again to a member who asks.
+ *
+ *  Senders append without a lock: each takes the next sequence
+ *  number with one atomic add and owns the slot it lands on.
+ *  Every slot carries a version which is odd while its line is
+ *  being written, so a reader copying a slot can tell whether
+ *  the line changed under it and skip it if so. A line too long
+ *  for a slot is not kept.
+ *
+ */
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "epoch.h"
+#include "history.h"
+#include "netio.h"
+#include "structures.h"
+
+
+struct historySlot
+{
+  // 2 * sequence + 2 once the line of that sequence is in place
+  unsigned long version;
+  int len;
+};
+
+typedef struct historySlot historySlot;
+
+struct historyRing
+{
+  unsigned long next;
+  int depth;
+  int slotSize;
+  historySlot * slots;
+  char * lines;
+};
+
+static int depth = HISTORYDEPTH;
+static int bytes = HISTORYBYTES;
+
+
+/* history_configure:
+ * Given a comma separated list of settings, such as
+ * "depth=64,bytes=32768", updates the size of every channel
+ * history created from now on. A depth of 0 turns history
+ * off. Returns -1 if the list is invalid, or leaves too
+ * few bytes per line.
+ */
+int history_configure(char * spec)
+{
+  int newDepth = depth;
+  int newBytes = bytes;
+  char * savePtr;
+  char * setting = strtok_r(spec, ",", &savePtr);
+  while (setting)
+  {
+    char * equals = strchr(setting, '=');
+    if (equals == NULL)
+      return -1;
+    *equals = '\0';
+    char * end;
+    long value = strtol(equals + 1, &end, 10);
+    if (end == equals + 1 || *end || value < 0 || value > INT_MAX)
+      return -1;
+    if (!strcmp(setting, "depth"))
+      newDepth = value;
+    else if (!strcmp(setting, "bytes"))
+      newBytes = value;
+    else
+      return -1;
+    setting = strtok_r(NULL, ",", &savePtr);
+  }
+  if (newDepth > HISTORYMAXDEPTH)
+    return -1;
+  if (newDepth && newBytes / newDepth < HISTORYMINLINE)
+    return -1;
+  depth = newDepth;
+  bytes = newBytes;
+  return 1;
+}
+
+
+/* history_init:
+ * Gives a new channel an empty history. Must be called
+ * before the channel is copied into the channel list.
+ */
+void history_init(channelData * channel)
+{
+  channel->history = NULL;
+  if (!depth)
+    return;
+  int slotSize = bytes / depth;
+  if (slotSize > HISTORYLINE)
+    slotSize = HISTORYLINE;
+  // the ring, its slots and their lines are freed together
+  historyRing * ring = (historyRing *) malloc(sizeof(historyRing) +
+                                              depth * sizeof(historySlot) +
+                                              depth * slotSize);
+  ring->next = 0;
+  ring->depth = depth;
+  ring->slotSize = slotSize;
+  ring->slots = (historySlot *) (ring + 1);
+  ring->lines = (char *) (ring->slots + depth);
+  memset(ring->slots, 0, depth * sizeof(historySlot));
+  channel->history = ring;
+}
+
+
+/* history_free:
+ * Frees the history of a channel which is being removed, once
+ * no sender or reader can still be using it.
+ */
+void history_free(channelData * channel)
+{
+  if (channel->history)
+    epoch_retire(channel->history);
+  channel->history = NULL;
+}
+
+
+/* history_append:
+ * Keeps a line sent to channel, made of begin followed by end
+ * if there is one. Safe to call from any number of threads at
+ * once; must be called between epoch_enter and epoch_exit.
+ */
+void history_append(channelData * channel, char * begin, int beginLen, char * end, int endLen)
+{
+  historyRing * ring = channel->history;
+  if (ring == NULL)
+    return;
+  if (!end)
+    endLen = 0;
+  int len = beginLen + endLen;
+  if (len > ring->slotSize)
+    return;
+
+  unsigned long seq = __atomic_fetch_add(&ring->next, 1, __ATOMIC_RELAXED);
+  unsigned long index = seq % ring->depth;
+  historySlot * slot = &ring->slots[index];
+  // a sender a whole ring behind or ahead may still hold the slot;
+  // one line is lost rather than waiting for it
+  unsigned long version = __atomic_load_n(&slot->version, __ATOMIC_RELAXED);
+  if ((version & 1) || version > 2 * seq)
+    return;
+  if (!__atomic_compare_exchange_n(&slot->version, &version, 2 * seq + 1, 0,
+                                   __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+    return;
+  // readers must see the odd version before any of the new line
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  char * line = ring->lines + index * ring->slotSize;
+  memcpy(line, begin, beginLen);
+  if (endLen)
+    memcpy(line + beginLen, end, endLen);
+  slot->len = len;
+  __atomic_store_n(&slot->version, 2 * seq + 2, __ATOMIC_RELEASE);
+}
+
+
+/* history_replay:
+ * Sends up to count of the most recent lines kept for channel
+ * to socket, oldest first. Lines being overwritten while they
+ * are read are skipped. Each line is sent from a copy on the
+ * stack, so this must not be called inside a netio batch. Must
+ * be called between epoch_enter and epoch_exit. Returns the
+ * number of lines sent.
+ */
+int history_replay(channelData * channel, int socket, int count)
+{
+  historyRing * ring = channel->history;
+  if (ring == NULL)
+    return 0;
+  if (count <= 0 || count > ring->depth)
+    count = ring->depth;
+  unsigned long next = __atomic_load_n(&ring->next, __ATOMIC_ACQUIRE);
+  unsigned long first = next > (unsigned long) count ? next - count : 0;
+
+  char line[HISTORYLINE];
+  int sent = 0;
+  for (unsigned long seq = first; seq < next; seq++)
+  {
+    unsigned long index = seq % ring->depth;
+    historySlot * slot = &ring->slots[index];
+    unsigned long version = __atomic_load_n(&slot->version, __ATOMIC_ACQUIRE);
+    if (version != 2 * seq + 2)
+      continue;
+    int len = slot->len;
+    memcpy(line, ring->lines + index * ring->slotSize, len);
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&slot->version, __ATOMIC_RELAXED) != version)
+      continue;
+    netio_line(socket, line, len, NULL, 0);
+    sent++;
+  }
+  return sent;
+}
@@ -0,0 +1,28 @@
+/*
+ *
+ *  CMSC 23300 / 33300 - Networks and Distributed Systems
+ *
+ *  Per-channel message history
+ *
+ */
+
+#ifndef HISTORY_H_
+#define HISTORY_H_
+
+#include "structures.h"
+
+// lines kept per channel, and bytes of storage per channel
+#define HISTORYDEPTH 64
+#define HISTORYBYTES 32768
+#define HISTORYMAXDEPTH 4096
+// longest line a slot needs to hold
+#define HISTORYLINE 1024
+#define HISTORYMINLINE 64
+
+int history_configure(char * spec);
+void history_init(channelData * channel);
+void history_free(channelData * channel);
+void history_append(channelData * channel, char * begin, int beginLen, char * end, int endLen);
+int history_replay(channelData * channel, int socket, int count);
+
+#endif /* HISTORY_H_ */
@@ -0,0 +1,168 @@
+/*
+ *
+ *  CMSC 23300 / 33300 - Networks and Distributed Systems
+ *
+ *  Input Buffer Functions
+ *
+ *  Each client connection receives into a buffer of its own on the
+ *  heap. It starts at one IRC line, so the many clients which only
+ *  ever send a line at a time cost little, and doubles whenever a
+ *  recv() fills it, up to the input_buffer limit, so a client
+ *  pushing large bursts reads them in as few calls as before. A
+ *  grown buffer is shrunk back to its starting size once what it
+ *  holds fits in that and the client has sent nothing for the
+ *  idle time; its thread waits for input with that timeout
+ *  instead of blocking in recv() outright. The buffer's current
+ *  size is charged to the connection's memory budget.
+ *
+ *  Commands are run as soon as whole lines have arrived; a line
+ *  cut short by the end of a recv() is kept at the front of the
+ *  buffer until the rest of it comes. A full buffer without a
+ *  single whole line has its last two bytes made "\r\n", cutting
+ *  the line short, as before.
+ *
+ */
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include "budget.h"
+#include "input.h"
+#include "netio.h"
+
+
+static int startSize = INPUTSTART;
+static int idleSecs = INPUTIDLE;
+
+
+/* input_configure:
+ * Given a comma separated list of settings, such as
+ * "start=512,idle=30", updates how input buffers are sized.
+ * start is the bytes each buffer starts with, and idle the
+ * seconds without input after which a grown buffer shrinks
+ * back, 0 for never. Returns -1 if the list is invalid.
+ */
+int input_configure(char * spec)
+{
+  char * savePtr;
+  char * setting = strtok_r(spec, ",", &savePtr);
+  while (setting)
+  {
+    char * equals = strchr(setting, '=');
+    if (equals == NULL)
+      return -1;
+    *equals = '\0';
+    char * end;
+    long value = strtol(equals + 1, &end, 10);
+    if (end == equals + 1 || *end || value < 0 || value > INT_MAX)
+      return -1;
+    if (!strcmp(setting, "start"))
+    {
+      // room for at least one line and its "\r\n"
+      if (value < 16)
+        return -1;
+      startSize = value;
+    }
+    else if (!strcmp(setting, "idle"))
+      idleSecs = value;
+    else
+      return -1;
+    setting = strtok_r(NULL, ",", &savePtr);
+  }
+  return 1;
+}
+
+
+/* resize:
+ * Changes the size of the buffer, which must still hold
+ * what it has received, and charges the difference.
+ */
+static void resize(inputBuffer * input, int size)
+{
+  char * buf = (char *) realloc(input->buf, size);
+  if (buf == NULL)
+    return;
+  budget_charge(input->socket, BUDGET_INPUT, size - input->size);
+  input->buf = buf;
+  input->size = size;
+}
+
+
+/* input_open:
+ * Sets up the input buffer of the client on socket, which may
+ * grow to cap bytes.
+ */
+void input_open(inputBuffer * input, int socket, int cap)
+{
+  input->socket = socket;
+  input->cap = cap;
+  input->len = 0;
+  input->size = 0;
+  input->buf = NULL;
+  resize(input, startSize < cap ? startSize : cap);
+}
+
+
+/* input_recv:
+ * Receives what the client has sent after what the buffer holds,
+ * growing the buffer first if it is full, and shrinking it while
+ * the client is idle. Returns what recv() does.
+ */
+int input_recv(inputBuffer * input)
+{
+  if (input->len == input->size && input->size < input->cap)
+    resize(input, input->size * 2 < input->cap ? input->size * 2 : input->cap);
+  if (input->size > startSize && input->len < startSize && idleSecs)
+  {
+    int ready = netio_wait(input->socket, idleSecs * 1000);
+    if (ready == -1)
+      return -1;
+    if (ready == 0)
+      resize(input, startSize);
+  }
+  int nbytes = netio_recv(input->socket, input->buf + input->len, input->size - input->len);
+  if (nbytes > 0)
+    input->len += nbytes;
+  return nbytes;
+}
+
+
+/* input_lines:
+ * Returns the bytes at the front of the buffer which make up
+ * whole lines, or 0 if a line is still arriving.
+ */
+int input_lines(inputBuffer * input)
+{
+  for (int n = input->len - 1; n > 0; n--)
+    if (input->buf[n] == '\n' && input->buf[n - 1] == '\r')
+      return n + 1;
+  // nothing more fits, so make do with what is there
+  if (input->len == input->cap)
+  {
+    input->buf[input->len - 2] = '\r';
+    input->buf[input->len - 1] = '\n';
+    return input->len;
+  }
+  return 0;
+}
+
+
+/* input_consume:
+ * Drops bytes from the front of the buffer once they are run.
+ */
+void input_consume(inputBuffer * input, int bytes)
+{
+  memmove(input->buf, input->buf + bytes, input->len - bytes);
+  input->len -= bytes;
+}
+
+
+/* input_close:
+ * Frees the input buffer of a connection which has closed.
+ */
+void input_close(inputBuffer * input)
+{
+  budget_charge(input->socket, BUDGET_INPUT, -input->size);
+  free(input->buf);
+  input->buf = NULL;
+  input->size = input->len = 0;
+}
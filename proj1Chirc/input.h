@@ -0,0 +1,37 @@
+/*
+ *
+ *  CMSC 23300 / 33300 - Networks and Distributed Systems
+ *
+ *  Per-connection input buffers
+ *
+ */
+
+#ifndef INPUT_H_
+#define INPUT_H_
+
+// bytes a connection's input buffer starts with: one IRC line
+#define INPUTSTART 512
+// seconds without input before a grown buffer shrinks back
+#define INPUTIDLE 30
+
+struct inputBuffer
+{
+  int socket;
+  char * buf;
+  // bytes received and not yet consumed
+  int len;
+  int size;
+  // most bytes the buffer may grow to
+  int cap;
+};
+
+typedef struct inputBuffer inputBuffer;
+
+int input_configure(char * spec);
+void input_open(inputBuffer * input, int socket, int cap);
+int input_recv(inputBuffer * input);
+int input_lines(inputBuffer * input);
+void input_consume(inputBuffer * input, int bytes);
+void input_close(inputBuffer * input);
+
+#endif /* INPUT_H_ */
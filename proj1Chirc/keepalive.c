@@ -0,0 +1,199 @@
+/*
+ *
+ *  CMSC 23300 / 33300 - Networks and Distributed Systems
+ *
+ *  Keepalive Functions
+ *
+ *  Every client connection has a timer on the timer wheel. A client
+ *  that has not registered within the registration timeout is
+ *  disconnected. A client that has been silent for the ping interval
+ *  is sent a PING, and disconnected if it still says nothing within
+ *  the ping timeout. Receiving input only records the time, so the
+ *  timer is not moved for every line a busy client sends; when it
+ *  fires it works out from that time how long to wait next.
+ *
+ *  The timer thread never tears a connection down itself. It shuts
+ *  down the reading side of the socket, which wakes the client's
+ *  thread out of recv(), and that thread calls keepalive_disconnect
+ *  to remove the client as if it had quit.
+ *
+ */
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include "command.h"
+#include "keepalive.h"
+#include "netio.h"
+
+
+/* now_ms:
+ * Returns the monotonic clock in milliseconds.
+ */
+static long now_ms(void)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC_COARSE, &now);
+  return now.tv_sec * 1000L + now.tv_nsec / 1000000L;
+}
+
+
+/* keepalive_default:
+ * Fills in the default keepalive settings.
+ */
+void keepalive_default(keepaliveConfig * config)
+{
+  config->ping = KEEPALIVEPING;
+  config->timeout = KEEPALIVETIMEOUT;
+  config->registration = KEEPALIVEREGISTER;
+}
+
+
+/* keepalive_configure:
+ * Given a comma separated list of settings in seconds, such as
+ * "ping=120,timeout=60,register=60", updates the keepalive
+ * settings. Returns -1 if the list is invalid.
+ */
+int keepalive_configure(keepaliveConfig * config, char * spec)
+{
+  char * savePtr;
+  char * setting = strtok_r(spec, ",", &savePtr);
+  while (setting)
+  {
+    char * equals = strchr(setting, '=');
+    if (equals == NULL)
+      return -1;
+    *equals = '\0';
+    char * end;
+    long value = strtol(equals + 1, &end, 10);
+    if (end == equals + 1 || *end || value < 0 || value > INT_MAX)
+      return -1;
+    if (!strcmp(setting, "ping"))
+      config->ping = value;
+    else if (!strcmp(setting, "timeout"))
+      config->timeout = value;
+    else if (!strcmp(setting, "register"))
+      config->registration = value;
+    else
+      return -1;
+    setting = strtok_r(NULL, ",", &savePtr);
+  }
+  return 1;
+}
+
+
+/* expire:
+ * Marks the connection as timed out and wakes its thread.
+ */
+static long expire(keepalive * ka, int reason)
+{
+  ka->expired = reason;
+  shutdown(ka->info->socket, SHUT_RD);
+  return 0;
+}
+
+
+/* keepalive_check:
+ * Timer callback. Closes connections which failed to register
+ * or to answer a PING in time, and pings those which have gone
+ * quiet. Returns when to check the connection again.
+ */
+static long keepalive_check(void * arg)
+{
+  keepalive * ka = (keepalive *) arg;
+  keepaliveConfig * config = ka->config;
+  long now = now_ms();
+  long lastActive = __atomic_load_n(&ka->lastActive, __ATOMIC_RELAXED);
+  long next = 0;
+
+  if (__atomic_load_n(&ka->info->channelModes, __ATOMIC_ACQUIRE) == NULL && config->registration)
+  {
+    long deadline = ka->start + config->registration * 1000L;
+    if (now >= deadline)
+      return expire(ka, KEEPALIVE_REGISTER);
+    next = deadline - now;
+  }
+
+  if (!config->ping)
+    return next;
+  long wait;
+  if (ka->pingSent && lastActive < ka->pingSent)
+  {
+    // waiting for any sign of life since the PING
+    long deadline = ka->pingSent + config->timeout * 1000L;
+    if (now >= deadline)
+      return expire(ka, KEEPALIVE_PING);
+    wait = deadline - now;
+  }
+  else if (now - lastActive >= config->ping * 1000L)
+  {
+    char ping[MAXHOST + 16];
+    int pingLen = snprintf(ping, sizeof(ping), "PING :%s", ka->serverHost);
+    // the timer thread must not block on a full socket
+    netio_post(ka->info->socket, ping, pingLen, NULL, 0);
+    ka->pingSent = now;
+    wait = config->timeout * 1000L;
+  }
+  else
+    wait = lastActive + config->ping * 1000L - now;
+  if (!next || wait < next)
+    next = wait;
+  return next;
+}
+
+
+/* keepalive_start:
+ * Starts watching a new client connection.
+ */
+void keepalive_start(keepalive * ka, userInfo * info, serverInfo * servData)
+{
+  memset(ka, 0, sizeof(keepalive));
+  ka->info = info;
+  ka->config = &servData->keepalive;
+  ka->serverHost = servData->serverHost;
+  ka->start = now_ms();
+  ka->lastActive = ka->start;
+  timer_setup(&ka->timer, keepalive_check, ka);
+  long first = 0;
+  if (ka->config->registration)
+    first = ka->config->registration * 1000L;
+  if (ka->config->ping && (!first || ka->config->ping * 1000L < first))
+    first = ka->config->ping * 1000L;
+  if (first)
+    timer_add(&ka->timer, first);
+}
+
+
+/* keepalive_touch:
+ * Records that the client sent something.
+ */
+void keepalive_touch(keepalive * ka)
+{
+  __atomic_store_n(&ka->lastActive, now_ms(), __ATOMIC_RELAXED);
+}
+
+
+/* keepalive_stop:
+ * Stops watching a connection. Its timer will not fire
+ * once this returns.
+ */
+void keepalive_stop(keepalive * ka)
+{
+  timer_cancel(&ka->timer);
+}
+
+
+/* keepalive_disconnect:
+ * Closes the connection of a client which timed out. Must be
+ * called from the client's own thread.
+ */
+void keepalive_disconnect(keepalive * ka, list_t * userList, list_t * chanList)
+{
+  char pingMsg[] = "Ping timeout";
+  char registerMsg[] = "Registration timeout";
+  char * msg = (ka->expired == KEEPALIVE_PING) ? pingMsg : registerMsg;
+  disconnect(ka->info, msg, userList, chanList);
+}
@@ -0,0 +1,47 @@
+/*
+ *
+ *  CMSC 23300 / 33300 - Networks and Distributed Systems
+ *
+ *  Connection keepalives and timeouts
+ *
+ */
+
+#ifndef KEEPALIVE_H_
+#define KEEPALIVE_H_
+
+#include "simclist.h"
+#include "structures.h"
+#include "timer.h"
+
+#define KEEPALIVEPING 120
+#define KEEPALIVETIMEOUT 60
+#define KEEPALIVEREGISTER 60
+
+// why a connection was closed
+#define KEEPALIVE_OK 0
+#define KEEPALIVE_PING 1
+#define KEEPALIVE_REGISTER 2
+
+struct keepalive
+{
+  timerEntry timer;
+  userInfo * info;
+  keepaliveConfig * config;
+  char * serverHost;
+  // monotonic milliseconds
+  long start;
+  long lastActive;
+  long pingSent;
+  int expired;
+};
+
+typedef struct keepalive keepalive;
+
+void keepalive_default(keepaliveConfig * config);
+int keepalive_configure(keepaliveConfig * config, char * spec);
+void keepalive_start(keepalive * ka, userInfo * info, serverInfo * servData);
+void keepalive_touch(keepalive * ka);
+void keepalive_stop(keepalive * ka);
+void keepalive_disconnect(keepalive * ka, list_t * userList, list_t * chanList);
+
+#endif /* KEEPALIVE_H_ */
@@ -0,0 +1,287 @@
+/*
+ *
+ *  CMSC 23300 / 33300 - Networks and Distributed Systems
+ *
+ *  Command Latency Functions
+ *
+ *  run_command times every command into a histogram kept for its
+ *  verb. Histograms are log-linear, like HDR histograms: each power
+ *  of two of nanoseconds is split into LATENCYSUB buckets, so any
+ *  percentile read back is within about 6% of the true value while
+ *  a histogram stays a fixed few kilobytes. Recording a command is
+ *  one relaxed atomic add to its bucket; counts and means are worked
+ *  out from the buckets when they are reported.
+ *
+ *  A command which takes longer than the slow threshold is written
+ *  to the slow log with its arguments, how long it waited for locks
+ *  and how many list elements it visited. Lock waits are measured
+ *  by latency_lock, which costs one trylock when the lock is free;
+ *  list elements are counted by simclist itself.
+ *
+ *  "STATS l" sends an operator the percentiles of every verb used
+ *  so far.
+ *
+ */
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "command.h"
+#include "latency.h"
+#include "netio.h"
+#include "simclist.h"
+#include "structures.h"
+
+
+struct latencyHist
+{
+  uint64_t counts[LATENCYBUCKETS];
+  uint64_t max;
+};
+
+typedef struct latencyHist latencyHist;
+
+static int enabled = 1;
+static int slowMs = LATENCYSLOW;
+static int logFd = STDERR_FILENO;
+static latencyHist hists[COMMANDNUM];
+static char * verbs[COMMANDNUM];
+// nanoseconds the calling thread has spent waiting for locks
+static __thread uint64_t lockWait __attribute__((tls_model("initial-exec"))) = 0;
+
+
+/* now_ns:
+ * Returns monotonic time in nanoseconds.
+ */
+static uint64_t now_ns(void)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t) now.tv_sec * 1000000000ull + now.tv_nsec;
+}
+
+
+/* bucket_of:
+ * Returns the histogram bucket a latency of ns falls in.
+ */
+static int bucket_of(uint64_t ns)
+{
+  if (ns < LATENCYSUB)
+    return (int) ns;
+  int power = 63 - __builtin_clzll(ns);
+  if (power >= LATENCYPOWERS)
+    return LATENCYBUCKETS - 1;
+  int sub = (ns >> (power - LATENCYSUBBITS)) & (LATENCYSUB - 1);
+  return (power - LATENCYSUBBITS + 1) * LATENCYSUB + sub;
+}
+
+
+/* bucket_floor:
+ * Returns the smallest latency, in ns, which falls in bucket.
+ */
+static uint64_t bucket_floor(int bucket)
+{
+  if (bucket < LATENCYSUB)
+    return bucket;
+  int power = bucket / LATENCYSUB + LATENCYSUBBITS - 1;
+  uint64_t sub = bucket % LATENCYSUB;
+  return (1ull << power) + (sub << (power - LATENCYSUBBITS));
+}
+
+
+/* percentile:
+ * Returns the latency, in ns, under which percent of the commands
+ * counted in counts fell, rounded up to the end of its bucket.
+ */
+static uint64_t percentile(uint64_t * counts, uint64_t total, double percent)
+{
+  uint64_t wanted = (uint64_t) (total * percent / 100.0 + 0.5);
+  if (wanted == 0)
+    wanted = 1;
+  uint64_t seen = 0;
+  for (int n = 0; n < LATENCYBUCKETS; n++)
+  {
+    seen += counts[n];
+    if (seen >= wanted)
+      return bucket_floor(n + 1) - 1;
+  }
+  return bucket_floor(LATENCYBUCKETS);
+}
+
+
+/* latency_configure:
+ * Given a comma separated list of settings, such as
+ * "enabled=1,slow=100,log=/var/log/chirc-slow.log", updates the
+ * latency settings. slow is in milliseconds, and 0 turns the slow
+ * log off; the log goes to stderr unless a file is given. Returns
+ * -1 if the list is invalid or the log cannot be opened.
+ */
+int latency_configure(char * spec)
+{
+  char * savePtr;
+  char * setting = strtok_r(spec, ",", &savePtr);
+  while (setting)
+  {
+    char * equals = strchr(setting, '=');
+    if (equals == NULL)
+      return -1;
+    *equals = '\0';
+    char * value = equals + 1;
+    if (!strcmp(setting, "enabled"))
+      enabled = atoi(value);
+    else if (!strcmp(setting, "slow"))
+    {
+      slowMs = atoi(value);
+      if (slowMs < 0)
+        return -1;
+    }
+    else if (!strcmp(setting, "log"))
+    {
+      int fd = open(value, O_WRONLY | O_APPEND | O_CREAT, 0644);
+      if (fd == -1)
+        return -1;
+      if (logFd != STDERR_FILENO)
+        close(logFd);
+      logFd = fd;
+    }
+    else
+      return -1;
+    setting = strtok_r(NULL, ",", &savePtr);
+  }
+  return 1;
+}
+
+
+/* latency_init:
+ * Learns the names of the verbs. Must be called before
+ * any command is run.
+ */
+void latency_init(void)
+{
+  command_init(verbs);
+}
+
+
+/* latency_start:
+ * Notes the start of a command run by the calling thread.
+ */
+void latency_start(latencySpan * span)
+{
+  if (!enabled)
+    return;
+  span->lockWait = lockWait;
+  span->visits = list_visits;
+  span->start = now_ns();
+}
+
+
+/* slow_log:
+ * Writes one line about a slow command to the slow log.
+ */
+static void slow_log(int command, uint64_t elapsed, uint64_t waited, unsigned long visits,
+                     char ** argList, int argNum, userInfo * info)
+{
+  char line[LATENCYLOGLEN];
+  char stamp[32];
+  time_t now = time(NULL);
+  struct tm tm;
+  strftime(stamp, sizeof(stamp), "%Y-%m-%dT%H:%M:%S", localtime_r(&now, &tm));
+  int len = snprintf(line, LATENCYLOGLEN - 1,
+                     "%s slow %s %.3f ms lockwait=%.3f ms visited=%lu nick=%s args=",
+                     stamp, verbs[command], elapsed / 1e6, waited / 1e6, visits,
+                     info->nickname[0] ? info->nickname : "*");
+  for (int n = 1; n < argNum && len < LATENCYLOGLEN - 1; n++)
+    len += snprintf(line + len, LATENCYLOGLEN - 1 - len, "%s%s", n > 1 ? " " : "", argList[n]);
+  if (len > LATENCYLOGLEN - 2)
+    len = LATENCYLOGLEN - 2;
+  line[len++] = '\n';
+  // one write per line, so lines from several threads never mix
+  if (write(logFd, line, len) == -1)
+    return;
+}
+
+
+/* latency_end:
+ * Counts a command started with latency_start into the histogram
+ * of its verb, and logs it if it was slow.
+ */
+void latency_end(latencySpan * span, int command, char ** argList, int argNum, userInfo * info)
+{
+  if (!enabled || command < 0 || command >= COMMANDNUM)
+    return;
+  uint64_t elapsed = now_ns() - span->start;
+  latencyHist * hist = &hists[command];
+  __atomic_fetch_add(&hist->counts[bucket_of(elapsed)], 1, __ATOMIC_RELAXED);
+  uint64_t max = __atomic_load_n(&hist->max, __ATOMIC_RELAXED);
+  while (elapsed > max &&
+         !__atomic_compare_exchange_n(&hist->max, &max, elapsed, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+    ;
+  if (slowMs && elapsed >= (uint64_t) slowMs * 1000000)
+    slow_log(command, elapsed, lockWait - span->lockWait, list_visits - span->visits,
+             argList, argNum, info);
+}
+
+
+/* latency_lock:
+ * Locks mutex, adding the time spent waiting for it to the
+ * calling thread's lock wait.
+ */
+void latency_lock(pthread_mutex_t * mutex)
+{
+  if (!enabled)
+  {
+    pthread_mutex_lock(mutex);
+    return;
+  }
+  if (!pthread_mutex_trylock(mutex))
+    return;
+  uint64_t start = now_ns();
+  pthread_mutex_lock(mutex);
+  lockWait += now_ns() - start;
+}
+
+
+/* latency_report:
+ * Sends nick one NOTICE per verb used so far, with its count and
+ * latency percentiles in microseconds.
+ */
+void latency_report(int socket, char * serverHost, char * nick)
+{
+  uint64_t counts[LATENCYBUCKETS];
+  char line[LATENCYLOGLEN];
+  for (int command = 0; command < COMMANDNUM; command++)
+  {
+    latencyHist * hist = &hists[command];
+    uint64_t total = 0;
+    double sum = 0;
+    // copy first, so the percentiles agree with each other
+    for (int n = 0; n < LATENCYBUCKETS; n++)
+    {
+      counts[n] = __atomic_load_n(&hist->counts[n], __ATOMIC_RELAXED);
+      total += counts[n];
+      // each latency counts as the middle of its bucket
+      sum += counts[n] * (bucket_floor(n) + bucket_floor(n + 1)) / 2.0;
+    }
+    if (!total)
+      continue;
+    uint64_t max = __atomic_load_n(&hist->max, __ATOMIC_RELAXED);
+    uint64_t p50 = percentile(counts, total, 50);
+    uint64_t p90 = percentile(counts, total, 90);
+    uint64_t p99 = percentile(counts, total, 99);
+    uint64_t p999 = percentile(counts, total, 99.9);
+    int len = snprintf(line, LATENCYLOGLEN,
+                       ":%s NOTICE %s :%s count=%llu mean=%.1f p50=%.1f p90=%.1f p99=%.1f "
+                       "p999=%.1f max=%.1f us",
+                       serverHost, nick, verbs[command], (unsigned long long) total,
+                       sum / 1e3 / total,
+                       (p50 < max ? p50 : max) / 1e3,
+                       (p90 < max ? p90 : max) / 1e3,
+                       (p99 < max ? p99 : max) / 1e3,
+                       (p999 < max ? p999 : max) / 1e3,
+                       max / 1e3);
+    netio_line(socket, line, len, NULL, 0);
+  }
+}
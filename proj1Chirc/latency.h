@@ -0,0 +1,44 @@
+/*
+ *
+ *  CMSC 23300 / 33300 - Networks and Distributed Systems
+ *
+ *  Per-command latency histograms and slow command log
+ *
+ */
+
+#ifndef LATENCY_H_
+#define LATENCY_H_
+
+#include <pthread.h>
+#include <stdint.h>
+#include "structures.h"
+
+// commands slower than this many milliseconds are logged
+#define LATENCYSLOW 100
+// each power of two of nanoseconds is split into this many buckets,
+// so a recorded latency is off by at most 1/LATENCYSUB
+#define LATENCYSUBBITS 4
+#define LATENCYSUB (1 << LATENCYSUBBITS)
+// the largest bucket starts at 2^(LATENCYPOWERS-1) ns, about 9 minutes
+#define LATENCYPOWERS 40
+#define LATENCYBUCKETS ((LATENCYPOWERS - LATENCYSUBBITS + 1) * LATENCYSUB)
+#define LATENCYLOGLEN 512
+
+// what run_command notes when it starts a command
+struct latencySpan
+{
+  uint64_t start;
+  uint64_t lockWait;
+  unsigned long visits;
+};
+
+typedef struct latencySpan latencySpan;
+
+int latency_configure(char * spec);
+void latency_init(void);
+void latency_start(latencySpan * span);
+void latency_end(latencySpan * span, int command, char ** argList, int argNum, userInfo * info);
+void latency_lock(pthread_mutex_t * mutex);
+void latency_report(int socket, char * serverHost, char * nick);
+
+#endif /* LATENCY_H_ */
@@ -5,9 +5,14 @@
  *  Aux Functions to create global lists maintained
  *  throughout a server runtime.
  *
+ *  Users, channels and channel modes are compared by the folded
+ *  forms of their names (see casemap.c). Seekers are given the
+ *  nameKey of the name being looked up.
+ *
  */
 #include <stdio.h>
 #include <string.h>
+#include "casemap.h"
 #include "listfxns.h"
 
 
@@ -20,22 +25,29 @@ size_t user_info_size(const void *el)
 }
 
 
+/* user_key:
+ * Folds and hashes a user's nickname after it was set.
+ */
+void user_key(userInfo * info)
+{
+  info->nickHash = casemap_fold(info->foldedNick, info->nickname, MAXNICK);
+}
+
+
 int nick_comparator(const void *a, const void *b)
 {
   userInfo *userInfoA = (userInfo *) a;
   userInfo *userInfoB = (userInfo *) b;
-  char * nickA, * nickB;
-  nickA = userInfoA->nickname;
-  nickB = userInfoB->nickname;
-  return strcmp(nickA, nickB);
+  return memcmp(userInfoA->foldedNick, userInfoB->foldedNick, MAXNICK);
 }
 
 
-int seeker(const void *el, const void ** nick)
+int seeker(const void *el, const void *key)
 {
   // let's assume el and key being always != NULL
   const userInfo *info = (userInfo *) el;
-  if (!(strcmp(info->nickname, *(char **) nick)))
+  const nameKey *nick = (nameKey *) key;
+  if ((info->nickHash == nick->hash) && !(memcmp(info->foldedNick, nick->folded, MAXNICK)))
     return 1;
   return 0;
 }
@@ -48,21 +60,27 @@ size_t chan_info_size(const void *el)
   return sizeof(channelData);
 }
 
+/* chan_key:
+ * Folds and hashes a channel's name after it was set.
+ */
+void chan_key(channelData * channel)
+{
+  channel->nameHash = casemap_fold(channel->foldedName, channel->name, MAXCHANNAME);
+}
+
 int chan_comparator(const void *a, const void *b)
 {
   channelData *chanDataA = (channelData *) a;
   channelData *chanDataB = (channelData *) b;
-  char * nameA, * nameB;
-  nameA = chanDataA->name;
-  nameB = chanDataB->name;
-  return strcmp(nameA, nameB);
+  return memcmp(chanDataA->foldedName, chanDataB->foldedName, MAXCHANNAME);
 }
 
-int chan_seeker(const void *el, const void ** name)
+int chan_seeker(const void *el, const void *key)
 {
   // let's assume el and key being always != NULL
   const channelData *data = (channelData *) el;
-  if (!(strcmp(data->name, *(char **) name)))
+  const nameKey *name = (nameKey *) key;
+  if ((data->nameHash == name->hash) && !(memcmp(data->foldedName, name->folded, MAXCHANNAME)))
     return 1;
   return 0;
 }
@@ -72,22 +90,50 @@ size_t chanmode_info_size(const void *el)
   return sizeof(forChannel);
 }
 
+/* chanmode_key:
+ * Folds and hashes the channel name of a user's channel
+ * modes after it was set.
+ */
+void chanmode_key(forChannel * chanMode)
+{
+  chanMode->nameHash = casemap_fold(chanMode->foldedName, chanMode->channelName, MAXCHANNAME);
+}
+
 int chanmode_comparator(const void *a, const void *b)
 {
   forChannel *chanModeDataA = (forChannel *) a;
   forChannel *chanModeDataB = (forChannel *) b;
-  char * nameA, * nameB;
-  nameA = chanModeDataA->channelName;
-  nameB = chanModeDataB->channelName;
-  return strcmp(nameA, nameB);
+  return memcmp(chanModeDataA->foldedName, chanModeDataB->foldedName, MAXCHANNAME);
 }
 
-int chanmode_seeker(const void *el, const void ** name)
+int chanmode_seeker(const void *el, const void *key)
 {
   // let's assume el and key being always != NULL
   const forChannel *data = (forChannel *) el;
-  if (!(strcmp(data->channelName, *(char **) name)))
+  const nameKey *name = (nameKey *) key;
+  if ((data->nameHash == name->hash) && !(memcmp(data->foldedName, name->folded, MAXCHANNAME)))
     return 1;
   return 0;
 }
 
+
+size_t link_info_size(const void *el)
+{
+  return sizeof(linkData);
+}
+
+int link_comparator(const void *a, const void *b)
+{
+  linkData *linkDataA = (linkData *) a;
+  linkData *linkDataB = (linkData *) b;
+  return strcmp(linkDataA->name, linkDataB->name);
+}
+
+int link_seeker(const void *el, const void ** name)
+{
+  // let's assume el and key being always != NULL
+  const linkData *data = (linkData *) el;
+  if (!(strcmp(data->name, *(char **) name)))
+    return 1;
+  return 0;
+}
@@ -13,13 +13,19 @@
 #include "structures.h"
 
 size_t user_info_size(const void *el);
+void user_key(userInfo * info);
 int nick_comparator(const void *a, const void *b);
-int seeker(const void *el, const void ** nick);
+int seeker(const void *el, const void *key);
 size_t chan_info_size(const void *el);
+void chan_key(channelData * channel);
 int chan_comparator(const void *a, const void *b);
-int chan_seeker(const void *el, const void ** name);
+int chan_seeker(const void *el, const void *key);
 size_t chanmode_info_size(const void *el);
+void chanmode_key(forChannel * chanMode);
 int chanmode_comparator(const void *a, const void *b);
-int chanmode_seeker(const void *el, const void ** name);
+int chanmode_seeker(const void *el, const void *key);
+size_t link_info_size(const void *el);
+int link_comparator(const void *a, const void *b);
+int link_seeker(const void *el, const void ** name);
 
 #endif /* LISTFXNS_H_ */
@@ -0,0 +1,177 @@
+/*
+ *
+ *  CMSC 23300 / 33300 - Networks and Distributed Systems
+ *
+ *  Local Socket Functions
+ *
+ *  Besides its TCP port, chirc can listen on a Unix domain socket,
+ *  for bots, bridges and loggers running on the same host. Clients
+ *  on it are handled exactly like TCP clients once accepted, but
+ *  skip the reverse DNS lookup: every one of them is given the same
+ *  configured host name. The kernel tells us which user is on the
+ *  other end (SO_PEERCRED), so connections from chosen uids can be
+ *  made IRC operators without sending OPER.
+ *
+ *  Local clients count towards the admission limits as a single
+ *  address, LOCALADDR, but are not held to the accept rate.
+ *
+ */
+// for accept4 and struct ucred
+#define _GNU_SOURCE
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include "admit.h"
+#include "local.h"
+
+
+static char path[LOCALPATHLEN];
+static char host[MAXHOST] = LOCALHOST;
+static mode_t mode = LOCALMODE;
+static uid_t opers[LOCALMAXOPERS];
+static int numOpers = 0;
+
+
+/* local_configure:
+ * Given a comma separated list of settings, such as
+ * "path=/run/chirc.sock,host=bots.local,mode=0660,oper=0:1000",
+ * updates the local socket settings. chirc only listens on a
+ * local socket once it has a path. oper is a colon separated list
+ * of uids whose connections are operators from the start. Returns
+ * -1 if the list is invalid.
+ */
+int local_configure(char * spec)
+{
+  char * savePtr;
+  char * setting = strtok_r(spec, ",", &savePtr);
+  while (setting)
+  {
+    char * equals = strchr(setting, '=');
+    if (equals == NULL)
+      return -1;
+    *equals = '\0';
+    char * value = equals + 1;
+    if (!strcmp(setting, "path"))
+    {
+      if (strlen(value) >= LOCALPATHLEN)
+        return -1;
+      strcpy(path, value);
+    }
+    else if (!strcmp(setting, "host"))
+    {
+      if (!value[0] || strlen(value) >= MAXHOST)
+        return -1;
+      strcpy(host, value);
+    }
+    else if (!strcmp(setting, "mode"))
+    {
+      char * end;
+      long bits = strtol(value, &end, 8);
+      if (end == value || *end || bits < 0 || bits > 0777)
+        return -1;
+      mode = (mode_t) bits;
+    }
+    else if (!strcmp(setting, "oper"))
+    {
+      char * uidPtr;
+      char * uid = strtok_r(value, ":", &uidPtr);
+      numOpers = 0;
+      while (uid)
+      {
+        char * end;
+        long n = strtol(uid, &end, 10);
+        if (end == uid || *end || n < 0 || numOpers == LOCALMAXOPERS)
+          return -1;
+        opers[numOpers++] = (uid_t) n;
+        uid = strtok_r(NULL, ":", &uidPtr);
+      }
+    }
+    else
+      return -1;
+    setting = strtok_r(NULL, ",", &savePtr);
+  }
+  return 1;
+}
+
+
+/* local_listen:
+ * Starts listening on the configured local socket, replacing a
+ * socket left at its path by an earlier run; any other file there
+ * is left alone and the socket is not opened. Returns the
+ * listening socket, 0 if no path was configured, or -1 on failure.
+ */
+int local_listen(void)
+{
+  if (!path[0])
+    return 0;
+  struct sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, path);
+
+  struct stat old;
+  if (lstat(path, &old) == 0)
+  {
+    if (!S_ISSOCK(old.st_mode))
+    {
+      errno = EEXIST;
+      return -1;
+    }
+    unlink(path);
+  }
+
+  int listener = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (listener == -1)
+    return -1;
+  // the socket is created with its mode, so no one outside it can
+  // connect before it is set; no other thread runs yet to be
+  // affected by the umask
+  mode_t oldMask = umask(~mode & 0777);
+  int bound = bind(listener, (struct sockaddr *) &addr, sizeof(addr));
+  umask(oldMask);
+  if (bound == -1 || listen(listener, admit_backlog()) == -1)
+  {
+    close(listener);
+    return -1;
+  }
+  return listener;
+}
+
+
+/* is_oper:
+ * Returns 1 if connections from uid are made operators.
+ */
+static int is_oper(uid_t uid)
+{
+  for (int n = 0; n < numOpers; n++)
+    if (opers[n] == uid)
+      return 1;
+  return 0;
+}
+
+
+/* local_accept:
+ * Accepts one connection from listener. On success, returns the
+ * new socket, sets clientHost to a copy of the host name its user
+ * is given and oper to whether it starts as an operator. Returns
+ * -1 with errno set if there was no connection to accept.
+ */
+int local_accept(int listener, char ** clientHost, int * oper)
+{
+  int socket = accept4(listener, NULL, NULL, SOCK_CLOEXEC);
+  if (socket == -1)
+    return -1;
+  struct ucred cred;
+  socklen_t credLen = sizeof(cred);
+  *oper = 0;
+  if (numOpers && !getsockopt(socket, SOL_SOCKET, SO_PEERCRED, &cred, &credLen))
+    *oper = is_oper(cred.uid);
+  *clientHost = strdup(host);
+  return socket;
+}
@@ -0,0 +1,26 @@
+/*
+ *
+ *  CMSC 23300 / 33300 - Networks and Distributed Systems
+ *
+ *  Unix domain socket listener
+ *
+ */
+
+#ifndef LOCAL_H_
+#define LOCAL_H_
+
+#include <stdint.h>
+#include "structures.h"
+
+#define LOCALPATHLEN 108
+#define LOCALHOST "localhost"
+#define LOCALMODE 0660
+#define LOCALMAXOPERS 16
+// address admission control counts local clients under
+#define LOCALADDR 0
+
+int local_configure(char * spec);
+int local_listen(void);
+int local_accept(int listener, char ** clientHost, int * oper);
+
+#endif /* LOCAL_H_ */
@@ -5,6 +5,10 @@
  *  main() code for chirc project
  *
  */
+// for accept4
+#define _GNU_SOURCE
+#include <errno.h>
+#include <poll.h>
 #include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -17,12 +21,28 @@
 #include <sys/socket.h>
 #include <sys/types.h>
 #include <time.h>
+#include "admit.h"
+#include "budget.h"
 #include "command.h"
+#include "config.h"
+#include "drain.h"
+#include "epoch.h"
+#include "flood.h"
 #include "globalData.h"
+#include "input.h"
+#include "keepalive.h"
+#include "latency.h"
 #include "listfxns.h"
+#include "local.h"
+#include "modes.h"
+#include "netio.h"
 #include "parser.h"
 #include "reply.h"
+#include "server.h"
+#include "shard.h"
 #include "structures.h" 
+#include "timer.h"
+#include "trace.h"
 
 extern pthread_mutex_t lock;
 extern pthread_mutex_t chanLock;
@@ -43,20 +63,17 @@ void *run_client(void *args){
     num_pthreads++;
     pthread_mutex_unlock(&lock);
 
-    // setting total amount of chars buf can parse
-    // at a time. (Command max len is handled in break_commands)
-    int bufLen = 6000;
     // setting total amount of commands which can be parsed at
     // at time.
-    int commandBufLen = 250;
+    int commandBufLen = wa->servData->limits.maxCommands;
     int nbytes;
     int n;
-    char inputBuf[bufLen];
-    char buildBuf[bufLen];
     char **commandList;
-    int buildLen = 0;
-    memset(inputBuf, 0, bufLen);
-    memset(buildBuf, 0, bufLen);
+    int isServer = 0;
+    int isFlooding = 0;
+    int isRefused = 0;
+    char linkPasswd[MAXPASSWORD];
+    memset(linkPasswd, 0, MAXPASSWORD);
     commandList = (char **) malloc(COMMANDNUM*sizeof(char **));
     command_init(commandList);
     userInfo * info;
@@ -70,30 +87,49 @@ void *run_client(void *args){
       hostLen = MAXHOST;
     memcpy(info->host, clientHost, hostLen);
     info->host[hostLen] = '\0';
+    free(clientHost);
+    uint32_t clientAddr = wa->addr;
     info->socket = clientSocket;
+    if (wa->oper)
+      info->modes |= MODE_OPER;
 
     list_t * userList = wa->userList;
     list_t * chanList = wa->chanList;
     struct serverInfo * servData = wa->servData;
+    floodBucket bucket;
+    flood_init(&bucket, &servData->flood, clientSocket);
+    int traceId = trace_connection();
+    keepalive ka;
+    keepalive_start(&ka, info, servData);
+    netio_open(clientSocket);
+    // this thread sends what other threads queue for the client
+    netio_queue(clientSocket);
+    // the arrays each batch is parsed into, the socket's held
+    // output and the user's own record; the input buffer charges
+    // for itself as it grows and shrinks
+    budget_open(clientSocket, info);
+    // grows to the most chars parsed at a time (command max len
+    // is handled in break_commands)
+    inputBuffer input;
+    input_open(&input, clientSocket, servData->limits.inputBuffer);
+    budget_charge(clientSocket, BUDGET_INPUT,
+                  (COMMANDNUM + servData->limits.maxParams + commandBufLen) * sizeof(char *));
+    budget_charge(clientSocket, BUDGET_OUTPUT, netio_hold_size());
+    budget_charge(clientSocket, BUDGET_USER, sizeof(userInfo));
+    drainEntry drain;
+    drain_open(&drain, clientSocket);
+    int hasQuit = 0;
 
-    // collect input from client until disconnect
-    // build input buffer until buffer terminates with "\r\n"
-    while( (nbytes = recv(clientSocket, inputBuf, bufLen, 0)) )
+    // collect input from client until disconnect or error
+    // run commands as soon as whole lines of them have arrived
+    while( (nbytes = input_recv(&input)) > 0 )
     {
-      if (nbytes + buildLen > bufLen)
-        nbytes = bufLen - buildLen;
-      memcpy(buildBuf+buildLen, inputBuf, nbytes);
-      buildLen = buildLen + nbytes;
-      // handles case if string is too long for buffer
-      if ((buildBuf[bufLen-1]) && (buildBuf[bufLen-1]!='\n'))
+      trace_data(traceId, input.buf + input.len - nbytes, nbytes);
+      keepalive_touch(&ka);
+      int lineLen = input_lines(&input);
+      if (lineLen)
       {
-        buildBuf[bufLen-2]='\r';
-        buildBuf[bufLen-1]='\n';
-      }
-      // if input buffer ends with \r\n, parse buffer and run commands
-      if (buildBuf[buildLen-1]=='\n' && buildBuf[buildLen-2]=='\r')
-      {
-        int maxArgs = 15;
+        int maxArgs = servData->limits.maxParams;
         char ** argList;
 
         argList = (char **) malloc(maxArgs*sizeof(char *));
@@ -103,13 +139,24 @@ void *run_client(void *args){
 	      memset(cmndList, 0, sizeof(cmndList));
 
         // determine how many commands are stored in buffer
-        int numCmnds = break_commands(buildBuf, buildLen, cmndList);
+        int numCmnds = break_commands(input.buf, lineLen, cmndList);
         int command;
+        // replies to all of them go out together
+        netio_hold(clientSocket);
 
         for (n=0; n<numCmnds; n++)
         {
           int argNum = parser(cmndList[n], strlen(cmndList[n]), argList);
           command = command_search(argList[0], commandList);
+          // hold back commands over the client's rate limit
+          int targets = shard_targets(command, argList, argNum, servData);
+          if (flood_wait(&bucket, &servData->flood, command, targets, numCmnds - n - 1, lineLen / numCmnds) == -1)
+          {
+            netio_release(clientSocket);
+            flood_disconnect(info, userList, chanList);
+            isFlooding = 1;
+            break;
+          }
           if (command == -1)
           { 
             replyPackage reply;
@@ -127,47 +174,286 @@ void *run_client(void *args){
             send_response(clientSocket, &reply);
   
           }
+          else if (command == PASS)
+          {
+            // only used by servers, to authenticate a SERVER command
+            if (argNum > 1)
+            {
+              memset(linkPasswd, 0, MAXPASSWORD);
+              strncpy(linkPasswd, argList[1], MAXPASSWORD - 1);
+            }
+          }
+          else if (command == SERVER && (info->nickname[0] || info->username[0]))
+          {
+            // a client which has given NICK or USER stays a client
+            replyPackage reply;
+            memset(&reply, 0, sizeof(replyPackage));
+            memcpy(reply.serverName, servData->serverHost, strlen(servData->serverHost));
+            if (info->nickname[0])
+              memcpy(reply.nickname, info->nickname, strlen(info->nickname));
+            else
+              memcpy(reply.nickname, "*", 1);
+            memcpy(reply.responseCode, ERR_ALREADYREGISTRED, REPLYCODELEN);
+            send_response(clientSocket, &reply);
+          }
+          else if (command == SERVER && !server_password(linkPasswd, servData))
+          {
+            netio_line(clientSocket, "ERROR :Bad password", strlen("ERROR :Bad password"), NULL, 0);
+            isRefused = 1;
+            break;
+          }
+          else if (command == SERVER)
+          {
+            // connection is a server link from now on
+            pthread_mutex_lock(&lock);
+            num_pthreads--;
+            pthread_mutex_unlock(&lock);
+            isServer = 1;
+            keepalive_stop(&ka);
+            drain_close(&drain);
+            netio_release(clientSocket);
+            netio_unqueue(clientSocket);
+            // whatever followed the last whole line is the link's
+            server_accept(clientSocket, argList, argNum, linkPasswd, cmndList+n+1, numCmnds-n-1,
+                          input.buf + lineLen, input.len - lineLen, userList, chanList, servData);
+            break;
+          }
           else
-            run_command(command, argList, argNum, info, userList, chanList, servData);
+          {
+            shard_command(command, argList, argNum, info, userList, chanList, servData);
+            if (command == QUIT)
+              hasQuit = 1;
+          }
         }
+        netio_release(clientSocket);
         free(argList);
         free(cmndList);
-        buildLen = 0;
-        memset(inputBuf, 0, bufLen);
-        memset(buildBuf, 0, bufLen);
+        input_consume(&input, lineLen);
+        if (isServer || isFlooding || isRefused)
+          break;
       }
     }
+    trace_close(traceId);
+    keepalive_stop(&ka);
+    // clients which quit, flooded or became links are gone already
+    if (!hasQuit && !isFlooding && !isServer)
+    {
+      if (ka.expired)
+        keepalive_disconnect(&ka, userList, chanList);
+      else if (__atomic_load_n(&drain.drained, __ATOMIC_ACQUIRE))
+        drain_disconnect(info, userList, chanList);
+      else if (budget_evicted(clientSocket))
+        budget_disconnect(info, budget_evicted(clientSocket), userList, chanList);
+    }
+    input_close(&input);
+    netio_close(clientSocket);
+    budget_close(clientSocket);
+    drain_close(&drain);
+    // a link's socket is only closed once nothing above can be
+    // handed its number by a new connection
+    if (isServer)
+      close(clientSocket);
+    admit_release(clientAddr);
     free(wa);
 
-    pthread_mutex_lock(&lock);
-    num_pthreads--;
-    pthread_mutex_unlock(&lock);
+    if (!isServer)
+    {
+      pthread_mutex_lock(&lock);
+      num_pthreads--;
+      pthread_mutex_unlock(&lock);
+    }
     pthread_exit(NULL);
 }
 
 
+/* start_client:
+ * Starts a thread to run a newly accepted client. If none can be
+ * started, the client is told the server is full and closed.
+ */
+static void start_client(int clientSocket, char * clientHost, uint32_t addr, int oper, char * ip,
+                         list_t * userList, list_t * chanList, serverInfo * servData)
+{
+  pthread_t worker_thread;
+  struct workerArgs * wa = malloc(sizeof(struct workerArgs));
+  wa->socket = clientSocket;
+  wa->clientHost = clientHost;
+  wa->addr = addr;
+  wa->oper = oper;
+  wa->userList = userList;
+  wa->chanList = chanList;
+  wa->servData = servData;
+  if (pthread_create(&worker_thread, NULL, run_client, wa) != 0)
+  {
+    // out of threads, so treat the server as full
+    perror("Could not create a worker thread");
+    admit_release(addr);
+    admit_reject(clientSocket, ip, ADMIT_FULL);
+    free(clientHost);
+    free(wa);
+  }
+}
+
+
+/* accept_local:
+ * Accepts every connection queued on the local socket.
+ */
+static void accept_local(int localSocket, list_t * userList, list_t * chanList, serverInfo * servData)
+{
+  while (1)
+  {
+    char * clientHost;
+    int oper;
+    int clientSocket = local_accept(localSocket, &clientHost, &oper);
+    if (clientSocket == -1)
+    {
+      if (errno == EINTR || errno == ECONNABORTED)
+        continue;
+      if (errno != EAGAIN && errno != EWOULDBLOCK)
+        poll(NULL, 0, 10);
+      return;
+    }
+    int reason = budget_full() ? ADMIT_MEMORY : admit_check(LOCALADDR);
+    if (reason != ADMIT_OK)
+    {
+      admit_reject(clientSocket, clientHost, reason);
+      free(clientHost);
+      continue;
+    }
+    start_client(clientSocket, clientHost, LOCALADDR, oper, clientHost, userList, chanList, servData);
+  }
+}
+
+
+#define OPTIONS "c:s:p:o:n:l:a:f:k:i:u:w:t:h"
+
 int main(int argc, char *argv[])
 {
   time_t current_time;
   char * createdDate;
   int opt;
-  char *port = "6667", *passwd = NULL;
+  chircConfig config;
+  config_default(&config);
 
+  // load the configuration file first, so flags override it
+  opterr = 0;
+  while ((opt = getopt(argc, argv, OPTIONS)) != -1)
+    if (opt == 'c')
+    {
+      int line = config_load(&config, optarg);
+      if (line == -1)
+      {
+        printf("ERROR: Cannot read configuration file -c %s\n", optarg);
+        exit(-1);
+      }
+      if (line)
+      {
+        printf("ERROR: Invalid setting on line %i of %s\n", line, optarg);
+        exit(-1);
+      }
+    }
+  optind = 1;
+  opterr = 1;
 
-  while ((opt = getopt(argc, argv, "p:o:h")) != -1)
+  while ((opt = getopt(argc, argv, OPTIONS)) != -1)
     switch (opt)
     {
+      case 'c':
+        break;
+      case 's':
+      {
+        // any setting, as key=value
+        char * equals = strchr(optarg, '=');
+        if (equals)
+          *equals = '\0';
+        if (!equals || config_set(&config, optarg, equals + 1) == -1)
+        {
+          printf("ERROR: Invalid setting -s %s\n", optarg);
+          exit(-1);
+        }
+        break;
+      }
       case 'p':
-        port = strdup(optarg);
+        config_set(&config, "port", optarg);
         break;
       case 'o':
-        passwd = strdup(optarg);
+        config_set(&config, "password", optarg);
+        break;
+      case 'n':
+        config_set(&config, "name", optarg);
+        break;
+      case 'l':
+        // server to link to, as host:port
+        if (config_set(&config, "link", optarg) == -1)
+        {
+          printf("ERROR: Invalid link -l %s\n", optarg);
+          exit(-1);
+        }
+        break;
+      case 'a':
+        // admission control, as backlog=N,max=N,perip=N,rate=N
+        if (config_set(&config, "admit", optarg) == -1)
+        {
+          printf("ERROR: Invalid admission control -a %s\n", optarg);
+          exit(-1);
+        }
+        break;
+      case 'f':
+        // flood control, as rate=N,burst=N,msg=N,chan=N,query=N,abuse=N
+        if (config_set(&config, "flood", optarg) == -1)
+        {
+          printf("ERROR: Invalid flood control -f %s\n", optarg);
+          exit(-1);
+        }
+        break;
+      case 'k':
+        // keepalives, as ping=N,timeout=N,register=N in seconds
+        if (config_set(&config, "keepalive", optarg) == -1)
+        {
+          printf("ERROR: Invalid keepalive -k %s\n", optarg);
+          exit(-1);
+        }
+        break;
+      case 'i':
+        // socket output backend, send or uring
+        if (config_set(&config, "backend", optarg) == -1)
+        {
+          printf("ERROR: Unknown output backend -i %s\n", optarg);
+          exit(-1);
+        }
+        break;
+      case 'u':
+        // local socket, as path=PATH,host=NAME,mode=N,oper=UID:UID
+        if (config_set(&config, "unix", optarg) == -1)
+        {
+          printf("ERROR: Invalid local socket -u %s\n", optarg);
+          exit(-1);
+        }
+        break;
+      case 'w':
+        // worker threads owning channels, 0 for none
+        if (config_set(&config, "workers", optarg) == -1)
+        {
+          printf("ERROR: Invalid number of workers -w %s\n", optarg);
+          exit(-1);
+        }
+        break;
+      case 't':
+        // record client traffic to a trace file
+        config_set(&config, "trace", optarg);
         break;
       default:
         printf("ERROR: Unknown option -%c\n", opt);
         exit(-1);
     }
 
+  if (config.trace && trace_open(config.trace) == -1)
+  {
+    printf("ERROR: Cannot write trace %s\n", config.trace);
+    exit(-1);
+  }
+  char *port = config.port, *passwd = config.passwd, *serverName = config.serverName;
+  parser_limits(config.limits.maxParams, config.limits.maxCommands, config.limits.lineLen);
+
   if (!passwd)
   {
     fprintf(stderr, "ERROR: You must specify an operator password\n");
@@ -196,21 +482,33 @@ int main(int argc, char *argv[])
   gethostname(hostname, 1023);
   heServ = gethostbyname(hostname);
   memcpy(servData->passwd, passwd, strlen(passwd));
-  memcpy(servData->serverHost, heServ->h_name, strlen(heServ->h_name));
+  servData->flood = config.flood;
+  servData->keepalive = config.keepalive;
+  servData->limits = config.limits;
+  // servers sharing a host must be given distinct names to be linked
+  if (serverName)
+    memcpy(servData->serverHost, serverName, strnlen(serverName, MAXHOST - 1));
+  else
+    memcpy(servData->serverHost, heServ->h_name, strlen(heServ->h_name));
   char serverVersion[] = "version2";
   memcpy(servData->serverVersion, serverVersion, strlen(serverVersion));
   current_time = time(NULL);
   createdDate = ctime(&current_time);
   memcpy(servData->createdDate, createdDate, strlen(createdDate));
-  char userModes[] = "ao";
-  memcpy(servData->userModes, userModes, strlen(userModes));
-  char chanModes[] = "mtov";
-  memcpy(servData->chanModes, chanModes, strlen(chanModes));
+  mode_render(MODEUSER, ~0u, servData->userModes);
+  int chanModesLen = mode_render(MODECHANNEL, ~0u, servData->chanModes);
+  mode_render(MODEMEMBER, ~0u, servData->chanModes + chanModesLen);
 
-  serverSocket = socket(PF_INET, SOCK_STREAM, IPPROTO_TCP);
+  serverSocket = socket(PF_INET, SOCK_STREAM | SOCK_NONBLOCK, IPPROTO_TCP);
   setsockopt(serverSocket, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(int));
   bind(serverSocket, (struct sockaddr *) &serverAddr, sizeof(serverAddr));
-  listen(serverSocket, 5);
+  listen(serverSocket, admit_backlog());
+  int localSocket = local_listen();
+  if (localSocket == -1)
+  {
+    perror("ERROR: Cannot listen on the local socket");
+    exit(-1);
+  }
 
   // initialize global list of users
   list_t * userList = (list_t *) malloc(sizeof(list_t));
@@ -240,35 +538,120 @@ int main(int argc, char *argv[])
   list_append(chanList, newChannel);
   list_sort(chanList, 1);
 */
-  struct workerArgs *wa;
-
   pthread_mutex_init(&lock, NULL);
   pthread_mutex_init(&chanLock, NULL);
+  epoch_init();
+  budget_init();
+  latency_init();
+  server_init();
+  if (timer_init() == -1)
+  {
+    fprintf(stderr, "ERROR: Could not start timer thread\n");
+    exit(-1);
+  }
+  if (netio_init(config.backend, config.ringEntries) != config.backend)
+    fprintf(stderr, "io_uring unavailable, sending with %s\n", netio_name());
+  if (netio_zerocopy() == -1)
+    fprintf(stderr, "MSG_ZEROCOPY unavailable, copying output\n");
+  if (shard_init(config.workers) == -1)
+  {
+    fprintf(stderr, "ERROR: Could not start channel workers\n");
+    exit(-1);
+  }
 
+  // link to the servers given with -l
+  for (int i = 0; i < config.numLinks; i++)
+  {
+    linkTarget * target = (linkTarget *) malloc(sizeof(linkTarget));
+    memset(target, 0, sizeof(linkTarget));
+    char * colon = strrchr(config.links[i], ':');
+    *colon = '\0';
+    strncpy(target->host, config.links[i], MAXHOST - 1);
+    strncpy(target->port, colon + 1, sizeof(target->port) - 1);
+    target->userList = userList;
+    target->chanList = chanList;
+    target->servData = servData;
+    if (pthread_create(&worker_thread, NULL, server_connect, target) != 0)
+    {
+      perror("Could not create a link thread");
+      exit(-1);
+    }
+  }
+
+  int drainFd = drain_init();
+  if (drainFd == -1)
+  {
+    perror("ERROR: Cannot set up draining");
+    exit(-1);
+  }
+  struct pollfd listeners[3];
+  int numListeners = 2;
+  listeners[0].fd = serverSocket;
+  listeners[0].events = POLLIN;
+  listeners[1].fd = drainFd;
+  listeners[1].events = POLLIN;
+  if (localSocket)
+  {
+    listeners[2].fd = localSocket;
+    listeners[2].events = POLLIN;
+    numListeners = 3;
+  }
   while(1)
   {
-    clientSocket = accept(serverSocket, (struct sockaddr *) &clientAddr, &sinSize);
-    setsockopt(clientSocket, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(int));
-    // retrieve client hostname
-    struct hostent *he;
-    struct in_addr ipv4addr;
-    char *IP = inet_ntoa(clientAddr.sin_addr);
-    inet_pton(AF_INET, IP, &ipv4addr);
-    he = gethostbyaddr(&ipv4addr, sizeof(ipv4addr), AF_INET);
-    char *clientHost = he->h_name;
-    // pass on arguments to worker thread
-    wa = malloc(sizeof(struct workerArgs));
-    wa->socket = clientSocket;
-    wa->clientHost = clientHost;
-    wa->userList = userList;
-    wa->chanList = chanList;
-    wa->servData = servData;
-    if(pthread_create(&worker_thread, NULL, run_client, wa) != 0)
+    poll(listeners, numListeners, -1);
+    if (listeners[1].revents)
     {
-      perror("Could not create a worker thread");
-      free(wa);
-      close(clientSocket);
-      pthread_exit(NULL);
+      // refuse new connections at once, then let clients go gradually
+      close(serverSocket);
+      if (localSocket)
+        close(localSocket);
+      fprintf(stderr, "Draining clients\n");
+      fprintf(stderr, "Drained %i clients\n", drain_run());
+      exit(0);
+    }
+    if (numListeners > 2 && listeners[2].revents)
+      accept_local(localSocket, userList, chanList, servData);
+    if (!listeners[0].revents)
+      continue;
+    // accept every connection already queued before polling again
+    while (1)
+    {
+      int wait = admit_throttle();
+      if (wait)
+      {
+        poll(NULL, 0, wait);
+        continue;
+      }
+      sinSize = sizeof(struct sockaddr_in);
+      clientSocket = accept4(serverSocket, (struct sockaddr *) &clientAddr, &sinSize, SOCK_CLOEXEC);
+      if (clientSocket == -1)
+      {
+        if (errno == EINTR || errno == ECONNABORTED)
+          continue;
+        // out of descriptors or memory, give clients time to leave
+        if (errno != EAGAIN && errno != EWOULDBLOCK)
+          poll(NULL, 0, 10);
+        break;
+      }
+      admit_accepted();
+      char *IP = inet_ntoa(clientAddr.sin_addr);
+      // turn connections away before anything is set up for them
+      int reason = budget_full() ? ADMIT_MEMORY : admit_check(clientAddr.sin_addr.s_addr);
+      if (reason != ADMIT_OK)
+      {
+        admit_reject(clientSocket, IP, reason);
+        continue;
+      }
+      setsockopt(clientSocket, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(int));
+      // retrieve client hostname
+      struct hostent *he;
+      struct in_addr ipv4addr;
+      inet_pton(AF_INET, IP, &ipv4addr);
+      he = gethostbyaddr(&ipv4addr, sizeof(ipv4addr), AF_INET);
+      // the next lookup reuses he, so the worker gets its own copy
+      char *clientHost = strdup(he ? he->h_name : IP);
+      start_client(clientSocket, clientHost, clientAddr.sin_addr.s_addr, 0, IP,
+                   userList, chanList, servData);
     }
   }
   close(serverSocket);
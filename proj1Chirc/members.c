@@ -0,0 +1,163 @@
+/*
+ *
+ *  CMSC 23300 / 33300 - Networks and Distributed Systems
+ *
+ *  Channel Member Snapshot Functions
+ *
+ *  Besides its userList, every channel publishes the sockets of
+ *  its local members as an immutable array. Channel messages are
+ *  fanned out over that array inside an epoch read section, with
+ *  no lock taken. Whenever a local user joins or leaves, the
+ *  channel's userList is changed as before, under chanUserLock,
+ *  and a new array is published in place of the old one, which
+ *  is freed once no sender can still be using it.
+ *
+ *  A line for everyone who can see a user, such as a QUIT or a
+ *  NICK, goes to the sockets of all the user's channels. They are
+ *  gathered from the snapshots into one set, which is sorted so
+ *  members who share several channels are in it once, and the
+ *  line is sent over the set once no lock is held any more. The
+ *  set only ever takes as much memory as the sockets it holds; if
+ *  it cannot grow, the members of the snapshot which did not fit
+ *  are sent to straight away, and may get the line twice.
+ *
+ */
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include "epoch.h"
+#include "members.h"
+#include "simclist.h"
+#include "structures.h"
+
+// sockets a set has room for when it is first grown
+#define MEMBERSETSIZE 64
+
+
+/* members_init:
+ * Gives a new channel an empty member snapshot. Must be called
+ * before the channel is copied into the channel list.
+ */
+void members_init(channelData * channel)
+{
+  channel->members = (memberSnapshot **) malloc(sizeof(memberSnapshot *));
+  *channel->members = NULL;
+}
+
+
+/* members_publish:
+ * Replaces the member snapshot of channel with one built from
+ * its userList. Caller must hold the channel's chanUserLock.
+ */
+void members_publish(channelData * channel)
+{
+  if (channel->members == NULL)
+    return;
+  memberSnapshot * snapshot = NULL;
+  int numMembers = list_size(channel->userList);
+  if (numMembers)
+  {
+    snapshot = (memberSnapshot *) malloc(sizeof(memberSnapshot) + numMembers * sizeof(int));
+    snapshot->numMembers = 0;
+    list_iterator_start(channel->userList);
+    while (list_iterator_hasnext(channel->userList))
+    {
+      userInfo * user = (userInfo *) list_iterator_next(channel->userList);
+      if (!user->remote)
+        snapshot->sockets[snapshot->numMembers++] = user->socket;
+    }
+    list_iterator_stop(channel->userList);
+  }
+  memberSnapshot * old = __atomic_exchange_n(channel->members, snapshot, __ATOMIC_ACQ_REL);
+  epoch_retire(old);
+}
+
+
+/* members_free:
+ * Frees the member snapshot of a channel which is being removed,
+ * once no sender can still be using it.
+ */
+void members_free(channelData * channel)
+{
+  if (channel->members == NULL)
+    return;
+  epoch_retire(__atomic_exchange_n(channel->members, NULL, __ATOMIC_ACQ_REL));
+  epoch_retire(channel->members);
+  channel->members = NULL;
+}
+
+
+/* members_read:
+ * Returns the current member snapshot of channel, or NULL if
+ * it has no local members. Must be called between epoch_enter
+ * and epoch_exit, and the snapshot must not be used after.
+ */
+memberSnapshot * members_read(channelData * channel)
+{
+  if (channel->members == NULL)
+    return NULL;
+  return __atomic_load_n(channel->members, __ATOMIC_ACQUIRE);
+}
+
+
+/* sockets_compar:
+ * Orders two sockets, for qsort.
+ */
+static int sockets_compar(const void * a, const void * b)
+{
+  return *(const int *) a - *(const int *) b;
+}
+
+
+/* members_gather:
+ * Adds the sockets of the members in snapshot to set, growing it
+ * as needed. Returns -1, leaving set as it was, if the set cannot
+ * grow; the caller must then reach those members some other way.
+ */
+int members_gather(memberSet * set, memberSnapshot * snapshot)
+{
+  if (snapshot == NULL)
+    return 0;
+  if (set->numSockets + snapshot->numMembers > set->size)
+  {
+    int size = set->size ? set->size : MEMBERSETSIZE;
+    while (size < set->numSockets + snapshot->numMembers)
+      size *= 2;
+    int * sockets = (int *) realloc(set->sockets, size * sizeof(int));
+    if (sockets == NULL)
+      return -1;
+    set->sockets = sockets;
+    set->size = size;
+  }
+  for (int i = 0; i < snapshot->numMembers; i++)
+    set->sockets[set->numSockets++] = snapshot->sockets[i];
+  return 0;
+}
+
+
+/* members_unique:
+ * Sorts the sockets of set and leaves each of them in it once.
+ */
+void members_unique(memberSet * set)
+{
+  if (set->numSockets == 0)
+    return;
+  qsort(set->sockets, set->numSockets, sizeof(int), sockets_compar);
+  int numUnique = 1;
+  for (int i = 1; i < set->numSockets; i++)
+  {
+    if (set->sockets[i] != set->sockets[numUnique - 1])
+      set->sockets[numUnique++] = set->sockets[i];
+  }
+  set->numSockets = numUnique;
+}
+
+
+/* members_release:
+ * Frees the sockets of set, leaving it empty.
+ */
+void members_release(memberSet * set)
+{
+  free(set->sockets);
+  memset(set, 0, sizeof(memberSet));
+}
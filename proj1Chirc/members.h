@@ -0,0 +1,32 @@
+/*
+ *
+ *  CMSC 23300 / 33300 - Networks and Distributed Systems
+ *
+ *  Channel member snapshots
+ *
+ */
+
+#ifndef MEMBERS_H_
+#define MEMBERS_H_
+
+#include "structures.h"
+
+// sockets of the members of one or more channels
+struct memberSet
+{
+  int numSockets;
+  int size;
+  int * sockets;
+};
+
+typedef struct memberSet memberSet;
+
+void members_init(channelData * channel);
+void members_publish(channelData * channel);
+void members_free(channelData * channel);
+memberSnapshot * members_read(channelData * channel);
+int members_gather(memberSet * set, memberSnapshot * snapshot);
+void members_unique(memberSet * set);
+void members_release(memberSet * set);
+
+#endif /* MEMBERS_H_ */
@@ -0,0 +1,79 @@
+/*
+ *
+ *  CMSC 23300 / 33300 - Networks and Distributed Systems
+ *
+ *  Mode Functions
+ *
+ *  Users, channels and memberships keep their modes as bitmasks,
+ *  so checking a mode on the message path is one AND. The tables
+ *  in modes.h are expanded here into a lookup from each letter to
+ *  its bit, and into the letters of each table in order, which is
+ *  all MODE parsing and mode replies need.
+ *
+ */
+#include "modes.h"
+
+
+#define MODE_ENTRY(letter, name) [letter] = MODE_##name,
+#define MODE_LETTER(letter, name) letter,
+
+static const unsigned int bits[MODEKINDS][128] =
+{
+  [MODEUSER] = { USER_MODES(MODE_ENTRY) },
+  [MODECHANNEL] = { CHANNEL_MODES(MODE_ENTRY) },
+  [MODEMEMBER] = { MEMBER_MODES(MODE_ENTRY) }
+};
+
+static const char letters[MODEKINDS][MODEMAXLETTERS] =
+{
+  [MODEUSER] = { USER_MODES(MODE_LETTER) },
+  [MODECHANNEL] = { CHANNEL_MODES(MODE_LETTER) },
+  [MODEMEMBER] = { MEMBER_MODES(MODE_LETTER) }
+};
+
+_Static_assert(NUMUSERMODES < MODEMAXLETTERS && NUMCHANNELMODES < MODEMAXLETTERS &&
+               NUMMEMBERMODES < MODEMAXLETTERS, "too many modes in one table");
+
+
+/* mode_bit:
+ * Returns the bit of the mode letter stands for in the table
+ * kind, or 0 if there is no such mode.
+ */
+unsigned int mode_bit(int kind, char letter)
+{
+  unsigned char c = (unsigned char) letter;
+  if (c >= 128)
+    return 0;
+  return bits[kind][c];
+}
+
+
+/* mode_parse:
+ * Returns the bits of the modes listed in list, such as "ao",
+ * from the table kind. Letters with no mode are ignored.
+ */
+unsigned int mode_parse(int kind, const char * list)
+{
+  unsigned int modes = 0;
+  for (; *list; list++)
+    modes |= mode_bit(kind, *list);
+  return modes;
+}
+
+
+/* mode_render:
+ * Writes the letters of the modes set in modes, from the table
+ * kind, to out in table order, followed by a NUL. out must
+ * hold MODEMAXLETTERS bytes. Returns the number of letters.
+ */
+int mode_render(int kind, unsigned int modes, char * out)
+{
+  int len = 0;
+  for (int n = 0; letters[kind][n]; n++)
+  {
+    if (modes & (1u << n))
+      out[len++] = letters[kind][n];
+  }
+  out[len] = '\0';
+  return len;
+}
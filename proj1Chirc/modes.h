@@ -0,0 +1,53 @@
+/*
+ *
+ *  CMSC 23300 / 33300 - Networks and Distributed Systems
+ *
+ *  User, channel and membership modes
+ *
+ */
+
+#ifndef MODES_H_
+#define MODES_H_
+
+/* Mode tables
+ *
+ * Each mode is M(letter, name). USER_MODES are set on users,
+ * CHANNEL_MODES on channels and MEMBER_MODES on a user's place in
+ * one channel. Every mode gets the bit MODE_<name> of the modes
+ * field it is kept in, numbered in table order, and modes are
+ * listed in table order wherever they are shown. A new mode only
+ * needs a line here, and a handler for what it does.
+ */
+#define USER_MODES(M) \
+  M('a', AWAY) \
+  M('o', OPER)
+
+#define CHANNEL_MODES(M) \
+  M('m', MODERATED) \
+  M('t', TOPICLOCK)
+
+#define MEMBER_MODES(M) \
+  M('o', CHANOP) \
+  M('v', VOICE)
+
+// the table a mode letter is looked up in
+#define MODEUSER 0
+#define MODECHANNEL 1
+#define MODEMEMBER 2
+#define MODEKINDS 3
+// most modes in one table, and so letters in a rendered list
+#define MODEMAXLETTERS 32
+
+#define MODE_INDEX(letter, name) MODEINDEX_##name,
+enum { USER_MODES(MODE_INDEX) NUMUSERMODES };
+enum { CHANNEL_MODES(MODE_INDEX) NUMCHANNELMODES };
+enum { MEMBER_MODES(MODE_INDEX) NUMMEMBERMODES };
+
+#define MODE_BIT(letter, name) MODE_##name = 1u << MODEINDEX_##name,
+enum { USER_MODES(MODE_BIT) CHANNEL_MODES(MODE_BIT) MEMBER_MODES(MODE_BIT) };
+
+unsigned int mode_bit(int kind, char letter);
+unsigned int mode_parse(int kind, const char * list);
+int mode_render(int kind, unsigned int modes, char * out);
+
+#endif /* MODES_H_ */
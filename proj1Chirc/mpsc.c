@@ -0,0 +1,77 @@
+/*
+ *
+ *  CMSC 23300 / 33300 - Networks and Distributed Systems
+ *
+ *  Lock-free Queue Functions
+ *
+ *  An intrusive multiple producer, single consumer queue: callers
+ *  embed an mpscNode in whatever they queue. Any thread may push
+ *  with one atomic exchange, but only the thread which owns the
+ *  queue may pop. The queue always holds a stub node, so pushing
+ *  never has to touch the consumer's end.
+ *
+ */
+#include <stddef.h>
+#include "mpsc.h"
+
+
+/* mpsc_init:
+ * Sets up an empty queue.
+ */
+void mpsc_init(mpscQueue * queue)
+{
+  queue->stub.next = NULL;
+  queue->head = &queue->stub;
+  queue->tail = &queue->stub;
+}
+
+
+/* mpsc_push:
+ * Adds node to the back of the queue. Safe to call from
+ * any number of threads at once.
+ */
+void mpsc_push(mpscQueue * queue, mpscNode * node)
+{
+  __atomic_store_n(&node->next, NULL, __ATOMIC_RELAXED);
+  mpscNode * prev = __atomic_exchange_n(&queue->head, node, __ATOMIC_ACQ_REL);
+  __atomic_store_n(&prev->next, node, __ATOMIC_RELEASE);
+}
+
+
+/* mpsc_pop:
+ * Removes and returns the node at the front of the queue, or
+ * NULL if it is empty. NULL is also returned while a producer
+ * is halfway through pushing the only node, so a consumer told
+ * a node is coming should try again. Only the owning thread
+ * may call this.
+ */
+mpscNode * mpsc_pop(mpscQueue * queue)
+{
+  mpscNode * tail = queue->tail;
+  mpscNode * next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+  // step over the stub
+  if (tail == &queue->stub)
+  {
+    if (next == NULL)
+      return NULL;
+    queue->tail = next;
+    tail = next;
+    next = __atomic_load_n(&next->next, __ATOMIC_ACQUIRE);
+  }
+  if (next)
+  {
+    queue->tail = next;
+    return tail;
+  }
+  // tail is the last node unless a push is in progress
+  if (tail != __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE))
+    return NULL;
+  mpsc_push(queue, &queue->stub);
+  next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+  if (next)
+  {
+    queue->tail = next;
+    return tail;
+  }
+  return NULL;
+}
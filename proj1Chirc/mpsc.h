@@ -0,0 +1,32 @@
+/*
+ *
+ *  CMSC 23300 / 33300 - Networks and Distributed Systems
+ *
+ *  Lock-free multiple producer, single consumer queue
+ *
+ */
+
+#ifndef MPSC_H_
+#define MPSC_H_
+
+struct mpscNode
+{
+  struct mpscNode * next;
+};
+
+typedef struct mpscNode mpscNode;
+
+struct mpscQueue
+{
+  mpscNode * head;
+  mpscNode * tail;
+  mpscNode stub;
+};
+
+typedef struct mpscQueue mpscQueue;
+
+void mpsc_init(mpscQueue * queue);
+void mpsc_push(mpscQueue * queue, mpscNode * node);
+mpscNode * mpsc_pop(mpscQueue * queue);
+
+#endif /* MPSC_H_ */
@@ -0,0 +1,1528 @@
+/*
+ *
+ *  CMSC 23300 / 33300 - Networks and Distributed Systems
+ *
+ *  Socket Output Functions
+ *
+ *  Every line sent to a client goes through netio_line, which
+ *  writes the parts of the line and its "\r\n" with a single
+ *  sendmsg() instead of one send() per part.
+ *
+ *  When built with HAVE_IO_URING and started with the io_uring
+ *  backend, lines sent between netio_batch_start and
+ *  netio_batch_flush (such as a message fanned out to every member
+ *  of a channel) are queued on the sending thread's own io_uring
+ *  and submitted together with one io_uring_enter() call. Each
+ *  thread sets up its ring the first time it opens a batch; if
+ *  that fails the thread falls back to sendmsg().
+ *
+ *  While a client thread handles the commands of one recv(), it
+ *  holds its socket's output: every line for that socket, from
+ *  whichever thread, is copied into the socket's hold buffer, and
+ *  the whole burst (registration, or a JOIN with its topic and
+ *  names) goes out with one send() when the thread releases it.
+ *  A full buffer is sent early. An optional flush timer sends
+ *  what is held if a batch runs long, and TCP_CORK can be set
+ *  while output is held.
+ *
+ *  Sockets whose output is held are set TCP_NODELAY. A burst is
+ *  already sent in as few pieces as the hold buffer allows, and
+ *  Nagle's algorithm would only keep its last, short piece back
+ *  until the client's delayed ACK of the piece before, some 40ms
+ *  on Linux.
+ *
+ *  Optionally, a message fanned out to a large channel is sent
+ *  with MSG_ZEROCOPY: netio_share copies the line once into a
+ *  shared, reference counted buffer, and the kernel sends every
+ *  member's copy straight from its pages instead of copying it
+ *  into each socket buffer. The kernel reports on each socket's
+ *  error queue once it is done with a send, and only then is the
+ *  send's reference dropped, so the buffer lives until the last
+ *  send completes. Completions are read before the next zerocopy
+ *  send on a socket, by a timer while any are outstanding, and by
+ *  netio_close. Lines go out copied as before if the kernel has no
+ *  MSG_ZEROCOPY, the socket refuses it, or too many of the
+ *  socket's sends are still outstanding.
+ *
+ *  With output queueing turned on, lines one thread sends to a
+ *  socket read by another are not written by the sender at all:
+ *  they are copied onto the socket's outbound queue, a lock-free
+ *  multiple producer, single consumer queue, and the thread which
+ *  reads the socket (its owner) sends them. So any number of
+ *  threads can fan out to a popular user without fighting over a
+ *  mutex or blocking on a slow client's socket. Owners wait in
+ *  netio_recv on both their socket and an eventfd; a producer only
+ *  writes the eventfd if no wakeup is pending yet, so a burst of
+ *  lines costs the owner one wakeup. An owner sends everything
+ *  queued before its own lines, so replies to the commands it runs
+ *  on worker threads keep their order. Queued lines are charged to
+ *  the socket's memory budget until they are sent, and a line
+ *  there is no memory to queue is dropped and counted. A line
+ *  fanned out with MSG_ZEROCOPY is queued as a reference to its
+ *  shared buffer, and the owner makes the zerocopy send.
+ *
+ *  Otherwise input is unaffected: each client thread keeps blocking
+ *  in recv() on its own socket.
+ *
+ */
+#include <errno.h>
+#include <limits.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <sys/eventfd.h>
+#ifdef SO_ZEROCOPY
+#include <linux/errqueue.h>
+#endif
+#ifdef HAVE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+#include "budget.h"
+#include "mpsc.h"
+#include "netio.h"
+#include "timer.h"
+
+
+struct netioHold
+{
+  pthread_mutex_t mutex;
+  timerEntry timer;
+  int socket;
+  int held;
+  int len;
+  char * buf;
+};
+
+typedef struct netioHold netioHold;
+
+// a line fanned out with MSG_ZEROCOPY
+struct netioShared
+{
+  int refs;
+  int len;
+  char data[];
+};
+
+typedef struct netioShared netioShared;
+
+#define ZC_UNSET 0
+#define ZC_ON 1
+#define ZC_REFUSED 2
+
+// the zerocopy sends of one socket awaiting completion
+struct netioZc
+{
+  pthread_mutex_t mutex;
+  timerEntry timer;
+  int socket;
+  // the connection on socket the state belongs to, see netio_open
+  unsigned generation;
+  int state;
+  // notification id of the socket's next zerocopy send
+  uint32_t next;
+  int pending;
+  // by notification id modulo NETIOZCPENDING
+  netioShared * sent[NETIOZCPENDING];
+  uint32_t ids[NETIOZCPENDING];
+};
+
+typedef struct netioZc netioZc;
+
+// a line on a socket's outbound queue, "\r\n" included; a line
+// being sent with MSG_ZEROCOPY is not copied but shared
+struct netioQueued
+{
+  mpscNode node;
+  int len;
+  char * data;
+  netioShared * shared;
+  char copy[];
+};
+
+typedef struct netioQueued netioQueued;
+
+// the outbound queue of a socket, drained by the thread reading it
+struct netioOut
+{
+  mpscQueue queue;
+  // what the owning thread waits on along with the socket
+  int wakeFd;
+  // set while a wakeup is pending, so producers write wakeFd once
+  int woken;
+  int open;
+};
+
+typedef struct netioOut netioOut;
+
+static int backend = NETIO_SEND;
+static int ringEntries = NETIORING;
+// set while the calling thread has a batch open
+static __thread int batching = 0;
+static int holdOutput = 1;
+static int holdSize = NETIOHOLD;
+static int holdFlushMs = 0;
+static int holdCork = 0;
+static int holdNoDelay = 1;
+// one hold for each descriptor which has held output, by descriptor
+static netioHold ** holds = NULL;
+static int numHolds = 0;
+// 1 if fan-outs may use MSG_ZEROCOPY, -1 if asked for but unavailable
+static int zerocopy = 0;
+static int zcBytes = NETIOZCBYTES;
+static int zcMembers = NETIOZCMEMBERS;
+static int queueOutput = 0;
+// one queue for each descriptor which has queued output, by descriptor
+static netioOut ** outs = NULL;
+static int numOuts = 0;
+// the socket whose outbound queue the calling thread drains
+static __thread int ownSocket = -1;
+// zerocopy state for each descriptor sent to with it, by descriptor
+static netioZc ** zcs = NULL;
+static int numZcs = 0;
+static netioZcStats zcStats;
+// numbers each connection opened, and the calling thread's
+static unsigned generations = 0;
+static __thread unsigned ownGeneration = 0;
+// lines not queued for want of memory
+static long queueDrops = 0;
+// the line of the calling thread's batch being sent with MSG_ZEROCOPY
+static __thread netioShared * share = NULL;
+static __thread char * shareBegin = NULL;
+static __thread char * shareEnd = NULL;
+
+
+/* send_rest:
+ * Sends whatever is left of msg once sent bytes of it have
+ * already gone out. Returns -1 if the socket fails.
+ */
+static int send_rest(int socket, struct msghdr * msg, ssize_t sent)
+{
+  while (1)
+  {
+    while (msg->msg_iovlen && (size_t) sent >= msg->msg_iov[0].iov_len)
+    {
+      sent -= msg->msg_iov[0].iov_len;
+      msg->msg_iov++;
+      msg->msg_iovlen--;
+    }
+    if (!msg->msg_iovlen)
+      return 1;
+    msg->msg_iov[0].iov_base = (char *) msg->msg_iov[0].iov_base + sent;
+    msg->msg_iov[0].iov_len -= sent;
+    sent = sendmsg(socket, msg, MSG_NOSIGNAL);
+    if (sent == -1 && errno != EINTR)
+      return -1;
+    if (sent == -1)
+      sent = 0;
+  }
+}
+
+
+/* fill_line:
+ * Points msg at the parts of a line and its "\r\n".
+ */
+static void fill_line(struct msghdr * msg, struct iovec * iov, char * begin, int beginLen, char * end, int endLen)
+{
+  static char crlf[] = "\r\n";
+  int n = 0;
+  iov[n].iov_base = begin;
+  iov[n++].iov_len = beginLen;
+  if (end && endLen)
+  {
+    iov[n].iov_base = end;
+    iov[n++].iov_len = endLen;
+  }
+  iov[n].iov_base = crlf;
+  iov[n++].iov_len = 2;
+  memset(msg, 0, sizeof(struct msghdr));
+  msg->msg_iov = iov;
+  msg->msg_iovlen = n;
+}
+
+
+/* hold_send:
+ * Sends everything held for a socket. Must be called with
+ * the hold's mutex locked.
+ */
+static void hold_send(netioHold * hold)
+{
+  struct msghdr msg;
+  struct iovec iov;
+  iov.iov_base = hold->buf;
+  iov.iov_len = hold->len;
+  memset(&msg, 0, sizeof(struct msghdr));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  send_rest(hold->socket, &msg, 0);
+  hold->len = 0;
+}
+
+
+/* hold_append:
+ * Adds a line to what is held for a socket, sending what is
+ * held first if the line does not fit. Must be called with the
+ * hold's mutex locked.
+ */
+static void hold_append(netioHold * hold, char * begin, int beginLen, char * end, int endLen)
+{
+  if (!end)
+    endLen = 0;
+  int lineLen = beginLen + endLen + 2;
+  if (hold->len + lineLen > holdSize)
+    hold_send(hold);
+  if (lineLen > holdSize)
+  {
+    struct msghdr msg;
+    struct iovec iov[3];
+    fill_line(&msg, iov, begin, beginLen, end, endLen);
+    send_rest(hold->socket, &msg, 0);
+    return;
+  }
+  char * out = hold->buf + hold->len;
+  memcpy(out, begin, beginLen);
+  if (endLen)
+    memcpy(out + beginLen, end, endLen);
+  out[beginLen + endLen] = '\r';
+  out[beginLen + endLen + 1] = '\n';
+  hold->len += lineLen;
+}
+
+
+/* hold_timeout:
+ * Timer callback which sends what has been held for too long,
+ * as far as the socket takes it without blocking.
+ */
+static long hold_timeout(void * arg)
+{
+  netioHold * hold = (netioHold *) arg;
+  // timer callbacks must not block; try again next tick
+  if (pthread_mutex_trylock(&hold->mutex))
+    return holdFlushMs;
+  if (hold->held && hold->len)
+  {
+    ssize_t sent = send(hold->socket, hold->buf, hold->len, MSG_DONTWAIT | MSG_NOSIGNAL);
+    if (sent > 0)
+    {
+      memmove(hold->buf, hold->buf + sent, hold->len - sent);
+      hold->len -= sent;
+    }
+  }
+  long again = hold->held ? holdFlushMs : 0;
+  pthread_mutex_unlock(&hold->mutex);
+  return again;
+}
+
+
+/* find_hold:
+ * Returns the hold of socket if its output is being held,
+ * or NULL.
+ */
+static netioHold * find_hold(int socket)
+{
+  if (socket < 0 || socket >= numHolds)
+    return NULL;
+  netioHold * hold = __atomic_load_n(&holds[socket], __ATOMIC_ACQUIRE);
+  if (hold && __atomic_load_n(&hold->held, __ATOMIC_RELAXED))
+    return hold;
+  return NULL;
+}
+
+
+/* find_out:
+ * Returns the outbound queue of socket if its output is being
+ * queued, or NULL.
+ */
+static netioOut * find_out(int socket)
+{
+  if (socket < 0 || socket >= numOuts)
+    return NULL;
+  netioOut * out = __atomic_load_n(&outs[socket], __ATOMIC_ACQUIRE);
+  if (out && __atomic_load_n(&out->open, __ATOMIC_ACQUIRE))
+    return out;
+  return NULL;
+}
+
+
+#ifdef SO_ZEROCOPY
+static void shared_put(netioShared * shared);
+static int zc_send(int socket, netioShared * shared);
+#endif
+
+
+/* out_push:
+ * Puts a line on the outbound queue of socket, waking its owner
+ * unless a wakeup is already pending. The line is copied, unless
+ * it is shared, when the queue takes a reference to it instead.
+ * A line there is no memory for is dropped and counted.
+ */
+static void out_push(netioOut * out, int socket, char * begin, int beginLen, char * end, int endLen, netioShared * shared)
+{
+  if (!end)
+    endLen = 0;
+  int lineLen = beginLen + endLen + 2;
+  int copyLen = shared ? 0 : lineLen;
+  netioQueued * line = (netioQueued *) malloc(sizeof(netioQueued) + copyLen);
+  if (line == NULL)
+  {
+    __atomic_add_fetch(&queueDrops, 1, __ATOMIC_RELAXED);
+    return;
+  }
+  line->len = lineLen;
+  line->shared = shared;
+  if (shared)
+  {
+    __atomic_add_fetch(&shared->refs, 1, __ATOMIC_RELAXED);
+    line->data = shared->data;
+  }
+  else
+  {
+    line->data = line->copy;
+    memcpy(line->data, begin, beginLen);
+    if (endLen)
+      memcpy(line->data + beginLen, end, endLen);
+    line->data[lineLen - 2] = '\r';
+    line->data[lineLen - 1] = '\n';
+  }
+  budget_charge(socket, BUDGET_OUTPUT, sizeof(netioQueued) + copyLen);
+  mpsc_push(&out->queue, &line->node);
+  // pushed first, so an owner which clears woken will find the line
+  if (!__atomic_exchange_n(&out->woken, 1, __ATOMIC_ACQ_REL))
+  {
+    uint64_t one = 1;
+    if (write(out->wakeFd, &one, sizeof(one)) == -1)
+      return;
+  }
+}
+
+
+/* queued_bytes:
+ * Returns the bytes a queued line is charged to its socket.
+ */
+static long queued_bytes(netioQueued * line)
+{
+  return sizeof(netioQueued) + (line->shared ? 0 : line->len);
+}
+
+
+/* queued_send:
+ * Sends one queued line on socket, with MSG_ZEROCOPY if it is
+ * shared and the socket takes it.
+ */
+static void queued_send(int socket, netioQueued * line)
+{
+#ifdef SO_ZEROCOPY
+  if (line->shared && zc_send(socket, line->shared))
+    return;
+#endif
+  struct msghdr msg;
+  struct iovec iov;
+  iov.iov_base = line->data;
+  iov.iov_len = line->len;
+  memset(&msg, 0, sizeof(struct msghdr));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  send_rest(socket, &msg, 0);
+}
+
+
+/* queued_free:
+ * Frees a queued line, dropping its reference if it is shared.
+ */
+static void queued_free(netioQueued * line)
+{
+#ifdef SO_ZEROCOPY
+  if (line->shared)
+    shared_put(line->shared);
+#endif
+  free(line);
+}
+
+
+/* out_drain:
+ * Sends the lines queued for socket, appending them to its hold
+ * instead if its output is held. Lines still halfway onto the
+ * queue are left for the wakeup their producer sends. Only the
+ * owner of socket may call this.
+ */
+static void out_drain(netioOut * out, int socket)
+{
+  netioQueued * lines[NETIOQUEUEIOV];
+  struct iovec iov[NETIOQUEUEIOV];
+  netioHold * hold = find_hold(socket);
+  while (1)
+  {
+    int n = 0;
+    long bytes = 0;
+    mpscNode * node;
+    // a shared line goes out by itself, so it ends the lines popped
+    while (n < NETIOQUEUEIOV && (n == 0 || !lines[n - 1]->shared) &&
+           (node = mpsc_pop(&out->queue)) != NULL)
+    {
+      lines[n] = (netioQueued *) node;
+      iov[n].iov_base = lines[n]->data;
+      iov[n].iov_len = lines[n]->len;
+      bytes += queued_bytes(lines[n]);
+      n++;
+    }
+    if (n == 0)
+      return;
+    int more = (n == NETIOQUEUEIOV) || lines[n - 1]->shared;
+    if (hold)
+    {
+      pthread_mutex_lock(&hold->mutex);
+      for (int i = 0; i < n; i++)
+      {
+        if (hold->held)
+          hold_append(hold, lines[i]->data, lines[i]->len - 2, NULL, 0);
+        else
+          queued_send(socket, lines[i]);
+      }
+      pthread_mutex_unlock(&hold->mutex);
+    }
+    else
+    {
+      // everything popped but a shared line goes out with one sendmsg()
+      int copied = lines[n - 1]->shared ? n - 1 : n;
+      if (copied)
+      {
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(struct msghdr));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = copied;
+        send_rest(socket, &msg, 0);
+      }
+      if (copied < n)
+        queued_send(socket, lines[n - 1]);
+    }
+    for (int i = 0; i < n; i++)
+      queued_free(lines[i]);
+    budget_charge(socket, BUDGET_OUTPUT, -bytes);
+    if (!more)
+      return;
+  }
+}
+
+
+/* out_discard:
+ * Throws away what was queued for a socket after its owner
+ * stopped draining it.
+ */
+static void out_discard(netioOut * out, int socket)
+{
+  mpscNode * node;
+  while ((node = mpsc_pop(&out->queue)) != NULL)
+  {
+    budget_charge(socket, BUDGET_OUTPUT, -queued_bytes((netioQueued *) node));
+    queued_free((netioQueued *) node);
+  }
+}
+
+
+#ifdef SO_ZEROCOPY
+
+/* shared_put:
+ * Drops a reference to a shared line, freeing it with the last.
+ */
+static void shared_put(netioShared * shared)
+{
+  if (__atomic_sub_fetch(&shared->refs, 1, __ATOMIC_ACQ_REL))
+    return;
+  __atomic_sub_fetch(&zcStats.buffers, 1, __ATOMIC_RELAXED);
+  __atomic_sub_fetch(&zcStats.bytes, shared->len, __ATOMIC_RELAXED);
+  free(shared);
+}
+
+
+/* zc_reap:
+ * Reads the completions on a socket's error queue, dropping the
+ * references of the sends which completed. Must be called with
+ * the zerocopy state's mutex locked.
+ */
+static void zc_reap(netioZc * zc)
+{
+  char control[CMSG_SPACE(sizeof(struct sock_extended_err)) + 64];
+  struct msghdr msg;
+  while (zc->pending)
+  {
+    memset(&msg, 0, sizeof(struct msghdr));
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    if (recvmsg(zc->socket, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) == -1)
+      return;
+    for (struct cmsghdr * cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg))
+    {
+      if (!((cmsg->cmsg_level == SOL_IP && cmsg->cmsg_type == IP_RECVERR) ||
+            (cmsg->cmsg_level == SOL_IPV6 && cmsg->cmsg_type == IPV6_RECVERR)))
+        continue;
+      struct sock_extended_err * err = (struct sock_extended_err *) CMSG_DATA(cmsg);
+      if (err->ee_errno != 0 || err->ee_origin != SO_EE_ORIGIN_ZEROCOPY)
+        continue;
+      // the sends from ee_info to ee_data completed
+      uint32_t first = err->ee_info;
+      uint32_t span = err->ee_data - first;
+      if (err->ee_code & SO_EE_CODE_ZEROCOPY_COPIED)
+        __atomic_add_fetch(&zcStats.copied, (long) span + 1, __ATOMIC_RELAXED);
+      for (int slot = 0; slot < NETIOZCPENDING; slot++)
+      {
+        if (zc->sent[slot] && zc->ids[slot] - first <= span)
+        {
+          shared_put(zc->sent[slot]);
+          zc->sent[slot] = NULL;
+          zc->pending--;
+        }
+      }
+    }
+  }
+}
+
+
+/* zc_timeout:
+ * Timer callback which reads a socket's completions for
+ * as long as any of its sends are outstanding.
+ */
+static long zc_timeout(void * arg)
+{
+  netioZc * zc = (netioZc *) arg;
+  // timer callbacks must not block; try again next tick
+  if (pthread_mutex_trylock(&zc->mutex))
+    return NETIOZCREAP;
+  zc_reap(zc);
+  long again = zc->pending ? NETIOZCREAP : 0;
+  pthread_mutex_unlock(&zc->mutex);
+  return again;
+}
+
+
+/* find_zc:
+ * Returns the zerocopy state of socket, setting it up the
+ * first time, or NULL if it cannot have one.
+ */
+static netioZc * find_zc(int socket)
+{
+  if (socket < 0 || socket >= numZcs)
+    return NULL;
+  netioZc * zc = __atomic_load_n(&zcs[socket], __ATOMIC_ACQUIRE);
+  if (zc)
+    return zc;
+  zc = (netioZc *) malloc(sizeof(netioZc));
+  if (zc == NULL)
+    return NULL;
+  memset(zc, 0, sizeof(netioZc));
+  pthread_mutex_init(&zc->mutex, NULL);
+  timer_setup(&zc->timer, zc_timeout, zc);
+  zc->socket = socket;
+  // another thread may have set one up meanwhile
+  netioZc * none = NULL;
+  if (!__atomic_compare_exchange_n(&zcs[socket], &none, zc, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+  {
+    pthread_mutex_destroy(&zc->mutex);
+    free(zc);
+    return none;
+  }
+  return zc;
+}
+
+
+/* zc_send:
+ * Sends a shared line on socket with MSG_ZEROCOPY. Returns 0,
+ * having sent nothing, if the line has to be sent by copying.
+ */
+static int zc_send(int socket, netioShared * shared)
+{
+  netioZc * zc = find_zc(socket);
+  if (zc == NULL)
+    return 0;
+  pthread_mutex_lock(&zc->mutex);
+  zc_reap(zc);
+  if (zc->state == ZC_UNSET)
+  {
+    int on = 1;
+    zc->state = setsockopt(socket, SOL_SOCKET, SO_ZEROCOPY, &on, sizeof(int)) ? ZC_REFUSED : ZC_ON;
+  }
+  int slot = zc->next % NETIOZCPENDING;
+  if (zc->state != ZC_ON || zc->sent[slot])
+  {
+    pthread_mutex_unlock(&zc->mutex);
+    __atomic_add_fetch(&zcStats.fallbacks, 1, __ATOMIC_RELAXED);
+    return 0;
+  }
+  struct msghdr msg;
+  struct iovec iov;
+  iov.iov_base = shared->data;
+  iov.iov_len = shared->len;
+  memset(&msg, 0, sizeof(struct msghdr));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  ssize_t sent;
+  do
+    sent = sendmsg(socket, &msg, MSG_ZEROCOPY | MSG_NOSIGNAL);
+  while (sent == -1 && errno == EINTR);
+  // out of memory for pinning pages; copy this one
+  if (sent == -1 && errno == ENOBUFS)
+  {
+    pthread_mutex_unlock(&zc->mutex);
+    __atomic_add_fetch(&zcStats.fallbacks, 1, __ATOMIC_RELAXED);
+    return 0;
+  }
+  // only sends which queued something are given a notification id
+  if (sent > 0)
+  {
+    __atomic_add_fetch(&shared->refs, 1, __ATOMIC_RELAXED);
+    zc->sent[slot] = shared;
+    zc->ids[slot] = zc->next++;
+    if (zc->pending++ == 0)
+      timer_add(&zc->timer, NETIOZCREAP);
+    __atomic_add_fetch(&zcStats.sends, 1, __ATOMIC_RELAXED);
+    if (sent < shared->len)
+      send_rest(socket, &msg, sent);
+  }
+  pthread_mutex_unlock(&zc->mutex);
+  return 1;
+}
+
+
+/* zc_errqueue:
+ * Reads the completions waiting on socket, which poll() reports
+ * as an error. Returns 1 if that is all the error was, or 0 if
+ * the socket really failed.
+ */
+static int zc_errqueue(int socket)
+{
+  if (socket < 0 || socket >= numZcs)
+    return 0;
+  netioZc * zc = __atomic_load_n(&zcs[socket], __ATOMIC_ACQUIRE);
+  int error;
+  socklen_t errorLen = sizeof(int);
+  if (zc == NULL || getsockopt(socket, SOL_SOCKET, SO_ERROR, &error, &errorLen) == -1 || error)
+    return 0;
+  pthread_mutex_lock(&zc->mutex);
+  zc_reap(zc);
+  // with no sends outstanding, what is left is from a closed socket
+  char control[CMSG_SPACE(sizeof(struct sock_extended_err)) + 64];
+  struct msghdr msg;
+  while (!zc->pending)
+  {
+    memset(&msg, 0, sizeof(struct msghdr));
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    if (recvmsg(socket, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) == -1)
+      break;
+  }
+  pthread_mutex_unlock(&zc->mutex);
+  return 1;
+}
+
+#endif /* SO_ZEROCOPY */
+
+
+#ifdef HAVE_IO_URING
+
+struct netioRing
+{
+  int fd;
+  unsigned entries;
+  unsigned * sqHead;
+  unsigned * sqTail;
+  unsigned * sqMask;
+  unsigned * sqArray;
+  unsigned * cqHead;
+  unsigned * cqTail;
+  unsigned * cqMask;
+  struct io_uring_sqe * sqes;
+  struct io_uring_cqe * cqes;
+  void * ringMem;
+  size_t ringSize;
+  size_t sqeSize;
+  // lines queued since the last submission
+  unsigned pending;
+  // one of each per submission queue entry
+  int * sockets;
+  struct msghdr * msgs;
+  struct iovec (* iovs)[3];
+};
+
+typedef struct netioRing netioRing;
+
+static pthread_key_t ringKey;
+static __thread netioRing * ring = NULL;
+// set once a thread failed to set up its ring
+static __thread int ringFailed = 0;
+
+
+/* ring_free:
+ * Tears down a thread's ring when the thread exits.
+ */
+static void ring_free(void * arg)
+{
+  netioRing * r = (netioRing *) arg;
+  munmap(r->sqes, r->sqeSize);
+  munmap(r->ringMem, r->ringSize);
+  close(r->fd);
+  free(r->sockets);
+  free(r->msgs);
+  free(r->iovs);
+  free(r);
+}
+
+
+/* ring_setup:
+ * Sets up an io_uring for the calling thread. Returns
+ * NULL if the kernel does not allow it.
+ */
+static netioRing * ring_setup(void)
+{
+  struct io_uring_params params;
+  memset(&params, 0, sizeof(params));
+  int fd = syscall(__NR_io_uring_setup, ringEntries, &params);
+  if (fd == -1)
+    return NULL;
+  // the submission and completion rings share one mapping
+  if (!(params.features & IORING_FEAT_SINGLE_MMAP))
+  {
+    close(fd);
+    return NULL;
+  }
+  netioRing * r = (netioRing *) malloc(sizeof(netioRing));
+  memset(r, 0, sizeof(netioRing));
+  r->fd = fd;
+  r->entries = params.sq_entries;
+  size_t sqSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  size_t cqSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+  r->ringSize = sqSize > cqSize ? sqSize : cqSize;
+  r->ringMem = mmap(NULL, r->ringSize, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+  if (r->ringMem == MAP_FAILED)
+  {
+    close(fd);
+    free(r);
+    return NULL;
+  }
+  r->sqeSize = params.sq_entries * sizeof(struct io_uring_sqe);
+  r->sqes = mmap(NULL, r->sqeSize, PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+  if (r->sqes == MAP_FAILED)
+  {
+    munmap(r->ringMem, r->ringSize);
+    close(fd);
+    free(r);
+    return NULL;
+  }
+  char * mem = (char *) r->ringMem;
+  r->sqHead = (unsigned *) (mem + params.sq_off.head);
+  r->sqTail = (unsigned *) (mem + params.sq_off.tail);
+  r->sqMask = (unsigned *) (mem + params.sq_off.ring_mask);
+  r->sqArray = (unsigned *) (mem + params.sq_off.array);
+  r->cqHead = (unsigned *) (mem + params.cq_off.head);
+  r->cqTail = (unsigned *) (mem + params.cq_off.tail);
+  r->cqMask = (unsigned *) (mem + params.cq_off.ring_mask);
+  r->cqes = (struct io_uring_cqe *) (mem + params.cq_off.cqes);
+  if (r->entries > (unsigned) ringEntries)
+    r->entries = ringEntries;
+  r->sockets = (int *) malloc(r->entries * sizeof(int));
+  r->msgs = (struct msghdr *) malloc(r->entries * sizeof(struct msghdr));
+  r->iovs = malloc(r->entries * sizeof(*r->iovs));
+  pthread_setspecific(ringKey, r);
+  return r;
+}
+
+
+/* ring_submit:
+ * Submits every queued line of the thread's ring and waits
+ * for all of them to complete. Lines which were only partly
+ * written are finished with sendmsg(), as are lines the ring
+ * refuses to take.
+ */
+static void ring_submit(netioRing * r)
+{
+  unsigned toSubmit = r->pending;
+  unsigned toReap = r->pending;
+  while (toReap)
+  {
+    int ret = syscall(__NR_io_uring_enter, r->fd, toSubmit, toReap,
+                      IORING_ENTER_GETEVENTS, NULL, 0);
+    if (ret == -1 && errno != EINTR && errno != EAGAIN && errno != EBUSY)
+    {
+      if (toSubmit)
+      {
+        // the ring refused the lines it had not taken yet, which are
+        // the last ones queued, so send those directly and take them
+        // back off the ring; the ones it took are still in flight and
+        // are reaped below before their buffers are reused
+        for (unsigned n = r->pending - toSubmit; n < r->pending; n++)
+          send_rest(r->sockets[n], &r->msgs[n], 0);
+        __atomic_store_n(r->sqTail, __atomic_load_n(r->sqHead, __ATOMIC_ACQUIRE), __ATOMIC_RELEASE);
+        toReap -= toSubmit;
+        toSubmit = 0;
+      }
+      else
+        // lines in flight complete without anyone waiting for them
+        sched_yield();
+    }
+    if (ret > 0)
+      toSubmit -= ret;
+    unsigned head = *r->cqHead;
+    unsigned tail = __atomic_load_n(r->cqTail, __ATOMIC_ACQUIRE);
+    while (head != tail)
+    {
+      struct io_uring_cqe * cqe = &r->cqes[head & *r->cqMask];
+      unsigned n = (unsigned) cqe->user_data;
+      if (cqe->res >= 0)
+        send_rest(r->sockets[n], &r->msgs[n], cqe->res);
+      head++;
+      toReap--;
+    }
+    __atomic_store_n(r->cqHead, head, __ATOMIC_RELEASE);
+  }
+  r->pending = 0;
+}
+
+
+/* ring_queue:
+ * Queues a sendmsg() of a line on the thread's ring, first
+ * submitting the queued lines if the ring is full.
+ */
+static void ring_queue(netioRing * r, int socket, char * begin, int beginLen, char * end, int endLen)
+{
+  if (r->pending == r->entries)
+    ring_submit(r);
+  unsigned n = r->pending++;
+  r->sockets[n] = socket;
+  fill_line(&r->msgs[n], r->iovs[n], begin, beginLen, end, endLen);
+  unsigned tail = *r->sqTail;
+  unsigned index = tail & *r->sqMask;
+  struct io_uring_sqe * sqe = &r->sqes[index];
+  memset(sqe, 0, sizeof(struct io_uring_sqe));
+  sqe->opcode = IORING_OP_SENDMSG;
+  sqe->fd = socket;
+  sqe->addr = (unsigned long) &r->msgs[n];
+  sqe->len = 1;
+  sqe->msg_flags = MSG_NOSIGNAL;
+  sqe->user_data = n;
+  r->sqArray[index] = index;
+  __atomic_store_n(r->sqTail, tail + 1, __ATOMIC_RELEASE);
+}
+
+#endif /* HAVE_IO_URING */
+
+
+/* netio_backend:
+ * Given the name of an output backend, returns its code,
+ * or -1 if there is no such backend.
+ */
+int netio_backend(char * name)
+{
+  if (!strcmp(name, "send"))
+    return NETIO_SEND;
+  if (!strcmp(name, "uring"))
+    return NETIO_URING;
+  return -1;
+}
+
+
+/* netio_configure:
+ * Given a comma separated list of settings, such as
+ * "hold=1,size=4096,flush=200,cork=0", updates how client output
+ * is held. hold turns holding on or off, size is the bytes held
+ * per socket before they are sent early, flush is the most
+ * milliseconds output is held, rounded up to the timer tick (0
+ * for no limit), cork sets TCP_CORK while output is held, and
+ * nodelay sets TCP_NODELAY on sockets whose output is held.
+ * zerocopy turns on MSG_ZEROCOPY for fan-outs of lines of at
+ * least zcbytes bytes to at least zcmembers members. queue has
+ * lines sent to a socket by other threads queued for the thread
+ * reading it.
+ * Must be called before netio_init. Returns -1 if the list is
+ * invalid.
+ */
+int netio_configure(char * spec)
+{
+  char * savePtr;
+  char * setting = strtok_r(spec, ",", &savePtr);
+  while (setting)
+  {
+    char * equals = strchr(setting, '=');
+    if (equals == NULL)
+      return -1;
+    *equals = '\0';
+    char * end;
+    long value = strtol(equals + 1, &end, 10);
+    if (end == equals + 1 || *end || value < 0 || value > INT_MAX)
+      return -1;
+    if (!strcmp(setting, "hold"))
+      holdOutput = value;
+    else if (!strcmp(setting, "size"))
+    {
+      if (value < NETIOMINHOLD || value > NETIOMAXHOLD)
+        return -1;
+      holdSize = value;
+    }
+    else if (!strcmp(setting, "flush"))
+      holdFlushMs = value;
+    else if (!strcmp(setting, "cork"))
+      holdCork = value;
+    else if (!strcmp(setting, "nodelay"))
+      holdNoDelay = value;
+    else if (!strcmp(setting, "zerocopy"))
+      zerocopy = (value != 0);
+    else if (!strcmp(setting, "zcbytes"))
+      zcBytes = value;
+    else if (!strcmp(setting, "zcmembers"))
+      zcMembers = value;
+    else if (!strcmp(setting, "queue"))
+      queueOutput = value;
+    else
+      return -1;
+    setting = strtok_r(NULL, ",", &savePtr);
+  }
+  return 1;
+}
+
+
+/* netio_init:
+ * Selects the output backend, and the number of lines each
+ * thread's io_uring can hold. Falls back to sendmsg() if
+ * io_uring was not built in or the kernel refuses to set
+ * one up, and to copying if MSG_ZEROCOPY is unavailable.
+ * Returns the backend in use.
+ */
+int netio_init(int requested, int entries)
+{
+  backend = NETIO_SEND;
+  if (entries > 0 && entries <= NETIORING)
+    ringEntries = entries;
+  // descriptors can never reach the limit they had at startup
+  int maxFds = NETIOMAXFDS;
+  struct rlimit limit;
+  if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur != RLIM_INFINITY &&
+      limit.rlim_cur < NETIOMAXFDS)
+    maxFds = limit.rlim_cur;
+  if (holdOutput)
+  {
+    numHolds = maxFds;
+    holds = (netioHold **) calloc(numHolds, sizeof(netioHold *));
+    if (holds == NULL)
+      numHolds = 0;
+  }
+  if (queueOutput)
+  {
+    numOuts = maxFds;
+    outs = (netioOut **) calloc(numOuts, sizeof(netioOut *));
+    if (outs == NULL)
+      numOuts = 0;
+  }
+  if (zerocopy)
+  {
+    zerocopy = -1;
+#ifdef SO_ZEROCOPY
+    // make sure the kernel takes SO_ZEROCOPY before relying on it
+    int probe = socket(AF_INET, SOCK_STREAM, 0);
+    int on = 1;
+    if (probe != -1 && setsockopt(probe, SOL_SOCKET, SO_ZEROCOPY, &on, sizeof(int)) == 0)
+    {
+      numZcs = maxFds;
+      zcs = (netioZc **) calloc(numZcs, sizeof(netioZc *));
+      if (zcs)
+        zerocopy = 1;
+      else
+        numZcs = 0;
+    }
+    if (probe != -1)
+      close(probe);
+#endif
+  }
+#ifdef HAVE_IO_URING
+  if (requested == NETIO_URING)
+  {
+    pthread_key_create(&ringKey, ring_free);
+    // make sure io_uring works here before relying on it
+    netioRing * probe = ring_setup();
+    if (probe)
+    {
+      ring = probe;
+      backend = NETIO_URING;
+    }
+  }
+#endif
+  return backend;
+}
+
+
+/* netio_name:
+ * Returns the name of the output backend in use.
+ */
+char * netio_name(void)
+{
+  return backend == NETIO_URING ? "uring" : "send";
+}
+
+
+/* netio_line:
+ * Sends begin, then end if there is one, then "\r\n" on socket
+ * as one line. Inside a batch the line may only be written once
+ * the batch is flushed, so its parts must stay valid until then.
+ */
+void netio_line(int socket, char * begin, int beginLen, char * end, int endLen)
+{
+  netioShared * shared = NULL;
+#ifdef SO_ZEROCOPY
+  if (share && begin == shareBegin && end == shareEnd &&
+      beginLen + (end ? endLen : 0) + 2 == share->len)
+    shared = share;
+#endif
+  netioOut * out = find_out(socket);
+  if (out)
+  {
+    // the owner makes the zerocopy send of a shared line too
+    if (socket != ownSocket)
+    {
+      out_push(out, socket, begin, beginLen, end, endLen, shared);
+      return;
+    }
+    // lines queued by other threads went first
+    out_drain(out, socket);
+  }
+  netioHold * hold = find_hold(socket);
+  if (hold)
+  {
+    pthread_mutex_lock(&hold->mutex);
+    if (hold->held)
+    {
+      hold_append(hold, begin, beginLen, end, endLen);
+      pthread_mutex_unlock(&hold->mutex);
+      return;
+    }
+    pthread_mutex_unlock(&hold->mutex);
+  }
+#ifdef SO_ZEROCOPY
+  // zerocopy sends are made directly, outside any io_uring
+  if (shared && zc_send(socket, shared))
+    return;
+#endif
+#ifdef HAVE_IO_URING
+  if (batching && ring)
+  {
+    ring_queue(ring, socket, begin, beginLen, end, endLen);
+    return;
+  }
+#endif
+  struct msghdr msg;
+  struct iovec iov[3];
+  fill_line(&msg, iov, begin, beginLen, end, endLen);
+  send_rest(socket, &msg, 0);
+}
+
+
+/* netio_post:
+ * Sends a line as netio_line does, from a thread which must not
+ * block, such as the timer thread: onto the socket's outbound
+ * queue if it has one, or else as far as the socket takes it
+ * without blocking.
+ */
+void netio_post(int socket, char * begin, int beginLen, char * end, int endLen)
+{
+  netioOut * out = find_out(socket);
+  if (out && socket != ownSocket)
+  {
+    out_push(out, socket, begin, beginLen, end, endLen, NULL);
+    return;
+  }
+  struct msghdr msg;
+  struct iovec iov[3];
+  fill_line(&msg, iov, begin, beginLen, end, endLen);
+  sendmsg(socket, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+}
+
+
+/* netio_batch_start:
+ * Starts queueing the calling thread's lines instead of
+ * sending them one at a time.
+ */
+void netio_batch_start(void)
+{
+#ifdef HAVE_IO_URING
+  if (backend == NETIO_URING && !ring && !ringFailed)
+  {
+    ring = ring_setup();
+    ringFailed = (ring == NULL);
+  }
+#endif
+  batching = 1;
+}
+
+
+/* netio_batch_flush:
+ * Sends every line queued since netio_batch_start.
+ */
+void netio_batch_flush(void)
+{
+#ifdef HAVE_IO_URING
+  if (ring && ring->pending)
+    ring_submit(ring);
+#endif
+#ifdef SO_ZEROCOPY
+  if (share)
+    shared_put(share);
+  share = NULL;
+#endif
+  batching = 0;
+}
+
+
+/* netio_share:
+ * Says the lines made of begin and end sent next in the calling
+ * thread's batch go to recipients sockets. If the fan-out is large
+ * enough, the line is copied once into a shared buffer and sent to
+ * each of them with MSG_ZEROCOPY. Must be called after
+ * netio_batch_start; the sharing ends with the batch.
+ */
+void netio_share(char * begin, int beginLen, char * end, int endLen, int recipients)
+{
+#ifdef SO_ZEROCOPY
+  if (!end)
+    endLen = 0;
+  int lineLen = beginLen + endLen + 2;
+  if (zerocopy != 1 || !batching || recipients < zcMembers || lineLen < zcBytes)
+    return;
+  if (share)
+    shared_put(share);
+  share = (netioShared *) malloc(sizeof(netioShared) + lineLen);
+  if (share == NULL)
+    return;
+  // the batch holds a reference until it is flushed
+  share->refs = 1;
+  share->len = lineLen;
+  memcpy(share->data, begin, beginLen);
+  if (endLen)
+    memcpy(share->data + beginLen, end, endLen);
+  share->data[lineLen - 2] = '\r';
+  share->data[lineLen - 1] = '\n';
+  shareBegin = begin;
+  shareEnd = end;
+  __atomic_add_fetch(&zcStats.buffers, 1, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&zcStats.bytes, lineLen, __ATOMIC_RELAXED);
+#endif
+}
+
+
+/* netio_zerocopy:
+ * Returns 1 if fan-outs may be sent with MSG_ZEROCOPY, 0 if
+ * that is turned off, and -1 if it was asked for but the
+ * kernel does not support it.
+ */
+int netio_zerocopy(void)
+{
+  return zerocopy;
+}
+
+
+/* netio_zerocopy_stats:
+ * Fills in stats with the shared lines still held for
+ * zerocopy sends, and the sends made so far.
+ */
+void netio_zerocopy_stats(netioZcStats * stats)
+{
+  stats->buffers = __atomic_load_n(&zcStats.buffers, __ATOMIC_RELAXED);
+  stats->bytes = __atomic_load_n(&zcStats.bytes, __ATOMIC_RELAXED);
+  stats->sends = __atomic_load_n(&zcStats.sends, __ATOMIC_RELAXED);
+  stats->copied = __atomic_load_n(&zcStats.copied, __ATOMIC_RELAXED);
+  stats->fallbacks = __atomic_load_n(&zcStats.fallbacks, __ATOMIC_RELAXED);
+}
+
+
+/* netio_queue_drops:
+ * Returns how many lines were dropped instead of queued as there
+ * was no memory to copy them.
+ */
+long netio_queue_drops(void)
+{
+  return __atomic_load_n(&queueDrops, __ATOMIC_RELAXED);
+}
+
+
+/* netio_open:
+ * Starts a connection on socket, run by the calling thread. The
+ * socket is set TCP_NODELAY if its output will be held. Its
+ * zerocopy state is stamped as the connection's, so netio_close
+ * only ever clears the state of the connection which closes.
+ */
+void netio_open(int socket)
+{
+  // set for every connection, as holds outlive the sockets they
+  // were made for and go to whichever connection gets the number
+  if (holdOutput && holdNoDelay)
+  {
+    int on = 1;
+    setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(int));
+  }
+  ownGeneration = __atomic_add_fetch(&generations, 1, __ATOMIC_RELAXED);
+#ifdef SO_ZEROCOPY
+  netioZc * zc = find_zc(socket);
+  if (zc == NULL)
+    return;
+  pthread_mutex_lock(&zc->mutex);
+  zc->generation = ownGeneration;
+  pthread_mutex_unlock(&zc->mutex);
+#endif
+}
+
+
+/* netio_close:
+ * Stops queueing the output of socket, and waits a while for the
+ * zerocopy sends still outstanding on socket to complete, then
+ * forgets them. Must be called by the thread which called
+ * netio_open, before the socket is closed, as its completions go
+ * with it.
+ */
+void netio_close(int socket)
+{
+  netio_unqueue(socket);
+#ifdef SO_ZEROCOPY
+  if (socket < 0 || socket >= numZcs)
+    return;
+  netioZc * zc = __atomic_load_n(&zcs[socket], __ATOMIC_ACQUIRE);
+  if (zc == NULL)
+    return;
+  pthread_mutex_lock(&zc->mutex);
+  // the descriptor was given to another connection meanwhile
+  if (zc->generation != ownGeneration)
+  {
+    pthread_mutex_unlock(&zc->mutex);
+    return;
+  }
+  pthread_mutex_unlock(&zc->mutex);
+  timer_cancel(&zc->timer);
+  pthread_mutex_lock(&zc->mutex);
+  zc_reap(zc);
+  for (int waited = 0; zc->pending && waited < NETIOZCWAIT; waited += 10)
+  {
+    // the error queue makes the socket report POLLERR
+    struct pollfd pfd = { socket, 0, 0 };
+    poll(&pfd, 1, 10);
+    zc_reap(zc);
+  }
+  for (int slot = 0; slot < NETIOZCPENDING; slot++)
+  {
+    if (zc->sent[slot])
+      shared_put(zc->sent[slot]);
+    zc->sent[slot] = NULL;
+  }
+  // the descriptor may be reused by a socket counting from 0
+  zc->pending = 0;
+  zc->next = 0;
+  zc->state = ZC_UNSET;
+  pthread_mutex_unlock(&zc->mutex);
+#endif
+}
+
+
+/* netio_hold_size:
+ * Returns the bytes of output held for each socket which has
+ * held output, and of the record of its outbound queue.
+ */
+int netio_hold_size(void)
+{
+  return (holdOutput ? (int) sizeof(netioHold) + holdSize : 0) +
+    (queueOutput ? (int) sizeof(netioOut) : 0);
+}
+
+
+/* netio_hold:
+ * Starts holding the output of socket, so the lines sent to it
+ * go out together once netio_release is called. Only the thread
+ * reading from socket may hold it.
+ */
+void netio_hold(int socket)
+{
+  if (socket < 0 || socket >= numHolds)
+    return;
+  netioHold * hold = holds[socket];
+  if (hold == NULL)
+  {
+    hold = (netioHold *) malloc(sizeof(netioHold) + holdSize);
+    if (hold == NULL)
+      return;
+    memset(hold, 0, sizeof(netioHold));
+    pthread_mutex_init(&hold->mutex, NULL);
+    timer_setup(&hold->timer, hold_timeout, hold);
+    hold->socket = socket;
+    hold->buf = (char *) (hold + 1);
+    __atomic_store_n(&holds[socket], hold, __ATOMIC_RELEASE);
+  }
+  if (holdCork)
+  {
+    int on = 1;
+    setsockopt(socket, IPPROTO_TCP, TCP_CORK, &on, sizeof(int));
+  }
+  __atomic_store_n(&hold->held, 1, __ATOMIC_RELAXED);
+  if (holdFlushMs)
+    timer_add(&hold->timer, holdFlushMs);
+}
+
+
+/* netio_release:
+ * Sends everything held for socket, and stops holding its
+ * output. Does nothing if its output is not held.
+ */
+void netio_release(int socket)
+{
+  // what other threads queued meanwhile goes out with the rest
+  netioOut * out = find_out(socket);
+  if (out && socket == ownSocket)
+    out_drain(out, socket);
+  netioHold * hold = find_hold(socket);
+  if (hold == NULL)
+    return;
+  if (holdFlushMs)
+    timer_cancel(&hold->timer);
+  pthread_mutex_lock(&hold->mutex);
+  hold->held = 0;
+  if (hold->len)
+    hold_send(hold);
+  pthread_mutex_unlock(&hold->mutex);
+  if (holdCork)
+  {
+    int off = 0;
+    setsockopt(socket, IPPROTO_TCP, TCP_CORK, &off, sizeof(int));
+  }
+}
+
+
+/* netio_queue:
+ * Has lines other threads send to socket queued for the calling
+ * thread, which must be the one reading socket, to send from
+ * netio_recv. Does nothing if output queueing is turned off.
+ */
+void netio_queue(int socket)
+{
+  if (socket < 0 || socket >= numOuts)
+    return;
+  netioOut * out = outs[socket];
+  if (out == NULL)
+  {
+    out = (netioOut *) malloc(sizeof(netioOut));
+    if (out == NULL)
+      return;
+    memset(out, 0, sizeof(netioOut));
+    mpsc_init(&out->queue);
+    out->wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (out->wakeFd == -1)
+    {
+      free(out);
+      return;
+    }
+    __atomic_store_n(&outs[socket], out, __ATOMIC_RELEASE);
+  }
+  else
+  {
+    // lines pushed after the last connection on this descriptor closed
+    out_discard(out, socket);
+    uint64_t count;
+    if (read(out->wakeFd, &count, sizeof(count)) == -1)
+      count = 0;
+    __atomic_store_n(&out->woken, 0, __ATOMIC_RELEASE);
+  }
+  ownSocket = socket;
+  __atomic_store_n(&out->open, 1, __ATOMIC_RELEASE);
+}
+
+
+/* netio_unqueue:
+ * Sends what is queued for socket, and has other threads send
+ * to it themselves again. Must be called by the thread which
+ * called netio_queue.
+ */
+void netio_unqueue(int socket)
+{
+  netioOut * out = find_out(socket);
+  if (out == NULL || socket != ownSocket)
+    return;
+  __atomic_store_n(&out->open, 0, __ATOMIC_RELEASE);
+  out_drain(out, socket);
+  ownSocket = -1;
+}
+
+
+/* netio_wait:
+ * Waits up to timeout milliseconds, or for as long as it takes if
+ * timeout is -1, for socket to have input. If the calling thread
+ * owns the outbound queue of socket, it sends whatever other
+ * threads queue for socket meanwhile. Returns 1 once socket has
+ * input, 0 if the time ran out first, or -1 on failure.
+ */
+int netio_wait(int socket, int timeout)
+{
+  netioOut * out = find_out(socket);
+  struct pollfd fds[2] = { { socket, POLLIN, 0 }, { -1, POLLIN, 0 } };
+  int numFds = 1;
+  if (out && socket == ownSocket)
+  {
+    fds[1].fd = out->wakeFd;
+    numFds = 2;
+  }
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  long deadline = now.tv_sec * 1000L + now.tv_nsec / 1000000 + timeout;
+  while (1)
+  {
+    int ready = poll(fds, numFds, timeout);
+    if (timeout != -1)
+    {
+      // waking to send output does not restart the wait
+      clock_gettime(CLOCK_MONOTONIC, &now);
+      long left = deadline - (now.tv_sec * 1000L + now.tv_nsec / 1000000);
+      timeout = left > 0 ? left : 0;
+    }
+    if (ready == -1)
+    {
+      if (errno == EINTR)
+        continue;
+      return -1;
+    }
+    if (ready == 0)
+      return 0;
+    if (numFds == 2 && (fds[1].revents & POLLIN))
+    {
+      uint64_t count;
+      if (read(out->wakeFd, &count, sizeof(count)) == -1)
+        count = 0;
+      // lines pushed from here on wake the owner again
+      __atomic_exchange_n(&out->woken, 0, __ATOMIC_ACQ_REL);
+      out_drain(out, socket);
+    }
+#ifdef SO_ZEROCOPY
+    // the owner's zerocopy sends complete on the socket's error queue
+    if (fds[0].revents == POLLERR && zc_errqueue(socket))
+      continue;
+#endif
+    if (fds[0].revents)
+      return 1;
+  }
+}
+
+
+/* netio_recv:
+ * Receives from socket as recv() does. If the calling thread
+ * owns the outbound queue of socket, it sends whatever other
+ * threads queue for socket while it waits.
+ */
+int netio_recv(int socket, char * buf, int len)
+{
+  netioOut * out = find_out(socket);
+  if (out && socket == ownSocket && netio_wait(socket, -1) == -1)
+    return -1;
+  return recv(socket, buf, len, 0);
+}
@@ -0,0 +1,72 @@
+/*
+ *
+ *  CMSC 23300 / 33300 - Networks and Distributed Systems
+ *
+ *  Socket output backends
+ *
+ */
+
+#ifndef NETIO_H_
+#define NETIO_H_
+
+#define NETIO_SEND 0
+#define NETIO_URING 1
+
+// most submission queue entries in each thread's io_uring
+#define NETIORING 128
+// bytes of output held for each socket while its input is handled
+#define NETIOHOLD 4096
+#define NETIOMINHOLD 512
+#define NETIOMAXHOLD 65536
+// most descriptors output can be held for
+#define NETIOMAXFDS 1048576
+// bytes a line and members a channel need before a fan-out is
+// sent with MSG_ZEROCOPY, when it is turned on
+#define NETIOZCBYTES 256
+#define NETIOZCMEMBERS 1000
+// zerocopy sends which may await completion on one socket
+#define NETIOZCPENDING 64
+// milliseconds between looks for a socket's completions
+#define NETIOZCREAP 100
+// most milliseconds a closing socket waits for its completions
+#define NETIOZCWAIT 1000
+// most queued lines an owning thread sends with one sendmsg()
+#define NETIOQUEUEIOV 64
+
+struct netioZcStats
+{
+  // shared lines still referenced by a send, and their bytes
+  long buffers;
+  long bytes;
+  long sends;
+  // sends the kernel completed by copying after all
+  long copied;
+  // sends made by copying as a socket refused zerocopy
+  long fallbacks;
+};
+
+typedef struct netioZcStats netioZcStats;
+
+int netio_backend(char * name);
+int netio_configure(char * spec);
+int netio_init(int backend, int entries);
+char * netio_name(void);
+void netio_line(int socket, char * begin, int beginLen, char * end, int endLen);
+void netio_post(int socket, char * begin, int beginLen, char * end, int endLen);
+void netio_batch_start(void);
+void netio_batch_flush(void);
+void netio_share(char * begin, int beginLen, char * end, int endLen, int recipients);
+int netio_zerocopy(void);
+void netio_zerocopy_stats(netioZcStats * stats);
+long netio_queue_drops(void);
+void netio_open(int socket);
+void netio_close(int socket);
+int netio_hold_size(void);
+void netio_hold(int socket);
+void netio_release(int socket);
+void netio_queue(int socket);
+void netio_unqueue(int socket);
+int netio_wait(int socket, int timeout);
+int netio_recv(int socket, char * buf, int len);
+
+#endif /* NETIO_H_ */
@@ -8,6 +8,24 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include "parser.h"
+
+
+static int maxArgs = PARSERMAXARGS;
+static int maxCommands = PARSERMAXCOMMANDS;
+static int msgLenTot = PARSERMAXLINE;
+
+
+/* parser_limits:
+ * Sets the most words kept from a command, the most commands
+ * taken from one buffer and the longest command kept.
+ */
+void parser_limits(int args, int commands, int line)
+{
+  maxArgs = args;
+  maxCommands = commands;
+  msgLenTot = line;
+}
 
 
 /* parser:
@@ -18,7 +36,6 @@
  */
 int parser(char *input,  int nbytes, char **argList)
 {
-  int maxArgs = 15;
   int array_index = 0;
   int start_cpy = 0;
   int n;
@@ -45,7 +62,7 @@ int parser(char *input,  int nbytes, char **argList)
       array_index++;
     }
     if (array_index == maxArgs)
-    { //prevent more than 15 arguments from being stored
+    { //prevent more than maxArgs arguments from being stored
       break;
     }
   }
@@ -63,13 +80,12 @@ int break_commands(char *input, int nbytes, char **cmndList)
   int array_index=0;
   int start_cpy=0;
   int n;
-  int msgLenTot = 512;
-  for (n=0; n<nbytes; n++)
+  for (n=0; n<nbytes && array_index<maxCommands; n++)
   {
     if ((input[n] == '\n') && (n>0) && (input[n-1] == '\r'))
     {
       int cmndSize = n-start_cpy;
-      // guarantee that all commands are 512 chars and under
+      // guarantee that all commands are msgLenTot chars and under
       if (cmndSize > msgLenTot)
         cmndSize = msgLenTot;
       cmndList[array_index] = (char *) malloc(cmndSize+1);
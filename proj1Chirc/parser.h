@@ -9,6 +9,11 @@
 #ifndef PARSER_H_
 #define PARSER_H_
 
+#define PARSERMAXARGS 15
+#define PARSERMAXCOMMANDS 250
+#define PARSERMAXLINE 512
+
+void parser_limits(int args, int commands, int line);
 int break_commands(char *input, int nbytes, char **argList);
 int parser(char *input,  int nbytes, char **argList);
 
@@ -4,6 +4,12 @@
  *
  *  Server Response Functions
  *
+ *  Replies are put together from the templates in reply.h, which
+ *  the preprocessor turns into a table indexed by reply code. Each
+ *  template is already split into its literal pieces and argument
+ *  slots, with the length of every piece known, so a reply is a
+ *  few memcpys with no format to parse.
+ *
  */
 #include <pthread.h>
 #include <stdio.h>
@@ -12,6 +18,8 @@
 #include <sys/socket.h>
 #include <sys/types.h>
 #include "globalData.h"
+#include "latency.h"
+#include "netio.h"
 #include "reply.h"
 #include "structures.h"
 
@@ -20,352 +28,144 @@ extern pthread_mutex_t lock;
 extern int num_pthreads;
 
 
+struct replyPiece
+{
+  // a slot has no text, and len is the number of the slot
+  const char * text;
+  int len;
+};
+
+typedef struct replyPiece replyPiece;
+
+struct replyTemplate
+{
+  int pad;
+  int room;
+  int numPieces;
+  replyPiece pieces[REPLYPIECES];
+};
+
+typedef struct replyTemplate replyTemplate;
+
+#define REPLY_ENUM(code, number, ...) REPLYT_##code,
+enum { REPLY_TEMPLATES(REPLY_ENUM) REPLYTEMPLATES };
+
+#define REPLY_ENTRY(code, number, pad, room, ...) \
+  { pad, room, sizeof((replyPiece[]) { __VA_ARGS__ }) / sizeof(replyPiece), { __VA_ARGS__ } },
+static const replyTemplate templates[REPLYTEMPLATES] = { REPLY_TEMPLATES(REPLY_ENTRY) };
+
+// one more than the index in templates of each reply code
+#define REPLY_INDEX(code, number, ...) [number] = REPLYT_##code + 1,
+static const unsigned char byCode[1000] = { REPLY_TEMPLATES(REPLY_INDEX) };
+
+
+/* find_template:
+ * Given a three digit reply code, returns its template,
+ * or NULL if there is none.
+ */
+static const replyTemplate * find_template(char * code)
+{
+  if (code[0] < '0' || code[0] > '9' ||
+      code[1] < '0' || code[1] > '9' ||
+      code[2] < '0' || code[2] > '9')
+    return NULL;
+  int number = (code[0] - '0') * 100 + (code[1] - '0') * 10 + (code[2] - '0');
+  if (!byCode[number])
+    return NULL;
+  return &templates[byCode[number] - 1];
+}
+
+
 /* send_response:
  * Given the client socket, and a replyPackage struct
- * sends an appropriate response to the client.
- * Returns 1 upon success and -1 upon failure.
+ * sends an appropriate response to the client. The reply is
+ * put together on the stack, so this must not be called inside
+ * a netio batch. Returns 1 upon success and -1 upon failure.
  */
 int send_response(int clientSocket, replyPackage * reply)
 {
-  char **args = NULL;
+  const replyTemplate * template = find_template(reply->responseCode);
+  if (template == NULL)
+    return -1;
 
-  // unpack the replyStruct argument list
-  // consider encompassing this into a new function
+  // fill in the slots, splitting the args at every space
+  const char * slotText[REPLYSLOTS];
+  int slotLen[REPLYSLOTS];
+  int numArgs = 0;
   if (reply->numArgs > 0)
   {
-    int argIndx = 0;
-    int argCharIndx = 0;
-    args = (char **) malloc(reply->numArgs*sizeof(char **));
-    for (int i = 0; i<=strlen(reply->args); i++)
-    {
-      if ((reply->args[i] == ' ') || (i == strlen(reply->args)))
+    char * word = reply->args;
+    char * argsEnd = reply->args + strnlen(reply->args, MAXARGS);
+    for (char * c = word; numArgs < REPLYARGS; c++)
+      if (c == argsEnd || *c == ' ')
       {
-        args[argIndx] = (char *) malloc(argCharIndx*sizeof(char *));
-        memcpy(args[argIndx], &(reply->args[i-argCharIndx]), argCharIndx);
-        args[argIndx][argCharIndx] = '\0';
-        argIndx++;
-        argCharIndx = 0;
+        slotText[numArgs] = word;
+        slotLen[numArgs++] = c - word;
+        if (c == argsEnd)
+          break;
+        word = c + 1;
       }
-      else
-        argCharIndx++;
-    }
-  }  
-
-  // create beginning of response message
-  char *replyEnd;
-  int replyEndLen;
-  int replyBeginLen = 1 + strlen(reply->serverName) + // account for colon
-                      strlen(reply->responseCode) + // reply identifier
-                      strlen(reply->nickname) +
-                      4; // account for spaces
-  char replyBeginning[replyBeginLen];
-  snprintf(replyBeginning, replyBeginLen, ":%s %s %s ", reply->serverName, 
-                                                        reply->responseCode,
-                                                        reply->nickname);
-  // create end of response message based on appropriate response
-  if (!(strcmp(reply->responseCode, RPL_WELCOME)))
-  {
-    replyEndLen = strlen(RPL_WELCOME_MSG) +
-                  strlen(reply->nickname) +
-                  strlen(args[0]) +
-                  strlen(args[1]) + 1;
-    replyEnd = (char *) malloc(replyEndLen*sizeof(char *));
-    snprintf(replyEnd, replyEndLen, RPL_WELCOME_MSG, reply->nickname, args[0], args[1]);
-  }
-  else if (!(strcmp(reply->responseCode, RPL_YOURHOST)))
-  {
-    replyEndLen = strlen(RPL_YOURHOST_MSG) +
-                  strlen(reply->serverName) +
-                  strlen(args[0]) + 1;
-    replyEnd = (char *) malloc(replyEndLen*sizeof(char *));
-    snprintf(replyEnd, replyEndLen, RPL_YOURHOST_MSG, reply->serverName, args[0]);
-  }
-  else if (!(strcmp(reply->responseCode, RPL_CREATED)))
-  {
-    replyEndLen = strlen(RPL_CREATED_MSG) +
-                  strlen(reply->message);// + 1;
-    replyEnd = (char *) malloc(replyEndLen*sizeof(char *));
-    snprintf(replyEnd, replyEndLen, RPL_CREATED_MSG, reply->message);
-  }
-  else if (!(strcmp(reply->responseCode, RPL_MYINFO)))
-  {
-    replyEndLen = strlen(RPL_MYINFO_MSG) +
-                  strlen(reply->serverName) +
-                  strlen(args[0]) +
-                  strlen(args[1]) +
-                  strlen(args[2]) + 1;
-    replyEnd = (char *) malloc(replyEndLen*sizeof(char *));
-    snprintf(replyEnd, replyEndLen, RPL_MYINFO_MSG, reply->serverName, args[0], args[1], args[2]);
-  }
-  else if (!(strcmp(reply->responseCode, ERR_UNKNOWNCOMMAND)))
-  {
-    replyEndLen = strlen(ERR_UNKNOWNCOMMAND_MSG) + strlen(args[0]) + 1;
-    replyEnd = (char *) malloc(replyEndLen*sizeof(char *));
-    snprintf(replyEnd, replyEndLen, ERR_UNKNOWNCOMMAND_MSG, args[0]);
   }
-  else if (!(strcmp(reply->responseCode, ERR_ALREADYREGISTRED)))
+  for (; numArgs < REPLYARGS; numArgs++)
   {
-    replyEndLen = strlen(ERR_ALREADYREGISTERED_MSG) + 1;
-    replyEnd = (char *) malloc(replyEndLen*sizeof(char *));
-    memcpy(replyEnd, ERR_ALREADYREGISTERED_MSG, replyEndLen);
+    slotText[numArgs] = "";
+    slotLen[numArgs] = 0;
   }
-  else if (!(strcmp(reply->responseCode, ERR_NICKNAMEINUSE)))
-  {
-    replyEndLen = strlen(args[0]) +
-                  strlen(ERR_NICKNAMEINUSE_MSG) + 1;
-    replyEnd = (char *) malloc(replyEndLen*sizeof(char *));
-    snprintf(replyEnd, replyEndLen, ERR_NICKNAMEINUSE_MSG, args[0]);
-  }
-  else if (!(strcmp(reply->responseCode, RPL_MOTDSTART)))
-  {
-    replyEndLen = strlen(reply->serverName) +
-                  strlen(RPL_MOTDSTART_MSG) + 1;
-    replyEnd = (char *) malloc(replyEndLen*sizeof(char *));
-    snprintf(replyEnd, replyEndLen, RPL_MOTDSTART_MSG, reply->serverName);
-  }
-  else if (!(strcmp(reply->responseCode, RPL_ENDOFMOTD)))
-  {
-    replyEndLen = strlen(RPL_ENDOFMOTD_MSG) + 1;
-    replyEnd = (char *) malloc(replyEndLen*sizeof(char *));
-    memcpy(replyEnd, RPL_ENDOFMOTD_MSG, replyEndLen);
-  }
-  else if (!(strcmp(reply->responseCode, RPL_MOTD)))
-  {
-    replyEndLen = strlen(RPL_MOTD_MSG) + strlen(reply->message) + 1;
-    replyEnd = (char *) malloc(replyEndLen*sizeof(char *));
-    snprintf(replyEnd, replyEndLen, RPL_MOTD_MSG, reply->message);
-  }
-  else if (!(strcmp(reply->responseCode, ERR_NOMOTD)))
-  {
-    replyEndLen = strlen(ERR_NOMOTD_MSG) + 1;
-    replyEnd = (char *) malloc(replyEndLen*sizeof(char *));
-    memcpy(replyEnd, ERR_NOMOTD_MSG, replyEndLen);
-  }
-  else if (!(strcmp(reply->responseCode, ERR_NOSUCHNICK)))
-  {
-    replyEndLen = strlen(ERR_NOSUCHNICK_MSG) + strlen(args[0]) + 1;
-    replyEnd = (char *) malloc(replyEndLen*sizeof(char *));
-    snprintf(replyEnd, replyEndLen, ERR_NOSUCHNICK_MSG, args[0]);
-  }
-  else if (!(strcmp(reply->responseCode, RPL_LUSERCLIENT)))
-  {
-    replyEndLen = strlen(RPL_LUSERCLIENT_MSG) + 1;
-    replyEnd = (char *) malloc(replyEndLen*sizeof(char *));
-    snprintf(replyEnd, replyEndLen, RPL_LUSERCLIENT_MSG, args[5], args[1], args[6]);
-  }
-  else if (!(strcmp(reply->responseCode, RPL_LUSEROP)))
-  {
-    replyEndLen = strlen(RPL_LUSEROP_MSG) + 1;
-    replyEnd = (char *) malloc(replyEndLen*sizeof(char *));
-    snprintf(replyEnd, replyEndLen, RPL_LUSEROP_MSG, args[2]);   
-  }
-  else if (!(strcmp(reply->responseCode, RPL_LUSERUNKNOWN)))
-  {
-    replyEndLen = strlen(RPL_LUSERUNKNOWN_MSG) + 1;
-    replyEnd = (char *) malloc(replyEndLen*sizeof(char *));
-    snprintf(replyEnd, replyEndLen, RPL_LUSERUNKNOWN_MSG, args[4]);     
-  }
-  else if (!(strcmp(reply->responseCode, RPL_LUSERCHANNELS)))
-  {
-    replyEndLen = strlen(RPL_LUSERCHANNELS_MSG) + 1;
-    replyEnd = (char *) malloc(replyEndLen*sizeof(char *));
-    snprintf(replyEnd, replyEndLen, RPL_LUSERCHANNELS_MSG, args[3]);     
-  }
-  else if (!(strcmp(reply->responseCode, RPL_LUSERME)))
-  {
-    replyEndLen = strlen(RPL_LUSERME_MSG) + 1;
-    replyEnd = (char *) malloc(replyEndLen*sizeof(char *));
-    snprintf(replyEnd, replyEndLen, RPL_LUSERME_MSG, args[0], args[6]);   
-  }
-  else if (!(strcmp(reply->responseCode, RPL_WHOISUSER)))
-  {
-    replyEndLen = strlen(RPL_WHOISUSER_MSG) +
-                  strlen(args[0]) + strlen(args[1]) +
-                  strlen(args[2]) + strlen(reply->message) + 1;
-    replyEnd = (char *) malloc(replyEndLen*sizeof(char *));
-    snprintf(replyEnd, replyEndLen, RPL_WHOISUSER_MSG, 
-             args[0], args[1], args[2], reply->message);
-  }
-  else if (!(strcmp(reply->responseCode, RPL_WHOISSERVER)))
-  {
-    replyEndLen = strlen(RPL_WHOISSERVER_MSG) +
-                  strlen(args[0]) + strlen(args[1]) +
-                  strlen(args[2]) +  1;
-    replyEnd = (char *) malloc(replyEndLen*sizeof(char *));
-    snprintf(replyEnd, replyEndLen, RPL_WHOISSERVER_MSG,
-             args[0], args[1], args[2]);
-  }
-  else if (!(strcmp(reply->responseCode, RPL_ENDOFWHOIS)))
-  {
-    replyEndLen = strlen(RPL_ENDOFWHOIS_MSG) +
-                  strlen(args[0]) + 1;
-    replyEnd = (char *) malloc(replyEndLen*sizeof(char *));
-    snprintf(replyEnd, replyEndLen, RPL_ENDOFWHOIS_MSG, args[0]);
-  }
-  else if (!(strcmp(reply->responseCode, RPL_NAMREPLY)))
-  {
-    replyEndLen = strlen(RPL_NAMREPLY_MSG) + strlen(args[0]) +
-                  strlen(args[1]) + strlen(reply->message) + 1;
-    replyEnd = (char *) malloc(replyEndLen*sizeof(char *));
-    snprintf(replyEnd, replyEndLen, RPL_NAMREPLY_MSG, args[0], args[1], reply->message);
-  }
-  else if (!(strcmp(reply->responseCode, RPL_ENDOFNAMES)))
-  {
-    replyEndLen = strlen(RPL_ENDOFNAMES_MSG) + strlen(args[0]) + 1;
-    replyEnd = (char *) malloc(replyEndLen*sizeof(char *));
-    snprintf(replyEnd, replyEndLen, RPL_ENDOFNAMES_MSG, args[0]);
-  }
-  else if (!(strcmp(reply->responseCode, ERR_NOSUCHCHANNEL)))
-  {
-    replyEndLen = strlen(ERR_NOSUCHCHANNEL_MSG) + strlen(args[0]) + 1;
-    replyEnd = (char *) malloc(replyEndLen*sizeof(char *));
-    snprintf(replyEnd, replyEndLen, ERR_NOSUCHCHANNEL_MSG, args[0]);
-  }
-  else if (!(strcmp(reply->responseCode, ERR_NOTONCHANNEL)))
-  {
-    replyEndLen = strlen(ERR_NOTONCHANNEL_MSG) + strlen(args[0]) + 1;
-    replyEnd = (char *) malloc(replyEndLen*sizeof(char *));
-    snprintf(replyEnd, replyEndLen, ERR_NOTONCHANNEL_MSG, args[0]);
-  }
-  else if (!(strcmp(reply->responseCode, ERR_CANNOTSENDTOCHAN)))
-  {
-    replyEndLen = strlen(ERR_CANNOTSENDTOCHAN_MSG) + strlen(args[0]) + 1;
-    replyEnd = (char *) malloc(replyEndLen*sizeof(char *));
-    snprintf(replyEnd, replyEndLen, ERR_CANNOTSENDTOCHAN_MSG, args[0]);
-  }
-  else if (!(strcmp(reply->responseCode, RPL_TOPIC)))
-  {
-    replyEndLen = strlen(RPL_TOPIC_MSG) + strlen(args[0]) + strlen(reply->message);
-    replyEnd = (char *) malloc(replyEndLen*sizeof(char *));
-    snprintf(replyEnd, replyEndLen, RPL_TOPIC_MSG, args[0], reply->message);
-  }
-  else if (!(strcmp(reply->responseCode, RPL_NOTOPIC)))
-  {
-    replyEndLen = strlen(RPL_NOTOPIC_MSG) + strlen(args[0]);
-    replyEnd = (char *) malloc(replyEndLen*sizeof(char *));
-    snprintf(replyEnd, replyEndLen, RPL_NOTOPIC_MSG, args[0]);
-  }
-  else if (!(strcmp(reply->responseCode, RPL_LIST)))
-  {
-    replyEndLen = strlen(RPL_LIST_MSG) + strlen(args[0]) +
-                  strlen(args[1]) + strlen(reply->message) + 1;
-    replyEnd = (char *) malloc(replyEndLen*sizeof(char));
-    snprintf(replyEnd, replyEndLen, RPL_LIST_MSG, args[0], args[1], reply->message);
-  }
-  else if (!(strcmp(reply->responseCode, RPL_LISTEND)))
-  {
-    replyEndLen = strlen(RPL_LISTEND_MSG) + 1;
-    replyEnd = (char *) malloc(replyEndLen*sizeof(char));
-    memcpy(replyEnd, RPL_LISTEND_MSG, replyEndLen);
-  }
-  else if (!(strcmp(reply->responseCode, RPL_WHOISCHANNELS)))
-  {
-    replyEndLen = strlen(RPL_WHOISCHANNELS_MSG) + strlen(args[0]) +
-                  strlen(reply->message) + 1;
-    replyEnd = (char *) malloc(replyEndLen*sizeof(char));
-    snprintf(replyEnd, replyEndLen, RPL_WHOISCHANNELS_MSG, args[0], reply->message);
-  }
-  else if (!(strcmp(reply->responseCode, ERR_UMODEUNKNOWNFLAG)))
-  {
-    replyEndLen = strlen(ERR_UMODEUNKNOWNFLAG_MSG) + 1;
-    replyEnd = (char *) malloc(replyEndLen*sizeof(char));
-    memcpy(replyEnd, ERR_UMODEUNKNOWNFLAG_MSG, replyEndLen);
-  }
-  else if (!(strcmp(reply->responseCode, ERR_USERSDONTMATCH)))
-  {
-    replyEndLen = strlen(ERR_USERSDONTMATCH_MSG) + 1;
-    replyEnd = (char *) malloc(replyEndLen*sizeof(char));
-    memcpy(replyEnd, ERR_USERSDONTMATCH_MSG, replyEndLen);
-  }
-  else if (!(strcmp(reply->responseCode, ERR_UNKNOWNMODE)))
-  {
-    replyEndLen = strlen(ERR_UNKNOWNMODE_MSG) + strlen(args[0]) +
-                  strlen(args[1]) + 1;
-    replyEnd = (char *) malloc(replyEndLen*sizeof(char));
-    snprintf(replyEnd, replyEndLen, ERR_UNKNOWNMODE_MSG, args[0], args[1]);
-  }
-  else if (!(strcmp(reply->responseCode, RPL_CHANNELMODEIS)))
-  {
-    replyEndLen = strlen(RPL_CHANNELMODEIS_MSG) + strlen(args[0]) +
-                  strlen(args[1]) + 1;
-    replyEnd = (char *) malloc(replyEndLen*sizeof(char));
-    snprintf(replyEnd, replyEndLen, RPL_CHANNELMODEIS_MSG, args[0], args[1]);
-  }
-  else if (!(strcmp(reply->responseCode, ERR_CHANOPRIVSNEEDED)))
-  {
-    replyEndLen = strlen(ERR_CHANOPRIVSNEEDED_MSG) + strlen(args[0]) + 1;
-    replyEnd = (char *) malloc(replyEndLen*sizeof(char));
-    snprintf(replyEnd, replyEndLen, ERR_CHANOPRIVSNEEDED_MSG, args[0]);
-  }
-  else if (!(strcmp(reply->responseCode, ERR_USERNOTINCHANNEL)))
-  {
-    replyEndLen = strlen(ERR_USERNOTINCHANNEL_MSG) + strlen(args[0]) +
-                  strlen(args[1]) + 1;
-    replyEnd = (char *) malloc(replyEndLen*sizeof(char));
-    snprintf(replyEnd, replyEndLen, ERR_USERNOTINCHANNEL_MSG, args[0], args[1]);
-  }
-  else if (!(strcmp(reply->responseCode, ERR_PASSWDMISMATCH)))
-  {
-    replyEndLen = strlen(ERR_PASSWDMISMATCH_MSG) + 1;
-    replyEnd = (char *) malloc(replyEndLen*sizeof(char));
-    memcpy(replyEnd, ERR_PASSWDMISMATCH_MSG, replyEndLen);
-  }
-  else if (!(strcmp(reply->responseCode, RPL_YOUREOPER)))
-  {
-    replyEndLen = strlen(RPL_YOUREOPER_MSG) + 1;
-    replyEnd = (char *) malloc(replyEndLen*sizeof(char));
-    memcpy(replyEnd, RPL_YOUREOPER_MSG, replyEndLen);
-  }
-  else if (!(strcmp(reply->responseCode, RPL_NOWAWAY)))
-  {
-    replyEndLen = strlen(RPL_NOWAWAY_MSG) + 1;
-    replyEnd = (char *) malloc(replyEndLen*sizeof(char));
-    memcpy(replyEnd, RPL_NOWAWAY_MSG, replyEndLen);
-  }
-  else if (!(strcmp(reply->responseCode, RPL_UNAWAY)))
-  {
-    replyEndLen = strlen(RPL_UNAWAY_MSG) + 1;
-    replyEnd = (char *) malloc(replyEndLen*sizeof(char));
-    memcpy(replyEnd, RPL_UNAWAY_MSG, replyEndLen);
-  }
-  else if (!(strcmp(reply->responseCode, RPL_AWAY)))
-  {
-    replyEndLen = strlen(RPL_AWAY_MSG) + strlen(args[0]) +
-                  strlen(reply->message) + 1;
-    replyEnd = (char *) malloc(replyEndLen*sizeof(char));
-    snprintf(replyEnd, replyEndLen, RPL_AWAY_MSG, args[0], reply->message);
-  }
-  else if (!(strcmp(reply->responseCode, RPL_WHOREPLY)))
-  {
-    //printf("args is %s\n", reply->message);
-    replyEndLen = strlen(reply->message);
-    replyEnd = (char *) malloc(replyEndLen*sizeof(char));
-    snprintf(replyEnd, replyEndLen, RPL_WHOREPLY_MSG, reply->message);
-  }
-  else if (!(strcmp(reply->responseCode, RPL_ENDOFWHO)))
-  {
-    //printf("args is %s\n", reply->message);
-    replyEndLen = strlen(args[0]) + strlen(RPL_ENDOFWHO_MSG);
-    replyEnd = (char *) malloc(replyEndLen*sizeof(char));
-    snprintf(replyEnd, replyEndLen, RPL_ENDOFWHO_MSG, args[0]);
-  }
-  else if (!(strcmp(reply->responseCode, RPL_WHOISOPERATOR)))
+  slotText[REPLYSLOTNICK] = reply->nickname;
+  slotLen[REPLYSLOTNICK] = strnlen(reply->nickname, MAXNICK);
+  slotText[REPLYSLOTSERVER] = reply->serverName;
+  slotLen[REPLYSLOTSERVER] = strnlen(reply->serverName, sizeof(reply->serverName));
+  slotText[REPLYSLOTMESSAGE] = reply->message;
+  slotLen[REPLYSLOTMESSAGE] = strnlen(reply->message, sizeof(reply->message));
+
+  int textLen = 0;
+  for (int n = 0; n < template->numPieces; n++)
   {
-    //printf("args is %s\n", reply->message);
-    replyEndLen = strlen(args[0]) + strlen(RPL_WHOISOPERATOR_MSG);
-    replyEnd = (char *) malloc(replyEndLen*sizeof(char));
-    snprintf(replyEnd, replyEndLen, RPL_WHOISOPERATOR_MSG, args[0]);
+    const replyPiece * piece = &template->pieces[n];
+    textLen += piece->text ? piece->len : slotLen[piece->len];
   }
-  else
-  {
+  int size = template->room ? template->room : textLen + template->pad;
+  int keep = textLen < size - 1 ? textLen : size - 1;
+  if (keep < 0)
+    keep = 0;
+
+  // create beginning of response message, ":server code nick "
+  char line[REPLYLINE];
+  int beginLen = 1 + slotLen[REPLYSLOTSERVER] + 1 + (REPLYCODELEN - 1) + 1 +
+                 slotLen[REPLYSLOTNICK] + 2;
+  if (beginLen + size > REPLYLINE)
     return -1;
-  }
+  char * out = line;
+  *out++ = ':';
+  memcpy(out, reply->serverName, slotLen[REPLYSLOTSERVER]);
+  out += slotLen[REPLYSLOTSERVER];
+  *out++ = ' ';
+  memcpy(out, reply->responseCode, REPLYCODELEN - 1);
+  out += REPLYCODELEN - 1;
+  *out++ = ' ';
+  memcpy(out, reply->nickname, slotLen[REPLYSLOTNICK]);
+  out += slotLen[REPLYSLOTNICK];
+  *out++ = ' ';
+  *out++ = '\0';
+
+  // then the pieces of the reply, as far as they fit
+  int left = keep;
+  for (int n = 0; n < template->numPieces && left; n++)
+  {
+    const replyPiece * piece = &template->pieces[n];
+    const char * text = piece->text ? piece->text : slotText[piece->len];
+    int len = piece->text ? piece->len : slotLen[piece->len];
+    if (len > left)
+      len = left;
+    memcpy(out, text, len);
+    out += len;
+    left -= len;
+  }
+  memset(out, 0, size - keep);
+
   // send message to client
-  pthread_mutex_lock(&lock);
-  send(clientSocket, replyBeginning, replyBeginLen, 0);
-  send(clientSocket, replyEnd, replyEndLen, 0);
-  send(clientSocket, "\r\n", 2,  0);
-  free(args);
+  latency_lock(&lock);
+  netio_line(clientSocket, line, beginLen + size, NULL, 0);
   pthread_mutex_unlock(&lock);
   return 1;
 }
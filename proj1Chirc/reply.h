@@ -37,6 +37,8 @@
 #define RPL_WHOREPLY		"352"
 #define RPL_ENDOFWHO		"315"
 
+#define RPL_ENDOFSTATS		"219"
+
 #define RPL_LIST			"322"
 #define RPL_LISTEND			"323"
 
@@ -57,6 +59,7 @@
 #define ERR_NOSUCHNICK			"401"
 #define ERR_NOSUCHCHANNEL		"403"
 #define ERR_CANNOTSENDTOCHAN	"404"
+#define ERR_TOOMANYTARGETS		"407"
 #define ERR_UNKNOWNCOMMAND		"421"
 #define ERR_NOMOTD              "422"
 #define ERR_NICKNAMEINUSE		"433"
@@ -66,55 +69,100 @@
 #define ERR_ALREADYREGISTRED	"462"
 #define ERR_PASSWDMISMATCH      "464"
 #define ERR_UNKNOWNMODE			"472"
+#define ERR_NOPRIVILEGES	"481"
 #define ERR_CHANOPRIVSNEEDED	"482"
 #define ERR_UMODEUNKNOWNFLAG	"501"
 #define ERR_USERSDONTMATCH		"502"
 
-#define RPL_WELCOME_MSG		":Welcome to the Internet Relay Network %s!%s@%s"
-#define RPL_YOURHOST_MSG	":Your host is %s, running version %s"
-#define RPL_CREATED_MSG		":This server was created %s"
-#define RPL_MYINFO_MSG		"%s %s %s %s"
-#define ERR_UNKNOWNCOMMAND_MSG  "%s :Unknown command"
-#define ERR_ALREADYREGISTERED_MSG ":Unauthorized command (already registered)"
-#define ERR_NICKNAMEINUSE_MSG "%s :Nickname is already in use"
-#define RPL_MOTDSTART_MSG	":- %s Message of the day - "
-#define RPL_MOTD_MSG 		":- %s"
-#define RPL_ENDOFMOTD_MSG 	":- End of MOTD command"
-#define ERR_NOSUCHNICK_MSG	"%s :No such nick/channel"
-#define RPL_LUSERCLIENT_MSG 	":There are %s users and %s services on %s servers"
-#define RPL_LUSEROP_MSG		"%s :operator(s) online"
-#define RPL_LUSERUNKNOWN_MSG	"%s :unknown connection(s)"
-#define RPL_LUSERCHANNELS_MSG	"%s :channels formed"
-#define RPL_LUSERME_MSG		":I have %s clients and %s servers"
-#define ERR_NOMOTD_MSG ":MOTD File is missing"
-#define RPL_WHOISUSER_MSG "%s %s %s * :%s"
-#define RPL_WHOISSERVER_MSG "%s %s :%s"
-#define RPL_ENDOFWHOIS_MSG "%s :End of WHOIS list"
-#define RPL_NAMREPLY_MSG "%s %s :%s"
-#define RPL_ENDOFNAMES_MSG "%s :End of NAMES list"
-#define ERR_NOSUCHCHANNEL_MSG "#%s :No such channel"
-#define ERR_NOTONCHANNEL_MSG "#%s :You're not on that channel"
-#define ERR_CANNOTSENDTOCHAN_MSG "#%s :Cannot send to channel"
-#define RPL_TOPIC_MSG "#%s :%s"
-#define RPL_NOTOPIC_MSG "#%s :No topic is set"
-#define RPL_LIST_MSG "%s %s :%s"
-#define RPL_LISTEND_MSG ":End of LIST"
-#define RPL_WHOISCHANNELS_MSG "%s :%s"
-#define ERR_UMODEUNKNOWNFLAG_MSG ":Unknown MODE flag"
-#define ERR_USERSDONTMATCH_MSG ":Cannot change mode for other users"
-#define ERR_UNKNOWNMODE_MSG "%s :is unknown mode char to me for #%s"
-#define RPL_CHANNELMODEIS_MSG "#%s +%s"
-#define ERR_CHANOPRIVSNEEDED_MSG "#%s :You're not channel operator"
-#define ERR_USERNOTINCHANNEL_MSG "%s #%s :They aren't on that channel"
-#define ERR_CANNOTSENDTOCHAN_MSG "#%s :Cannot send to channel"
-#define ERR_PASSWDMISMATCH_MSG ":Password incorrect"
-#define RPL_YOUREOPER_MSG ":You are now an IRC operator"
-#define RPL_UNAWAY_MSG ":You are no longer marked as being away"
-#define RPL_NOWAWAY_MSG ":You have been marked as being away"
-#define RPL_AWAY_MSG "%s %s"
-#define RPL_WHOREPLY_MSG "%s"
-#define RPL_ENDOFWHO_MSG "%s :End of WHO list"
-#define RPL_WHOISOPERATOR_MSG "%s :is an IRC operator"
+/* Reply templates
+ *
+ * Every reply is the text after ":server code nick ", made of
+ * literal pieces and the argument slots between them. Each entry
+ * is T(code, number, pad, room, pieces...), where pieces are
+ * REPLY_TEXT("literal") or a slot: REPLY_ARG(n) is the nth space
+ * separated word of the replyPackage args, and REPLY_NICK,
+ * REPLY_SERVER and REPLY_MESSAGE are the fields of the same name.
+ *
+ * Replies are sent followed by NUL bytes: pad of them after the
+ * text, or if room is not 0, as many as fill room bytes, the text
+ * being cut to room - 1 bytes if it is longer. Clients have always
+ * seen replies this way, so the table keeps them exactly.
+ */
+#define REPLYSLOTNICK 8
+#define REPLYSLOTSERVER 9
+#define REPLYSLOTMESSAGE 10
+#define REPLYSLOTS 11
+// replyPackage args words which may be used as slots
+#define REPLYARGS 8
+// most pieces in one template
+#define REPLYPIECES 8
+// longest reply, with its NUL bytes
+#define REPLYLINE 1024
+
+#define REPLY_TEXT(s)	{ s, sizeof(s) - 1 }
+#define REPLY_ARG(n)	{ NULL, n }
+#define REPLY_NICK		{ NULL, REPLYSLOTNICK }
+#define REPLY_SERVER	{ NULL, REPLYSLOTSERVER }
+#define REPLY_MESSAGE	{ NULL, REPLYSLOTMESSAGE }
+
+#define REPLY_TEMPLATES(T) \
+  T(RPL_WELCOME, 1, 7, 0, REPLY_TEXT(":Welcome to the Internet Relay Network "), REPLY_NICK, \
+    REPLY_TEXT("!"), REPLY_ARG(0), REPLY_TEXT("@"), REPLY_ARG(1)) \
+  T(RPL_YOURHOST, 2, 5, 0, REPLY_TEXT(":Your host is "), REPLY_SERVER, \
+    REPLY_TEXT(", running version "), REPLY_ARG(0)) \
+  T(RPL_CREATED, 3, 2, 0, REPLY_TEXT(":This server was created "), REPLY_MESSAGE) \
+  T(RPL_MYINFO, 4, 9, 0, REPLY_SERVER, REPLY_TEXT(" "), REPLY_ARG(0), REPLY_TEXT(" "), \
+    REPLY_ARG(1), REPLY_TEXT(" "), REPLY_ARG(2)) \
+  T(RPL_ENDOFSTATS, 219, 2, 0, REPLY_ARG(0), REPLY_TEXT(" :End of STATS report")) \
+  T(RPL_LUSERCLIENT, 251, 0, 50, REPLY_TEXT(":There are "), REPLY_ARG(5), REPLY_TEXT(" users and "), \
+    REPLY_ARG(1), REPLY_TEXT(" services on "), REPLY_ARG(6), REPLY_TEXT(" servers")) \
+  T(RPL_LUSEROP, 252, 0, 23, REPLY_ARG(2), REPLY_TEXT(" :operator(s) online")) \
+  T(RPL_LUSERUNKNOWN, 253, 0, 26, REPLY_ARG(4), REPLY_TEXT(" :unknown connection(s)")) \
+  T(RPL_LUSERCHANNELS, 254, 0, 20, REPLY_ARG(3), REPLY_TEXT(" :channels formed")) \
+  T(RPL_LUSERME, 255, 0, 34, REPLY_TEXT(":I have "), REPLY_ARG(0), REPLY_TEXT(" clients and "), \
+    REPLY_ARG(6), REPLY_TEXT(" servers")) \
+  T(RPL_AWAY, 301, 5, 0, REPLY_ARG(0), REPLY_TEXT(" "), REPLY_MESSAGE) \
+  T(RPL_UNAWAY, 305, 1, 0, REPLY_TEXT(":You are no longer marked as being away")) \
+  T(RPL_NOWAWAY, 306, 1, 0, REPLY_TEXT(":You have been marked as being away")) \
+  T(RPL_WHOISUSER, 311, 9, 0, REPLY_ARG(0), REPLY_TEXT(" "), REPLY_ARG(1), REPLY_TEXT(" "), \
+    REPLY_ARG(2), REPLY_TEXT(" * :"), REPLY_MESSAGE) \
+  T(RPL_WHOISSERVER, 312, 7, 0, REPLY_ARG(0), REPLY_TEXT(" "), REPLY_ARG(1), REPLY_TEXT(" :"), \
+    REPLY_ARG(2)) \
+  T(RPL_WHOISOPERATOR, 313, 2, 0, REPLY_ARG(0), REPLY_TEXT(" :is an IRC operator")) \
+  T(RPL_ENDOFWHO, 315, 2, 0, REPLY_ARG(0), REPLY_TEXT(" :End of WHO list")) \
+  T(RPL_ENDOFWHOIS, 318, 3, 0, REPLY_ARG(0), REPLY_TEXT(" :End of WHOIS list")) \
+  T(RPL_WHOISCHANNELS, 319, 5, 0, REPLY_ARG(0), REPLY_TEXT(" :"), REPLY_MESSAGE) \
+  T(RPL_LIST, 322, 7, 0, REPLY_ARG(0), REPLY_TEXT(" "), REPLY_ARG(1), REPLY_TEXT(" :"), REPLY_MESSAGE) \
+  T(RPL_LISTEND, 323, 1, 0, REPLY_TEXT(":End of LIST")) \
+  T(RPL_CHANNELMODEIS, 324, 5, 0, REPLY_TEXT("#"), REPLY_ARG(0), REPLY_TEXT(" +"), REPLY_ARG(1)) \
+  T(RPL_NOTOPIC, 331, 2, 0, REPLY_TEXT("#"), REPLY_ARG(0), REPLY_TEXT(" :No topic is set")) \
+  T(RPL_TOPIC, 332, 4, 0, REPLY_TEXT("#"), REPLY_ARG(0), REPLY_TEXT(" :"), REPLY_MESSAGE) \
+  T(RPL_WHOREPLY, 352, 0, 0, REPLY_MESSAGE) \
+  T(RPL_NAMREPLY, 353, 7, 0, REPLY_ARG(0), REPLY_TEXT(" "), REPLY_ARG(1), REPLY_TEXT(" :"), REPLY_MESSAGE) \
+  T(RPL_ENDOFNAMES, 366, 3, 0, REPLY_ARG(0), REPLY_TEXT(" :End of NAMES list")) \
+  T(RPL_MOTD, 372, 3, 0, REPLY_TEXT(":- "), REPLY_MESSAGE) \
+  T(RPL_MOTDSTART, 375, 3, 0, REPLY_TEXT(":- "), REPLY_SERVER, REPLY_TEXT(" Message of the day - ")) \
+  T(RPL_ENDOFMOTD, 376, 1, 0, REPLY_TEXT(":- End of MOTD command")) \
+  T(RPL_YOUREOPER, 381, 1, 0, REPLY_TEXT(":You are now an IRC operator")) \
+  T(ERR_NOSUCHNICK, 401, 3, 0, REPLY_ARG(0), REPLY_TEXT(" :No such nick/channel")) \
+  T(ERR_NOSUCHCHANNEL, 403, 3, 0, REPLY_TEXT("#"), REPLY_ARG(0), REPLY_TEXT(" :No such channel")) \
+  T(ERR_CANNOTSENDTOCHAN, 404, 3, 0, REPLY_TEXT("#"), REPLY_ARG(0), REPLY_TEXT(" :Cannot send to channel")) \
+  T(ERR_TOOMANYTARGETS, 407, 2, 0, REPLY_ARG(0), REPLY_TEXT(" :Too many targets, the rest were dropped")) \
+  T(ERR_UNKNOWNCOMMAND, 421, 3, 0, REPLY_ARG(0), REPLY_TEXT(" :Unknown command")) \
+  T(ERR_NOMOTD, 422, 1, 0, REPLY_TEXT(":MOTD File is missing")) \
+  T(ERR_NICKNAMEINUSE, 433, 3, 0, REPLY_ARG(0), REPLY_TEXT(" :Nickname is already in use")) \
+  T(ERR_USERNOTINCHANNEL, 441, 5, 0, REPLY_ARG(0), REPLY_TEXT(" #"), REPLY_ARG(1), \
+    REPLY_TEXT(" :They aren't on that channel")) \
+  T(ERR_NOTONCHANNEL, 442, 3, 0, REPLY_TEXT("#"), REPLY_ARG(0), REPLY_TEXT(" :You're not on that channel")) \
+  T(ERR_ALREADYREGISTRED, 462, 1, 0, REPLY_TEXT(":Unauthorized command (already registered)")) \
+  T(ERR_PASSWDMISMATCH, 464, 1, 0, REPLY_TEXT(":Password incorrect")) \
+  T(ERR_UNKNOWNMODE, 472, 5, 0, REPLY_ARG(0), REPLY_TEXT(" :is unknown mode char to me for #"), \
+    REPLY_ARG(1)) \
+  T(ERR_NOPRIVILEGES, 481, 1, 0, REPLY_TEXT(":Permission Denied- You're not an IRC operator")) \
+  T(ERR_CHANOPRIVSNEEDED, 482, 3, 0, REPLY_TEXT("#"), REPLY_ARG(0), \
+    REPLY_TEXT(" :You're not channel operator")) \
+  T(ERR_UMODEUNKNOWNFLAG, 501, 1, 0, REPLY_TEXT(":Unknown MODE flag")) \
+  T(ERR_USERSDONTMATCH, 502, 1, 0, REPLY_TEXT(":Cannot change mode for other users"))
 
 int send_response(int clientSocket, replyPackage * reply);
 
@@ -0,0 +1,1213 @@
+/*
+ *
+ *  CMSC 23300 / 33300 - Networks and Distributed Systems
+ *
+ *  Server-to-server Link Functions
+ *
+ *  Servers are linked in a spanning tree. Each server keeps the
+ *  user and channel state of the whole network: remote users live
+ *  in the global user list and in channel user lists like local
+ *  ones, but with their socket set to -1 and their link set to the
+ *  socket of the server link they are reached through.
+ *
+ *  Link protocol (a small subset of RFC 2813), one line each:
+ *    PASS <password>
+ *    [:<uplink>] SERVER <name> <hopcount> :<info>
+ *    NICK <nick> <hopcount> <username> <host> <server> +<modes> :<name>
+ *    :<nick> NICK <newnick>
+ *    NJOIN #<channel> :[@|+]<nick>[,[@|+]<nick>...]
+ *    :<nick> PART #<channel> [:<message>]
+ *    :<nick> PRIVMSG|NOTICE <target> :<message>
+ *    :<nick> QUIT :<message>
+ *    SQUIT <name> :<reason>
+ *
+ */
+#include <netdb.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include "casemap.h"
+#include "epoch.h"
+#include "history.h"
+#include "listfxns.h"
+#include "members.h"
+#include "modes.h"
+#include "netio.h"
+#include "parser.h"
+#include "server.h"
+#include "structures.h"
+
+
+extern pthread_mutex_t lock;
+extern pthread_mutex_t chanLock;
+
+// every server known to us, directly linked (hopcount 1) or not
+static list_t servList;
+static pthread_mutex_t servLock;
+// size of servList, readable without servLock
+static int numServers = 0;
+
+struct linkState
+{
+  int socket;
+  int registered;
+  int outbound;
+  char name[MAXHOST];
+  char passwd[MAXPASSWORD];
+  list_t * userList;
+  list_t * chanList;
+  serverInfo * servData;
+};
+
+
+/* server_init:
+ * Initializes the list of known servers.
+ */
+void server_init(void)
+{
+  pthread_mutex_init(&servLock, NULL);
+  list_init(&servList);
+  list_attributes_copy(&servList, link_info_size, 1);
+  list_attributes_comparator(&servList, link_comparator);
+  list_attributes_seeker(&servList, (element_seeker) link_seeker);
+}
+
+
+/* server_count:
+ * Returns the number of servers known to this server,
+ * not counting itself.
+ */
+int server_count(void)
+{
+  pthread_mutex_lock(&servLock);
+  int num_servers = list_size(&servList);
+  pthread_mutex_unlock(&servLock);
+  return num_servers;
+}
+
+
+/* clean_message:
+ * Copies msg into text without its leading colon
+ * and trailing line terminators.
+ */
+static void clean_message(char * text, char * msg)
+{
+  if (msg[0] == ':')
+    msg++;
+  int msgLen = strlen(msg);
+  if (msgLen > MAXTOPIC - 1)
+    msgLen = MAXTOPIC - 1;
+  memcpy(text, msg, msgLen);
+  while ((msgLen > 0) && ((text[msgLen-1] == '\r') || (text[msgLen-1] == '\n')))
+    msgLen--;
+  text[msgLen] = '\0';
+}
+
+
+/* format_line:
+ * Formats a protocol line terminated by "\r\n" into line,
+ * which must hold SERVERLINELEN chars. Returns its length.
+ */
+static int format_line(char * line, const char * fmt, va_list ap)
+{
+  int lineLen = vsnprintf(line, SERVERLINELEN - 2, fmt, ap);
+  if (lineLen > SERVERLINELEN - 3)
+    lineLen = SERVERLINELEN - 3;
+  line[lineLen++] = '\r';
+  line[lineLen++] = '\n';
+  line[lineLen] = '\0';
+  return lineLen;
+}
+
+
+/* send_line:
+ * Sends a single formatted line on socket. The line goes out in
+ * one send() so that lines written by different threads to the
+ * same link never interleave.
+ */
+static void send_line(int socket, const char * fmt, ...)
+{
+  char line[SERVERLINELEN];
+  va_list ap;
+  va_start(ap, fmt);
+  int lineLen = format_line(line, fmt, ap);
+  va_end(ap);
+  send(socket, line, lineLen, MSG_NOSIGNAL);
+}
+
+
+/* propagate:
+ * Sends a formatted line to every directly linked server
+ * except the one on socket fromLink.
+ */
+static void propagate(int fromLink, const char * fmt, ...)
+{
+  char line[SERVERLINELEN];
+  va_list ap;
+  va_start(ap, fmt);
+  int lineLen = format_line(line, fmt, ap);
+  va_end(ap);
+
+  pthread_mutex_lock(&servLock);
+  list_iterator_start(&servList);
+  while (list_iterator_hasnext(&servList))
+  {
+    linkData * server = (linkData *) list_iterator_next(&servList);
+    if ((server->hopcount == 1) && (server->socket != fromLink))
+      send(server->socket, line, lineLen, MSG_NOSIGNAL);
+  }
+  list_iterator_stop(&servList);
+  pthread_mutex_unlock(&servLock);
+}
+
+
+/* route_channel:
+ * Sends a formatted line once to every server link, other than
+ * fromLink, through which at least one member of channel is reached.
+ */
+static void route_channel(channelData * channel, int fromLink, const char * fmt, ...)
+{
+  int links[MAXLINKS];
+  int numLinks = 0;
+
+  // keeps channel messages lock free when no server is linked
+  if (__atomic_load_n(&numServers, __ATOMIC_ACQUIRE) == 0)
+    return;
+  pthread_mutex_lock(&channel->chanUserLock);
+  list_iterator_start(channel->userList);
+  while (list_iterator_hasnext(channel->userList))
+  {
+    userInfo * user = (userInfo *) list_iterator_next(channel->userList);
+    if ((!user->remote) || (user->link == fromLink))
+      continue;
+    int n;
+    for (n=0; n<numLinks; n++)
+      if (links[n] == user->link)
+        break;
+    if ((n == numLinks) && (numLinks < MAXLINKS))
+      links[numLinks++] = user->link;
+  }
+  list_iterator_stop(channel->userList);
+  pthread_mutex_unlock(&channel->chanUserLock);
+
+  if (numLinks == 0)
+    return;
+  char line[SERVERLINELEN];
+  va_list ap;
+  va_start(ap, fmt);
+  int lineLen = format_line(line, fmt, ap);
+  va_end(ap);
+  for (int n=0; n<numLinks; n++)
+    send(links[n], line, lineLen, MSG_NOSIGNAL);
+}
+
+
+/* server_introduce:
+ * Announces a newly registered local user to all linked servers.
+ */
+void server_introduce(userInfo * info, serverInfo * servData)
+{
+  char name[MAXTOPIC];
+  char modes[MODEMAXLETTERS];
+  clean_message(name, info->name);
+  mode_render(MODEUSER, info->modes, modes);
+  propagate(0, "NICK %s 1 %s %s %s +%s :%s", info->nickname,
+                                              info->username,
+                                              info->host,
+                                              servData->serverHost,
+                                              modes,
+                                              name);
+}
+
+
+/* server_nick:
+ * Announces a local user's nickname change to all linked servers.
+ */
+void server_nick(char * oldNick, char * newNick)
+{
+  propagate(0, ":%s NICK %s", oldNick, newNick);
+}
+
+
+/* server_join:
+ * Announces that a local user joined a channel, with
+ * channel member mode mode ('o', 'v' or none).
+ */
+void server_join(userInfo * info, char * chanName, char mode)
+{
+  char * prefix = "";
+  if (mode == 'o')
+    prefix = "@";
+  else if (mode == 'v')
+    prefix = "+";
+  propagate(0, "NJOIN #%s :%s%s", chanName, prefix, info->nickname);
+}
+
+
+/* server_part:
+ * Announces that a local user left a channel.
+ */
+void server_part(userInfo * info, char * chanName, char * msg)
+{
+  char text[MAXTOPIC];
+  if (msg)
+  {
+    clean_message(text, msg);
+    propagate(0, ":%s PART #%s :%s", info->nickname, chanName, text);
+  }
+  else
+    propagate(0, ":%s PART #%s", info->nickname, chanName);
+}
+
+
+/* server_message:
+ * Routes a PRIVMSG or NOTICE sent by a local user. Channel messages
+ * go only to the servers that have members in channel; messages to
+ * a remote user go only to the link that user is reached through.
+ */
+void server_message(userInfo * info, char * verb, channelData * channel, userInfo * to_user, char * msg)
+{
+  char text[MAXTOPIC];
+  clean_message(text, msg);
+  if (channel)
+    route_channel(channel, 0, ":%s %s #%s :%s", info->nickname, verb, channel->name, text);
+  else if (to_user && to_user->remote)
+    send_line(to_user->link, ":%s %s %s :%s", info->nickname, verb, to_user->nickname, text);
+}
+
+
+/* server_quit:
+ * Announces that a local user quit.
+ */
+void server_quit(userInfo * info, char * msg)
+{
+  char text[MAXTOPIC];
+  clean_message(text, msg);
+  propagate(0, ":%s QUIT :%s", info->nickname, text);
+}
+
+
+/* deliver_local:
+ * Sends line, which ends in "\r\n", to every local member of
+ * channel. Caller must hold the channel's chanUserLock.
+ */
+static void deliver_local(channelData * channel, char * line, int lineLen)
+{
+  netio_batch_start();
+  list_iterator_start(channel->userList);
+  while (list_iterator_hasnext(channel->userList))
+  {
+    userInfo * user = (userInfo *) list_iterator_next(channel->userList);
+    if (!user->remote)
+      netio_line(user->socket, line, lineLen - 2, NULL, 0);
+  }
+  list_iterator_stop(channel->userList);
+  netio_batch_flush();
+}
+
+
+/* user_line:
+ * Formats a line with the full ":nick!user@host" prefix of user,
+ * as it is delivered to local clients. Returns its length.
+ */
+static int user_line(char * line, userInfo * user, const char * fmt, ...)
+{
+  char body[SERVERLINELEN];
+  va_list ap;
+  va_start(ap, fmt);
+  vsnprintf(body, SERVERLINELEN, fmt, ap);
+  va_end(ap);
+  int lineLen = snprintf(line, SERVERLINELEN - 2, ":%s!%s@%s %s", user->nickname,
+                                                                 user->username,
+                                                                 user->host,
+                                                                 body);
+  if (lineLen > SERVERLINELEN - 3)
+    lineLen = SERVERLINELEN - 3;
+  line[lineLen++] = '\r';
+  line[lineLen++] = '\n';
+  line[lineLen] = '\0';
+  return lineLen;
+}
+
+
+/* remote_user:
+ * Copies the user with nickname nick into user, provided that the
+ * user is reached through the link in ls. Returns 1 if found.
+ */
+static int remote_user(struct linkState * ls, char * nick, userInfo * user)
+{
+  pthread_mutex_lock(&lock);
+  userInfo * found = (userInfo *) list_seek(ls->userList, casemap_key(nick));
+  if ((!found) || (!found->remote) || (found->link != ls->socket))
+  {
+    pthread_mutex_unlock(&lock);
+    return 0;
+  }
+  memcpy(user, found, sizeof(userInfo));
+  pthread_mutex_unlock(&lock);
+  return 1;
+}
+
+
+/* user_channels:
+ * Returns a malloc'd array of the names of all channels user is
+ * on, each MAXCHANNAME chars long, and stores its length in num.
+ */
+static char * user_channels(userInfo * user, int * num)
+{
+  char * chanNames = NULL;
+  *num = 0;
+  if (!user->channelModes)
+    return NULL;
+  pthread_mutex_lock(&lock);
+  chanNames = (char *) malloc((list_size(user->channelModes) + 1) * MAXCHANNAME);
+  list_iterator_start(user->channelModes);
+  while (list_iterator_hasnext(user->channelModes))
+  {
+    forChannel * chanModes = (forChannel *) list_iterator_next(user->channelModes);
+    memcpy(chanNames + (*num) * MAXCHANNAME, chanModes->channelName, MAXCHANNAME);
+    (*num)++;
+  }
+  list_iterator_stop(user->channelModes);
+  pthread_mutex_unlock(&lock);
+  return chanNames;
+}
+
+
+/* channel_find:
+ * Returns the channel named chanName, creating it
+ * if create is set and it does not exist yet.
+ */
+static channelData * channel_find(list_t * chanList, char * chanName, int create)
+{
+  pthread_mutex_lock(&chanLock);
+  channelData * channel = (channelData *) list_seek(chanList, casemap_key(chanName));
+  if ((channel == NULL) && (create))
+  {
+    channelData newChannel;
+    memset(&newChannel, 0, sizeof(channelData));
+    strncpy(newChannel.name, chanName, MAXCHANNAME - 1);
+    chan_key(&newChannel);
+    pthread_mutex_init(&newChannel.chanUserLock, NULL);
+    newChannel.userList = (list_t *) malloc(sizeof(list_t));
+    list_init(newChannel.userList);
+    list_attributes_copy(newChannel.userList, user_info_size, 1);
+    list_attributes_comparator(newChannel.userList, nick_comparator);
+    list_attributes_seeker(newChannel.userList, (element_seeker) seeker);
+    members_init(&newChannel);
+    history_init(&newChannel);
+    list_append(chanList, &newChannel);
+    list_sort(chanList, 1);
+    char * newName = newChannel.name;
+    channel = (channelData *) list_seek(chanList, casemap_key(newName));
+  }
+  pthread_mutex_unlock(&chanLock);
+  return channel;
+}
+
+
+/* channel_remove:
+ * Removes an empty channel from the global channel list.
+ */
+static void channel_remove(list_t * chanList, channelData * channel)
+{
+  pthread_mutex_lock(&chanLock);
+  int chanIndex = list_locate(chanList, channel);
+  if (chanIndex > -1)
+  {
+    members_free(channel);
+    history_free(channel);
+    list_delete_at(chanList, chanIndex);
+  }
+  pthread_mutex_unlock(&chanLock);
+}
+
+
+/* remove_user:
+ * Removes a remote user from all of its channels and from the
+ * global user list, telling local channel members that it quit.
+ */
+static void remove_user(list_t * userList, list_t * chanList, userInfo * user, char * msg)
+{
+  char line[SERVERLINELEN];
+  int lineLen = user_line(line, user, "QUIT :%s", msg);
+  int numChans;
+  char * chanNames = user_channels(user, &numChans);
+
+  for (int n=0; n<numChans; n++)
+  {
+    channelData * channel = channel_find(chanList, chanNames + n * MAXCHANNAME, 0);
+    if (channel == NULL)
+      continue;
+    pthread_mutex_lock(&channel->chanUserLock);
+    int userIndex = list_locate(channel->userList, user);
+    if (userIndex > -1)
+      list_delete_at(channel->userList, userIndex);
+    deliver_local(channel, line, lineLen);
+    int isEmpty = (list_size(channel->userList) == 0);
+    pthread_mutex_unlock(&channel->chanUserLock);
+    if (isEmpty)
+      channel_remove(chanList, channel);
+  }
+  free(chanNames);
+
+  pthread_mutex_lock(&lock);
+  int userIndex = list_locate(userList, user);
+  if (userIndex > -1)
+    list_delete_at(userList, userIndex);
+  pthread_mutex_unlock(&lock);
+  if (user->channelModes)
+  {
+    list_destroy(user->channelModes);
+    free(user->channelModes);
+  }
+}
+
+
+/* link_add:
+ * Adds a server to the list of known servers.
+ * Returns -1 if a server with that name is already known.
+ */
+static int link_add(char * name, char * uplink, int hopcount, int socket)
+{
+  linkData newLink;
+  memset(&newLink, 0, sizeof(linkData));
+  strncpy(newLink.name, name, MAXHOST - 1);
+  strncpy(newLink.uplink, uplink, MAXHOST - 1);
+  newLink.hopcount = hopcount;
+  newLink.socket = socket;
+
+  pthread_mutex_lock(&servLock);
+  if (list_seek(&servList, &name))
+  {
+    pthread_mutex_unlock(&servLock);
+    return -1;
+  }
+  list_append(&servList, &newLink);
+  __atomic_store_n(&numServers, list_size(&servList), __ATOMIC_RELEASE);
+  pthread_mutex_unlock(&servLock);
+  return 1;
+}
+
+
+/* squit:
+ * Forgets server name, every server behind it, and every user on
+ * those servers. Users reached through socket dropLink are removed
+ * as well, which cleans up after a directly linked server.
+ */
+static void squit(struct linkState * ls, char * name, int dropLink, char * reason)
+{
+  int numGone = 0;
+  char * gone = (char *) malloc(MAXHOST);
+  strncpy(gone, name, MAXHOST - 1);
+  gone[MAXHOST-1] = '\0';
+  numGone++;
+
+  // collect the server and, transitively, all servers it introduced
+  pthread_mutex_lock(&servLock);
+  int n = 0;
+  while (n < list_size(&servList))
+  {
+    linkData * server = (linkData *) list_get_at(&servList, n);
+    int isGone = !strcmp(server->name, name);
+    for (int i=0; (i<numGone) && (!isGone); i++)
+      if (!strcmp(server->uplink, gone + i * MAXHOST))
+        isGone = 1;
+    if (isGone)
+    {
+      if (strcmp(server->name, name))
+      {
+        gone = (char *) realloc(gone, (numGone + 1) * MAXHOST);
+        memcpy(gone + numGone * MAXHOST, server->name, MAXHOST);
+        numGone++;
+      }
+      list_delete_at(&servList, n);
+      n = 0;
+    }
+    else
+      n++;
+  }
+  __atomic_store_n(&numServers, list_size(&servList), __ATOMIC_RELEASE);
+  pthread_mutex_unlock(&servLock);
+
+  // collect the users on those servers
+  int numUsers = 0;
+  userInfo * users = NULL;
+  pthread_mutex_lock(&lock);
+  users = (userInfo *) malloc((list_size(ls->userList) + 1) * sizeof(userInfo));
+  list_iterator_start(ls->userList);
+  while (list_iterator_hasnext(ls->userList))
+  {
+    userInfo * user = (userInfo *) list_iterator_next(ls->userList);
+    if (!user->remote)
+      continue;
+    int isGone = (user->link == dropLink);
+    for (int i=0; i<numGone; i++)
+      if (!strcmp(user->server, gone + i * MAXHOST))
+        isGone = 1;
+    if (isGone)
+      memcpy(&users[numUsers++], user, sizeof(userInfo));
+  }
+  list_iterator_stop(ls->userList);
+  pthread_mutex_unlock(&lock);
+
+  for (int i=0; i<numUsers; i++)
+    remove_user(ls->userList, ls->chanList, &users[i], reason);
+  free(users);
+  free(gone);
+}
+
+
+/* link_burst:
+ * Sends every server, user and channel membership known to
+ * us, except those reached through the link itself.
+ */
+static void link_burst(struct linkState * ls)
+{
+  serverInfo * servData = ls->servData;
+
+  pthread_mutex_lock(&servLock);
+  list_iterator_start(&servList);
+  while (list_iterator_hasnext(&servList))
+  {
+    linkData * server = (linkData *) list_iterator_next(&servList);
+    if (server->socket != ls->socket)
+      send_line(ls->socket, ":%s SERVER %s %d :chirc", server->uplink,
+                                                      server->name,
+                                                      server->hopcount + 1);
+  }
+  list_iterator_stop(&servList);
+  pthread_mutex_unlock(&servLock);
+
+  pthread_mutex_lock(&lock);
+  list_iterator_start(ls->userList);
+  while (list_iterator_hasnext(ls->userList))
+  {
+    userInfo * user = (userInfo *) list_iterator_next(ls->userList);
+    if (user->remote && (user->link == ls->socket))
+      continue;
+    char name[MAXTOPIC];
+    char modes[MODEMAXLETTERS];
+    clean_message(name, user->name);
+    mode_render(MODEUSER, user->modes, modes);
+    send_line(ls->socket, "NICK %s 1 %s %s %s +%s :%s", user->nickname,
+                                                        user->username,
+                                                        user->host,
+                                                        user->remote ? user->server : servData->serverHost,
+                                                        modes,
+                                                        name);
+  }
+  list_iterator_stop(ls->userList);
+  pthread_mutex_unlock(&lock);
+
+  pthread_mutex_lock(&chanLock);
+  list_iterator_start(ls->chanList);
+  while (list_iterator_hasnext(ls->chanList))
+  {
+    channelData * channel = (channelData *) list_iterator_next(ls->chanList);
+    char members[SERVERLINELEN];
+    int membersLen = 0;
+    char * chanName = channel->name;
+    pthread_mutex_lock(&channel->chanUserLock);
+    list_iterator_start(channel->userList);
+    while (list_iterator_hasnext(channel->userList))
+    {
+      userInfo * user = (userInfo *) list_iterator_next(channel->userList);
+      if (user->remote && (user->link == ls->socket))
+        continue;
+      char * prefix = "";
+      forChannel * userChannel = (forChannel *) list_seek(user->channelModes, casemap_key(chanName));
+      if (userChannel && (userChannel->modes & MODE_CHANOP))
+        prefix = "@";
+      else if (userChannel && (userChannel->modes & MODE_VOICE))
+        prefix = "+";
+      membersLen += snprintf(members + membersLen, SERVERLINELEN - membersLen, "%s%s%s",
+                             membersLen ? "," : "", prefix, user->nickname);
+      // keep each NJOIN well below the line length limit
+      if (membersLen > SERVERLINELEN / 2)
+      {
+        send_line(ls->socket, "NJOIN #%s :%s", channel->name, members);
+        membersLen = 0;
+      }
+    }
+    list_iterator_stop(channel->userList);
+    pthread_mutex_unlock(&channel->chanUserLock);
+    if (membersLen > 0)
+      send_line(ls->socket, "NJOIN #%s :%s", channel->name, members);
+  }
+  list_iterator_stop(ls->chanList);
+  pthread_mutex_unlock(&chanLock);
+}
+
+
+/* link_establish:
+ * Registers the server name on the other end of the link, replying
+ * with our own PASS and SERVER if reply is set, and bursts our state.
+ * Returns -1 if the link must be refused.
+ */
+static int link_establish(struct linkState * ls, char * name, int reply)
+{
+  serverInfo * servData = ls->servData;
+  if (!server_password(ls->passwd, servData))
+  {
+    send_line(ls->socket, "ERROR :Bad password");
+    return -1;
+  }
+  if ((!strcmp(name, servData->serverHost)) ||
+      (link_add(name, servData->serverHost, 1, ls->socket) == -1))
+  {
+    send_line(ls->socket, "ERROR :Server %s already exists", name);
+    return -1;
+  }
+  strncpy(ls->name, name, MAXHOST - 1);
+  ls->registered = 1;
+  if (reply)
+  {
+    send_line(ls->socket, "PASS %s", servData->passwd);
+    send_line(ls->socket, "SERVER %s 1 :chirc", servData->serverHost);
+  }
+  link_burst(ls);
+  propagate(ls->socket, ":%s SERVER %s 2 :chirc", servData->serverHost, name);
+  return 1;
+}
+
+
+/* link_nick:
+ * Handles a NICK from a linked server, which either introduces
+ * a new remote user or changes a remote user's nickname.
+ */
+static void link_nick(struct linkState * ls, char * prefix, char ** argList, int argNum)
+{
+  // nickname change
+  if (prefix)
+  {
+    char * newNick = argList[1];
+    userInfo user;
+    if (!remote_user(ls, prefix, &user))
+      return;
+    pthread_mutex_lock(&lock);
+    if (list_seek(ls->userList, casemap_key(newNick)))
+    {
+      pthread_mutex_unlock(&lock);
+      return;
+    }
+    userInfo * found = (userInfo *) list_seek(ls->userList, casemap_key(prefix));
+    if (found)
+    {
+      memset(found->nickname, 0, MAXNICK);
+      strncpy(found->nickname, newNick, MAXNICK - 1);
+      user_key(found);
+      list_sort(ls->userList, -1);
+    }
+    pthread_mutex_unlock(&lock);
+
+    char line[SERVERLINELEN];
+    int lineLen = user_line(line, &user, "NICK :%s", newNick);
+    int numChans;
+    char * chanNames = user_channels(&user, &numChans);
+    for (int n=0; n<numChans; n++)
+    {
+      channelData * channel = channel_find(ls->chanList, chanNames + n * MAXCHANNAME, 0);
+      if (channel == NULL)
+        continue;
+      pthread_mutex_lock(&channel->chanUserLock);
+      userInfo * member = (userInfo *) list_seek(channel->userList, casemap_key(prefix));
+      if (member)
+      {
+        memset(member->nickname, 0, MAXNICK);
+        strncpy(member->nickname, newNick, MAXNICK - 1);
+        user_key(member);
+        list_sort(channel->userList, -1);
+      }
+      deliver_local(channel, line, lineLen);
+      pthread_mutex_unlock(&channel->chanUserLock);
+    }
+    free(chanNames);
+    propagate(ls->socket, ":%s NICK %s", prefix, newNick);
+    return;
+  }
+
+  // new remote user
+  if (argNum < 8)
+    return;
+  char * nick = argList[1];
+  char * modes = argList[6];
+  char name[MAXTOPIC];
+  if (modes[0] == '+')
+    modes++;
+  clean_message(name, argList[7]);
+
+  userInfo newUser;
+  memset(&newUser, 0, sizeof(userInfo));
+  strncpy(newUser.nickname, nick, MAXNICK - 1);
+  user_key(&newUser);
+  strncpy(newUser.username, argList[3], MAXUSER - 1);
+  strncpy(newUser.host, argList[4], MAXHOST - 1);
+  strncpy(newUser.server, argList[5], MAXHOST - 1);
+  newUser.modes = mode_parse(MODEUSER, modes);
+  // stored like local names, which keep the client's trailing '\r'
+  int nameLen = strnlen(name, MAXNAME - 2);
+  memcpy(newUser.name, name, nameLen);
+  newUser.name[nameLen] = '\r';
+  newUser.socket = -1;
+  newUser.remote = 1;
+  newUser.link = ls->socket;
+  newUser.channelModes = (list_t *) malloc(sizeof(list_t));
+  list_init(newUser.channelModes);
+  list_attributes_copy(newUser.channelModes, chanmode_info_size, 1);
+  list_attributes_comparator(newUser.channelModes, chanmode_comparator);
+  list_attributes_seeker(newUser.channelModes, (element_seeker) chanmode_seeker);
+
+  pthread_mutex_lock(&lock);
+  if (list_seek(ls->userList, casemap_key(nick)))
+  {
+    // nickname collision: keep the user we already know about
+    pthread_mutex_unlock(&lock);
+    list_destroy(newUser.channelModes);
+    free(newUser.channelModes);
+    return;
+  }
+  list_append(ls->userList, &newUser);
+  list_sort(ls->userList, -1);
+  pthread_mutex_unlock(&lock);
+
+  char userModes[MODEMAXLETTERS];
+  mode_render(MODEUSER, newUser.modes, userModes);
+  propagate(ls->socket, "NICK %s %d %s %s %s +%s :%s", newUser.nickname,
+                                                       atoi(argList[2]) + 1,
+                                                       newUser.username,
+                                                       newUser.host,
+                                                       newUser.server,
+                                                       userModes,
+                                                       name);
+}
+
+
+/* link_join:
+ * Adds a remote user to a channel with member mode mode,
+ * creating the channel if needed.
+ */
+static void link_join(struct linkState * ls, char * chanName, char * nick, char mode)
+{
+  userInfo user;
+  if (!remote_user(ls, nick, &user))
+    return;
+  channelData * channel = channel_find(ls->chanList, chanName, 1);
+  char * nickname = user.nickname;
+
+  pthread_mutex_lock(&channel->chanUserLock);
+  if (list_seek(channel->userList, casemap_key(nickname)))
+  {
+    pthread_mutex_unlock(&channel->chanUserLock);
+    return;
+  }
+  list_append(channel->userList, &user);
+  list_sort(channel->userList, -1);
+  char line[SERVERLINELEN];
+  int lineLen = user_line(line, &user, "JOIN #%s", channel->name);
+  deliver_local(channel, line, lineLen);
+  pthread_mutex_unlock(&channel->chanUserLock);
+
+  forChannel memberStatusMode;
+  memset(&memberStatusMode, 0, sizeof(forChannel));
+  strncpy(memberStatusMode.channelName, channel->name, MAXCHANNAME - 1);
+  chanmode_key(&memberStatusMode);
+  memberStatusMode.modes = mode_bit(MODEMEMBER, mode);
+  pthread_mutex_lock(&lock);
+  list_append(user.channelModes, &memberStatusMode);
+  list_sort(user.channelModes, -1);
+  pthread_mutex_unlock(&lock);
+}
+
+
+/* link_njoin:
+ * Handles an NJOIN from a linked server.
+ */
+static void link_njoin(struct linkState * ls, char * chanName, char * members)
+{
+  char text[MAXTOPIC];
+  char memberList[MAXTOPIC];
+  char * savePtr;
+  if (chanName[0] == '#')
+    chanName++;
+  clean_message(text, members);
+  memcpy(memberList, text, MAXTOPIC);
+
+  char * member = strtok_r(memberList, ",", &savePtr);
+  while (member)
+  {
+    char mode = '\0';
+    if (member[0] == '@')
+      mode = 'o';
+    else if (member[0] == '+')
+      mode = 'v';
+    if (mode)
+      member++;
+    link_join(ls, chanName, member, mode);
+    member = strtok_r(NULL, ",", &savePtr);
+  }
+  propagate(ls->socket, "NJOIN #%s :%s", chanName, text);
+}
+
+
+/* link_part:
+ * Handles a PART from a linked server.
+ */
+static void link_part(struct linkState * ls, char * nick, char * chanName, char * msg)
+{
+  userInfo user;
+  char text[MAXTOPIC];
+  if (!remote_user(ls, nick, &user))
+    return;
+  if (chanName[0] == '#')
+    chanName++;
+  channelData * channel = channel_find(ls->chanList, chanName, 0);
+  if (channel == NULL)
+    return;
+  if (msg)
+    clean_message(text, msg);
+
+  pthread_mutex_lock(&channel->chanUserLock);
+  int userIndex = list_locate(channel->userList, &user);
+  if (userIndex == -1)
+  {
+    pthread_mutex_unlock(&channel->chanUserLock);
+    return;
+  }
+  char line[SERVERLINELEN];
+  int lineLen;
+  if (msg)
+    lineLen = user_line(line, &user, "PART #%s :%s", chanName, text);
+  else
+    lineLen = user_line(line, &user, "PART #%s", chanName);
+  deliver_local(channel, line, lineLen);
+  list_delete_at(channel->userList, userIndex);
+  int isEmpty = (list_size(channel->userList) == 0);
+  pthread_mutex_unlock(&channel->chanUserLock);
+  if (isEmpty)
+    channel_remove(ls->chanList, channel);
+
+  pthread_mutex_lock(&lock);
+  forChannel * chanAndModeRef = (forChannel *) list_seek(user.channelModes, casemap_key(chanName));
+  if (chanAndModeRef)
+    list_delete_at(user.channelModes, list_locate(user.channelModes, chanAndModeRef));
+  pthread_mutex_unlock(&lock);
+
+  if (msg)
+    propagate(ls->socket, ":%s PART #%s :%s", nick, chanName, text);
+  else
+    propagate(ls->socket, ":%s PART #%s", nick, chanName);
+}
+
+
+/* link_message:
+ * Handles a PRIVMSG or NOTICE from a linked server, delivering it
+ * to local recipients and routing it on towards remote ones.
+ */
+static void link_message(struct linkState * ls, char * nick, char * verb, char * target, char * msg)
+{
+  userInfo user;
+  char text[MAXTOPIC];
+  char line[SERVERLINELEN];
+  int lineLen;
+  if (!remote_user(ls, nick, &user))
+    return;
+  clean_message(text, msg);
+
+  if (target[0] == '#')
+  {
+    char * chanName = target + 1;
+    channelData * channel = channel_find(ls->chanList, chanName, 0);
+    if (channel == NULL)
+      return;
+    lineLen = user_line(line, &user, "%s #%s :%s", verb, channel->name, text);
+    pthread_mutex_lock(&channel->chanUserLock);
+    deliver_local(channel, line, lineLen);
+    pthread_mutex_unlock(&channel->chanUserLock);
+    epoch_enter();
+    history_append(channel, line, lineLen - 2, NULL, 0);
+    epoch_exit();
+    route_channel(channel, ls->socket, ":%s %s #%s :%s", nick, verb, channel->name, text);
+    return;
+  }
+
+  userInfo to_user;
+  pthread_mutex_lock(&lock);
+  userInfo * found = (userInfo *) list_seek(ls->userList, casemap_key(target));
+  if (found)
+    memcpy(&to_user, found, sizeof(userInfo));
+  pthread_mutex_unlock(&lock);
+  if (!found)
+    return;
+  if (!to_user.remote)
+  {
+    lineLen = user_line(line, &user, "%s %s :%s", verb, to_user.nickname, text);
+    // queued for the thread reading the socket, as in deliver_local
+    netio_line(to_user.socket, line, lineLen - 2, NULL, 0);
+  }
+  else if (to_user.link != ls->socket)
+    send_line(to_user.link, ":%s %s %s :%s", nick, verb, to_user.nickname, text);
+}
+
+
+/* link_dispatch:
+ * Given one line received on a server link, updates local state,
+ * notifies local clients and propagates it to other links.
+ * Returns -1 if the link must be closed.
+ */
+static int link_dispatch(struct linkState * ls, char * line)
+{
+  char * prefix = NULL;
+  char * argList[15];
+  int result = 1;
+  memset(argList, 0, sizeof(argList));
+
+  if (line[0] == ':')
+  {
+    char * space = strchr(line, ' ');
+    if (space == NULL)
+      return 1;
+    *space = '\0';
+    prefix = line + 1;
+    line = space + 1;
+    char * bang = strchr(prefix, '!');
+    if (bang)
+      *bang = '\0';
+  }
+  if (strlen(line) < 2)
+    return 1;
+  int argNum = parser(line, strlen(line), argList);
+  if (argNum == 0)
+    return 1;
+  char * command = argList[0];
+
+  if (!strcmp(command, "PASS"))
+  {
+    if (argNum > 1)
+    {
+      memset(ls->passwd, 0, MAXPASSWORD);
+      strncpy(ls->passwd, argList[1], MAXPASSWORD - 1);
+    }
+  }
+  else if (!strcmp(command, "ERROR"))
+    result = -1;
+  else if (!ls->registered)
+  {
+    // nothing but our peer's SERVER is accepted before registration
+    if ((!strcmp(command, "SERVER")) && (argNum > 1))
+      result = link_establish(ls, argList[1], !ls->outbound);
+    else
+      result = -1;
+  }
+  else if (!strcmp(command, "PING"))
+    send_line(ls->socket, "PONG %s", ls->servData->serverHost);
+  else if (!strcmp(command, "PONG"))
+    ;
+  else if ((!strcmp(command, "SERVER")) && (prefix) && (argNum > 2))
+  {
+    if (link_add(argList[1], prefix, atoi(argList[2]), ls->socket) == -1)
+    {
+      // a server we already know about: the link would create a loop
+      send_line(ls->socket, "ERROR :Server %s already exists", argList[1]);
+      result = -1;
+    }
+    else
+      propagate(ls->socket, ":%s SERVER %s %d :chirc", prefix, argList[1], atoi(argList[2]) + 1);
+  }
+  else if ((!strcmp(command, "SQUIT")) && (argNum > 1))
+  {
+    char reason[MAXTOPIC];
+    snprintf(reason, MAXTOPIC, "%s %s", ls->servData->serverHost, argList[1]);
+    squit(ls, argList[1], -1, reason);
+    propagate(ls->socket, "SQUIT %s :%s", argList[1], reason);
+  }
+  else if ((!strcmp(command, "NICK")) && (argNum > 1))
+    link_nick(ls, prefix, argList, argNum);
+  else if ((!strcmp(command, "NJOIN")) && (argNum > 2))
+    link_njoin(ls, argList[1], argList[2]);
+  else if ((!strcmp(command, "PART")) && (prefix) && (argNum > 1))
+    link_part(ls, prefix, argList[1], argNum > 2 ? argList[2] : NULL);
+  else if (((!strcmp(command, "PRIVMSG")) || (!strcmp(command, "NOTICE"))) &&
+           (prefix) && (argNum > 2))
+    link_message(ls, prefix, command, argList[1], argList[2]);
+  else if ((!strcmp(command, "QUIT")) && (prefix))
+  {
+    userInfo user;
+    char text[MAXTOPIC];
+    if (remote_user(ls, prefix, &user))
+    {
+      clean_message(text, argNum > 1 ? argList[1] : ":Client Quit");
+      remove_user(ls->userList, ls->chanList, &user, text);
+      propagate(ls->socket, ":%s QUIT :%s", prefix, text);
+    }
+  }
+
+  for (int n=0; n<argNum; n++)
+    free(argList[n]);
+  return result;
+}
+
+
+/* link_run:
+ * Reads and dispatches lines from a server link until
+ * it is closed by either end. pending is the start of a line
+ * read before the connection became a link, if any. A line
+ * too long to fit in the buffer is dropped up to its end.
+ */
+static void link_run(struct linkState * ls, char * pending, int pendingLen)
+{
+  char buf[SERVERLINELEN * 4];
+  int bufLen = 0;
+  int nbytes;
+  int skipping = 0;
+
+  if (pendingLen >= (int) sizeof(buf) - 1)
+    skipping = 1;
+  else if (pendingLen > 0)
+  {
+    memcpy(buf, pending, pendingLen);
+    bufLen = pendingLen;
+  }
+
+  while ((nbytes = recv(ls->socket, buf + bufLen, sizeof(buf) - bufLen - 1, 0)) > 0)
+  {
+    bufLen += nbytes;
+    int start = 0;
+    for (int n=0; n<bufLen; n++)
+    {
+      if (buf[n] == '\n')
+      {
+        // lines are handed over with their '\r', as parser() expects
+        buf[n] = '\0';
+        if (!skipping && link_dispatch(ls, buf + start) == -1)
+          return;
+        skipping = 0;
+        start = n + 1;
+      }
+    }
+    memmove(buf, buf + start, bufLen - start);
+    bufLen -= start;
+    // drop a line too long to ever fit in the buffer, and the
+    // rest of it still to come
+    if (skipping || bufLen == sizeof(buf) - 1)
+    {
+      skipping = 1;
+      bufLen = 0;
+    }
+  }
+}
+
+
+/* link_close:
+ * Cleans up after a server link went down: forgets every server
+ * and user behind it and tells the rest of the network. The
+ * socket is left for the caller to close.
+ */
+static void link_close(struct linkState * ls)
+{
+  if (ls->registered)
+  {
+    char reason[MAXTOPIC];
+    snprintf(reason, MAXTOPIC, "%s %s", ls->servData->serverHost, ls->name);
+    squit(ls, ls->name, ls->socket, reason);
+    propagate(ls->socket, "SQUIT %s :%s", ls->name, reason);
+  }
+}
+
+
+/* server_password:
+ * Returns 1 if passwd is the password linked servers must
+ * give, or 0 if it is not.
+ */
+int server_password(char * passwd, serverInfo * servData)
+{
+  return !strcmp(passwd, servData->passwd);
+}
+
+
+/* server_accept:
+ * Takes over a client connection which sent SERVER. Given the
+ * SERVER arguments, the password from a preceding PASS, the
+ * commands received after SERVER in the same read, and the
+ * start of a line received after those, runs the server link
+ * until it goes down. The caller closes the socket after.
+ */
+void server_accept(int socket, char ** argList, int argNum, char * passwd, char ** cmndList, int numCmnds,
+                   char * pending, int pendingLen, list_t * userList, list_t * chanList, serverInfo * servData)
+{
+  struct linkState ls;
+  memset(&ls, 0, sizeof(struct linkState));
+  ls.socket = socket;
+  ls.userList = userList;
+  ls.chanList = chanList;
+  ls.servData = servData;
+  if (passwd)
+    strncpy(ls.passwd, passwd, MAXPASSWORD - 1);
+
+  if ((argNum < 2) || (link_establish(&ls, argList[1], 1) == -1))
+    return;
+  for (int n=0; n<numCmnds; n++)
+    if (link_dispatch(&ls, cmndList[n]) == -1)
+    {
+      link_close(&ls);
+      return;
+    }
+  link_run(&ls, pending, pendingLen);
+  link_close(&ls);
+}
+
+
+/* server_connect:
+ * This is the function run by the p_thread spawned for each
+ * server given with -l. Connects to that server, runs the link,
+ * and reconnects every LINKRETRY seconds after it goes down.
+ */
+void *server_connect(void * args)
+{
+  linkTarget * target = (linkTarget *) args;
+  serverInfo * servData = target->servData;
+  pthread_detach(pthread_self());
+
+  while (1)
+  {
+    struct addrinfo hints, *res;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(target->host, target->port, &hints, &res) != 0)
+    {
+      sleep(LINKRETRY);
+      continue;
+    }
+    int linkSocket = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+    if ((linkSocket == -1) || (connect(linkSocket, res->ai_addr, res->ai_addrlen) == -1))
+    {
+      if (linkSocket != -1)
+        close(linkSocket);
+      freeaddrinfo(res);
+      sleep(LINKRETRY);
+      continue;
+    }
+    freeaddrinfo(res);
+
+    struct linkState ls;
+    memset(&ls, 0, sizeof(struct linkState));
+    ls.socket = linkSocket;
+    ls.outbound = 1;
+    ls.userList = target->userList;
+    ls.chanList = target->chanList;
+    ls.servData = servData;
+    send_line(linkSocket, "PASS %s", servData->passwd);
+    send_line(linkSocket, "SERVER %s 1 :chirc", servData->serverHost);
+    link_run(&ls, NULL, 0);
+    link_close(&ls);
+    close(linkSocket);
+    sleep(LINKRETRY);
+  }
+  return NULL;
+}
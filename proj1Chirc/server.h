@@ -0,0 +1,43 @@
+/*
+ *
+ *  CMSC 23300 / 33300 - Networks and Distributed Systems
+ *
+ *  Server-to-server link functions
+ *
+ */
+
+#ifndef SERVER_H_
+#define SERVER_H_
+
+#include "simclist.h"
+#include "structures.h"
+
+#define SERVERLINELEN 1024
+#define MAXLINKS 32
+#define LINKRETRY 5
+
+struct linkTarget
+{
+  char host[MAXHOST];
+  char port[8];
+  list_t * userList;
+  list_t * chanList;
+  serverInfo * servData;
+};
+
+typedef struct linkTarget linkTarget;
+
+void server_init(void);
+int server_count(void);
+int server_password(char * passwd, serverInfo * servData);
+void server_accept(int socket, char ** argList, int argNum, char * passwd, char ** cmndList, int numCmnds,
+                   char * pending, int pendingLen, list_t * userList, list_t * chanList, serverInfo * servData);
+void *server_connect(void * args);
+void server_introduce(userInfo * info, serverInfo * servData);
+void server_nick(char * oldNick, char * newNick);
+void server_join(userInfo * info, char * chanName, char mode);
+void server_part(userInfo * info, char * chanName, char * msg);
+void server_message(userInfo * info, char * verb, channelData * channel, userInfo * to_user, char * msg);
+void server_quit(userInfo * info, char * msg);
+
+#endif /* SERVER_H_ */
@@ -0,0 +1,315 @@
+/*
+ *
+ *  CMSC 23300 / 33300 - Networks and Distributed Systems
+ *
+ *  Channel Sharding Functions
+ *
+ *  When started with worker threads (-w), every channel is owned
+ *  by one worker, chosen by hashing the channel name. Commands
+ *  aimed at a channel (JOIN, PART, TOPIC, MODE, NAMES, LIST, WHO,
+ *  and PRIVMSG or NOTICE to a channel) are pushed by the client's
+ *  thread onto the owner's lock-free queue, and the owner runs
+ *  them, fan-out included. The client's thread waits for its
+ *  command to finish, so replies keep their order.
+ *
+ *  Since a channel's traffic is all handled by one thread, its
+ *  chanUserLock is no longer fought over. The lock is still taken:
+ *  NICK, QUIT and server links walk the channels of a user from
+ *  other threads.
+ *
+ *  PRIVMSG, NOTICE, JOIN and PART take a comma separated list of
+ *  targets, such as "JOIN #a,#b,#c". Each target is run as a
+ *  command of its own, in the order given and on the worker owning
+ *  its channel, so a list costs one line to parse and dispatch
+ *  rather than one per target. The replies to every target are
+ *  held with the rest of the client's batch and sent together.
+ *
+ */
+#include <pthread.h>
+#include <semaphore.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "casemap.h"
+#include "command.h"
+#include "mpsc.h"
+#include "reply.h"
+#include "shard.h"
+#include "structures.h"
+
+
+struct shardJob
+{
+  mpscNode node;
+  int command;
+  char ** argList;
+  int argNum;
+  userInfo * info;
+  list_t * userList;
+  list_t * chanList;
+  serverInfo * servData;
+  int result;
+  sem_t done;
+};
+
+typedef struct shardJob shardJob;
+
+struct shard
+{
+  mpscQueue queue;
+  // counts jobs pushed but not yet taken
+  sem_t pending;
+  pthread_t thread;
+};
+
+typedef struct shard shard;
+
+static shard * shards = NULL;
+static int numShards = 0;
+
+
+/* run_shard:
+ * The function each worker thread runs. Takes commands off
+ * the worker's queue and runs them.
+ */
+static void *run_shard(void * args)
+{
+  shard * self = (shard *) args;
+  while (1)
+  {
+    while (sem_wait(&self->pending) == -1)
+      ;
+    mpscNode * node;
+    // a job which was counted may still be halfway onto the queue
+    while ((node = mpsc_pop(&self->queue)) == NULL)
+      sched_yield();
+    shardJob * job = (shardJob *) node;
+    job->result = run_command(job->command, job->argList, job->argNum, job->info,
+                              job->userList, job->chanList, job->servData);
+    sem_post(&job->done);
+  }
+  return NULL;
+}
+
+
+/* shard_init:
+ * Starts count worker threads to own channels. A count of 0
+ * leaves sharding off. Returns -1 if the threads cannot be
+ * started.
+ */
+int shard_init(int count)
+{
+  if (count <= 0)
+    return 1;
+  shards = (shard *) malloc(count * sizeof(shard));
+  memset(shards, 0, count * sizeof(shard));
+  for (int i = 0; i < count; i++)
+  {
+    mpsc_init(&shards[i].queue);
+    sem_init(&shards[i].pending, 0, 0);
+    if (pthread_create(&shards[i].thread, NULL, run_shard, &shards[i]) != 0)
+      return -1;
+    pthread_detach(shards[i].thread);
+  }
+  numShards = count;
+  return 1;
+}
+
+
+/* shard_count:
+ * Returns the number of worker threads owning channels.
+ */
+int shard_count(void)
+{
+  return numShards;
+}
+
+
+/* shard_owner:
+ * Given a channel name, with or without its '#', returns the
+ * worker which owns the channel.
+ */
+int shard_owner(char * chanName)
+{
+  if (chanName[0] == '#')
+    chanName++;
+  // FNV-1a of the folded name, so every spelling of a
+  // channel's name belongs to the same worker
+  unsigned int hash = 2166136261u;
+  for (; *chanName && *chanName != '\r'; chanName++)
+  {
+    hash ^= casemap_char((unsigned char) *chanName);
+    hash *= 16777619u;
+  }
+  return hash % numShards;
+}
+
+
+/* command_channel:
+ * Returns the channel a command is aimed at, or NULL if it
+ * is not aimed at a channel.
+ */
+static char * command_channel(int command, char ** argList, int argNum)
+{
+  if (argNum < 2 || !argList[1] || argList[1][0] != '#')
+    return NULL;
+  switch (command)
+  {
+    case PRIVMSG:
+    case NOTICE:
+    case JOIN:
+    case PART:
+    case TOPIC:
+    case LIST:
+    case MODE:
+    case NAMES:
+    case WHO:
+      return argList[1];
+    default:
+      return NULL;
+  }
+}
+
+
+/* shard_run:
+ * Runs a command, handing it to the worker owning its channel
+ * if sharding is on and the command is aimed at a channel, and
+ * waits for it to finish. Returns what run_command returns.
+ */
+static int shard_run(int command, char ** argList, int argNum, userInfo * info, list_t * userList, list_t * chanList, serverInfo * servData)
+{
+  char * chanName;
+  if (!numShards || !(chanName = command_channel(command, argList, argNum)))
+    return run_command(command, argList, argNum, info, userList, chanList, servData);
+
+  shardJob job;
+  memset(&job, 0, sizeof(shardJob));
+  job.command = command;
+  job.argList = argList;
+  job.argNum = argNum;
+  job.info = info;
+  job.userList = userList;
+  job.chanList = chanList;
+  job.servData = servData;
+  sem_init(&job.done, 0, 0);
+
+  shard * owner = &shards[shard_owner(chanName)];
+  mpsc_push(&owner->queue, &job.node);
+  sem_post(&owner->pending);
+  while (sem_wait(&job.done) == -1)
+    ;
+  sem_destroy(&job.done);
+  return job.result;
+}
+
+
+/* takes_targets:
+ * Returns 1 if command takes a comma separated list of
+ * targets as its first argument.
+ */
+static int takes_targets(int command)
+{
+  switch (command)
+  {
+    case PRIVMSG:
+    case NOTICE:
+    case JOIN:
+    case PART:
+      return 1;
+    default:
+      return 0;
+  }
+}
+
+
+/* shard_targets:
+ * Returns the number of targets a command will be run for: the
+ * length of its target list, up to the target limit, or 1 for
+ * a command without one.
+ */
+int shard_targets(int command, char ** argList, int argNum, serverInfo * servData)
+{
+  if (argNum < 2 || !argList[1] || !takes_targets(command))
+    return 1;
+  int targets = 0;
+  int inTarget = 0;
+  for (char * c = argList[1]; *c; c++)
+  {
+    if (*c == ',')
+      inTarget = 0;
+    else if (!inTarget)
+    {
+      inTarget = 1;
+      targets++;
+    }
+  }
+  if (targets > servData->limits.maxTargets)
+    targets = servData->limits.maxTargets;
+  return targets ? targets : 1;
+}
+
+
+/* too_many_targets:
+ * Tells the client that target and the ones after it were
+ * dropped for going over the target limit.
+ */
+static void too_many_targets(char * target, userInfo * info, serverInfo * servData)
+{
+  replyPackage reply;
+  memset(&reply, 0, sizeof(replyPackage));
+  memcpy(reply.serverName, servData->serverHost, strlen(servData->serverHost));
+  memcpy(reply.nickname, info->nickname, strlen(info->nickname));
+  memcpy(reply.responseCode, ERR_TOOMANYTARGETS, REPLYCODELEN);
+  reply.numArgs = 1;
+  snprintf(reply.args, MAXARGS, "%s", target);
+  send_response(info->socket, &reply);
+}
+
+
+/* shard_command:
+ * Runs a command as shard_run does. A command with a comma
+ * separated list of targets is run once for each target, up to
+ * the target limit. Returns -1 if running any target failed,
+ * and 1 otherwise.
+ */
+int shard_command(int command, char ** argList, int argNum, userInfo * info, list_t * userList, list_t * chanList, serverInfo * servData)
+{
+  if (argNum < 2 || !argList[1] || !takes_targets(command) || !strchr(argList[1], ','))
+    return shard_run(command, argList, argNum, info, userList, chanList, servData);
+
+  char * targetArgs[MAXARGS];
+  memset(targetArgs, 0, sizeof(targetArgs));
+  memcpy(targetArgs, argList, argNum * sizeof(char *));
+  char targets[strlen(argList[1]) + 1];
+  strcpy(targets, argList[1]);
+  // commands change their arguments in place, so each target
+  // gets fresh copies of its own
+  char target[sizeof(targets)];
+  int textLen = argNum > 2 && argList[2] ? strlen(argList[2]) + 1 : 1;
+  char text[textLen];
+
+  int result = 1;
+  int numTargets = 0;
+  char * savePtr;
+  char * next = strtok_r(targets, ",", &savePtr);
+  while (next)
+  {
+    if (++numTargets > servData->limits.maxTargets)
+    {
+      too_many_targets(next, info, servData);
+      break;
+    }
+    strcpy(target, next);
+    targetArgs[1] = target;
+    if (textLen > 1)
+    {
+      memcpy(text, argList[2], textLen);
+      targetArgs[2] = text;
+    }
+    if (shard_run(command, targetArgs, argNum, info, userList, chanList, servData) == -1)
+      result = -1;
+    next = strtok_r(NULL, ",", &savePtr);
+  }
+  return result;
+}
@@ -0,0 +1,26 @@
+/*
+ *
+ *  CMSC 23300 / 33300 - Networks and Distributed Systems
+ *
+ *  Channel sharding across worker threads
+ *
+ */
+
+#ifndef SHARD_H_
+#define SHARD_H_
+
+#include "simclist.h"
+#include "structures.h"
+
+#define MAXSHARDS 64
+// targets one PRIVMSG, NOTICE, JOIN or PART may name
+#define SHARDTARGETS 100
+#define SHARDMAXTARGETS 256
+
+int shard_init(int count);
+int shard_count(void);
+int shard_owner(char * chanName);
+int shard_targets(int command, char ** argList, int argNum, serverInfo * servData);
+int shard_command(int command, char ** argList, int argNum, userInfo * info, list_t * userList, list_t * chanList, serverInfo * servData);
+
+#endif /* SHARD_H_ */
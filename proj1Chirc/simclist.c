@@ -218,6 +218,9 @@ static void *list_get_minmax(const list_t *restrict l, int versus);
 
 static inline struct list_entry_s *list_findpos(const list_t *restrict l, int posstart);
 
+/* elements visited by each thread, see simclist.h */
+__thread unsigned long list_visits __attribute__((tls_model("initial-exec"))) = 0;
+
 /*
  * Random Number Generator
  *
@@ -689,6 +692,7 @@ int list_locate(const list_t *restrict l, const void *data) {
             if (el->data == data) break;
         }
     }
+    list_visits += (el == l->tail_sentinel) ? pos : pos + 1;
     if (el == l->tail_sentinel) return -1;
 
     return pos;
@@ -700,6 +704,7 @@ void *list_seek(list_t *restrict l, const void *indicator) {
     if (l->attrs.seeker == NULL) return NULL;
 
     for (iter = l->head_sentinel->next; iter != l->tail_sentinel; iter = iter->next) {
+        list_visits++;
         if (l->attrs.seeker(iter->data, indicator) != 0) return iter->data;
     }
 
@@ -951,6 +956,7 @@ void *list_iterator_next(list_t *restrict l) {
     toret = l->iter_curentry->data;
     l->iter_curentry = l->iter_curentry->next;
     l->iter_pos++;
+    list_visits++;
 
     return toret;
 }
@@ -972,6 +972,15 @@ list_hash_t list_hashcomputer_double(const void *el);
  */
 list_hash_t list_hashcomputer_string(const void *el);
 
+/**
+ * number of elements the calling thread has visited.
+ *
+ * Every element list_seek() or list_locate() examines, and every
+ * element an iteration session returns, adds one. Meant to be read
+ * before and after some work, to tell how many elements it walked.
+ */
+extern __thread unsigned long list_visits __attribute__((tls_model("initial-exec")));
+
 #ifdef __cplusplus
 }
 #endif
@@ -6,6 +6,8 @@
  *
  */
 
+#include <stdint.h>
+#include <time.h>
 #include "simclist.h"
 
 #ifndef STRUCTURES_H_
@@ -18,30 +20,86 @@
 #define MAXHOST 64
 #define MAXVERSION 10
 #define MAXCREATED 25
-#define MAXUSERMODES 8
-#define MAXCHANMODES 10 
+// room for the letters of every user mode, and of every channel
+// and member mode, as listed in RPL_MYINFO
+#define MAXUSERMODES 32
+#define MAXCHANMODES 64
 #define MAXARGS 256
-#define MAXCHANNAME 10
+// room for the longest channel name RFC 2812 allows; chanlen
+// limits the names of new channels below that
+#define MAXCHANNAME 51
 #define MAXTOPIC 512
 #define MAXUSERINCHAN 20
-#define MAXCHANSPECMODE 2
+// most of a RPL_NAMREPLY taken by names; the rest go on more lines
+#define MAXNAMES 400
 #define MAXPASSWORD 21
 #define MAXAWAY 512
+#define FLOODCLASSES 4
 
 struct userInfo
 {
   char nickname[MAXNICK];
+  // set with user_key whenever nickname changes
+  char foldedNick[MAXNICK];
+  uint32_t nickHash;
   char username[MAXUSER];
   char name[MAXNAME];
   char host[MAXHOST];
   char away[MAXAWAY];
   int socket;
-  char modes[MAXUSERMODES];
+  int remote; // set if the user is on another server
+  int link; // socket of the server link a remote user is reached through
+  char server[MAXHOST];
+  unsigned int modes; // bits of USER_MODES, see modes.h
   list_t * channelModes;
 };
 
 typedef struct userInfo userInfo;
 
+struct floodConfig
+{
+  double rate;
+  double burst;
+  double cost[FLOODCLASSES];
+  double abuse;
+};
+
+typedef struct floodConfig floodConfig;
+
+struct floodBucket
+{
+  int socket;
+  double tokens;
+  struct timespec last;
+};
+
+typedef struct floodBucket floodBucket;
+
+// seconds; 0 turns a check off
+struct keepaliveConfig
+{
+  int ping;
+  int timeout;
+  int registration;
+};
+
+typedef struct keepaliveConfig keepaliveConfig;
+
+struct limitConfig
+{
+  int inputBuffer;
+  int maxCommands;
+  int maxParams;
+  int maxTargets;
+  int lineLen;
+  int nickLen;
+  int chanLen;
+  int topicLen;
+  int awayLen;
+};
+
+typedef struct limitConfig limitConfig;
+
 struct serverInfo
 {
   char serverHost[MAXHOST];
@@ -50,6 +108,9 @@ struct serverInfo
   char userModes[MAXUSERMODES];
   char chanModes[MAXCHANMODES];
   char passwd[MAXPASSWORD];
+  floodConfig flood;
+  keepaliveConfig keepalive;
+  limitConfig limits;
 };
 
 typedef struct serverInfo serverInfo;
@@ -58,6 +119,9 @@ typedef struct serverInfo serverInfo;
 {
   int socket;
   char * clientHost;
+  uint32_t addr;
+  // made an operator without OPER, see local.c
+  int oper;
   list_t * userList;
   list_t * chanList;
   serverInfo * servData;
@@ -76,12 +140,32 @@ struct replyPackage
 
 typedef struct replyPackage replyPackage;
 
+struct memberSnapshot
+{
+  int numMembers;
+  int sockets[];
+};
+
+typedef struct memberSnapshot memberSnapshot;
+
+// defined in history.c
+typedef struct historyRing historyRing;
+
+// channelData and forChannel start alike, as channels and channel
+// modes are compared with each other
 struct channelData
 {
   char name[MAXCHANNAME];
+  // set with chan_key whenever name changes
+  char foldedName[MAXCHANNAME];
+  uint32_t nameHash;
   list_t * userList;
+  // sockets of local members, shared by every copy of the channel
+  memberSnapshot ** members;
+  // recent messages, shared by every copy of the channel
+  historyRing * history;
   char topic[MAXTOPIC];
-  char modes[MAXCHANMODES];
+  unsigned int modes; // bits of CHANNEL_MODES, see modes.h
   pthread_mutex_t chanUserLock;
 };
 
@@ -90,10 +174,23 @@ typedef struct channelData channelData;
 struct forChannel
 {
   char channelName[MAXCHANNAME];
-  char modes[MAXCHANSPECMODE];
+  // set with chanmode_key whenever channelName changes
+  char foldedName[MAXCHANNAME];
+  uint32_t nameHash;
+  unsigned int modes; // bits of MEMBER_MODES, see modes.h
   int numModes;
 };
 
 typedef struct forChannel forChannel;
 
+struct linkData
+{
+  char name[MAXHOST];
+  char uplink[MAXHOST];
+  int hopcount;
+  int socket;
+};
+
+typedef struct linkData linkData;
+
 #endif /* STRUCTURES_H_ */
@@ -0,0 +1,200 @@
+/*
+ *
+ *  CMSC 23300 / 33300 - Networks and Distributed Systems
+ *
+ *  Timer Functions
+ *
+ *  All timers live in one hierarchical timing wheel driven by a
+ *  single timer thread. Level 0 has a slot for each of the next 64
+ *  ticks, level 1 a slot for each of the next 64 groups of 64 ticks,
+ *  and so on. A timer is linked into the slot of the level matching
+ *  how far away it expires, so adding and cancelling one is O(1).
+ *  Each time a level wraps around, the timers in the next slot of
+ *  the level above are moved down to the level they now belong in,
+ *  which is the only time a timer is touched before it expires.
+ *
+ *  Callbacks run on the timer thread while wheelLock is held, so
+ *  timer_cancel never returns while its callback is running. They
+ *  must not block, and re-arm their timer through their return
+ *  value instead of calling timer_add.
+ *
+ */
+#include <pthread.h>
+#include <stddef.h>
+#include <time.h>
+#include "timer.h"
+
+
+static timerEntry wheel[TIMERLEVELS][TIMERSLOTS];
+static uint64_t wheelNow = 0;
+static pthread_mutex_t wheelLock;
+static pthread_t wheelThread;
+
+
+/* ticks:
+ * Returns the number of ticks, at least one, needed for
+ * ms milliseconds to pass.
+ */
+static uint64_t ticks(long ms)
+{
+  if (ms < TIMERTICK)
+    return 1;
+  return (ms + TIMERTICK - 1) / TIMERTICK;
+}
+
+
+/* slot_insert:
+ * Links timer into the slot matching its expiry time.
+ * wheelLock must be held.
+ */
+static void slot_insert(timerEntry * timer)
+{
+  if (timer->expires < wheelNow)
+    timer->expires = wheelNow;
+  uint64_t delta = timer->expires - wheelNow;
+  int level = 0;
+  while (level < TIMERLEVELS - 1 && delta >= (1ull << (TIMERSLOTBITS * (level + 1))))
+    level++;
+  // clamp timers beyond the top level to its furthest slot
+  if (delta >= (1ull << (TIMERSLOTBITS * TIMERLEVELS)))
+    timer->expires = wheelNow + (1ull << (TIMERSLOTBITS * TIMERLEVELS)) - 1;
+  timerEntry * head = &wheel[level][(timer->expires >> (TIMERSLOTBITS * level)) & TIMERSLOTMASK];
+  timer->prev = head;
+  timer->next = head->next;
+  head->next->prev = timer;
+  head->next = timer;
+}
+
+
+/* slot_remove:
+ * Unlinks timer from its slot. wheelLock must be held.
+ */
+static void slot_remove(timerEntry * timer)
+{
+  timer->prev->next = timer->next;
+  timer->next->prev = timer->prev;
+  timer->next = NULL;
+  timer->prev = NULL;
+}
+
+
+/* wheel_tick:
+ * Advances the wheel by one tick, moving timers down from the
+ * levels which wrapped and running those which expired.
+ * wheelLock must be held.
+ */
+static void wheel_tick(void)
+{
+  wheelNow++;
+  for (int level = 1; level < TIMERLEVELS; level++)
+  {
+    if (wheelNow & ((1ull << (TIMERSLOTBITS * level)) - 1))
+      break;
+    timerEntry * head = &wheel[level][(wheelNow >> (TIMERSLOTBITS * level)) & TIMERSLOTMASK];
+    while (head->next != head)
+    {
+      timerEntry * timer = head->next;
+      slot_remove(timer);
+      slot_insert(timer);
+    }
+  }
+
+  timerEntry * head = &wheel[0][wheelNow & TIMERSLOTMASK];
+  while (head->next != head)
+  {
+    timerEntry * timer = head->next;
+    slot_remove(timer);
+    long ms = timer->callback(timer->arg);
+    if (ms > 0)
+    {
+      timer->expires = wheelNow + ticks(ms);
+      slot_insert(timer);
+    }
+  }
+}
+
+
+/* run_wheel:
+ * Body of the timer thread. Sleeps until each tick is due and
+ * catches up on ticks it slept through.
+ */
+static void * run_wheel(void * arg)
+{
+  struct timespec next;
+  clock_gettime(CLOCK_MONOTONIC, &next);
+  while (1)
+  {
+    next.tv_nsec += TIMERTICK * 1000000L;
+    while (next.tv_nsec >= 1000000000L)
+    {
+      next.tv_nsec -= 1000000000L;
+      next.tv_sec++;
+    }
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+    pthread_mutex_lock(&wheelLock);
+    wheel_tick();
+    pthread_mutex_unlock(&wheelLock);
+  }
+  return NULL;
+}
+
+
+/* timer_init:
+ * Sets up the wheel and starts the timer thread.
+ * Returns -1 if the thread cannot be started.
+ */
+int timer_init(void)
+{
+  pthread_mutex_init(&wheelLock, NULL);
+  for (int level = 0; level < TIMERLEVELS; level++)
+    for (int slot = 0; slot < TIMERSLOTS; slot++)
+    {
+      wheel[level][slot].next = &wheel[level][slot];
+      wheel[level][slot].prev = &wheel[level][slot];
+    }
+  if (pthread_create(&wheelThread, NULL, run_wheel, NULL) != 0)
+    return -1;
+  pthread_detach(wheelThread);
+  return 1;
+}
+
+
+/* timer_setup:
+ * Prepares a timer which is not armed yet.
+ */
+void timer_setup(timerEntry * timer, timerCallback callback, void * arg)
+{
+  timer->next = NULL;
+  timer->prev = NULL;
+  timer->expires = 0;
+  timer->callback = callback;
+  timer->arg = arg;
+}
+
+
+/* timer_add:
+ * Arms timer to expire in ms milliseconds, moving it if it
+ * was already armed.
+ */
+void timer_add(timerEntry * timer, long ms)
+{
+  pthread_mutex_lock(&wheelLock);
+  if (timer->next)
+    slot_remove(timer);
+  timer->expires = wheelNow + ticks(ms);
+  slot_insert(timer);
+  pthread_mutex_unlock(&wheelLock);
+}
+
+
+/* timer_cancel:
+ * Disarms timer. Once this returns its callback is not running
+ * and will not run again.
+ */
+void timer_cancel(timerEntry * timer)
+{
+  pthread_mutex_lock(&wheelLock);
+  if (timer->next)
+    slot_remove(timer);
+  pthread_mutex_unlock(&wheelLock);
+}
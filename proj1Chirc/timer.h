@@ -0,0 +1,42 @@
+/*
+ *
+ *  CMSC 23300 / 33300 - Networks and Distributed Systems
+ *
+ *  Hierarchical timer wheel
+ *
+ */
+
+#ifndef TIMER_H_
+#define TIMER_H_
+
+#include <stdint.h>
+
+// milliseconds per tick of the wheel
+#define TIMERTICK 100
+// four levels of 64 slots cover 2^24 ticks, about 19 days
+#define TIMERLEVELS 4
+#define TIMERSLOTBITS 6
+#define TIMERSLOTS (1 << TIMERSLOTBITS)
+#define TIMERSLOTMASK (TIMERSLOTS - 1)
+
+// called from the timer thread when a timer expires; returns the
+// number of milliseconds until it should expire again, or 0
+typedef long (*timerCallback)(void * arg);
+
+struct timerEntry
+{
+  struct timerEntry * next;
+  struct timerEntry * prev;
+  uint64_t expires;
+  timerCallback callback;
+  void * arg;
+};
+
+typedef struct timerEntry timerEntry;
+
+int timer_init(void);
+void timer_setup(timerEntry * timer, timerCallback callback, void * arg);
+void timer_add(timerEntry * timer, long ms);
+void timer_cancel(timerEntry * timer);
+
+#endif /* TIMER_H_ */
@@ -0,0 +1,120 @@
+/*
+ *
+ *  CMSC 23300 / 33300 - Networks and Distributed Systems
+ *
+ *  Traffic Capture Functions
+ *
+ *  When started with -t, chirc appends everything its clients send
+ *  to a binary trace: one record when a connection opens, one per
+ *  recv() with the bytes received, and one when it closes. Each
+ *  record is written with a single writev() under traceLock, so
+ *  records from different connections never interleave. The
+ *  tests/replay.py tool plays traces back against a server.
+ *
+ */
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#include "trace.h"
+
+
+static int traceFd = -1;
+static int nextConn = 0;
+static struct timespec traceStart;
+static pthread_mutex_t traceLock;
+
+
+/* put_le:
+ * Stores the low len bytes of value at buf, little-endian.
+ */
+static void put_le(unsigned char * buf, uint64_t value, int len)
+{
+  for (int i = 0; i < len; i++)
+    buf[i] = (value >> (8 * i)) & 0xff;
+}
+
+
+/* trace_record:
+ * Appends one record to the trace.
+ */
+static void trace_record(int conn, int type, char * buf, int len)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  uint64_t elapsed = (uint64_t) (now.tv_sec - traceStart.tv_sec) * 1000000000ull +
+                     now.tv_nsec - traceStart.tv_nsec;
+  unsigned char header[TRACEHEADERLEN];
+  put_le(header, elapsed, 8);
+  put_le(header + 8, conn, 4);
+  put_le(header + 12, (uint32_t) len | ((uint32_t) type << 30), 4);
+
+  struct iovec iov[2];
+  iov[0].iov_base = header;
+  iov[0].iov_len = TRACEHEADERLEN;
+  iov[1].iov_base = buf;
+  iov[1].iov_len = len;
+  pthread_mutex_lock(&traceLock);
+  writev(traceFd, iov, len ? 2 : 1);
+  pthread_mutex_unlock(&traceLock);
+}
+
+
+/* trace_open:
+ * Starts recording client traffic to the file at path.
+ * Returns -1 if the file cannot be written.
+ */
+int trace_open(char * path)
+{
+  traceFd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+  if (traceFd == -1)
+    return -1;
+  if (write(traceFd, TRACEMAGIC, TRACEMAGICLEN) != TRACEMAGICLEN)
+  {
+    close(traceFd);
+    traceFd = -1;
+    return -1;
+  }
+  pthread_mutex_init(&traceLock, NULL);
+  clock_gettime(CLOCK_MONOTONIC, &traceStart);
+  return 1;
+}
+
+
+/* trace_connection:
+ * Records a new client connection and returns its id,
+ * or -1 if traffic is not being recorded.
+ */
+int trace_connection(void)
+{
+  if (traceFd == -1)
+    return -1;
+  int conn = __atomic_fetch_add(&nextConn, 1, __ATOMIC_RELAXED);
+  trace_record(conn, TRACE_OPEN, NULL, 0);
+  return conn;
+}
+
+
+/* trace_data:
+ * Records len bytes received on connection conn.
+ */
+void trace_data(int conn, char * buf, int len)
+{
+  if (conn == -1 || len <= 0)
+    return;
+  trace_record(conn, TRACE_DATA, buf, len);
+}
+
+
+/* trace_close:
+ * Records that connection conn was closed.
+ */
+void trace_close(int conn)
+{
+  if (conn == -1)
+    return;
+  trace_record(conn, TRACE_CLOSE, NULL, 0);
+}
@@ -0,0 +1,29 @@
+/*
+ *
+ *  CMSC 23300 / 33300 - Networks and Distributed Systems
+ *
+ *  Inbound traffic capture
+ *
+ */
+
+#ifndef TRACE_H_
+#define TRACE_H_
+
+// trace file layout, all integers little-endian:
+//   "CHIRCTR1"
+//   records of: u64 nanoseconds since start, u32 connection id,
+//               u32 length | type << 30, then length bytes of data
+#define TRACEMAGIC "CHIRCTR1"
+#define TRACEMAGICLEN 8
+#define TRACEHEADERLEN 16
+
+#define TRACE_OPEN 0
+#define TRACE_DATA 1
+#define TRACE_CLOSE 2
+
+int trace_open(char * path);
+int trace_connection(void);
+void trace_data(int conn, char * buf, int len);
+void trace_close(int conn);
+
+#endif /* TRACE_H_ */
@@ -9,6 +9,8 @@ import test_unknown
 import test_channel
 import test_modes
 import test_robustness
+import test_golden
+import test_link
 
 alltests = unittest.TestSuite([
                                unittest.TestLoader().loadTestsFromModule(test_connection),
@@ -19,7 +21,9 @@ alltests = unittest.TestSuite([
                                unittest.TestLoader().loadTestsFromModule(test_unknown),
                                unittest.TestLoader().loadTestsFromModule(test_channel),
                                unittest.TestLoader().loadTestsFromModule(test_modes),
-                               unittest.TestLoader().loadTestsFromModule(test_robustness)
+                               unittest.TestLoader().loadTestsFromModule(test_robustness),
+                               unittest.TestLoader().loadTestsFromModule(test_golden),
+                               unittest.TestLoader().loadTestsFromModule(test_link)
                                ])
 
 DEBUG = False
\ No newline at end of file
@@ -116,7 +116,7 @@ class ChircClient(object):
 
         while tries > 0:
             try:
-                self.client = telnetlib.Telnet("localhost", "7776", 1)
+                self.client = telnetlib.Telnet(self.host, self.port, 1)
                 break
             except Exception, e:
                 tries -= 1
@@ -146,6 +146,7 @@ class ChircTestCase(unittest.TestCase):
     CHIRC_EXE = "./chirc"
     MESSAGE_TIMEOUT = 1.0
     INTERTEST_PAUSE = 0.0
+    CHIRC_ARGS = []
 
     def setUp(self):
         self.tmpdir = tempfile.mkdtemp()
@@ -155,7 +156,7 @@ class ChircTestCase(unittest.TestCase):
         else:
             stdout = open('/dev/null', 'w')
             stderr = subprocess.STDOUT 
-        self.chirc_proc = subprocess.Popen([os.path.abspath(ChircTestCase.CHIRC_EXE), "-p", "7776", "-o", OPER_PASSWD], stdout=stdout, stderr=stderr, cwd = self.tmpdir)
+        self.chirc_proc = subprocess.Popen([os.path.abspath(ChircTestCase.CHIRC_EXE), "-p", "7776", "-o", OPER_PASSWD] + self.CHIRC_ARGS, stdout=stdout, stderr=stderr, cwd = self.tmpdir)
         rc = self.chirc_proc.poll()        
         if rc != None:
             self.fail("chirc process failed to start. rc = %i" % rc)
@@ -173,8 +174,8 @@ class ChircTestCase(unittest.TestCase):
         shutil.rmtree(self.tmpdir)
         time.sleep(self.INTERTEST_PAUSE)
         
-    def get_client(self):
-        c = ChircClient(msg_timeout = self.MESSAGE_TIMEOUT)
+    def get_client(self, port = TESTING_PORT):
+        c = ChircClient(port = port, msg_timeout = self.MESSAGE_TIMEOUT)
         self.clients.append(c)
         return c
         
@@ -598,8 +599,8 @@ class ChircTestCase(unittest.TestCase):
                        expect_nparams = 2)        
     
         
-    def _connect_user(self, nick, username):
-        client = self.get_client()
+    def _connect_user(self, nick, username, port = TESTING_PORT):
+        client = self.get_client(port)
         
         client.send_cmd("NICK %s" % nick)
         client.send_cmd("USER %s * * :%s" % (nick, username))
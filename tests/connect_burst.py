@@ -0,0 +1,198 @@
+"""Measures how a chirc server copes with a burst of simultaneous connects.
+
+Opens a large number of connections at once, registers each one with
+NICK and USER as soon as it is established, and reports how quickly
+connections were established and how long each client waited for its
+RPL_WELCOME. Connects which took a second or more were almost always
+dropped from a full listen backlog and retransmitted by the kernel.
+
+Each client then reads the rest of its registration burst, up to the
+end of the MOTD, and reports how many TCP segments (from the kernel's
+TCP_INFO) and recv() calls it took to arrive.
+
+Run from the top of the repository, for example:
+
+    python -m tests.connect_burst --server ./chirc --clients 10000
+    python -m tests.connect_burst --server ./chirc --server-args "-a backlog=5"
+"""
+
+import errno
+import optparse
+import resource
+import select
+import socket
+import struct
+import sys
+import time
+
+import tests.common
+from tests.replay import percentile, start_server, stop_server
+
+
+# offset of tcpi_segs_in in struct tcp_info
+TCP_INFO_SEGS_IN = 140
+
+
+def segments_in(sock):
+    """Returns the number of segments sock has received, or None
+    if the kernel does not report it."""
+    try:
+        info = sock.getsockopt(socket.IPPROTO_TCP, socket.TCP_INFO, 256)
+    except (socket.error, AttributeError):
+        return None
+    if len(info) < TCP_INFO_SEGS_IN + 4:
+        return None
+    return struct.unpack_from("I", info, TCP_INFO_SEGS_IN)[0]
+
+
+def handle(poller, conns, results, fd, now):
+    """Moves one connection along from connecting to registered.
+    Returns True once the connection is finished with."""
+    conn = conns[fd]
+    sock = conn["sock"]
+    if not conn["connected"]:
+        if sock.getsockopt(socket.SOL_SOCKET, socket.SO_ERROR):
+            results["failed"] += 1
+            poller.unregister(fd)
+            return True
+        conn["connected"] = True
+        results["connect"].append(now - conn["start"])
+        results["lastConnect"] = now
+        nick = conn["nick"]
+        sock.send("NICK %s\r\nUSER %s * * :%s\r\n" % (nick, nick, nick))
+        poller.modify(fd, select.EPOLLIN)
+        return False
+    try:
+        data = sock.recv(65536)
+    except socket.error:
+        data = ""
+    conn["buf"] += data
+    conn["recvs"] += 1
+    if " 001 " in conn["buf"]:
+        if not conn["welcomed"]:
+            conn["welcomed"] = True
+            results["welcome"].append(now - conn["start"])
+        # keep reading until the end of the MOTD ends the burst
+        if data and " 376 " not in conn["buf"] and " 422 " not in conn["buf"]:
+            return False
+        if data:
+            segments = segments_in(sock)
+            if segments is not None:
+                results["segments"].append(segments)
+            results["recvs"].append(conn["recvs"])
+    elif conn["buf"].startswith("ERROR"):
+        results["rejected"] += 1
+    elif data:
+        return False
+    else:
+        results["failed"] += 1
+    # welcomed clients stay connected until the burst is over
+    poller.unregister(fd)
+    return True
+
+
+def burst(host, port, clients, timeout):
+    """Connects clients clients at once and registers them. Returns
+    a dict of results; latencies are in seconds from the connect."""
+    addr = (socket.gethostbyname(host), int(port))
+    poller = select.epoll()
+    conns = {}
+    results = {"connect": [], "welcome": [], "segments": [], "recvs": [],
+               "failed": 0, "rejected": 0}
+
+    start = time.time()
+    results["lastConnect"] = start
+    pending = 0
+    for i in range(clients):
+        sock = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+        sock.setblocking(0)
+        rc = sock.connect_ex(addr)
+        if rc not in (0, errno.EINPROGRESS):
+            results["failed"] += 1
+            sock.close()
+            continue
+        conns[sock.fileno()] = {"sock": sock, "nick": "user%i" % i, "start": time.time(),
+                                "connected": False, "welcomed": False, "buf": "", "recvs": 0}
+        poller.register(sock.fileno(), select.EPOLLOUT)
+        pending += 1
+        # keep up with connections completing while the rest are started,
+        # so their times are not inflated by this loop
+        if i % 64 == 63:
+            for (fd, event) in poller.poll(0):
+                if handle(poller, conns, results, fd, time.time()):
+                    pending -= 1
+
+    while pending and time.time() - start < timeout:
+        for (fd, event) in poller.poll(0.1):
+            if handle(poller, conns, results, fd, time.time()):
+                pending -= 1
+
+    results["elapsed"] = results["lastConnect"] - start
+    results["timedout"] = pending
+    for conn in conns.values():
+        conn["sock"].close()
+    poller.close()
+    return results
+
+
+def report(out, clients, results):
+    connect = sorted(results["connect"])
+    welcome = sorted(results["welcome"])
+    print >> out, "clients          %i" % clients
+    print >> out, "connected        %i in %.3f s (%.0f connects/s)" % (
+        len(connect), results["elapsed"], len(connect) / results["elapsed"] if results["elapsed"] > 0 else 0)
+    if connect:
+        print >> out, "connect (ms)     p50 %.1f  p99 %.1f  max %.1f  (%i took 1s or more)" % (
+            percentile(connect, 50) * 1e3, percentile(connect, 99) * 1e3, connect[-1] * 1e3,
+            len([c for c in connect if c >= 1.0]))
+    if welcome:
+        print >> out, "welcome (ms)     p50 %.1f  p99 %.1f  max %.1f  (%i welcomed)" % (
+            percentile(welcome, 50) * 1e3, percentile(welcome, 99) * 1e3, welcome[-1] * 1e3, len(welcome))
+    if results["segments"]:
+        segments = results["segments"]
+        print >> out, "segments in      %.1f per registration (SYN-ACK and ACKs included)" % (
+            float(sum(segments)) / len(segments))
+    if results["recvs"]:
+        recvs = results["recvs"]
+        print >> out, "recv calls       %.1f per registration" % (float(sum(recvs)) / len(recvs))
+    print >> out, "rejected         %i" % results["rejected"]
+    print >> out, "failed           %i" % results["failed"]
+    print >> out, "timed out        %i" % results["timedout"]
+
+
+def main(argv):
+    parser = optparse.OptionParser(usage = "%prog [options]")
+    parser.add_option("--host", default = "localhost")
+    parser.add_option("--port", default = tests.common.TESTING_PORT)
+    parser.add_option("--clients", type = "int", default = 10000)
+    parser.add_option("--timeout", type = "float", default = 60.0,
+                      help = "give up on clients not welcomed after this many seconds")
+    parser.add_option("--server", help = "start this chirc binary for the benchmark")
+    parser.add_option("--server-args", default = "",
+                      help = "extra arguments for the started server, such as \"-a backlog=5\"")
+    (options, args) = parser.parse_args(argv)
+
+    # every client needs a descriptor here, and in a server started from here
+    (soft, hard) = resource.getrlimit(resource.RLIMIT_NOFILE)
+    wanted = options.clients + 64
+    if soft < wanted:
+        resource.setrlimit(resource.RLIMIT_NOFILE, (min(wanted, hard), hard))
+        if hard < wanted:
+            print >> sys.stderr, "warning: descriptor limit is %i" % hard
+
+    server = None
+    if options.server:
+        server = start_server(options.server, options.port, options.server_args)
+        if server is None:
+            return 1
+    try:
+        results = burst(options.host, options.port, options.clients, options.timeout)
+        report(sys.stdout, options.clients, results)
+    finally:
+        if server:
+            stop_server(server)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv[1:]))
@@ -0,0 +1,138 @@
+"""Measures how fast clients of a stopped chirc arrive at another one.
+
+Starts two chirc binaries: one to take down, and one which stays up.
+A number of clients connect and register with the first. The first
+is then either drained with SIGUSR1 (--mode drain) or killed outright
+(--mode kill), and every client reconnects to the second the moment
+it loses its connection, the way clients behind a load balancer do.
+
+Reported are how many clients were sent an ERROR line saying why
+they were disconnected, how long the reconnects took from first to
+last, and the most reconnects the remaining server saw in any one
+second, which is checked against --target.
+
+Run from the top of the repository, for example:
+
+    python -m tests.drain_bench --server ./chirc --clients 500 --rate 100
+    python -m tests.drain_bench --server ./chirc --mode kill
+"""
+
+import optparse
+import os
+import select
+import signal
+import socket
+import sys
+import time
+
+import tests.common
+from tests.replay import start_server, stop_server
+
+
+def register(host, port, nick):
+    """Connects and registers one client, waiting for its welcome."""
+    sock = socket.create_connection((host, int(port)))
+    sock.sendall("NICK %s\r\nUSER %s * * :%s\r\n" % (nick, nick, nick))
+    buf = ""
+    while " 376 " not in buf and " 422 " not in buf:
+        data = sock.recv(65536)
+        if not data:
+            raise socket.error("connection closed")
+        buf += data
+    return sock
+
+
+def peak_rate(times, window = 1.0):
+    """Returns the most of the sorted times falling in any window."""
+    peak = 0
+    first = 0
+    for last in range(len(times)):
+        while times[last] - times[first] > window:
+            first += 1
+        peak = max(peak, last - first + 1)
+    return peak
+
+
+def stop(server):
+    (proc, tmpdir) = server
+    if proc.poll() is None:
+        stop_server(server)
+
+
+def main(argv):
+    parser = optparse.OptionParser(usage = "%prog [options]")
+    parser.add_option("--host", default = "localhost")
+    parser.add_option("--port", type = "int", default = int(tests.common.TESTING_PORT))
+    parser.add_option("--clients", type = "int", default = 500)
+    parser.add_option("--rate", type = "int", default = 100,
+                      help = "clients the drained server disconnects per second")
+    parser.add_option("--target", type = "int", default = 150,
+                      help = "most reconnects per second the remaining server should see")
+    parser.add_option("--mode", default = "drain", choices = ["drain", "kill"])
+    parser.add_option("--timeout", type = "float", default = 60)
+    parser.add_option("--server", default = "./chirc", help = "chirc binary to start")
+    parser.add_option("--server-args", default = "",
+                      help = "extra arguments for the started servers, such as \"-w 4\"")
+    (options, args) = parser.parse_args(argv)
+
+    old = start_server(options.server, options.port,
+                       "-s drain=rate=%i %s" % (options.rate, options.server_args))
+    new = start_server(options.server, options.port + 1, options.server_args)
+    if old is None or new is None:
+        for server in (old, new):
+            if server:
+                stop(server)
+        return 1
+    try:
+        clients = {}
+        for i in range(options.clients):
+            sock = register(options.host, options.port, "drain%i" % i)
+            sock.setblocking(0)
+            clients[sock.fileno()] = (sock, "drain%i" % i)
+        poller = select.poll()
+        for fd in clients:
+            poller.register(fd, select.POLLIN)
+
+        errors = 0
+        arrivals = []
+        moved = []
+        start = time.time()
+        os.kill(old[0].pid, signal.SIGUSR1 if options.mode == "drain" else signal.SIGKILL)
+        while clients and time.time() - start < options.timeout:
+            for (fd, event) in poller.poll(100):
+                (sock, nick) = clients[fd]
+                try:
+                    data = sock.recv(65536)
+                except socket.error:
+                    data = ""
+                if "Closing Link" in data:
+                    errors += 1
+                elif data:
+                    continue
+                poller.unregister(fd)
+                del clients[fd]
+                sock.close()
+                # reconnect straight away, as a client would
+                arrivals.append(time.time() - start)
+                moved.append(socket.create_connection((options.host, options.port + 1)))
+                moved[-1].sendall("NICK %s\r\nUSER %s * * :%s\r\n" % (nick, nick, nick))
+
+        arrivals.sort()
+        peak = peak_rate(arrivals)
+        print "mode             %s" % options.mode
+        print "clients          %i, %i reconnected" % (options.clients, len(arrivals))
+        print "ERROR lines      %i" % errors
+        if arrivals:
+            print "reconnects over  %.2f s" % (arrivals[-1] - arrivals[0])
+        print "peak reconnects  %i per second (target %i): %s" % (
+            peak, options.target, "ok" if peak <= options.target else "OVER")
+        for sock in moved:
+            sock.close()
+    finally:
+        stop(old)
+        stop(new)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv[1:]))
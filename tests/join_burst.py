@@ -0,0 +1,139 @@
+"""Measures how long a chirc client takes to connect and join many channels.
+
+Connects a number of clients one after another. Each registers with
+NICK and USER, waits for the end of the MOTD, then joins every channel
+and waits for the RPL_ENDOFNAMES of the last one. The time from the
+connect to that reply is reported, along with how many recv() calls
+and TCP segments (from the kernel's TCP_INFO) the JOIN replies took.
+
+JOINs are sent either one channel per command, as every client had to
+before servers took lists, or as comma separated lists packed into
+lines of at most 510 bytes:
+
+    JOIN #join000                       (--mode separate)
+    JOIN #join000,#join001,#join002,... (--mode list)
+
+Run from the top of the repository, for example:
+
+    python -m tests.join_burst --server ./chirc --channels 200
+    python -m tests.join_burst --server ./chirc --mode separate
+"""
+
+import optparse
+import socket
+import sys
+import time
+
+import tests.common
+from tests.connect_burst import segments_in
+from tests.replay import percentile, start_server, stop_server
+
+
+# longest line a client may send, without its "\r\n"
+MAX_LINE = 510
+
+
+def join_lines(channels, mode):
+    """Returns the JOIN commands which join channels, as one string."""
+    names = ["#join%03i" % i for i in range(channels)]
+    if mode == "separate":
+        return "".join("JOIN %s\r\n" % name for name in names)
+    lines = []
+    line = ""
+    for name in names:
+        if line and len(line) + 1 + len(name) > MAX_LINE:
+            lines.append(line)
+            line = ""
+        line = (line + "," + name) if line else "JOIN " + name
+    lines.append(line)
+    return "".join("%s\r\n" % line for line in lines)
+
+
+def read_until(sock, buf, marker, count = 1):
+    """Reads from sock until marker has appeared count times in what
+    was read. Returns the data read and the number of recv() calls."""
+    recvs = 0
+    while buf.count(marker) < count:
+        data = sock.recv(65536)
+        recvs += 1
+        if not data:
+            raise socket.error("connection closed")
+        buf += data
+    return buf, recvs
+
+
+def connect_and_join(host, port, nick, joins, channels):
+    """Connects one client, registers it and joins channels. Returns
+    the seconds taken, and the recv() calls and segments the JOIN
+    replies took."""
+    start = time.time()
+    sock = socket.create_connection((host, int(port)))
+    sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+    sock.sendall("NICK %s\r\nUSER %s * * :%s\r\n" % (nick, nick, nick))
+    buf = ""
+    while " 376 " not in buf and " 422 " not in buf:
+        data = sock.recv(65536)
+        if not data:
+            raise socket.error("connection closed")
+        buf += data
+    before = segments_in(sock)
+    sock.sendall(joins)
+    buf, recvs = read_until(sock, "", " 366 ", channels)
+    elapsed = time.time() - start
+    after = segments_in(sock)
+    sock.close()
+    segments = after - before if before is not None and after is not None else None
+    return elapsed, recvs, segments
+
+
+def report(out, mode, channels, joins, times, recvs, segments):
+    times = sorted(times)
+    print >> out, "mode             %s" % mode
+    print >> out, "channels         %i in %i JOIN commands" % (channels, joins.count("\r\n"))
+    print >> out, "clients          %i" % len(times)
+    print >> out, "connect+join (ms) mean %.2f  p50 %.2f  p99 %.2f  max %.2f" % (
+        sum(times) / len(times) * 1e3, percentile(times, 50) * 1e3,
+        percentile(times, 99) * 1e3, times[-1] * 1e3)
+    print >> out, "recv calls       %.1f per client" % (float(sum(recvs)) / len(recvs))
+    if segments:
+        print >> out, "segments in      %.1f per client" % (float(sum(segments)) / len(segments))
+
+
+def main(argv):
+    parser = optparse.OptionParser(usage = "%prog [options]")
+    parser.add_option("--host", default = "localhost")
+    parser.add_option("--port", default = tests.common.TESTING_PORT)
+    parser.add_option("--clients", type = "int", default = 50)
+    parser.add_option("--channels", type = "int", default = 200)
+    parser.add_option("--mode", default = "list", choices = ["list", "separate"])
+    parser.add_option("--server", help = "start this chirc binary for the benchmark")
+    parser.add_option("--server-args", default = "",
+                      help = "extra arguments for the started server, such as \"-w 4\"")
+    (options, args) = parser.parse_args(argv)
+
+    server = None
+    if options.server:
+        server = start_server(options.server, options.port, options.server_args)
+        if server is None:
+            return 1
+    try:
+        joins = join_lines(options.channels, options.mode)
+        times = []
+        recvs = []
+        segments = []
+        for i in range(options.clients):
+            (elapsed, calls, segs) = connect_and_join(options.host, options.port, "join%i" % i,
+                                                      joins, options.channels)
+            times.append(elapsed)
+            recvs.append(calls)
+            if segs is not None:
+                segments.append(segs)
+        report(sys.stdout, options.mode, options.channels, joins, times, recvs, segments)
+    finally:
+        if server:
+            stop_server(server)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv[1:]))
@@ -0,0 +1,136 @@
+"""Compares chirc clients on the local Unix socket with loopback TCP.
+
+Starts a chirc binary listening both on its TCP port and on a Unix
+domain socket, then runs the same work over each transport in turn:
+
+  - connect and register a number of clients one after another,
+    timing each from the connect to the end of its MOTD
+  - send PINGs from one client, one at a time, timing each round
+    trip to its PONG
+
+The server's CPU time (user plus system, from /proc) spent on the
+PINGs is reported per thousand round trips.
+
+Run from the top of the repository, for example:
+
+    python -m tests.local_bench --server ./chirc
+    python -m tests.local_bench --server ./chirc --pings 100000
+"""
+
+import optparse
+import os
+import socket
+import sys
+import time
+
+import tests.common
+from tests.replay import percentile, start_server, stop_server
+
+
+SOCKET_NAME = "chirc.sock"
+
+
+def cpu_seconds(pid):
+    """Returns the user and system CPU seconds process pid has used."""
+    with open("/proc/%i/stat" % pid) as stat:
+        # the command name may hold spaces, so split after it
+        fields = stat.read().rsplit(")", 1)[1].split()
+    return (int(fields[11]) + int(fields[12])) / float(os.sysconf("SC_CLK_TCK"))
+
+
+def connect(transport, host, port, path):
+    if transport == "unix":
+        sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        sock.connect(path)
+    else:
+        sock = socket.create_connection((host, int(port)))
+        sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+    return sock
+
+
+def read_until(sock, marker):
+    buf = ""
+    while marker not in buf:
+        data = sock.recv(65536)
+        if not data:
+            raise socket.error("connection closed")
+        buf += data
+    return buf
+
+
+def register(transport, host, port, path, nick):
+    """Connects and registers one client. Returns the socket and
+    the seconds it took."""
+    start = time.time()
+    sock = connect(transport, host, port, path)
+    sock.sendall("NICK %s\r\nUSER %s * * :%s\r\n" % (nick, nick, nick))
+    buf = ""
+    while " 376 " not in buf and " 422 " not in buf:
+        data = sock.recv(65536)
+        if not data:
+            raise socket.error("connection closed")
+        buf += data
+    return sock, time.time() - start
+
+
+def run(transport, options, pid, path):
+    connects = []
+    for i in range(options.clients):
+        (sock, elapsed) = register(transport, options.host, options.port, path,
+                                   "%s%i" % (transport, i))
+        connects.append(elapsed)
+        sock.sendall("QUIT\r\n")
+        sock.close()
+
+    (sock, elapsed) = register(transport, options.host, options.port, path, transport)
+    rtts = []
+    cpu = cpu_seconds(pid)
+    for i in range(options.pings):
+        start = time.time()
+        sock.sendall("PING %i\r\n" % i)
+        read_until(sock, "PONG")
+        rtts.append(time.time() - start)
+    cpu = cpu_seconds(pid) - cpu
+    sock.sendall("QUIT\r\n")
+    sock.close()
+    return sorted(connects), sorted(rtts), cpu
+
+
+def report(out, transport, connects, rtts, cpu):
+    print >> out, "%s" % transport
+    print >> out, "  connect+register (ms) mean %.3f  p50 %.3f  p99 %.3f" % (
+        sum(connects) / len(connects) * 1e3, percentile(connects, 50) * 1e3,
+        percentile(connects, 99) * 1e3)
+    print >> out, "  PING round trip (us)   mean %.1f  p50 %.1f  p99 %.1f" % (
+        sum(rtts) / len(rtts) * 1e6, percentile(rtts, 50) * 1e6, percentile(rtts, 99) * 1e6)
+    print >> out, "  server CPU            %.1f ms per 1000 PINGs" % (cpu * 1e3 * 1000 / len(rtts))
+
+
+def main(argv):
+    parser = optparse.OptionParser(usage = "%prog [options]")
+    parser.add_option("--host", default = "localhost")
+    parser.add_option("--port", default = tests.common.TESTING_PORT)
+    parser.add_option("--clients", type = "int", default = 200)
+    parser.add_option("--pings", type = "int", default = 20000)
+    parser.add_option("--server", default = "./chirc", help = "chirc binary to start")
+    parser.add_option("--server-args", default = "",
+                      help = "extra arguments for the started server, such as \"-w 4\"")
+    (options, args) = parser.parse_args(argv)
+
+    server = start_server(options.server, options.port,
+                          "-u path=%s %s" % (SOCKET_NAME, options.server_args))
+    if server is None:
+        return 1
+    try:
+        (proc, tmpdir) = server
+        path = os.path.join(tmpdir, SOCKET_NAME)
+        for transport in ("tcp", "unix"):
+            (connects, rtts, cpu) = run(transport, options, proc.pid, path)
+            report(sys.stdout, transport, connects, rtts, cpu)
+    finally:
+        stop_server(server)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv[1:]))
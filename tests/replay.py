@@ -0,0 +1,444 @@
+"""Replays client traffic captured by chirc -t against a server.
+
+A trace holds, for every client connection, when it was opened, every
+chunk of bytes the server received on it, and when it was closed (see
+proj1Chirc/trace.h for the layout). Replaying a trace opens the same
+connections and sends the same chunks, either on the original schedule
+or as fast as the server will take them, and reports throughput, the
+latency of each chunk and the CPU time the server spent.
+
+Latency is measured by following every chunk which ends a line with a
+"PING" probe: the server handles a client's commands in order, so the
+matching "PONG" arrives once the whole chunk has been processed.
+
+Canned traces can also be built from the channel fixtures used by the
+tests (channels1 to channels4 in tests/common.py), or with --announce
+from one large channel which a single member sends to, to measure
+the fan-out of a message, with or without MSG_ZEROCOPY.
+
+Run from the top of the repository, for example:
+
+    python -m tests.replay --record channels3.trace --fixture channels3
+    python -m tests.replay --server ./chirc --fast channels3.trace
+    python -m tests.replay --pid 1234 --speed 2 capture.trace
+    python -m tests.replay --server ./chirc --fast --announce 5000 --messages 200 \
+        --server-args "-s flood=rate=0 -s output=zerocopy=1"
+"""
+
+import optparse
+import os
+import select
+import shutil
+import socket
+import struct
+import subprocess
+import sys
+import tempfile
+import time
+
+import tests.common
+
+TRACE_MAGIC = "CHIRCTR1"
+TRACE_HEADER = struct.Struct("<QII")
+
+TRACE_OPEN = 0
+TRACE_DATA = 1
+TRACE_CLOSE = 2
+
+PROBE = "PING replay\r\n"
+
+class TraceFormatException(Exception):
+    pass
+
+
+def read_trace(path):
+    """Returns the records of a trace as (nanoseconds, connection, type, data) tuples."""
+    f = open(path, "rb")
+    if f.read(len(TRACE_MAGIC)) != TRACE_MAGIC:
+        raise TraceFormatException("%s is not a chirc trace" % path)
+    records = []
+    while True:
+        header = f.read(TRACE_HEADER.size)
+        if len(header) == 0:
+            break
+        if len(header) < TRACE_HEADER.size:
+            raise TraceFormatException("%s ends in the middle of a record" % path)
+        (ns, conn, lentype) = TRACE_HEADER.unpack(header)
+        length = lentype & 0x3fffffff
+        data = f.read(length)
+        if len(data) < length:
+            raise TraceFormatException("%s ends in the middle of a record" % path)
+        records.append((ns, conn, lentype >> 30, data))
+    f.close()
+    return records
+
+
+def write_trace(path, records):
+    f = open(path, "wb")
+    f.write(TRACE_MAGIC)
+    for (ns, conn, rtype, data) in records:
+        f.write(TRACE_HEADER.pack(ns, conn, len(data) | (rtype << 30)))
+        f.write(data)
+    f.close()
+
+
+def fixture_trace(channels, messages = 10, step = 1000000):
+    """Builds a trace in which the users of a channel fixture connect and
+    join their channels the way ChircTestCase._channels_connect does,
+    then each member sends a number of messages to each of its channels
+    before everyone quits. Records are step nanoseconds apart."""
+    records = []
+    conns = {}
+    members = {}
+    clock = [0]
+
+    def record(nick, rtype, data = ""):
+        records.append((clock[0], conns[nick], rtype, data))
+        clock[0] += step
+
+    def connect(nick):
+        if not conns.has_key(nick):
+            conns[nick] = len(conns)
+            members[nick] = []
+            record(nick, TRACE_OPEN)
+            record(nick, TRACE_DATA, "NICK %s\r\nUSER %s * * :%s\r\n" % (nick, nick, nick))
+
+    channelsl = channels.keys()
+    channelsl.sort()
+    for channel in channelsl:
+        if channel is None:
+            for nick in channels[channel]:
+                connect(nick)
+            continue
+        op = channels[channel][0][1:]
+        for user in channels[channel]:
+            if user[0] in ("@", "+"):
+                nick = user[1:]
+            else:
+                nick = user
+            connect(nick)
+            record(nick, TRACE_DATA, "JOIN %s\r\n" % channel)
+            members[nick].append(channel)
+            if user[0] in ("@", "+") and nick != op:
+                mode = "+o" if user[0] == "@" else "+v"
+                record(op, TRACE_DATA, "MODE %s %s %s\r\n" % (channel, mode, nick))
+
+    nicks = conns.keys()
+    nicks.sort(key = lambda nick: conns[nick])
+    for i in range(messages):
+        for nick in nicks:
+            for channel in members[nick]:
+                record(nick, TRACE_DATA, "PRIVMSG %s :message %i from %s\r\n" % (channel, i, nick))
+            if not members[nick]:
+                other = nicks[(nicks.index(nick) + 1) % len(nicks)]
+                record(nick, TRACE_DATA, "PRIVMSG %s :message %i from %s\r\n" % (other, i, nick))
+
+    for nick in nicks:
+        record(nick, TRACE_DATA, "QUIT :Done\r\n")
+        record(nick, TRACE_CLOSE)
+    return records
+
+
+def announce_trace(members, messages = 10, size = 400, step = 100000):
+    """Builds a trace in which a number of members join one channel,
+    #announce, and the first of them sends messages to it, each line
+    about size bytes long, before everyone quits. Records are step
+    nanoseconds apart."""
+    records = []
+    clock = [0]
+
+    def record(conn, rtype, data = ""):
+        records.append((clock[0], conn, rtype, data))
+        clock[0] += step
+
+    for conn in range(members):
+        nick = "ann%i" % conn
+        record(conn, TRACE_OPEN)
+        record(conn, TRACE_DATA, "NICK %s\r\nUSER %s * * :%s\r\nJOIN #announce\r\n" % (nick, nick, nick))
+    for i in range(messages):
+        line = "PRIVMSG #announce :announcement %i " % i
+        record(0, TRACE_DATA, line + "x" * max(0, size - len(line) - 2) + "\r\n")
+    for conn in range(members):
+        record(conn, TRACE_DATA, "QUIT :Done\r\n")
+        record(conn, TRACE_CLOSE)
+    return records
+
+
+def cpu_times(pid):
+    """Returns the user and system CPU seconds of a process and of each
+    of its threads, as (user, system, {tid: (user, system)})."""
+    tick = float(os.sysconf("SC_CLK_TCK"))
+
+    def stat_times(path):
+        try:
+            stat = open(path).read()
+        except IOError:
+            return None
+        # the command name may contain spaces, so skip past it
+        fields = stat[stat.rindex(")") + 2:].split()
+        return (int(fields[11]) / tick, int(fields[12]) / tick)
+
+    threads = {}
+    try:
+        tids = os.listdir("/proc/%i/task" % pid)
+    except OSError:
+        tids = []
+    for tid in tids:
+        times = stat_times("/proc/%i/task/%s/stat" % (pid, tid))
+        if times is not None:
+            threads[int(tid)] = times
+    total = stat_times("/proc/%i/stat" % pid) or (0.0, 0.0)
+    return (total[0], total[1], threads)
+
+
+def start_server(path, port, args = ""):
+    """Starts a chirc binary in a scratch directory the way the tests do.
+    Returns (process, directory), or None if it exits straight away."""
+    tmpdir = tempfile.mkdtemp()
+    proc = subprocess.Popen([os.path.abspath(path), "-p", str(port),
+                             "-o", tests.common.OPER_PASSWD] + args.split(),
+                            stdout = open(os.devnull, "w"), stderr = subprocess.STDOUT, cwd = tmpdir)
+    time.sleep(0.2)
+    if proc.poll() is not None:
+        print >> sys.stderr, "chirc process failed to start. rc = %i" % proc.returncode
+        shutil.rmtree(tmpdir)
+        return None
+    return (proc, tmpdir)
+
+
+def stop_server(server):
+    (proc, tmpdir) = server
+    proc.terminate()
+    proc.wait()
+    shutil.rmtree(tmpdir)
+
+
+def percentile(samples, p):
+    if not samples:
+        return 0.0
+    return samples[min(len(samples) - 1, int(len(samples) * p / 100.0))]
+
+
+class Connection(object):
+
+    def __init__(self, host, port):
+        self.sock = socket.create_connection((host, int(port)))
+        self.sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+        self.sock.setblocking(0)
+        self.unsent = ""
+        self.partial = ""
+        # (pongs still to come, time sent) for every probed chunk
+        self.probes = []
+        self.closing = False
+
+    def send(self, data):
+        self.unsent += data
+        self.flush()
+
+    def flush(self):
+        while self.unsent:
+            try:
+                sent = self.sock.send(self.unsent)
+            except socket.error:
+                return
+            self.unsent = self.unsent[sent:]
+
+    def receive(self, now, latencies):
+        try:
+            data = self.sock.recv(65536)
+        except socket.error:
+            data = ""
+        if not data:
+            return False
+        lines = (self.partial + data).split("\r\n")
+        self.partial = lines.pop()
+        for line in lines:
+            if line.startswith("PONG ") and self.probes:
+                (pongs, sent) = self.probes[0]
+                if pongs == 1:
+                    latencies.append(now - sent)
+                    self.probes.pop(0)
+                else:
+                    self.probes[0] = (pongs - 1, sent)
+        return True
+
+    def close(self):
+        self.sock.close()
+
+
+def replay(records, host = "localhost", port = tests.common.TESTING_PORT,
+           speed = 1.0, probe = True, drain = 2.0):
+    """Sends the traffic in records to a server. A speed of 0 sends
+    everything as fast as possible; otherwise the original gaps
+    between records are divided by speed. Returns the replay time, the
+    number of bytes and lines sent and the latency of every probed chunk."""
+    conns = {}
+    # poll() rather than select(), which stops at descriptor 1024
+    poller = select.poll()
+    byFd = {}
+    latencies = []
+    sentBytes = 0
+    sentLines = 0
+
+    def drop(connId):
+        conn = conns.pop(connId)
+        poller.unregister(conn.sock)
+        del byFd[conn.sock.fileno()]
+        conn.close()
+
+    start = time.time()
+    lastSend = start
+    base = records[0][0] if records else 0
+    i = 0
+    while i < len(records) or [c for c in conns.values() if c.probes or c.closing]:
+        now = time.time()
+        if i < len(records):
+            if speed > 0:
+                due = start + (records[i][0] - base) / 1e9 / speed
+            else:
+                due = now
+            timeout = max(0.0, due - now)
+        else:
+            due = None
+            timeout = 0.05
+            if now - lastSend > drain:
+                break
+
+        if conns:
+            readable = [byFd[fd] for (fd, event) in poller.poll(timeout * 1000) if fd in byFd]
+        else:
+            readable = []
+            time.sleep(timeout)
+        now = time.time()
+        for connId in readable:
+            if conns.has_key(connId) and not conns[connId].receive(now, latencies):
+                drop(connId)
+
+        # send what is due, reading replies at least every 64 records
+        burst = 0
+        while i < len(records) and burst < 64 and (due is None or due <= time.time()):
+            burst += 1
+            (ns, connId, rtype, data) = records[i]
+            i += 1
+            if rtype == TRACE_OPEN:
+                conns[connId] = Connection(host, port)
+                byFd[conns[connId].sock.fileno()] = connId
+                poller.register(conns[connId].sock, select.POLLIN)
+            elif rtype == TRACE_DATA and conns.has_key(connId):
+                conn = conns[connId]
+                conn.send(data)
+                sentBytes += len(data)
+                lines = data.count("\n")
+                sentLines += lines
+                if probe and data.endswith("\r\n") and "QUIT" not in data:
+                    pings = len([l for l in data.split("\r\n") if l.startswith("PING")])
+                    conn.probes.append((pings + 1, time.time()))
+                    conn.send(PROBE)
+            elif rtype == TRACE_CLOSE and conns.has_key(connId):
+                # wait for the server to answer what was sent first
+                conns[connId].closing = True
+                if not conns[connId].probes:
+                    drop(connId)
+            lastSend = time.time()
+            if i < len(records) and speed > 0:
+                due = start + (records[i][0] - base) / 1e9 / speed
+
+        for connId in conns.keys():
+            conn = conns[connId]
+            conn.flush()
+            if conn.closing and not conn.probes:
+                drop(connId)
+
+    elapsed = time.time() - start
+    for conn in conns.values():
+        conn.close()
+    latencies.sort()
+    return (elapsed, sentBytes, sentLines, latencies)
+
+
+def report(out, elapsed, sentBytes, sentLines, latencies, before = None, after = None):
+    print >> out, "replay time      %.3f s" % elapsed
+    print >> out, "sent             %i bytes, %i lines" % (sentBytes, sentLines)
+    if elapsed > 0:
+        print >> out, "throughput       %.0f lines/s, %.0f bytes/s" % (sentLines / elapsed, sentBytes / elapsed)
+    if latencies:
+        print >> out, "latency (us)     p50 %.0f  p90 %.0f  p99 %.0f  max %.0f  (%i chunks)" % (
+            percentile(latencies, 50) * 1e6, percentile(latencies, 90) * 1e6,
+            percentile(latencies, 99) * 1e6, latencies[-1] * 1e6, len(latencies))
+    if before and after:
+        user = after[0] - before[0]
+        system = after[1] - before[1]
+        print >> out, "server cpu       %.2f s user, %.2f s system (%.0f%% of one cpu)" % (
+            user, system, 100.0 * (user + system) / elapsed if elapsed > 0 else 0)
+        threads = []
+        for (tid, times) in after[2].items():
+            start = before[2].get(tid, (0.0, 0.0))
+            threads.append((times[0] - start[0] + times[1] - start[1], tid))
+        threads.sort(reverse = True)
+        for (busy, tid) in threads[:5]:
+            if busy > 0:
+                print >> out, "  thread %-8i %.2f s" % (tid, busy)
+
+
+def main(argv):
+    parser = optparse.OptionParser(usage = "%prog [options] TRACE")
+    parser.add_option("--host", default = "localhost")
+    parser.add_option("--port", default = tests.common.TESTING_PORT)
+    parser.add_option("--speed", type = "float", default = 1.0,
+                      help = "divide the original gaps between records by this")
+    parser.add_option("--fast", action = "store_const", const = 0.0, dest = "speed",
+                      help = "send everything as fast as possible")
+    parser.add_option("--no-probe", action = "store_false", dest = "probe", default = True,
+                      help = "do not measure latency with PING probes")
+    parser.add_option("--pid", type = "int", help = "measure the CPU time of this server process")
+    parser.add_option("--server", help = "start this chirc binary for the replay")
+    parser.add_option("--server-args", default = "",
+                      help = "extra arguments for the started server, such as \"-f rate=0\"")
+    parser.add_option("--fixture", help = "use a canned trace built from a test fixture, such as channels3")
+    parser.add_option("--messages", type = "int", default = 10,
+                      help = "messages each user sends in a canned trace")
+    parser.add_option("--announce", type = "int", metavar = "MEMBERS",
+                      help = "use a canned trace of messages to one channel of MEMBERS members")
+    parser.add_option("--size", type = "int", default = 400,
+                      help = "bytes in each line of an --announce trace")
+    parser.add_option("--record", metavar = "FILE", help = "write the trace to FILE instead of replaying it")
+    (options, args) = parser.parse_args(argv)
+
+    if options.fixture:
+        channels = getattr(tests.common, options.fixture, None)
+        if not isinstance(channels, dict):
+            parser.error("no fixture named %s" % options.fixture)
+        records = fixture_trace(channels, options.messages)
+    elif options.announce:
+        records = announce_trace(options.announce, options.messages, options.size)
+    elif len(args) == 1:
+        records = read_trace(args[0])
+    else:
+        parser.error("expected a trace file, --fixture or --announce")
+
+    if options.record:
+        write_trace(options.record, records)
+        return 0
+
+    server = None
+    pid = options.pid
+    if options.server:
+        server = start_server(options.server, options.port, options.server_args)
+        if server is None:
+            return 1
+        pid = server[0].pid
+
+    try:
+        before = cpu_times(pid) if pid else None
+        (elapsed, sentBytes, sentLines, latencies) = replay(records, options.host, options.port,
+                                                            options.speed, options.probe)
+        after = cpu_times(pid) if pid else None
+        report(sys.stdout, elapsed, sentBytes, sentLines, latencies, before, after)
+    finally:
+        if server:
+            stop_server(server)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv[1:]))
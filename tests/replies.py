@@ -32,6 +32,7 @@ RPL_YOUREOPER = "381"
 ERR_NOSUCHNICK = "401"
 ERR_NOSUCHCHANNEL = "403"
 ERR_CANNOTSENDTOCHAN = "404"
+ERR_TOOMANYTARGETS = "407"
 ERR_UNKNOWNCOMMAND = "421"
 ERR_NOMOTD = "422"
 ERR_NICKNAMEINUSE = "433"
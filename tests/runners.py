@@ -130,3 +130,46 @@ def single_runner(test_name):
     tests.DEBUG = True
     runner = unittest.TextTestRunner()   
     runner.run(t)
+
+def scale_runner(copies, budget = 0, growth = 2.0, exe = None, fast = 1):
+    import tests.scale
+
+    if exe != None:
+        tests.common.ChircTestCase.CHIRC_EXE = exe
+
+    if fast == 1:
+        tests.common.ChircTestCase.MESSAGE_TIMEOUT = 0.2
+        tests.common.ChircTestCase.INTERTEST_PAUSE = 0.0
+    else:
+        tests.common.ChircTestCase.MESSAGE_TIMEOUT = 1.0
+        tests.common.ChircTestCase.INTERTEST_PAUSE = 0.15
+
+    ok = True
+    times = {}
+    for n in copies:
+        tests.scale.ScaleTestCase.COPIES = n
+        runner = unittest.TextTestRunner(stream = sys.stderr, resultclass = tests.scale.TimedResult)
+        result = runner.run(tests.scale.scaletests)
+        ok = ok and result.wasSuccessful()
+        times[n] = result.times
+
+    print "%-40s" % "Test" + "".join(["%12s" % ("x%i" % n) for n in copies])
+    print "-" * (40 + 12 * len(copies))
+    for name in sorted(times[copies[0]]):
+        print "%-40s" % name.split(".", 2)[-1] + "".join(["%11.2fs" % times[n].get(name, 0) for n in copies])
+    print
+
+    # a test's time should grow about as fast as the number of copies
+    for name in sorted(times[copies[0]]):
+        for small, large in zip(copies, copies[1:]):
+            tsmall = max(times[small].get(name, 0), 0.1)
+            tlarge = times[large].get(name, 0)
+            if tlarge > tsmall * growth * large / small:
+                print "%s: %.2fs at x%i but %.2fs at x%i, growing faster than the copies" % (name, tsmall, small, tlarge, large)
+                ok = False
+        if budget and times[copies[-1]].get(name, 0) > budget:
+            print "%s: %.2fs at x%i, over the budget of %.2fs" % (name, times[copies[-1]][name], copies[-1], budget)
+            ok = False
+
+    print "Scale tests %s" % ("passed" if ok else "FAILED")
+    return ok
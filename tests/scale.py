@@ -0,0 +1,227 @@
+"""Runs the channel tests with their fixtures multiplied.
+
+Each test starts chirc the way ChircTestCase does, then connects a
+layout of users and channels made of many copies of one of the
+fixtures in tests.common (channels1 to channels4), every copy with
+its own nicks and channel names. The same NAMES, WHO and LIST
+assertions as in test_channel are then made against the whole
+layout, so a server which stays correct for a handful of users but
+not for thousands fails here.
+
+The wall time of every test is recorded. Run at two or more numbers
+of copies, a test whose time grows much faster than the number of
+copies fails too, which is how an O(n^2) walk over every user or
+channel shows up before it reaches production. See
+tests.runners.scale_runner, or run from the top of the repository:
+
+    python -m tests.scale --copies 25,100
+    python -m tests.scale --copies 200 --budget 120
+"""
+
+import optparse
+import sys
+import time
+import unittest
+
+import tests.replies as replies
+import tests.test_channel as test_channel
+from tests.common import ChircTestCase
+from tests.common import channels1, channels2, channels3, channels4
+
+
+def scale_nick(nick, copy):
+    """Returns the name of user "userN" in the given copy."""
+    return "u%sx%i" % (nick[len("user"):], copy)
+
+
+def scale_channel(channel, copy):
+    """Returns the name of channel "#testN" in the given copy."""
+    return "#c%sx%i" % (channel[len("#test"):], copy)
+
+
+def scale_channels(channels, copies):
+    """Returns a layout with the given copies of the layout channels,
+    in the same form as the fixtures in tests.common. Users without a
+    channel are all kept under None, as in the fixtures."""
+    scaled = {}
+    for copy in range(1, copies + 1):
+        for channel, users in channels.items():
+            scaledusers = []
+            for user in users:
+                if user[0] in ("@", "+"):
+                    scaledusers.append(user[0] + scale_nick(user[1:], copy))
+                else:
+                    scaledusers.append(scale_nick(user, copy))
+            if channel is None:
+                scaled[None] = scaled.get(None, ()) + tuple(scaledusers)
+            else:
+                scaled[scale_channel(channel, copy)] = tuple(scaledusers)
+    return scaled
+
+
+class ScaleTestCase(ChircTestCase):
+
+    COPIES = 100
+    # one client asks about every channel, which flood control would throttle
+    CHIRC_ARGS = ["-s", "flood=rate=0"]
+
+    def tearDown(self):
+        ChircTestCase.tearDown(self)
+        # with thousands of clients chirc takes a while to let go of the port
+        self.chirc_proc.wait()
+
+    def _scale_connect(self, channels, aways = [], ircops = [], test_names = False):
+        layout = scale_channels(channels, self.COPIES)
+        aways = [scale_nick(user, copy) for user in aways for copy in range(1, self.COPIES + 1)]
+        ircops = [scale_nick(user, copy) for user in ircops for copy in range(1, self.COPIES + 1)]
+        users = self._channels_connect(layout, aways, ircops, test_names)
+        return layout, users
+
+    def _test_names_all(self, channels, client, nick):
+        # long lists of names may be split over several replies
+        client.send_cmd("NAMES")
+
+        names = {}
+        while True:
+            reply = self.get_reply(client, expect_nick = nick)
+            if reply.cmd == replies.RPL_ENDOFNAMES:
+                break
+            self._test_reply(reply, expect_code = replies.RPL_NAMREPLY, expect_nick = nick,
+                             expect_nparams = 3)
+            if reply.params[2] == "*":
+                channel = None
+                self._test_names_single(reply, nick, expect_channel = "*")
+            else:
+                channel = reply.params[2]
+                self.assertIn(channel, channels, "Received unexpected RPL_NAMREPLY for %s: %s" % (channel, reply._s))
+                self._test_names_single(reply, nick, expect_channel = channel)
+            names.setdefault(channel, []).extend(reply.params[3][1:].split(" "))
+
+        for channel, channelusers in channels.items():
+            if channel is None and len(channelusers) == 0:
+                continue
+            self.assertIn(channel, names, "Did not receive RPL_NAMREPLY for %s" % (channel or "*"))
+            got = sorted(names.pop(channel))
+            self.assertEqual(got, sorted(channelusers), "Expected names in %s to be %s, got %s" % (channel or "*", sorted(channelusers), got))
+
+
+class NAMES(ScaleTestCase):
+
+    _test_names_channel = test_channel.NAMES.__dict__["_test_names_channel"]
+
+    def test_names1(self):
+        layout, users = self._scale_connect(channels2, test_names = True)
+        self._test_names_channel(layout, users[scale_nick("user1", 1)], scale_nick("user1", 1))
+
+    def test_names2(self):
+        layout, users = self._scale_connect(channels3, test_names = True)
+        self._test_names_channel(layout, users[scale_nick("user1", 1)], scale_nick("user1", 1))
+
+    def test_names3(self):
+        layout, users = self._scale_connect(channels2)
+        self._test_names_all(layout, users[scale_nick("user1", 1)], scale_nick("user1", 1))
+
+    def test_names4(self):
+        layout, users = self._scale_connect(channels3)
+        self._test_names_all(layout, users[scale_nick("user10", 1)], scale_nick("user10", 1))
+
+    def test_names5(self):
+        layout, users = self._scale_connect(channels4)
+        self._test_names_all(layout, users[scale_nick("user1", 1)], scale_nick("user1", 1))
+
+
+class WHO(ScaleTestCase):
+
+    _test_who = test_channel.WHO.__dict__["_test_who"]
+
+    def test_who1(self):
+        layout, users = self._scale_connect(channels1)
+        nick = scale_nick("user1", 1)
+        for channel in sorted(layout.keys()):
+            self._test_who(layout, users[nick], nick, channel = channel)
+
+    def test_who2(self):
+        layout, users = self._scale_connect(channels2)
+        for user in ("user1", "user10"):
+            nick = scale_nick(user, self.COPIES)
+            self._test_who(layout, users[nick], nick, channel = "*")
+
+    def test_who3(self):
+        aways = ["user4", "user8", "user10"]
+        ircops = ["user8", "user9", "user10", "user11"]
+        layout, users = self._scale_connect(channels3, aways, ircops)
+        nick = scale_nick("user1", 1)
+        aways = [scale_nick(user, copy) for user in aways for copy in range(1, self.COPIES + 1)]
+        ircops = [scale_nick(user, copy) for user in ircops for copy in range(1, self.COPIES + 1)]
+        for channel in sorted(k for k in layout.keys() if k is not None):
+            self._test_who(layout, users[nick], nick, channel = channel, aways = aways, ircops = ircops)
+
+
+class LIST(ScaleTestCase):
+
+    _test_list = test_channel.LIST.__dict__["_test_list"]
+
+    def test_list1(self):
+        layout, users = self._scale_connect(channels3)
+        self._test_list(layout, users[scale_nick("user1", 1)], scale_nick("user1", 1))
+
+    def test_list2(self):
+        layout, users = self._scale_connect(channels2)
+        topics = {}
+        for copy in range(1, self.COPIES + 1):
+            for (user, channel) in (("user1", "#test1"), ("user4", "#test2"), ("user7", "#test3")):
+                nick = scale_nick(user, copy)
+                channel = scale_channel(channel, copy)
+                topic = "Topic of %s" % channel
+                users[nick].send_cmd("TOPIC %s :%s" % (channel, topic))
+                self._test_relayed_topic(users[nick], from_nick = nick, channel = channel, topic = topic)
+                topics[channel] = topic
+        nick = scale_nick("user10", 1)
+        self._test_list(layout, users[nick], nick, expect_topics = topics)
+
+
+scaletests = unittest.TestSuite([
+                                 unittest.TestLoader().loadTestsFromTestCase(NAMES),
+                                 unittest.TestLoader().loadTestsFromTestCase(WHO),
+                                 unittest.TestLoader().loadTestsFromTestCase(LIST)
+                                 ])
+
+
+class TimedResult(unittest.TextTestResult):
+    """Test result which records the wall time of every test."""
+
+    def __init__(self, stream, descriptions, verbosity):
+        unittest.TextTestResult.__init__(self, stream, descriptions, verbosity)
+        self.times = {}
+
+    def startTest(self, test):
+        self.started = time.time()
+        unittest.TextTestResult.startTest(self, test)
+
+    def stopTest(self, test):
+        unittest.TextTestResult.stopTest(self, test)
+        self.times[test.id()] = time.time() - self.started
+
+
+def main(argv):
+    import tests.runners
+
+    parser = optparse.OptionParser(usage = "%prog [options]")
+    parser.add_option("--copies", default = "25,100",
+                      help = "comma separated copies of each fixture to run at")
+    parser.add_option("--budget", type = "float", default = 0,
+                      help = "most seconds any one test may take, 0 for no limit")
+    parser.add_option("--growth", type = "float", default = 2.0,
+                      help = "how much faster than the copies a test's time may grow")
+    parser.add_option("--server", default = "./chirc", help = "chirc binary to test")
+    parser.add_option("--fast", type = "int", default = 1)
+    (options, args) = parser.parse_args(argv)
+
+    copies = [int(n) for n in options.copies.split(",")]
+    ok = tests.runners.scale_runner(copies, budget = options.budget, growth = options.growth,
+                                    exe = options.server, fast = options.fast)
+    return 0 if ok else 1
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv[1:]))
@@ -47,3 +47,4 @@ PROJ_1C.add_category("NAMES", "NAMES", 5)
 PROJ_1C.add_category("LIST", "LIST", 5)
 PROJ_1C.add_category("WHO", "WHO", 5)
 PROJ_1C.add_category("UPDATE_1B", "UPDATE_1B", 5)
+PROJ_1C.add_category("LINK", "Server links", 0)
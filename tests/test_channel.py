@@ -86,6 +86,17 @@ class PRIVMSG(ChircTestCase):
     def test_channel_privmsg3(self):
         self._test_join_and_privmsg(20)
         
+    @score(category="CHANNEL_PRIVMSG_NOTICE")
+    def test_channel_privmsg_case(self):
+        # channel names are compared without regard to case
+        clients = self._clients_connect(3, join_channel = "#Chan")
+
+        for (nick1, client1) in clients:
+            client1.send_cmd("PRIVMSG #chan :Hello from %s!" % nick1)
+            for (nick2, client2) in clients:
+                if nick1 != nick2:
+                    self._test_relayed_privmsg(client2, from_nick=nick1, recip="#Chan", msg="Hello from %s!" % nick1)
+
     @score(category="CHANNEL_PRIVMSG_NOTICE")
     def test_channel_privmsg_nochannel(self):
         client1 = self._connect_user("user1", "User One")
@@ -121,6 +132,30 @@ class NOTICE(ChircTestCase):
 
         self.assertRaises(ReplyTimeoutException, self.get_reply, client1)   
         
+class HISTORY(ChircTestCase):
+    """HISTORY with channels keeping their last HISTORY_DEPTH messages."""
+
+    HISTORY_DEPTH = 4
+    CHIRC_ARGS = ["-s", "history=depth=%i" % HISTORY_DEPTH]
+
+    @score(category="CHANNEL_PRIVMSG_NOTICE")
+    def test_history_replay(self):
+        clients = self._clients_connect(2, join_channel = "#test")
+        (nick1, client1) = clients[0]
+        (nick2, client2) = clients[1]
+
+        # one more message than the channel keeps
+        for i in range(self.HISTORY_DEPTH + 1):
+            client1.send_cmd("PRIVMSG #test :Message %i" % (i + 1))
+            self._test_relayed_privmsg(client2, from_nick=nick1, recip="#test", msg="Message %i" % (i + 1))
+
+        client2.send_cmd("HISTORY #test")
+        for i in range(1, self.HISTORY_DEPTH + 1):
+            self._test_relayed_privmsg(client2, from_nick=nick1, recip="#test", msg="Message %i" % (i + 1))
+        self.get_message(client2, expect_prefix = True, expect_cmd = "NOTICE", expect_nparams = 2,
+                         expect_short_params = [nick2], long_param_re = "End of #test history")
+
+        
 class PART(ChircTestCase):
     def _test_join_and_part(self, numclients):
         clients = self._clients_connect(numclients, join_channel = "#test")
@@ -705,6 +740,60 @@ class WHO(ChircTestCase):
         self._test_who(channels3, users["user1"], "user1", channel = "#test5", aways = aways, ircops = ircops)                            
                  
                  
+class TARGETS(ChircTestCase):
+    """Commands given comma separated lists of targets, with the
+    target limit lowered to MAX_TARGETS."""
+
+    MAX_TARGETS = 2
+    CHIRC_ARGS = ["-s", "max_targets=%i" % MAX_TARGETS]
+
+    @score(category="CHANNEL_JOIN")
+    def test_targets_join(self):
+        client1 = self._connect_user("user1", "User One")
+
+        client1.send_cmd("JOIN #a,#b")
+        self._test_join(client1, "user1", "#a", expect_names = ["@user1"])
+        self._test_join(client1, "user1", "#b", expect_names = ["@user1"])
+
+    @score(category="CHANNEL_PART")
+    def test_targets_part(self):
+        clients = self._clients_connect(2)
+        (nick1, client1) = clients[0]
+        (nick2, client2) = clients[1]
+        for channel in ("#a", "#b"):
+            self._clients_join(clients, channel)
+
+        client1.send_cmd("PART #a,#b :%s is out of here!" % nick1)
+        for client in (client1, client2):
+            for channel in ("#a", "#b"):
+                self._test_relayed_part(client, from_nick=nick1, channel=channel, msg="%s is out of here!" % nick1)
+
+    @score(category="CHANNEL_PRIVMSG_NOTICE")
+    def test_targets_privmsg(self):
+        clients = self._clients_connect(3)
+        (nick1, client1) = clients[0]
+        (nick2, client2) = clients[1]
+        (nick3, client3) = clients[2]
+        self._clients_join(clients[:2], "#a")
+
+        # one channel and one user outside it
+        client1.send_cmd("PRIVMSG #a,%s :Hello, everyone" % nick3)
+        self._test_relayed_privmsg(client2, from_nick=nick1, recip="#a", msg="Hello, everyone")
+        self._test_relayed_privmsg(client3, from_nick=nick1, recip=nick3, msg="Hello, everyone")
+
+    @score(category="CHANNEL_JOIN")
+    def test_targets_too_many(self):
+        client1 = self._connect_user("user1", "User One")
+
+        client1.send_cmd("JOIN #a,#b,#c,#d")
+        self._test_join(client1, "user1", "#a", expect_names = ["@user1"])
+        self._test_join(client1, "user1", "#b", expect_names = ["@user1"])
+        self.get_reply(client1, expect_code = replies.ERR_TOOMANYTARGETS, expect_nick = "user1",
+                       expect_nparams = 2, expect_short_params = ["#c"],
+                       long_param_re = "Too many targets, the rest were dropped")
+        self.assertRaises(ReplyTimeoutException, self.get_reply, client1)
+
+
 class UPDATE1b(ChircTestCase):
                                     
     @score(category="UPDATE_1B")
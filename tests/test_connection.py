@@ -88,4 +88,22 @@ class MultiuserConnection(ChircTestCase):
         reply = self.get_reply(client2, expect_code = replies.ERR_NICKNAMEINUSE, expect_nick = "*", expect_nparams = 2,
                                expect_short_params = ["user1"],
                                long_param_re = "Nickname is already in use")
-        
+
+    def _test_duplicate_nick_casemapped(self, nick1, nick2):
+        # nicks differing only in case, or in the characters RFC 1459
+        # maps onto each other, are the same nick
+        client1 = self._connect_user(nick1, "User One")
+
+        client2 = self.get_client()
+        client2.send_cmd("NICK %s" % nick2)
+        reply = self.get_reply(client2, expect_code = replies.ERR_NICKNAMEINUSE, expect_nick = "*", expect_nparams = 2,
+                               expect_short_params = [nick2],
+                               long_param_re = "Nickname is already in use")
+
+    @score(category="CONNECTION_REGISTRATION")
+    def test_connect_duplicate_nick_case(self):
+        self._test_duplicate_nick_casemapped("Foo", "foo")
+
+    @score(category="CONNECTION_REGISTRATION")
+    def test_connect_duplicate_nick_brackets(self):
+        self._test_duplicate_nick_casemapped("{X}", "[x]")
@@ -0,0 +1,150 @@
+import re
+import socket
+import time
+from tests.common import ChircTestCase, CouldNotConnectException, ReplyTimeoutException
+from tests.common import TESTING_PORT
+from tests.scores import score
+
+# Replies exactly as chirc has always sent them, NUL bytes included.
+# %(server)s and %(host)s stand for the server's and the client's
+# host names, and %(created)s for the time the server was started.
+
+REGISTRATION = [
+    ":%(server)s 001 user1 \x00:Welcome to the Internet Relay Network user1!user1@%(host)s\x00\x00\x00\x00\x00\x00\x00",
+    ":%(server)s 002 user1 \x00:Your host is %(server)s, running version version2\x00\x00\x00\x00\x00",
+    ":%(server)s 003 user1 \x00:This server was created %(created)s\x00\x00",
+    ":%(server)s 004 user1 \x00%(server)s version2 ao mtov\x00\x00\x00\x00\x00\x00\x00\x00\x00",
+    ":%(server)s 251 user1 \x00:There are 1 users and 0 services on 1 servers\x00\x00\x00\x00",
+    ":%(server)s 252 user1 \x000 :operator(s) online\x00\x00",
+    ":%(server)s 253 user1 \x000 :unknown connection(s)\x00\x00",
+    ":%(server)s 254 user1 \x000 :channels formed\x00\x00",
+    ":%(server)s 255 user1 \x00:I have 1 clients and 1 servers\x00\x00\x00",
+    ":%(server)s 422 user1 \x00:MOTD File is missing\x00"
+]
+
+ERRORS = [
+    ("FOO", [":%(server)s 421 user1 \x00FOO :Unknown command\x00\x00\x00"]),
+    ("USER x * * :x", [":%(server)s 462 user1 \x00:Unauthorized command (already registered)\x00"]),
+    ("WHOIS nobody", [":%(server)s 401 user1 \x00nobody :No such nick/channel\x00\x00\x00"]),
+    ("PART #nochan", [":%(server)s 403 user1 \x00#nochan :No such channel\x00\x00\x00"]),
+    ("MODE user1 +x", [":%(server)s 501 user1 \x00:Unknown MODE flag\x00"]),
+    ("MODE user2 +i", [":%(server)s 502 user1 \x00:Cannot change mode for other users\x00"]),
+    ("OPER user1 wrong", [":%(server)s 464 user1 \x00:Password incorrect\x00"]),
+    ("STATS x", [":%(server)s 219 user1 \x00x :End of STATS report\x00\x00"]),
+    ("STATS l", [":%(server)s 481 user1 \x00:Permission Denied- You're not an IRC operator\x00"]),
+    ("STATS z", [":%(server)s 481 user1 \x00:Permission Denied- You're not an IRC operator\x00"]),
+    ("MOTD", [":%(server)s 422 user1 \x00:MOTD File is missing\x00"])
+]
+
+CHANNEL = [
+    ("JOIN #test", [":user1!user1@%(host)s JOIN #test\x00",
+                    ":%(server)s 353 user1 \x00= #test :@user1\x00\x00\x00\x00\x00\x00\x00",
+                    ":%(server)s 366 user1 \x00#test :End of NAMES list\x00\x00\x00"]),
+    ("TOPIC #test", [":%(server)s 331 user1 \x00#test :No topic is set\x00\x00"]),
+    ("TOPIC #test :Golden topic", [":user1!user1@%(host)s \x00TOPIC #test :Golden topic\x00"]),
+    ("TOPIC #test", [":%(server)s 332 user1 \x00#test :Golden topic\x00\x00\x00\x00"]),
+    ("LIST", [":%(server)s 322 user1 \x00#test 1 :Golden topic\x00\x00\x00\x00\x00\x00\x00",
+              ":%(server)s 323 user1 \x00:End of LIST\x00"]),
+    ("MODE #test", [":%(server)s 324 user1 \x00#test +\x00\x00\x00\x00\x00"]),
+    ("MODE #test +z", [":%(server)s 472 user1 \x00z :is unknown mode char to me for #test\x00\x00\x00\x00\x00"]),
+    ("MODE #test +o user9", [":%(server)s 441 user1 \x00user9 #test :They aren't on that channel\x00\x00\x00\x00\x00"]),
+    ("WHO #test", [":%(server)s 352 user1 \x00#test user1 %(host)s %(server)s user1 H@ :0 User One\x00",
+                   ":%(server)s 315 user1 \x00#test :End of WHO list\x00\x00"])
+]
+
+WHOIS = [
+    ("OPER user1 foobar", [":%(server)s 381 user1 \x00:You are now an IRC operator\x00"]),
+    ("AWAY :gone", [":%(server)s 306 user1 \x00:You have been marked as being away\x00"]),
+    ("WHOIS user1", [":%(server)s 311 user1 \x00user1 user1 %(host)s * :User One\x00\x00\x00\x00\x00\x00\x00\x00\x00",
+                     ":%(server)s 312 user1 \x00user1 %(server)s :version2\x00\x00\x00\x00\x00\x00\x00",
+                     ":%(server)s 301 user1 \x00user1 :gone\x00\x00\x00\x00\x00",
+                     ":%(server)s 313 user1 \x00user1 :is an IRC operator\x00\x00",
+                     ":%(server)s 318 user1 \x00user1 :End of WHOIS list\x00\x00\x00"]),
+    ("AWAY", [":%(server)s 305 user1 \x00:You are no longer marked as being away\x00"])
+]
+
+# telnetlib drops NUL bytes, so replies are read straight off a socket
+class RawClient(object):
+
+    def __init__(self, msg_timeout = 1.0):
+        tries = 3
+
+        while tries > 0:
+            try:
+                self.sock = socket.create_connection(("localhost", int(TESTING_PORT)), 1)
+                break
+            except Exception, e:
+                tries -= 1
+                time.sleep(0.1)
+
+        if tries == 0:
+            raise CouldNotConnectException()
+        self.sock.settimeout(msg_timeout)
+        self.buf = ""
+
+    def disconnect(self):
+        self.sock.close()
+
+    def send_cmd(self, cmd):
+        self.sock.sendall("%s\r\n" % cmd)
+
+    def get_raw(self):
+        while "\r\n" not in self.buf:
+            try:
+                data = self.sock.recv(4096)
+            except socket.timeout:
+                raise ReplyTimeoutException()
+            if not data:
+                raise ReplyTimeoutException()
+            self.buf += data
+        line, self.buf = self.buf.split("\r\n", 1)
+        return line
+
+class GoldenReplies(ChircTestCase):
+
+    longMessage = True
+
+    def _get_raw(self, client):
+        return client.get_raw()
+
+    def _register(self):
+        client = RawClient(self.MESSAGE_TIMEOUT)
+        self.clients.append(client)
+        client.send_cmd("NICK user1")
+        client.send_cmd("USER user1 * * :User One")
+
+        welcome = self._get_raw(client)
+        names = {"server": welcome.split(" ")[0][1:],
+                 "host": re.search("@([^\x00]*)\x00", welcome).group(1)}
+        lines = [welcome] + [self._get_raw(client) for i in range(len(REGISTRATION) - 1)]
+        names["created"] = re.search("created ([^\x00]*)\x00", lines[2]).group(1)
+
+        for line, expected in zip(lines, REGISTRATION):
+            self.assertEqual(line, expected % names)
+        return client, names
+
+    def _test_golden(self, client, names, golden):
+        for cmd, expected in golden:
+            client.send_cmd(cmd)
+            for line in expected:
+                self.assertEqual(self._get_raw(client), line % names, "Reply to %s" % cmd)
+        self.assertRaises(ReplyTimeoutException, self._get_raw, client)
+
+    @score(category="ROBUST", points=False)
+    def test_golden_registration(self):
+        self._register()
+
+    @score(category="ROBUST", points=False)
+    def test_golden_errors(self):
+        client, names = self._register()
+        self._test_golden(client, names, ERRORS)
+
+    @score(category="ROBUST", points=False)
+    def test_golden_channel(self):
+        client, names = self._register()
+        self._test_golden(client, names, CHANNEL)
+
+    @score(category="ROBUST", points=False)
+    def test_golden_whois(self):
+        client, names = self._register()
+        self._test_golden(client, names, WHOIS)
@@ -0,0 +1,152 @@
+import os
+import re
+import socket
+import subprocess
+import time
+import tests
+import tests.replies as replies
+from tests.common import ChircTestCase, OPER_PASSWD, TESTING_PORT
+from tests.scores import score
+
+# port of the second server, which links to the one every test starts
+LINK_PORT = "7777"
+
+class Link(ChircTestCase):
+    """Two linked servers: users on either one must see each other
+    as if they were on the same server."""
+
+    CHIRC_ARGS = ["-n", "irc1.test"]
+
+    def setUp(self):
+        ChircTestCase.setUp(self)
+
+        if tests.DEBUG:
+            stdout = stderr = None
+        else:
+            stdout = open('/dev/null', 'w')
+            stderr = subprocess.STDOUT
+        self._wait_for_port(TESTING_PORT)
+        self.chirc_proc2 = subprocess.Popen([os.path.abspath(ChircTestCase.CHIRC_EXE), "-p", LINK_PORT,
+                                             "-o", OPER_PASSWD, "-n", "irc2.test",
+                                             "-l", "localhost:%s" % TESTING_PORT],
+                                            stdout=stdout, stderr=stderr, cwd = self.tmpdir)
+        self._wait_for_link()
+
+    def tearDown(self):
+        rc = self.chirc_proc2.poll()
+        self.chirc_proc2.terminate()
+        ChircTestCase.tearDown(self)
+        if rc != None:
+            self.fail("second chirc process failed during test. rc = %i" % rc)
+
+    def _wait_for_port(self, port):
+        for i in range(50):
+            try:
+                socket.create_connection(("localhost", int(port))).close()
+                return
+            except socket.error:
+                time.sleep(0.1)
+        self.fail("chirc is not listening on port %s" % port)
+
+    def _wait_for_link(self):
+        # registers on the second server until it reports both servers
+        self._wait_for_port(LINK_PORT)
+        for i in range(50):
+            sock = socket.create_connection(("localhost", int(LINK_PORT)))
+            sock.sendall("NICK linkwait\r\nUSER linkwait * * :linkwait\r\n")
+            buf = ""
+            while " 376 " not in buf and " 422 " not in buf:
+                data = sock.recv(4096)
+                if not data:
+                    break
+                buf += data
+            sock.sendall("QUIT\r\n")
+            sock.close()
+            if re.search(" 251 [^\r]* on 2 servers", buf):
+                return
+            time.sleep(0.1)
+        self.fail("second chirc did not link to the first")
+
+    def _wait_for_names(self, client, nick, channel, expect_names):
+        # state from the other server arrives on its own time, so
+        # ask until it has
+        for i in range(20):
+            client.send_cmd("NAMES %s" % channel)
+            # a channel the server has not heard of yet has no RPL_NAMREPLY
+            reply = self.get_reply(client, expect_nick = nick)
+            if reply.cmd == replies.RPL_NAMREPLY:
+                self.get_reply(client, expect_code = replies.RPL_ENDOFNAMES, expect_nick = nick,
+                               expect_nparams = 2)
+                if sorted(reply.params[3][1:].split(" ")) == sorted(expect_names):
+                    return
+            time.sleep(0.1)
+        self.fail("Expected NAMES %s to be %s: %s" % (channel, " ".join(expect_names), reply._s))
+
+    def _link_join(self, channel):
+        # user1 on the first server creates channel, user2 on the
+        # second server joins it once it can see user1 there
+        client1 = self._connect_user("user1", "User One")
+        client2 = self._connect_user("user2", "User Two", port = LINK_PORT)
+
+        client1.send_cmd("JOIN %s" % channel)
+        self._test_join(client1, "user1", channel)
+        self._wait_for_names(client2, "user2", channel, ["@user1"])
+
+        client2.send_cmd("JOIN %s" % channel)
+        self._test_join(client2, "user2", channel, expect_names = ["@user1", "user2"])
+        self._test_relayed_join(client1, from_nick = "user2", channel = channel)
+
+        return client1, client2
+
+    @score(category="LINK")
+    def test_link_lusers(self):
+        client1 = self._connect_user("user1", "User One")
+        client2 = self._connect_user("user2", "User Two", port = LINK_PORT)
+
+        for (nick, client) in [("user1", client1), ("user2", client2)]:
+            client.send_cmd("LUSERS")
+            self.get_reply(client, expect_code = replies.RPL_LUSERCLIENT, expect_nick = nick,
+                           expect_nparams = 1,
+                           long_param_re = "There are \d+ users and 0 services on 2 servers")
+            self.get_reply(client, expect_code = replies.RPL_LUSEROP, expect_nick = nick)
+            self.get_reply(client, expect_code = replies.RPL_LUSERUNKNOWN, expect_nick = nick)
+            self.get_reply(client, expect_code = replies.RPL_LUSERCHANNELS, expect_nick = nick)
+            self.get_reply(client, expect_code = replies.RPL_LUSERME, expect_nick = nick,
+                           expect_nparams = 1,
+                           long_param_re = "I have \d+ clients and 2 servers")
+
+    @score(category="LINK")
+    def test_link_join(self):
+        self._link_join("#test")
+
+    @score(category="LINK")
+    def test_link_channel_privmsg(self):
+        client1, client2 = self._link_join("#test")
+
+        client2.send_cmd("PRIVMSG #test :Hello from the second server")
+        self._test_relayed_privmsg(client1, from_nick = "user2", recip = "#test",
+                                   msg = "Hello from the second server")
+
+        client1.send_cmd("PRIVMSG #test :Hello from the first server")
+        self._test_relayed_privmsg(client2, from_nick = "user1", recip = "#test",
+                                   msg = "Hello from the first server")
+
+    @score(category="LINK")
+    def test_link_privmsg(self):
+        client1, client2 = self._link_join("#test")
+
+        client2.send_cmd("PRIVMSG user1 :Hello, user1")
+        self._test_relayed_privmsg(client1, from_nick = "user2", recip = "user1",
+                                   msg = "Hello, user1")
+
+        client1.send_cmd("PRIVMSG user2 :Hello, user2")
+        self._test_relayed_privmsg(client2, from_nick = "user1", recip = "user2",
+                                   msg = "Hello, user2")
+
+    @score(category="LINK")
+    def test_link_quit(self):
+        client1, client2 = self._link_join("#test")
+
+        client2.send_cmd("QUIT :Gone to the other server")
+        self._test_relayed_quit(client1, from_nick = "user2", msg = "Gone to the other server")
+        self._wait_for_names(client1, "user1", "#test", ["@user1"])
@@ -118,4 +118,33 @@ class NOTICE(ChircTestCase):
         client1.send_cmd("NOTICE user2 :Hello")
 
         self.assertRaises(ReplyTimeoutException, self.get_reply, client1)        
-    
\ No newline at end of file
+    
+
+class QueuedPRIVMSG(PRIVMSG):
+    """The PRIVMSG tests again, with lines to each user queued
+    for the thread reading its socket."""
+
+    CHIRC_ARGS = ["-s", "output=queue=1"]
+
+    @score(category="PRIVMSG_NOTICE")
+    def test_privmsg_popular(self):
+        clients = self._clients_connect(20)
+        (popular, client1) = clients[0]
+        client1.msg_timeout = 5
+
+        # every other user messages the same one, all at once
+        for i in range(10):
+            for (nick, client) in clients[1:]:
+                client.send_cmd("PRIVMSG %s :Message %i from %s" % (popular, i + 1, nick))
+
+        seen = dict([(nick, 0) for (nick, client) in clients[1:]])
+        for i in range(10 * (len(clients) - 1)):
+            relayed_privmsg = self.get_message(client1, expect_prefix = True, expect_cmd = "PRIVMSG",
+                                               expect_nparams = 2, expect_short_params = [popular],
+                                               long_param_re = "Message \d+ from user\d+")
+            match = re.match(":Message (?P<msgnum>\d+) from (?P<from>user\d+)", relayed_privmsg.params[-1])
+            from_nick = match.group("from")
+            self.assertEqual(relayed_privmsg.prefix.nick, from_nick)
+            self.assertEqual(seen[from_nick] + 1, int(match.group("msgnum")),
+                             "Message from %s arrived out of sequence (expected message %i)" % (from_nick, seen[from_nick] + 1))
+            seen[from_nick] += 1
@@ -114,3 +114,43 @@ class Robustness(ChircTestCase):
             msg = self._gen_long_msg(i - len(base))
             client1.send_cmd(base + msg)
             self._test_relayed_privmsg(client2, from_nick="user1", recip="user2", msg=truncated_msg)                  
+
+
+class FloodControl(ChircTestCase):
+    """Clients are held back when they send faster than the
+    flood control rate, but only disconnected when they keep
+    doing so for longer than the abuse limit."""
+
+    CHIRC_ARGS = ["-f", "rate=10,burst=5,abuse=1"]
+
+    @score(category="ROBUST")
+    def test_flood_at_rate(self):
+        client1 = self._connect_user("user1", "User One")
+        client2 = self._connect_user("user2", "User Two")
+
+        # empty the bucket, then send at the rate for three times
+        # the abuse limit
+        start = time.time()
+        for i in range(35):
+            if i >= 5:
+                delay = start + (i - 5) / 10.0 - time.time()
+                if delay > 0:
+                    time.sleep(delay)
+            client1.send_cmd("PRIVMSG user2 :Message %i" % (i + 1))
+
+        for i in range(35):
+            self._test_relayed_privmsg(client2, from_nick="user1", recip="user2", msg="Message %i" % (i + 1))
+
+        client1.send_cmd("PING foobar")
+        self.get_message(client1, expect_cmd = "PONG", expect_nparams = 1)
+
+    @score(category="ROBUST")
+    def test_flood_above_rate(self):
+        client1 = self._connect_user("user1", "User One")
+        client2 = self._connect_user("user2", "User Two")
+        client1.msg_timeout = 5
+
+        for i in range(100):
+            client1.send_cmd("PRIVMSG user2 :Message %i" % (i + 1))
+
+        self.get_message(client1, expect_cmd = "Error")